@@ -9,6 +9,9 @@ CXXFLAGS+= -DFW_ENABLED
 #CXXFLAGS+= -DLOG_ENABLED
 #CXXFLAGS+= -DLOG_STDOUT
 
+# Enable this flag to remove the sampled per-input update time measurements
+#CXXFLAGS+= -DCYCLE_SAMPLING_DISABLED
+
 ################
 ### Lib name ###
 ################
@@ -0,0 +1,552 @@
+#include <central_node_archive.h>
+#include <central_node_exception.h>
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <sys/stat.h>
+
+static uint32_t putVarint(uint8_t *buffer, uint64_t value) {
+  uint32_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  buffer[size++] = static_cast<uint8_t>(value);
+  return size;
+}
+
+static bool getVarint(FILE *file, uint64_t &value) {
+  value = 0;
+  for (uint32_t shift = 0; shift < 64; shift += 7) {
+    int byte = fgetc(file);
+    if (byte == EOF) {
+      return false;
+    }
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t getWord(const std::vector<uint8_t> &frame, size_t word) {
+  uint64_t value = 0;
+  size_t offset = word * sizeof(uint64_t);
+  size_t size = std::min(sizeof(uint64_t), frame.size() - offset);
+  memcpy(&value, &frame[offset], size);
+  return value;
+}
+
+static std::string segmentName(std::string directory, uint64_t timestamp, const char *extension) {
+  std::stringstream name;
+  name << directory << "/archive-" << std::setw(20) << std::setfill('0') << timestamp << extension;
+  return name.str();
+}
+
+/**
+ * Base names (directory + "/archive-<timestamp>") of the segments in an
+ * archive directory, oldest first. Returns false if the directory cannot
+ * be read.
+ */
+static bool listSegments(std::string directory, std::vector<std::string> &names) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == NULL) {
+    return false;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string name = entry->d_name;
+    if (name.size() > 12 && name.compare(0, 8, "archive-") == 0 &&
+	name.compare(name.size() - 4, 4, ".seg") == 0) {
+      names.push_back(directory + "/" + name.substr(0, name.size() - 4));
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  return true;
+}
+
+/*
+ * FrameArchiver
+ */
+
+FrameArchiver::FrameArchiver() :
+  _head(0), _tail(0), _running(false), _writerThread(NULL),
+  _frameSize(0), _keyframeInterval(ARCHIVE_DEFAULT_KEYFRAME_INTERVAL),
+  _segmentFrames(ARCHIVE_DEFAULT_SEGMENT_FRAMES), _maxSegments(0),
+  _segment(NULL), _index(NULL), _segmentOffset(0), _segmentFrameCount(0),
+  _framesSinceKeyframe(0),
+  _frameCount(0), _keyframeCount(0), _dropCount(0), _rawBytes(0),
+  _archivedBytes(0), _segmentCount(0), _writeErrors(0) {
+}
+
+/**
+ * Start archiving to 'directory' (created if needed). Frames are written
+ * as deltas with a keyframe every 'keyframeInterval' frames, a new segment
+ * is started every 'segmentFrames' frames and only the last 'maxSegments'
+ * segments in the directory are kept, whichever run wrote them (0 keeps
+ * all of them).
+ */
+void FrameArchiver::start(std::string directory, uint32_t keyframeInterval,
+			  uint32_t segmentFrames, uint32_t maxSegments, uint32_t frameSize) {
+  if (_running) {
+    throw(CentralNodeException("ERROR: Frame archiver already started"));
+  }
+
+  if (keyframeInterval == 0 || segmentFrames == 0 || frameSize == 0) {
+    throw(CentralNodeException("ERROR: Invalid frame archiver configuration"));
+  }
+
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to create archive directory " << directory
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _directory = directory;
+  _frameSize = frameSize;
+  _keyframeInterval = keyframeInterval;
+  _segmentFrames = segmentFrames;
+  _maxSegments = maxSegments;
+
+  _slots.resize(ARCHIVE_QUEUE_SIZE);
+  for (uint32_t i = 0; i < ARCHIVE_QUEUE_SIZE; ++i) {
+    _slots[i].data.resize(frameSize, 0);
+  }
+  _previous.resize(frameSize, 0);
+  // Worst case record: every word changed
+  _record.resize(17 + 10 + ((frameSize + 7) / 8) * (10 + sizeof(uint64_t)));
+
+  _head = 0;
+  _tail = 0;
+  _running = true;
+  _writerThread = new std::thread(&FrameArchiver::writerThread, this);
+  if (pthread_setname_np(_writerThread->native_handle(), "FrameArchiver")) {
+    perror("pthread_setname_np failed");
+  }
+
+  std::cout << "INFO: Archiving update frames to " << directory << std::endl;
+}
+
+void FrameArchiver::stop() {
+  if (!_running) {
+    return;
+  }
+  _running = false;
+  _writerThread->join();
+  delete _writerThread;
+  _writerThread = NULL;
+}
+
+/**
+ * Queue a frame for archiving. Called by the input update thread, copies
+ * the frame and returns immediately.
+ */
+void FrameArchiver::push(const std::vector<uint8_t> &frame, uint64_t cycle, uint64_t timestamp) {
+  if (!_running) {
+    return;
+  }
+
+  uint64_t head = _head.load(std::memory_order_relaxed);
+  if (head - _tail.load(std::memory_order_acquire) >= ARCHIVE_QUEUE_SIZE ||
+      frame.size() != _frameSize) {
+    _dropCount++;
+    return;
+  }
+
+  Slot &slot = _slots[head % ARCHIVE_QUEUE_SIZE];
+  memcpy(slot.data.data(), frame.data(), _frameSize);
+  slot.cycle = cycle;
+  slot.timestamp = timestamp;
+  _head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Encode a frame record against 'reference' (the previous frame, or all
+ * zeros for a keyframe). Returns the record size.
+ */
+uint32_t FrameArchiver::encode(uint8_t type, uint64_t timestamp, uint64_t cycle,
+			       const std::vector<uint8_t> &frame, const std::vector<uint8_t> &reference,
+			       std::vector<uint8_t> &record) {
+  const uint32_t headerSize = 1 + 2 * sizeof(uint64_t);
+  const uint32_t countSize = 10;
+  size_t words = (frame.size() + 7) / 8;
+
+  if (record.size() < headerSize + countSize + words * (10 + sizeof(uint64_t))) {
+    record.resize(headerSize + countSize + words * (10 + sizeof(uint64_t)));
+  }
+
+  // Changed words are written after room for the count, then moved down
+  uint8_t *pairs = &record[headerSize + countSize];
+  uint32_t length = 0;
+  uint64_t count = 0;
+  uint64_t skip = 0;
+  for (size_t i = 0; i < words; ++i) {
+    uint64_t delta = getWord(frame, i) ^ getWord(reference, i);
+    if (delta == 0) {
+      skip++;
+      continue;
+    }
+    length += putVarint(&pairs[length], skip);
+    memcpy(&pairs[length], &delta, sizeof(delta));
+    length += sizeof(delta);
+    skip = 0;
+    count++;
+  }
+
+  record[0] = type;
+  memcpy(&record[1], &timestamp, sizeof(timestamp));
+  memcpy(&record[1 + sizeof(timestamp)], &cycle, sizeof(cycle));
+  uint32_t size = headerSize;
+  size += putVarint(&record[size], count);
+  memmove(&record[size], pairs, length);
+
+  return size + length;
+}
+
+bool FrameArchiver::openSegment(uint64_t timestamp) {
+  std::string segmentFileName = segmentName(_directory, timestamp, ".seg");
+  std::string indexFileName = segmentName(_directory, timestamp, ".idx");
+
+  _segment = fopen(segmentFileName.c_str(), "wb");
+  _index = fopen(indexFileName.c_str(), "wb");
+  if (_segment == NULL || _index == NULL) {
+    std::cerr << "ERROR: Failed to create archive segment " << segmentFileName
+	      << " (" << strerror(errno) << ")" << std::endl;
+    closeSegment();
+    return false;
+  }
+
+  ArchiveSegmentHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = ARCHIVE_MAGIC;
+  header.version = ARCHIVE_VERSION;
+  header.frameSize = _frameSize;
+  header.keyframeInterval = _keyframeInterval;
+  fwrite(&header, sizeof(header), 1, _segment);
+
+  _segmentOffset = sizeof(header);
+  _segmentFrameCount = 0;
+  _framesSinceKeyframe = 0;
+  _segmentCount++;
+
+  // Remove the oldest segments, including the ones left by earlier runs
+  // (never the new one, the firmware timestamp may have been reset)
+  std::vector<std::string> segments;
+  if (_maxSegments > 0 && listSegments(_directory, segments)) {
+    std::string current = segmentName(_directory, timestamp, "");
+    for (size_t i = 0; i + _maxSegments < segments.size(); ++i) {
+      if (segments[i] == current) {
+        continue;
+      }
+      unlink((segments[i] + ".seg").c_str());
+      unlink((segments[i] + ".idx").c_str());
+    }
+  }
+
+  return true;
+}
+
+void FrameArchiver::closeSegment() {
+  if (_segment != NULL) {
+    fclose(_segment);
+    _segment = NULL;
+  }
+  if (_index != NULL) {
+    fclose(_index);
+    _index = NULL;
+  }
+}
+
+void FrameArchiver::write(Slot &slot) {
+  if (_segment == NULL || _segmentFrameCount >= _segmentFrames) {
+    closeSegment();
+    if (!openSegment(slot.timestamp)) {
+      _writeErrors++;
+      return;
+    }
+  }
+
+  bool keyframe = (_framesSinceKeyframe == 0 || _framesSinceKeyframe >= _keyframeInterval);
+  uint32_t size;
+  if (keyframe) {
+    // Keyframes are encoded against zeros, the previous frame is not needed
+    std::fill(_previous.begin(), _previous.end(), 0);
+    size = encode(ARCHIVE_KEYFRAME, slot.timestamp, slot.cycle, slot.data, _previous, _record);
+  }
+  else {
+    size = encode(ARCHIVE_DELTA, slot.timestamp, slot.cycle, slot.data, _previous, _record);
+  }
+
+  if (fwrite(_record.data(), 1, size, _segment) != size) {
+    _writeErrors++;
+  }
+
+  // The keyframe must be in the segment file before the index entry that
+  // points at it, so after a crash the index never refers to lost data
+  if (keyframe) {
+    fflush(_segment);
+
+    ArchiveIndexEntry entry;
+    entry.timestamp = slot.timestamp;
+    entry.cycle = slot.cycle;
+    entry.offset = _segmentOffset;
+    fwrite(&entry, sizeof(entry), 1, _index);
+    fflush(_index);
+    _framesSinceKeyframe = 0;
+    _keyframeCount++;
+  }
+  _segmentOffset += size;
+  _segmentFrameCount++;
+  _framesSinceKeyframe++;
+
+  // Keep at most about one second of frames in the stdio buffer
+  if (_segmentFrameCount % 360 == 0) {
+    fflush(_segment);
+  }
+
+  _frameCount++;
+  _rawBytes += _frameSize;
+  _archivedBytes += size;
+
+  // The frame just written is the reference for the next one. The slot
+  // gets the old reference storage, it is overwritten by the next push()
+  _previous.swap(slot.data);
+}
+
+void FrameArchiver::writerThread() {
+  while (true) {
+    uint64_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) {
+      if (!_running) {
+	break;
+      }
+      usleep(5000);
+      continue;
+    }
+
+    write(_slots[tail % ARCHIVE_QUEUE_SIZE]);
+    _tail.store(tail + 1, std::memory_order_release);
+  }
+
+  closeSegment();
+}
+
+std::ostream & operator<<(std::ostream &os, FrameArchiver * const archiver) {
+  os << "=== Frame archiver ===" << std::endl;
+  if (!archiver->_running) {
+    os << "  not running" << std::endl;
+    return os;
+  }
+  os << "  directory: " << archiver->_directory << std::endl;
+  os << "  frames: " << archiver->_frameCount << " (" << archiver->_keyframeCount
+     << " keyframes, " << archiver->_dropCount << " dropped)" << std::endl;
+  os << "  bytes: " << archiver->_archivedBytes << " (raw " << archiver->_rawBytes;
+  if (archiver->_archivedBytes > 0) {
+    os << ", ratio " << archiver->_rawBytes / archiver->_archivedBytes << ":1";
+  }
+  os << ")" << std::endl;
+  os << "  segments: " << archiver->_segmentCount << " (write errors "
+     << archiver->_writeErrors << ")" << std::endl;
+  return os;
+}
+
+/*
+ * FrameArchiveReader
+ */
+
+FrameArchiveReader::FrameArchiveReader() : _current(0), _file(NULL), _frameSize(0) {
+}
+
+FrameArchiveReader::~FrameArchiveReader() {
+  close();
+}
+
+void FrameArchiveReader::close() {
+  if (_file != NULL) {
+    fclose(_file);
+    _file = NULL;
+  }
+}
+
+/**
+ * Load the segment list and indexes of an archive directory. Segments
+ * without any keyframe are skipped.
+ */
+void FrameArchiveReader::open(std::string directory) {
+  close();
+  _segments.clear();
+  _directory = directory;
+
+  std::vector<std::string> names;
+  if (!listSegments(directory, names)) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to open archive directory " << directory
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  for (size_t i = 0; i < names.size(); ++i) {
+    Segment segment;
+    segment.name = names[i];
+    FILE *index = fopen((segment.name + ".idx").c_str(), "rb");
+    if (index == NULL) {
+      continue;
+    }
+    ArchiveIndexEntry indexEntry;
+    while (fread(&indexEntry, sizeof(indexEntry), 1, index) == 1) {
+      segment.index.push_back(indexEntry);
+    }
+    fclose(index);
+    if (!segment.index.empty()) {
+      _segments.push_back(segment);
+    }
+  }
+}
+
+bool FrameArchiveReader::getRange(uint64_t &firstTimestamp, uint64_t &lastKeyframeTimestamp) const {
+  if (_segments.empty()) {
+    return false;
+  }
+  firstTimestamp = _segments.front().index.front().timestamp;
+  lastKeyframeTimestamp = _segments.back().index.back().timestamp;
+  return true;
+}
+
+void FrameArchiveReader::getSegmentInfo(size_t segment, std::string &name, uint64_t &firstTimestamp,
+					uint32_t &keyframes) const {
+  name = _segments.at(segment).name;
+  firstTimestamp = _segments.at(segment).index.front().timestamp;
+  keyframes = _segments.at(segment).index.size();
+}
+
+bool FrameArchiveReader::openSegment(size_t segment, uint64_t offset) {
+  close();
+  _current = segment;
+  if (segment >= _segments.size()) {
+    return false;
+  }
+
+  _file = fopen((_segments[segment].name + ".seg").c_str(), "rb");
+  if (_file == NULL) {
+    return false;
+  }
+
+  ArchiveSegmentHeader header;
+  if (fread(&header, sizeof(header), 1, _file) != 1 ||
+      header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION) {
+    close();
+    return false;
+  }
+
+  _frameSize = header.frameSize;
+  _frame.assign(_frameSize, 0);
+  if (fseek(_file, offset, SEEK_SET) != 0) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Open the first readable segment from 'segment' on, at its first
+ * keyframe. Missing or damaged segments are skipped.
+ */
+bool FrameArchiveReader::openNextSegment(size_t segment) {
+  for (; segment < _segments.size(); ++segment) {
+    if (openSegment(segment, _segments[segment].index.front().offset)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Position the reader at the last keyframe with a timestamp not after
+ * 'timestamp' (or at the first frame of the archive). The frames returned
+ * by next() may start before 'timestamp'.
+ */
+bool FrameArchiveReader::seek(uint64_t timestamp) {
+  if (_segments.empty()) {
+    return false;
+  }
+
+  size_t segment = 0;
+  for (size_t i = 0; i < _segments.size(); ++i) {
+    if (_segments[i].index.front().timestamp <= timestamp) {
+      segment = i;
+    }
+  }
+
+  const std::vector<ArchiveIndexEntry> &index = _segments[segment].index;
+  uint64_t offset = index.front().offset;
+  for (size_t i = 0; i < index.size() && index[i].timestamp <= timestamp; ++i) {
+    offset = index[i].offset;
+  }
+
+  return openSegment(segment, offset) || openNextSegment(segment + 1);
+}
+
+bool FrameArchiveReader::readRecord(ArchiveFrame &frame) {
+  int type = fgetc(_file);
+  uint64_t count;
+  if (type == EOF ||
+      fread(&frame.timestamp, sizeof(frame.timestamp), 1, _file) != 1 ||
+      fread(&frame.cycle, sizeof(frame.cycle), 1, _file) != 1 ||
+      !getVarint(_file, count)) {
+    return false;
+  }
+
+  if (type == ARCHIVE_KEYFRAME) {
+    std::fill(_frame.begin(), _frame.end(), 0);
+  }
+  else if (type != ARCHIVE_DELTA) {
+    return false;
+  }
+
+  size_t words = (_frameSize + 7) / 8;
+  size_t word = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t skip, delta;
+    if (!getVarint(_file, skip) || fread(&delta, sizeof(delta), 1, _file) != 1) {
+      return false;
+    }
+    word += skip;
+    if (word >= words) {
+      return false;
+    }
+    uint64_t value = getWord(_frame, word) ^ delta;
+    size_t offset = word * sizeof(uint64_t);
+    memcpy(&_frame[offset], &value, std::min(sizeof(uint64_t), _frame.size() - offset));
+    word++;
+  }
+
+  frame.data = _frame;
+  return true;
+}
+
+/**
+ * Read the next frame. Returns false at the end of the archive. An
+ * incomplete or corrupted record ends the segment, reading continues with
+ * the next segment that can be opened.
+ */
+bool FrameArchiveReader::next(ArchiveFrame &frame) {
+  while (_file != NULL) {
+    if (readRecord(frame)) {
+      return true;
+    }
+    if (!openNextSegment(_current + 1)) {
+      return false;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,188 @@
+#ifndef CENTRAL_NODE_ARCHIVE_H
+#define CENTRAL_NODE_ARCHIVE_H
+
+#include <central_node_database_defs.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+/**
+ * Long-term archive of the firmware update frames.
+ *
+ * The archive is a directory of segments, 'archive-<timestamp>.seg' named
+ * after the firmware timestamp of their first frame, each with an index
+ * 'archive-<timestamp>.idx'. A segment starts with an
+ * ArchiveSegmentHeader followed by one record per frame:
+ *
+ *   uint8_t type              // ARCHIVE_KEYFRAME or ARCHIVE_DELTA
+ *   uint64_t timestamp        // Firmware timestamp
+ *   uint64_t cycle
+ *   varint  count             // Number of changed words
+ *   'count' x {
+ *     varint   skip           // Unchanged words since the previous changed word
+ *     uint64_t word           // XOR of the word with the previous frame
+ *   }
+ *
+ * Frames are split in 64-bit words. Delta records are XORed with the
+ * previous frame in the segment, keyframes with an all-zero frame, so
+ * only the words that changed are stored. The first record of a segment
+ * is always a keyframe, and there is one every 'keyframeInterval' frames.
+ * The index has one ArchiveIndexEntry per keyframe, for random access by
+ * timestamp. Both files are only appended to, and a keyframe is flushed
+ * to the segment before its index entry is written, so a crash leaves at
+ * most an incomplete last record, which the reader ignores.
+ */
+const uint64_t ARCHIVE_MAGIC = 0x5652484341534D4DULL; // "MMSACHRV"
+const uint32_t ARCHIVE_VERSION = 1;
+const uint8_t ARCHIVE_KEYFRAME = 1;
+const uint8_t ARCHIVE_DELTA = 2;
+
+const uint32_t ARCHIVE_DEFAULT_KEYFRAME_INTERVAL = 3600;  // 10 s at 360 Hz
+const uint32_t ARCHIVE_DEFAULT_SEGMENT_FRAMES = 216000;   // 10 min at 360 Hz
+const uint32_t ARCHIVE_QUEUE_SIZE = 64;                   // Frames buffered for the writer thread
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t frameSize;
+  uint32_t keyframeInterval;
+  uint32_t reserved;
+} ArchiveSegmentHeader;
+
+typedef struct {
+  uint64_t timestamp;
+  uint64_t cycle;
+  uint64_t offset;   // Offset of the keyframe record in the segment
+} ArchiveIndexEntry;
+
+/**
+ * Frame read back from the archive
+ */
+struct ArchiveFrame {
+  uint64_t timestamp;
+  uint64_t cycle;
+  std::vector<uint8_t> data;
+};
+
+/**
+ * Background archiver. The input update thread hands each frame over with
+ * push(), which copies it to a preallocated slot and never blocks (frames
+ * are dropped if the writer thread falls behind - deltas are always taken
+ * against the previous written frame, so a drop only leaves a gap in
+ * cycles). The writer thread runs with normal priority, encodes the frames
+ * and writes the segments.
+ */
+class FrameArchiver {
+ private:
+  struct Slot {
+    uint64_t timestamp;
+    uint64_t cycle;
+    std::vector<uint8_t> data;
+  };
+
+  FrameArchiver();
+  FrameArchiver(FrameArchiver const &);
+  void operator=(FrameArchiver const &);
+
+  std::vector<Slot> _slots;
+  std::atomic<uint64_t> _head;   // Written by push()
+  std::atomic<uint64_t> _tail;   // Written by the writer thread
+  std::atomic<bool> _running;
+
+  std::thread *_writerThread;
+  std::string _directory;
+  uint32_t _frameSize;
+  uint32_t _keyframeInterval;
+  uint32_t _segmentFrames;
+  uint32_t _maxSegments;
+
+  FILE *_segment;
+  FILE *_index;
+  uint64_t _segmentOffset;
+  uint32_t _segmentFrameCount;
+  uint32_t _framesSinceKeyframe;
+  std::vector<uint8_t> _previous;
+  std::vector<uint8_t> _record;
+
+  // Statistics
+  uint64_t _frameCount;
+  uint64_t _keyframeCount;
+  uint64_t _dropCount;
+  uint64_t _rawBytes;
+  uint64_t _archivedBytes;
+  uint32_t _segmentCount;
+  uint32_t _writeErrors;
+
+  void writerThread();
+  void write(Slot &slot);
+  bool openSegment(uint64_t timestamp);
+  void closeSegment();
+
+ public:
+  void start(std::string directory,
+	     uint32_t keyframeInterval = ARCHIVE_DEFAULT_KEYFRAME_INTERVAL,
+	     uint32_t segmentFrames = ARCHIVE_DEFAULT_SEGMENT_FRAMES,
+	     uint32_t maxSegments = 0,
+	     uint32_t frameSize = FW_UPDATE_BUFFER_SIZE_BYTES);
+  void stop();
+  bool isRunning() const { return _running; }
+
+  void push(const std::vector<uint8_t> &frame, uint64_t cycle, uint64_t timestamp);
+
+  static uint32_t encode(uint8_t type, uint64_t timestamp, uint64_t cycle,
+			 const std::vector<uint8_t> &frame, const std::vector<uint8_t> &reference,
+			 std::vector<uint8_t> &record);
+
+  static FrameArchiver &getInstance() {
+    static FrameArchiver instance;
+    return instance;
+  }
+
+  friend std::ostream & operator<<(std::ostream &os, FrameArchiver * const archiver);
+};
+
+/**
+ * Reads frames back from an archive directory, in cycle order. seek()
+ * positions the reader at the last keyframe at or before a timestamp,
+ * next() returns the following frames fully reconstructed.
+ */
+class FrameArchiveReader {
+ private:
+  struct Segment {
+    std::string name;
+    std::vector<ArchiveIndexEntry> index;
+  };
+
+  std::string _directory;
+  std::vector<Segment> _segments;
+  size_t _current;
+  FILE *_file;
+  uint32_t _frameSize;
+  std::vector<uint8_t> _frame;
+
+  bool openSegment(size_t segment, uint64_t offset);
+  bool openNextSegment(size_t segment);
+  bool readRecord(ArchiveFrame &frame);
+
+ public:
+  FrameArchiveReader();
+  ~FrameArchiveReader();
+
+  void open(std::string directory);
+  void close();
+
+  size_t getSegmentCount() const { return _segments.size(); }
+  bool getRange(uint64_t &firstTimestamp, uint64_t &lastKeyframeTimestamp) const;
+  void getSegmentInfo(size_t segment, std::string &name, uint64_t &firstTimestamp,
+		      uint32_t &keyframes) const;
+
+  bool seek(uint64_t timestamp);
+  bool next(ArchiveFrame &frame);
+};
+
+#endif
@@ -2,6 +2,9 @@
 #include <sstream>
 #include <stdio.h>
 #include <time.h>
+#include <chrono>
+#include <unistd.h>
+#include <sys/timerfd.h>
 
 #include <central_node_bypass_manager.h>
 #include <central_node_bypass.h>
@@ -16,17 +19,30 @@ using namespace easyloggingpp;
 static Logger *bypassLogger;
 #endif
 
-bool BypassManager::refreshFirmwareConfiguration = false;
+std::atomic<bool> BypassManager::refreshFirmwareConfiguration(false);
 
 BypassManager::BypassManager() :
-  threadDone(false), _bypassThread(NULL), initialized(false) {
+  threadDone(false), _bypassThread(NULL), timerFd(-1), nextStatusRefresh(0),
+  initialized(false),
+  bypassGeneration(0), stagedValid(false), stagedUntil(0),
+  stagedBypassGeneration(0), stagedFwGeneration(0), pendingExpiry(0),
+  expiryCount(0), expirySkewLast(0), expirySkewMax(0), expirySkewSum(0),
+  stagedPushCount(0), fullReloadCount(0),
+  stagedPushTime("Bypass staged config push time", 60) {
 #if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
   bypassLogger = Loggers::getLogger("BYPASS");
   LOG_TRACE("BYPASS", "Created BypassManager");
 #endif
+  timerFd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+  if (timerFd < 0) {
+    perror("timerfd_create failed, bypass thread will poll once a second");
+  }
 }
 
 BypassManager::~BypassManager() {
+  if (timerFd >= 0) {
+    close(timerFd);
+  }
 }
 
 bool BypassManager::isInitialized() {
@@ -48,6 +64,7 @@ void BypassManager::startBypassThread() {
 void BypassManager::stopBypassThread() {
   std::cout << "INFO: bypassThread stopping..." << std::endl;
   threadDone = true;
+  wakeBypassThread();
   if (_bypassThread != NULL) {
     _bypassThread->join();
   }
@@ -119,6 +136,18 @@ void BypassManager::createBypassMap(MpsDbPtr db) {
       bypassMap->insert(std::pair<int, InputBypassPtr>(bypassId, bypassPtr));
     }
   }
+
+  // One published state record per bypass, indexed by bypass id
+  stateTable.resize(bypassId);
+}
+
+/**
+ * Copy the bypass status/value to the state table read by the engine.
+ * Must be called with the mutex held, between stateTable.beginUpdate()
+ * and stateTable.endUpdate().
+ */
+void BypassManager::publishBypass(InputBypassPtr bypass) {
+  stateTable.set(bypass->id, bypass->status, bypass->value);
 }
 
 /**
@@ -162,7 +191,6 @@ void BypassManager::assignBypass(MpsDbPtr db) {
       }
       else {
 	(*analogInput).second->bypass[(*bypass).second->index] = (*bypass).second;
-	(*bypass).second->bypassMask = &((*analogInput).second->bypassMask);
       }
     }
   }
@@ -231,9 +259,14 @@ void BypassManager::checkBypassQueue(time_t testTime) {
   bool expired = true;
   {
     std::unique_lock<std::mutex> lock(mutex);
+    if (bypassQueue.empty() || bypassQueue.top().first > now) {
+      return;
+    }
+    stateTable.beginUpdate();
     while (expired) {
       expired = checkBypassQueueTop(now);
     }
+    stateTable.endUpdate();
   }
 }
 
@@ -242,79 +275,54 @@ void BypassManager::checkBypassQueue(time_t testTime) {
  * remove it from the queue, mark as expired and return
  * true (expired). Otherwise return false (bypass still valid).
  *
+ * There is only one entry per bypass in the queue, so the
+ * expiration time of the top entry is always the bypass until time.
+ *
  * @param now current time, in seconds
  */
 bool BypassManager::checkBypassQueueTop(time_t now) {
-  BypassQueueEntry top;
-  if (!bypassQueue.empty()) {
-    top = bypassQueue.top();
-    // The time from the priority queue expired
-    if (top.first <= now) {
-      LOG_TRACE("BYPASS", "Bypass for device [" << top.second->deviceId << "] expired, "
-		<< "type=" << top.second->type
-		<< ", until=" << top.first << " sec"
-		<< ", now=" << now << " sec"
-		<< ", (actual until=" << top.second->until << ")");
-      bypassQueue.pop();
-      // Check if bypass expiration time (from the queue) is different
-      // than top.first
-      // - If top.second->until is greater than top.first, then the bypass
-      //   was extended, i.e. there is at least one other entry in the priority
-      //   queue for this bypass. In this case the bypass status is kept BYPASS_VALID
-      // - If top.second->until is smaller than top.first then the bypass
-      //   was shortened. In this case the bypass is set to BYPASS_EXPIRED
-      // - If they are the same then the bypass is also set to BYPASS_EXPIRED
-      if (top.second->until > top.first) {
-	// If the bypass expiration time is greater than the current time then
-	// the status must still be BYPASS_VALID
-	if (top.second->status != BYPASS_VALID) {
-	  LOG_TRACE("BYPASS", "Found BYPASS_EXPIRED status, setting back to BYPASS_VALID"
-		    << " and returning error");
-	  top.second->status = BYPASS_VALID;
-	  return false;
-	}
-	else {
-	  LOG_TRACE("BYPASS", "Found BYPASS_VALID, no bypass status change");
-	}
-      }
-      else if (top.second->until <= top.first) {
-	if (top.second->type == BYPASS_ANALOG) {
-	  History::getInstance().logBypassState(top.second->deviceId,
-						top.second->status,
-						BYPASS_EXPIRED,
-						top.second->index);
-	  // If analog/threshold bypass, change bypassMask
-	  // set integrator thresholds bit to 1 (not-bypassed)
-	  uint32_t *bypassMask = top.second->bypassMask;//&((*analogInput).second->bypassMask);
-	  if (top.second->index >= 0 && bypassMask != NULL) {
-	    uint32_t m = 0xFF << (top.second->index * ANALOG_CHANNEL_INTEGRATORS_SIZE); // clear bypassed integrator thresholds
-	    *bypassMask |= m;
-	  }
-	}
-	else {
-	  History::getInstance().logBypassState(top.second->deviceId,
-						top.second->status,
-						BYPASS_EXPIRED,
-						BYPASS_DIGITAL_INDEX);
-	}
+  if (bypassQueue.empty() || bypassQueue.top().first > now) {
+    return false;
+  }
 
-	// Check if expired bypass requires firmware configuration update
-	if (top.second->configUpdate) {
-	  refreshFirmwareConfiguration = true;
-	}
+  BypassQueueEntry top = bypassQueue.top();
+  LOG_TRACE("BYPASS", "Bypass for device [" << top.second->deviceId << "] expired, "
+	    << "type=" << top.second->type
+	    << ", until=" << top.first << " sec"
+	    << ", now=" << now << " sec");
+  bypassQueue.pop();
+
+  if (top.second->type == BYPASS_ANALOG) {
+    History::getInstance().logBypassState(top.second->deviceId,
+					  top.second->status,
+					  BYPASS_EXPIRED,
+					  top.second->index);
+  }
+  else {
+    History::getInstance().logBypassState(top.second->deviceId,
+					  top.second->status,
+					  BYPASS_EXPIRED,
+					  BYPASS_DIGITAL_INDEX);
+  }
 
-	top.second->status = BYPASS_EXPIRED;
-	LOG_TRACE("BYPASS", "Setting status to BYPASS_EXPIRED");
-      }
-      return true;
-    }
-    else {
-      return false;
+  // Check if expired bypass requires firmware configuration update
+  if (top.second->configUpdate) {
+    refreshFirmwareConfiguration = true;
+    // The staged configuration only covers the expirations at stagedUntil
+    if (top.first != stagedUntil) {
+      stagedValid = false;
     }
   }
-  else {
-    return false;
+
+  if (pendingExpiry == 0 || top.first < pendingExpiry) {
+    pendingExpiry = top.first;
   }
+
+  top.second->status = BYPASS_EXPIRED;
+  publishBypass(top.second);
+  LOG_TRACE("BYPASS", "Setting status to BYPASS_EXPIRED");
+
+  return true;
 }
 
 /**
@@ -325,24 +333,12 @@ bool BypassManager::checkBypassQueueTop(time_t now) {
  *
  * 2) Change bypass: there is already a bypass in the queue, the
  * new expiration time may be earlier or later than the previous.
- * In either case a new entry is added to the queue.
- * - If later: change the until field in the deviceBypass and keep
- *   the status BYPASS_VALID. When the first timer expires the
- *   checkBypassQueue verifies if the time from the queue is the
- *   same as the one saved in the bypass. The expiration time in
- *   the bypass is later, so the status is kept at BYPASS_VALID.
- *
- * - If earlier: change the until in the deviceBypass and
- *   keep the status set to BYPASS_VALID. The new timer will expire
- *   earlier, and when that happens the status should be changed
- *   to BYPASS_EXPIRED. When the later timer expires the status
- *   of the bypass will already be BYPASS_EXPIRED.
+ * In either case the existing queue entry is moved to the new
+ * expiration time - each bypass has at most one entry in the queue.
  *
  * 3) Cancel bypass: by specifying a bypassUntil parameter of ZERO. The
- *    until field in the bypass is set to ZERO and status changed to
- *    BYPASS_EXPIRED. No new element is added to the priority queue.
- *    If there are entries in the queue then they will be removed
- *    the next time the bypasses are checked.
+ *    until field in the bypass is set to ZERO, status changed to
+ *    BYPASS_EXPIRED and the bypass is removed from the queue.
  *
  * Multiple bypass to the same device can be added, the last one
  * to be added will be the the one that controls when the bypass
@@ -354,15 +350,15 @@ void BypassManager::setBypass(MpsDbPtr db, BypassType bypassType,
   setThresholdBypass(db, bypassType, deviceId, value, bypassUntil, -1, test);
 }
 
-void BypassManager::setThresholdBypass(MpsDbPtr db, BypassType bypassType,
-				       uint32_t deviceId, uint32_t value, time_t bypassUntil,
-				       int intIndex, bool test) {
-  InputBypassPtr bypass;
+/**
+ * Find the bypass for the given digital input or analog device integrator.
+ * All devices must have a bypass assigned, the assignment must be after the
+ * BypassManager is created.
+ */
+InputBypassPtr BypassManager::findBypass(MpsDbPtr db, BypassType bypassType,
+					 uint32_t deviceId, int index) {
   std::stringstream errorStream;
-  uint32_t *bypassMask = NULL;
 
-  // Find the device and its bypass - all devices must have a bypass assigned.
-  // The assignment must be after the BypassManager is created.
   if (bypassType == BYPASS_DIGITAL) {
     DbDeviceInputMap::iterator digitalInput = db->deviceInputs->find(deviceId);
     if (digitalInput == db->deviceInputs->end()) {
@@ -370,7 +366,7 @@ void BypassManager::setThresholdBypass(MpsDbPtr db, BypassType bypassType,
 		  << "] while setting bypass";
       throw(CentralNodeException(errorStream.str()));
     }
-    bypass = (*digitalInput).second->bypass;
+    return (*digitalInput).second->bypass;
   }
   else {
     DbAnalogDeviceMap::iterator analogInput = db->analogDevices->find(deviceId);
@@ -379,13 +375,14 @@ void BypassManager::setThresholdBypass(MpsDbPtr db, BypassType bypassType,
 		  << "] while setting bypass";
       throw(CentralNodeException(errorStream.str()));
     }
-    bypass = (*analogInput).second->bypass[intIndex];
-    bypassMask = &(*analogInput).second->bypassMask;
+    return (*analogInput).second->bypass[index];
   }
+}
 
-  BypassQueueEntry newEntry;
-  newEntry.first = bypassUntil;
-  newEntry.second = bypass;
+void BypassManager::setThresholdBypass(MpsDbPtr db, BypassType bypassType,
+				       uint32_t deviceId, uint32_t value, time_t bypassUntil,
+				       int intIndex, bool test) {
+  InputBypassPtr bypass = findBypass(db, bypassType, deviceId, intIndex);
 
   // This handles case #3 - cancel bypass
   if (bypassUntil == 0) {
@@ -402,20 +399,23 @@ void BypassManager::setThresholdBypass(MpsDbPtr db, BypassType bypassType,
 					    BYPASS_DIGITAL_INDEX);
     }
 
-    bypass->status = BYPASS_EXPIRED;
-    bypass->until = 0;
-
-    // If analog/threshold bypass, change bypassMask - set integrator thresholds bit to 1 (not-bypassed)
-    if (intIndex >= 0 && bypassType == BYPASS_ANALOG && bypassMask != NULL) {
-      uint32_t m = 0xFF << (intIndex * ANALOG_CHANNEL_INTEGRATORS_SIZE); // clear bypassed integrator thresholds
-      *bypassMask |= m;
-    }
-
     // Check if expired bypass requires firmware configuration update
     if (bypass->configUpdate) {
       refreshFirmwareConfiguration = true;
     }
 
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      bypass->status = BYPASS_EXPIRED;
+      bypass->until = 0;
+      stateTable.beginUpdate();
+      publishBypass(bypass);
+      stateTable.endUpdate();
+      bypassQueue.remove(bypass->id);
+      bypassGeneration++;
+      armTimer();
+    }
+
     LOG_TRACE("BYPASS", "Set bypass EXPIRED for device [" << deviceId << "], "
 	      << "type=" << bypassType);
   }
@@ -457,16 +457,142 @@ void BypassManager::setThresholdBypass(MpsDbPtr db, BypassType bypassType,
 	bypass->until = bypassUntil;
 	bypass->status = BYPASS_VALID;
 	bypass->value = value;
+	stateTable.beginUpdate();
+	publishBypass(bypass);
+	stateTable.endUpdate();
 
-	// If analog/threshold bypass, change bypassMask - set threshold bit to 0 (bypassed)
-	if (intIndex >= 0 && bypassType == BYPASS_ANALOG && bypassMask != NULL) {
-	  uint32_t m = ~(0xFF << (intIndex * ANALOG_CHANNEL_INTEGRATORS_SIZE)); // zero the bypassed threshold bit
-	  *bypassMask &= m;
-	}
+	bypassQueue.update(bypass, bypassUntil);
+	bypassGeneration++;
+	armTimer();
+      }
+    }
+  }
+}
+
+/**
+ * Apply a batch of bypasses at once. All requests are validated before any
+ * bypass is changed - if one of them is invalid an exception is thrown and
+ * nothing is applied. The bypasses are changed under a single lock
+ * acquisition, the History messages are queued as one batch and the
+ * firmware configuration is reloaded only once for the whole batch.
+ *
+ * Each request follows the same rules as setThresholdBypass(): an until
+ * time of zero cancels the bypass, otherwise it must be in the future.
+ *
+ * If 'reloadFirmware' is false the firmware configuration is not reloaded,
+ * the caller writes it (used when the bypasses are restored on startup).
+ */
+void BypassManager::setBypasses(MpsDbPtr db, const BypassRequestList &requests,
+				bool test, bool reloadFirmware) {
+  std::stringstream errorStream;
+  std::vector<InputBypassPtr> bypasses(requests.size());
+
+  time_t now;
+  time(&now);
+
+  // Validate all requests first
+  for (size_t i = 0; i < requests.size(); ++i) {
+    const BypassRequest &request = requests[i];
+    if (request.type == BYPASS_ANALOG &&
+	(request.index < 0 ||
+	 request.index >= static_cast<int>(ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL))) {
+      errorStream << "ERROR: Invalid integrator index " << request.index
+		  << " for AnalogDevice[" << request.deviceId
+		  << "] in bypass request #" << i;
+      throw(CentralNodeException(errorStream.str()));
+    }
+
+    if (request.until != 0 && !test && request.until <= now) {
+      errorStream << "ERROR: Bypass request #" << i << " for device ["
+		  << request.deviceId << "] expires in the past (until="
+		  << request.until << ", now=" << now << ")";
+      throw(CentralNodeException(errorStream.str()));
+    }
+
+    bypasses[i] = findBypass(db, request.type, request.deviceId, request.index);
+  }
+
+  std::vector<Message> messages;
+  messages.reserve(requests.size());
+  bool refresh = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stateTable.beginUpdate();
+    for (size_t i = 0; i < requests.size(); ++i) {
+      const BypassRequest &request = requests[i];
+      InputBypassPtr bypass = bypasses[i];
+
+      Message message;
+      message.type = BypassStateType;
+      message.id = bypass->deviceId;
+      message.oldValue = bypass->status;
+      message.aux = bypass->type == BYPASS_ANALOG ? bypass->index : BYPASS_DIGITAL_INDEX;
+
+      if (request.until == 0) {
+	message.newValue = BYPASS_EXPIRED;
+	bypass->status = BYPASS_EXPIRED;
+	bypass->until = 0;
+	bypassQueue.remove(bypass->id);
+      }
+      else {
+	message.newValue = BYPASS_VALID;
+	bypass->until = request.until;
+	bypass->status = BYPASS_VALID;
+	bypass->value = request.value;
+	bypassQueue.update(bypass, request.until);
+      }
+      publishBypass(bypass);
+      messages.push_back(message);
 
-	bypassQueue.push(newEntry);
+      if (bypass->configUpdate && reloadFirmware) {
+	refresh = true;
       }
     }
+
+    stateTable.endUpdate();
+    bypassGeneration++;
+    if (refresh) {
+      refreshFirmwareConfiguration = true;
+    }
+    armTimer();
+  }
+
+  LOG_TRACE("BYPASS", "Applied " << requests.size() << " bypass requests"
+	    << (refresh ? ", firmware configuration reload pending" : ""));
+
+  History::getInstance().add(messages);
+
+  // Let the bypass thread do the reload right away
+  if (refresh) {
+    wakeBypassThread();
+  }
+}
+
+/**
+ * Returns the bypasses currently in effect, as requests that set them
+ * again (see EngineCheckpoint).
+ */
+void BypassManager::getActiveBypasses(BypassRequestList &requests) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  requests.clear();
+  if (!bypassMap) {
+    return;
+  }
+
+  for (InputBypassMap::iterator it = bypassMap->begin(); it != bypassMap->end(); ++it) {
+    InputBypassPtr bypass = (*it).second;
+    if (bypass->status != BYPASS_VALID) {
+      continue;
+    }
+
+    BypassRequest request;
+    request.type = bypass->type;
+    request.deviceId = bypass->deviceId;
+    request.index = bypass->index;
+    request.value = bypass->value;
+    request.until = bypass->until;
+    requests.push_back(request);
   }
 }
 
@@ -478,35 +604,229 @@ void BypassManager::printBypassQueue() {
   time_t now;
   time(&now);
 
-  BypassPriorityQueue copy;
+  std::vector<BypassQueueEntry> entries;
   {
     std::unique_lock<std::mutex> lock(mutex);
-    copy = bypassQueue;
+    bypassQueue.getSorted(entries);
   }
   std::cout << "=== Bypass Queue (orded by expiration date) ===" << std::endl;
   std::cout << "=== Current time: " << now << "(s) ===" << std::endl;
-  while (!copy.empty()) {
+  for (std::vector<BypassQueueEntry>::iterator entry = entries.begin();
+       entry != entries.end(); ++entry) {
     struct tm *ptr;
     char buf[40];
-    ptr = localtime(&copy.top().first);
+    ptr = localtime(&(*entry).first);
     strftime(buf, 40, "%x %X", ptr);
-    std::cout << buf << " (" << copy.top().first << "): deviceId=" << copy.top().second->deviceId;
-    if (copy.top().second->type == BYPASS_ANALOG) {
-      std::cout << " integrator " << copy.top().second->index;
+    std::cout << buf << " (" << (*entry).first << "): deviceId=" << (*entry).second->deviceId;
+    if ((*entry).second->type == BYPASS_ANALOG) {
+      std::cout << " integrator " << (*entry).second->index;
     }
-    if (copy.top().second->configUpdate) {
+    if ((*entry).second->configUpdate) {
       std::cout << " [FW bypass]";
     }
-    if (copy.top().second->status == BYPASS_VALID) {
+    if ((*entry).second->status == BYPASS_VALID) {
       std::cout << " [VALID]";
     }
     else {
       std::cout << " [EXPIRED]";
     }
-    std::cout << " BYPV=" << copy.top().second->value << std::endl;
+    std::cout << " BYPV=" << (*entry).second->value << std::endl;
+  }
+}
 
-    copy.pop();
+/**
+ * Build the firmware configuration for the cards affected by the next
+ * bypass expiration, so that when it expires only those cards need to
+ * be written to the firmware. Nothing is done if the configuration for
+ * the next expiration is already staged and still current.
+ */
+void BypassManager::stageNextExpiration() {
+  MpsDbPtr db = Engine::getInstance().getCurrentDb();
+  if (!db) {
+    return;
+  }
+
+  time_t next = 0;
+  uint32_t generation = 0;
+  std::vector<InputBypassPtr> expiring;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (bypassQueue.empty()) {
+      return;
+    }
+
+    next = bypassQueue.top().first;
+    if (stagedValid && stagedUntil == next && stagedDb == db &&
+	stagedBypassGeneration == bypassGeneration &&
+	stagedFwGeneration == db->getFwConfigGeneration()) {
+      return;
+    }
+
+    // Find the firmware bypasses that expire at 'next'
+    std::vector<InputBypassPtr> candidates;
+    bypassQueue.getExpiringAt(next, candidates);
+    for (std::vector<InputBypassPtr>::iterator bypass = candidates.begin();
+	 bypass != candidates.end(); ++bypass) {
+      if ((*bypass)->configUpdate && (*bypass)->status == BYPASS_VALID) {
+	expiring.push_back(*bypass);
+      }
+    }
+    generation = bypassGeneration;
   }
+
+  std::set<uint32_t> cards;
+  uint32_t fwGeneration = 0;
+  {
+    std::unique_lock<std::mutex> lock(*db->getMutex());
+    for (std::vector<InputBypassPtr>::iterator bypass = expiring.begin();
+	 bypass != expiring.end(); ++bypass) {
+      if ((*bypass)->type == BYPASS_DIGITAL) {
+	DbDeviceInputMap::iterator input = db->deviceInputs->find((*bypass)->deviceId);
+	if (input != db->deviceInputs->end() && (*input).second->channel) {
+	  cards.insert((*input).second->channel->cardId);
+	}
+      }
+      else {
+	DbAnalogDeviceMap::iterator analog = db->analogDevices->find((*bypass)->deviceId);
+	if (analog != db->analogDevices->end()) {
+	  cards.insert((*analog).second->cardId);
+	}
+      }
+    }
+    db->stageFirmwareConfiguration(cards, next);
+    fwGeneration = db->getFwConfigGeneration();
+  }
+
+  LOG_TRACE("BYPASS", "Staged firmware configuration for " << cards.size()
+	    << " application(s), expiration at " << next << " sec");
+
+  std::unique_lock<std::mutex> lock(mutex);
+  stagedValid = true;
+  stagedUntil = next;
+  stagedCards = cards;
+  stagedDb = db;
+  stagedBypassGeneration = generation;
+  stagedFwGeneration = fwGeneration;
+}
+
+/**
+ * Write the staged card configurations to the firmware. Returns false
+ * if there is no usable staged configuration, in which case the caller
+ * must reload the whole firmware configuration.
+ */
+bool BypassManager::pushStagedConfiguration() {
+  std::set<uint32_t> cards;
+  MpsDbPtr db = Engine::getInstance().getCurrentDb();
+  uint32_t fwGeneration;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    bool valid = stagedValid && stagedDb == db &&
+      stagedBypassGeneration == bypassGeneration;
+    stagedValid = false;
+    if (!valid) {
+      return false;
+    }
+    cards = stagedCards;
+    fwGeneration = stagedFwGeneration;
+  }
+
+  std::unique_lock<std::mutex> lock(*db->getMutex());
+  if (db->getFwConfigGeneration() != fwGeneration) {
+    return false;
+  }
+
+  stagedPushTime.start();
+  db->writeStagedFirmwareConfiguration(cards);
+  stagedPushTime.tick();
+  stagedPushTime.stop();
+
+  return true;
+}
+
+/**
+ * Arm the timer for the next bypass expiration, or for the next application
+ * timeout status refresh if that comes first. Must be called with the
+ * mutex held.
+ */
+void BypassManager::armTimer() {
+  if (timerFd < 0) {
+    return;
+  }
+
+  time_t next = nextStatusRefresh;
+  if (!bypassQueue.empty() && (next == 0 || bypassQueue.top().first < next)) {
+    next = bypassQueue.top().first;
+  }
+
+  // A zero it_value would disarm the timer, fire immediately instead
+  struct itimerspec spec = {{0, 0}, {next > 0 ? next : 0, next > 0 ? 0 : 1}};
+  if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+    perror("timerfd_settime failed");
+  }
+}
+
+/**
+ * Make the bypass thread return from waitNextExpiration() right away.
+ */
+void BypassManager::wakeBypassThread() {
+  if (timerFd >= 0) {
+    struct itimerspec spec = {{0, 0}, {0, 1}};
+    timerfd_settime(timerFd, 0, &spec, NULL);
+  }
+}
+
+/**
+ * Block until the next bypass expiration time, or at most one second
+ * (the application timeout status is refreshed at that rate). The timer
+ * is re-armed whenever a bypass changes, so new earlier expirations are
+ * honored.
+ */
+void BypassManager::waitNextExpiration() {
+  if (timerFd < 0) {
+    sleep(1);
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    // A firmware reload was requested while the thread was busy
+    if (refreshFirmwareConfiguration) {
+      return;
+    }
+    nextStatusRefresh = time(NULL) + 1;
+    armTimer();
+  }
+
+  uint64_t expirations;
+  if (!threadDone && read(timerFd, &expirations, sizeof(expirations)) < 0) {
+    perror("read timerfd failed");
+  }
+}
+
+void BypassManager::recordExpirySkew(time_t scheduled) {
+  std::chrono::microseconds skew =
+    std::chrono::duration_cast<std::chrono::microseconds>
+    (std::chrono::system_clock::now() - std::chrono::system_clock::from_time_t(scheduled));
+
+  expirySkewLast = skew.count();
+  if (expirySkewLast > expirySkewMax) {
+    expirySkewMax = expirySkewLast;
+  }
+  expirySkewSum += expirySkewLast;
+  expiryCount++;
+}
+
+void BypassManager::showStats() {
+  std::cout << ">>> Bypass Manager Stats <<<" << std::endl;
+  std::cout << "Expirations processed: " << expiryCount << std::endl;
+  if (expiryCount > 0) {
+    std::cout << "Expiration skew (actual - scheduled): last="
+	      << expirySkewLast << " us, avg=" << expirySkewSum / expiryCount
+	      << " us, max=" << expirySkewMax << " us" << std::endl;
+  }
+  std::cout << "Staged config pushes: " << stagedPushCount
+	    << ", full config reloads: " << fullReloadCount << std::endl;
+  stagedPushTime.show();
 }
 
 void BypassManager::bypassThread() {
@@ -518,12 +838,24 @@ void BypassManager::bypassThread() {
       return;
     }
     if (Engine::getInstance().getBypassManager()) {
-      Engine::getInstance().getBypassManager()->checkBypassQueue();
-      if (refreshFirmwareConfiguration) {
-	Engine::getInstance().reloadConfig();
-	refreshFirmwareConfiguration = false;
+      checkBypassQueue();
+      if (refreshFirmwareConfiguration.exchange(false)) {
+	if (pushStagedConfiguration()) {
+	  stagedPushCount++;
+	}
+	else {
+	  Engine::getInstance().reloadConfig();
+	  fullReloadCount++;
+	}
+      }
+      if (pendingExpiry != 0) {
+	recordExpirySkew(pendingExpiry);
+	pendingExpiry = 0;
       }
-      sleep(1);
+
+      // Get ready for the next expiration, then sleep until it is due
+      stageNextExpiration();
+      waitNextExpiration();
 
       // Refresh the application timeout status - not really something related
       // to bypass, but it is done here for convenience
@@ -531,4 +863,3 @@ void BypassManager::bypassThread() {
     }
   }
 }
-
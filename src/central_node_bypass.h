@@ -4,6 +4,7 @@
 #include <boost/shared_ptr.hpp>
 #include <time.h>
 #include <queue>
+#include <map>
 #include <stdint.h>
 
 enum BypassType {
@@ -70,7 +71,6 @@ class InputBypass {
   // 32 InputBypass - each threshold can be bypassed individually
   // Analog integrator index (from 0 to 4)
   uint16_t index;
-  uint32_t *bypassMask;
 
   // Indicates if this bypass requires firmware configuration update - this
   // is needed for inputs used by the fast rules
@@ -80,6 +80,13 @@ class InputBypass {
     type(BYPASS_DIGITAL), until(0), status(BYPASS_EXPIRED),
     configUpdate(false) {
   }
+
+  // Returns true if the bypass is in effect. If 'expiredBy' is non-zero the
+  // bypasses expiring at or before that time are considered expired - this
+  // is used to build the firmware configuration ahead of an expiration.
+  bool isActive(time_t expiredBy = 0) const {
+    return status == BYPASS_VALID && (expiredBy == 0 || until > expiredBy);
+  }
 };
 
 typedef boost::shared_ptr<InputBypass> InputBypassPtr;
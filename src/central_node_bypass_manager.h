@@ -3,38 +3,86 @@
 
 #include <central_node_database_tables.h>
 #include <central_node_database.h>
+#include <central_node_bypass_queue.h>
+#include <central_node_bypass_state.h>
 #include <stdint.h>
 #include <thread>
+#include <atomic>
+#include <set>
 
 /**
- * The bypass expirations are monitored via a priority queue. The head of the
- * queue points to the bypass that will expire first. If a bypass time is
- *
+ * One entry of a bulk bypass request (see BypassManager::setBypasses()).
+ * The index selects the integrator for analog bypasses and is ignored for
+ * digital bypasses. An until time of zero cancels the bypass.
  */
-typedef std::pair<time_t, InputBypassPtr> BypassQueueEntry;
-
-class CompareBypassTime {
- public:
-  bool operator()(BypassQueueEntry f1, BypassQueueEntry f2) {
-    return f1.first > f2.first;
-  }
+struct BypassRequest {
+  BypassType type;
+  uint32_t deviceId;
+  int index;
+  uint32_t value;
+  time_t until;
 };
 
-typedef std::priority_queue<BypassQueueEntry,
-  std::vector<BypassQueueEntry>, CompareBypassTime> BypassPriorityQueue;
+typedef std::vector<BypassRequest> BypassRequestList;
 
 class BypassManager {
  private:
   InputBypassMapPtr bypassMap;
-  BypassPriorityQueue bypassQueue;
+  BypassQueue bypassQueue;
 
   bool checkBypassQueueTop(time_t now);
 
   bool threadDone;
   std::thread *_bypassThread;
   std::mutex mutex;
+
+  // The bypass thread sleeps on this timer, which is armed for the next
+  // expiration (or the next application timeout status refresh)
+  int timerFd;
+  time_t nextStatusRefresh;
   bool initialized;
-  static bool refreshFirmwareConfiguration;
+  // Set by any thread that changes a firmware bypass, taken by the bypass
+  // thread (also ends its timer wait early)
+  static std::atomic<bool> refreshFirmwareConfiguration;
+
+  // Incremented whenever a bypass is added, changed or cancelled
+  uint32_t bypassGeneration;
+
+  // Firmware configuration staged for the next expiration time. The staged
+  // card configurations are only used if neither the bypasses nor the full
+  // firmware configuration changed since they were built.
+  bool stagedValid;
+  time_t stagedUntil;
+  std::set<uint32_t> stagedCards;
+  MpsDbPtr stagedDb;
+  uint32_t stagedBypassGeneration;
+  uint32_t stagedFwGeneration;
+
+  // Earliest scheduled expiration handled by the last checkBypassQueue()
+  time_t pendingExpiry;
+
+  // Actual versus scheduled expiration time, in microseconds
+  uint32_t expiryCount;
+  long expirySkewLast;
+  long expirySkewMax;
+  long expirySkewSum;
+
+  uint32_t stagedPushCount;
+  uint32_t fullReloadCount;
+  Timer<double> stagedPushTime;
+
+  void stageNextExpiration();
+  bool pushStagedConfiguration();
+  void armTimer();
+  void wakeBypassThread();
+  InputBypassPtr findBypass(MpsDbPtr db, BypassType bypassType, uint32_t deviceId,
+			    int index);
+
+  // Bypass status/value published to the engine thread
+  BypassStateTable stateTable;
+  void publishBypass(InputBypassPtr bypass);
+  void waitNextExpiration();
+  void recordExpirySkew(time_t scheduled);
 
  public:
   BypassManager();
@@ -47,7 +95,12 @@ class BypassManager {
 			  int thresholdIndex, bool test = false);
   void setBypass(MpsDbPtr db, BypassType bypassType, uint32_t deviceId,
 		 uint32_t value, time_t bypassUntil, bool test = false);
+  void setBypasses(MpsDbPtr db, const BypassRequestList &requests, bool test = false,
+		   bool reloadFirmware = true);
+  void getActiveBypasses(BypassRequestList &requests);
+  const BypassStateTable &getStateTable() const { return stateTable; }
   void printBypassQueue();
+  void showStats();
   bool isInitialized();
 
   void startBypassThread();
@@ -0,0 +1,148 @@
+#include <algorithm>
+
+#include <central_node_bypass_queue.h>
+
+static bool compareBypassTime(const BypassQueueEntry &a, const BypassQueueEntry &b) {
+  return a.first < b.first;
+}
+
+void BypassQueue::swapEntries(size_t a, size_t b) {
+  std::swap(heap[a], heap[b]);
+  position[heap[a].second->id] = a;
+  position[heap[b].second->id] = b;
+}
+
+void BypassQueue::siftUp(size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (heap[parent].first <= heap[i].first) {
+      break;
+    }
+    swapEntries(i, parent);
+    i = parent;
+  }
+}
+
+void BypassQueue::siftDown(size_t i) {
+  size_t n = heap.size();
+  while (true) {
+    size_t smallest = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < n && heap[left].first < heap[smallest].first) {
+      smallest = left;
+    }
+    if (right < n && heap[right].first < heap[smallest].first) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      break;
+    }
+    swapEntries(i, smallest);
+    i = smallest;
+  }
+}
+
+void BypassQueue::removeAt(size_t i) {
+  size_t last = heap.size() - 1;
+  position[heap[i].second->id] = -1;
+  if (i != last) {
+    heap[i] = heap[last];
+    position[heap[i].second->id] = i;
+  }
+  heap.pop_back();
+
+  // The entry moved into the hole may belong above or below it
+  if (i < heap.size()) {
+    if (i > 0 && heap[i].first < heap[(i - 1) / 2].first) {
+      siftUp(i);
+    }
+    else {
+      siftDown(i);
+    }
+  }
+}
+
+void BypassQueue::pop() {
+  if (!heap.empty()) {
+    removeAt(0);
+  }
+}
+
+/**
+ * Add the bypass to the queue, or change its expiration time if it is
+ * already queued.
+ */
+void BypassQueue::update(InputBypassPtr bypass, time_t until) {
+  if (bypass->id >= position.size()) {
+    position.resize(bypass->id + 1, -1);
+  }
+
+  int32_t i = position[bypass->id];
+  if (i < 0) {
+    heap.push_back(BypassQueueEntry(until, bypass));
+    position[bypass->id] = heap.size() - 1;
+    siftUp(heap.size() - 1);
+  }
+  else {
+    time_t previous = heap[i].first;
+    heap[i].first = until;
+    if (until < previous) {
+      siftUp(i);
+    }
+    else {
+      siftDown(i);
+    }
+  }
+}
+
+/**
+ * Remove the bypass from the queue. Returns false if it was not queued.
+ */
+bool BypassQueue::remove(uint32_t bypassId) {
+  if (!contains(bypassId)) {
+    return false;
+  }
+  removeAt(position[bypassId]);
+  return true;
+}
+
+bool BypassQueue::contains(uint32_t bypassId) const {
+  return bypassId < position.size() && position[bypassId] >= 0;
+}
+
+/**
+ * Collect all bypasses expiring exactly at the specified time. Subtrees
+ * whose root expires later than 'until' are not visited.
+ */
+void BypassQueue::getExpiringAt(time_t until, std::vector<InputBypassPtr> &bypasses) const {
+  std::vector<size_t> pending;
+  if (!heap.empty()) {
+    pending.push_back(0);
+  }
+
+  while (!pending.empty()) {
+    size_t i = pending.back();
+    pending.pop_back();
+    if (heap[i].first > until) {
+      continue;
+    }
+    if (heap[i].first == until) {
+      bypasses.push_back(heap[i].second);
+    }
+    if (2 * i + 1 < heap.size()) {
+      pending.push_back(2 * i + 1);
+    }
+    if (2 * i + 2 < heap.size()) {
+      pending.push_back(2 * i + 2);
+    }
+  }
+}
+
+/**
+ * Copy all entries, ordered by expiration time (for display).
+ */
+void BypassQueue::getSorted(std::vector<BypassQueueEntry> &entries) const {
+  entries = heap;
+  std::sort(entries.begin(), entries.end(), compareBypassTime);
+}
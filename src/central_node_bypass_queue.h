@@ -0,0 +1,48 @@
+#ifndef CENTRAL_NODE_BYPASS_QUEUE_H
+#define CENTRAL_NODE_BYPASS_QUEUE_H
+
+#include <central_node_bypass.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+/**
+ * The bypass expirations are kept in a min-heap ordered by expiration time.
+ * The head of the queue points to the bypass that will expire first.
+ */
+typedef std::pair<time_t, InputBypassPtr> BypassQueueEntry;
+
+/**
+ * Indexed min-heap of bypass expirations. The heap keeps at most one
+ * entry per bypass (indexed by InputBypass::id), extending or shortening
+ * a bypass moves its entry up or down the heap instead of adding another
+ * one. All operations are O(log n).
+ */
+class BypassQueue {
+ private:
+  std::vector<BypassQueueEntry> heap;
+
+  // Position of each bypass in the heap, indexed by bypass id (-1 if the
+  // bypass is not in the queue)
+  std::vector<int32_t> position;
+
+  void siftUp(size_t i);
+  void siftDown(size_t i);
+  void swapEntries(size_t a, size_t b);
+  void removeAt(size_t i);
+
+ public:
+  bool empty() const { return heap.empty(); }
+  size_t size() const { return heap.size(); }
+  const BypassQueueEntry &top() const { return heap.front(); }
+
+  void pop();
+  void update(InputBypassPtr bypass, time_t until);
+  bool remove(uint32_t bypassId);
+  bool contains(uint32_t bypassId) const;
+
+  void getExpiringAt(time_t until, std::vector<InputBypassPtr> &bypasses) const;
+  void getSorted(std::vector<BypassQueueEntry> &entries) const;
+};
+
+#endif
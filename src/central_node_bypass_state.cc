@@ -0,0 +1,67 @@
+#include <central_node_bypass_state.h>
+
+BypassStateTable::BypassStateTable() : sequence(0) {
+}
+
+/**
+ * Allocate one record per bypass, all expired. Must be called before
+ * the engine thread starts reading the table.
+ */
+void BypassStateTable::resize(size_t size) {
+  std::vector<std::atomic<uint32_t> > newStatus(size);
+  std::vector<std::atomic<uint32_t> > newValue(size);
+  for (size_t i = 0; i < size; ++i) {
+    newStatus[i].store(BYPASS_EXPIRED, std::memory_order_relaxed);
+    newValue[i].store(0, std::memory_order_relaxed);
+  }
+  status.swap(newStatus);
+  value.swap(newValue);
+  sequence.fetch_add(2, std::memory_order_release);
+}
+
+void BypassStateTable::beginUpdate() {
+  // Odd sequence number means an update is in progress
+  sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void BypassStateTable::set(uint32_t bypassId, BypassStatus bypassStatus, uint32_t bypassValue) {
+  if (bypassId < status.size()) {
+    status[bypassId].store(bypassStatus, std::memory_order_relaxed);
+    value[bypassId].store(bypassValue, std::memory_order_relaxed);
+  }
+}
+
+void BypassStateTable::endUpdate() {
+  sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+uint32_t BypassStateTable::getSequence() const {
+  return sequence.load(std::memory_order_acquire);
+}
+
+/**
+ * Copy all records. Returns false (and the copy must be discarded) if an
+ * update was in progress or happened while copying. On success the sequence
+ * number of the copied state is returned in 'readSequence'.
+ */
+bool BypassStateTable::read(std::vector<BypassRecord> &records, uint32_t &readSequence) const {
+  uint32_t before = sequence.load(std::memory_order_acquire);
+  if (before & 1) {
+    return false;
+  }
+
+  records.resize(status.size());
+  for (size_t i = 0; i < status.size(); ++i) {
+    records[i].status = static_cast<BypassStatus>(status[i].load(std::memory_order_relaxed));
+    records[i].value = value[i].load(std::memory_order_relaxed);
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (sequence.load(std::memory_order_relaxed) != before) {
+    return false;
+  }
+
+  readSequence = before;
+  return true;
+}
@@ -0,0 +1,48 @@
+#ifndef CENTRAL_NODE_BYPASS_STATE_H
+#define CENTRAL_NODE_BYPASS_STATE_H
+
+#include <central_node_bypass.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/**
+ * Copy of the state of one bypass, as seen by the engine thread.
+ */
+struct BypassRecord {
+  BypassStatus status;
+  uint32_t value;
+};
+
+/**
+ * Bypass state (status and value for each bypass, indexed by the
+ * InputBypass::id) published from the BypassManager to the engine
+ * thread with a sequence lock.
+ *
+ * Writers bracket their changes with beginUpdate()/endUpdate() and must be
+ * serialized by the caller (the BypassManager mutex). The reader never
+ * blocks and never makes the writers wait: read() returns false if a writer
+ * was active while the records were copied, and the engine then keeps the
+ * previous view until the next cycle.
+ */
+class BypassStateTable {
+ private:
+  std::atomic<uint32_t> sequence;
+  std::vector<std::atomic<uint32_t> > status;
+  std::vector<std::atomic<uint32_t> > value;
+
+ public:
+  BypassStateTable();
+
+  void resize(size_t size);
+  size_t size() const { return status.size(); }
+
+  void beginUpdate();
+  void set(uint32_t bypassId, BypassStatus bypassStatus, uint32_t bypassValue);
+  void endUpdate();
+
+  uint32_t getSequence() const;
+  bool read(std::vector<BypassRecord> &records, uint32_t &readSequence) const;
+};
+
+#endif
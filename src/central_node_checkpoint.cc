@@ -0,0 +1,329 @@
+#include <central_node_checkpoint.h>
+#include <central_node_firmware.h>
+#include <central_node_exception.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+
+static std::string getMd5sum(MpsDbPtr db) {
+  if (db->databaseInfo && !db->databaseInfo->empty()) {
+    return db->databaseInfo->begin()->second->md5sum;
+  }
+  return "";
+}
+
+static uint32_t getBeamClassId(DbBeamClassPtr beamClass) {
+  return beamClass ? beamClass->id : CLEAR_BEAM_CLASS;
+}
+
+EngineCheckpoint::EngineCheckpoint() : _time(0), _fwFingerprint(0), _fpgaVersion(0) {
+}
+
+/**
+ * Hash of the checkpoint records, stored in the header.
+ */
+uint64_t EngineCheckpoint::hash() const {
+  uint64_t h = DB_IMAGE_HASH_INIT;
+  if (!_bypasses.empty()) {
+    h = dbImageHash(h, &_bypasses[0], _bypasses.size() * sizeof(EngineCheckpointBypass));
+  }
+  if (!_destinations.empty()) {
+    h = dbImageHash(h, &_destinations[0], _destinations.size() * sizeof(EngineCheckpointDestination));
+  }
+  if (!_digitalLatches.empty()) {
+    h = dbImageHash(h, &_digitalLatches[0], _digitalLatches.size() * sizeof(EngineCheckpointLatch));
+  }
+  if (!_analogLatches.empty()) {
+    h = dbImageHash(h, &_analogLatches[0], _analogLatches.size() * sizeof(EngineCheckpointLatch));
+  }
+  return h;
+}
+
+/**
+ * Hash of the records and the firmware configuration fingerprint, used
+ * to skip writing a checkpoint when nothing changed since the last one.
+ */
+uint64_t EngineCheckpoint::getStateHash() const {
+  return dbImageHash(hash(), &_fwFingerprint, sizeof(_fwFingerprint));
+}
+
+/**
+ * Take a copy of the engine state. Must be called with the database mutex
+ * held.
+ */
+void EngineCheckpoint::capture(MpsDbPtr db, BypassManagerPtr bypassManager) {
+  time(&_time);
+  _fwFingerprint = db->getFirmwareFingerprint();
+  _fpgaVersion = Firmware::getInstance().fpgaVersion;
+  _gitHash = Firmware::getInstance().gitHashString;
+  _dbMd5sum = getMd5sum(db);
+
+  _bypasses.clear();
+  BypassRequestList requests;
+  bypassManager->getActiveBypasses(requests);
+  for (BypassRequestList::iterator it = requests.begin(); it != requests.end(); ++it) {
+    EngineCheckpointBypass bypass;
+    bypass.type = it->type;
+    bypass.deviceId = it->deviceId;
+    bypass.index = it->index;
+    bypass.value = it->value;
+    bypass.until = it->until;
+    _bypasses.push_back(bypass);
+  }
+
+  _destinations.clear();
+  for (DbBeamDestinationMap::iterator it = db->beamDestinations->begin();
+       it != db->beamDestinations->end(); ++it) {
+    EngineCheckpointDestination destination;
+    destination.destinationId = it->first;
+    destination.forceBeamClassId = getBeamClassId(it->second->forceBeamClass);
+    destination.softPermitId = getBeamClassId(it->second->softPermit);
+    destination.maxPermitId = getBeamClassId(it->second->maxPermit);
+    _destinations.push_back(destination);
+  }
+
+  _digitalLatches.resize(db->deviceInputs->size());
+  uint32_t i = 0;
+  for (DbDeviceInputMap::iterator it = db->deviceInputs->begin();
+       it != db->deviceInputs->end(); ++it, ++i) {
+    _digitalLatches[i].id = it->first;
+    _digitalLatches[i].latchedValue = it->second->latchedValue;
+  }
+
+  _analogLatches.resize(db->analogDevices->size());
+  i = 0;
+  for (DbAnalogDeviceMap::iterator it = db->analogDevices->begin();
+       it != db->analogDevices->end(); ++it, ++i) {
+    _analogLatches[i].id = it->first;
+    _analogLatches[i].latchedValue = it->second->latchedValue;
+  }
+}
+
+/**
+ * Restore the bypasses still active and the forced, soft and max permits.
+ * The bypasses are set without requesting a firmware configuration reload,
+ * the caller writes (or checks) the configuration afterwards. Entries not
+ * found in the database are ignored.
+ *
+ * Must be called with the database mutex held, returns the number of
+ * bypasses restored.
+ */
+uint32_t EngineCheckpoint::restore(MpsDbPtr db, BypassManagerPtr bypassManager) {
+  time_t now;
+  time(&now);
+
+  BypassRequestList requests;
+  for (std::vector<EngineCheckpointBypass>::iterator it = _bypasses.begin(); it != _bypasses.end(); ++it) {
+    if (static_cast<time_t>(it->until) <= now) {
+      continue;
+    }
+    if ((it->type == BYPASS_DIGITAL && db->deviceInputs->find(it->deviceId) == db->deviceInputs->end()) ||
+        (it->type == BYPASS_ANALOG && db->analogDevices->find(it->deviceId) == db->analogDevices->end())) {
+      continue;
+    }
+    BypassRequest request;
+    request.type = static_cast<BypassType>(it->type);
+    request.deviceId = it->deviceId;
+    request.index = it->index;
+    request.value = it->value;
+    request.until = it->until;
+    requests.push_back(request);
+  }
+  if (!requests.empty()) {
+    bypassManager->setBypasses(db, requests, false, false);
+  }
+
+  for (std::vector<EngineCheckpointDestination>::iterator it = _destinations.begin();
+       it != _destinations.end(); ++it) {
+    DbBeamDestinationMap::iterator destination = db->beamDestinations->find(it->destinationId);
+    if (destination == db->beamDestinations->end()) {
+      continue;
+    }
+    db->forceBeamDestination(it->destinationId, it->forceBeamClassId);
+    db->softPermitDestination(it->destinationId, it->softPermitId);
+
+    DbBeamClassMap::iterator beamClass = db->beamClasses->find(it->maxPermitId);
+    if (beamClass != db->beamClasses->end()) {
+      destination->second->setMaxPermit(beamClass->second);
+    }
+    else {
+      destination->second->resetMaxPermit();
+    }
+  }
+
+  return requests.size();
+}
+
+/**
+ * Restore the latched input values. Called once the bypass state has been
+ * copied to the inputs, so the bypass overrides are applied to the
+ * restored values.
+ */
+void EngineCheckpoint::restoreLatches(MpsDbPtr db) {
+  for (std::vector<EngineCheckpointLatch>::iterator it = _digitalLatches.begin();
+       it != _digitalLatches.end(); ++it) {
+    DbDeviceInputMap::iterator input = db->deviceInputs->find(it->id);
+    if (input != db->deviceInputs->end()) {
+      input->second->latchedValue = it->latchedValue;
+      input->second->applyBypassOverride();
+    }
+  }
+
+  for (std::vector<EngineCheckpointLatch>::iterator it = _analogLatches.begin();
+       it != _analogLatches.end(); ++it) {
+    DbAnalogDeviceMap::iterator device = db->analogDevices->find(it->id);
+    if (device != db->analogDevices->end()) {
+      device->second->latchedValue = it->latchedValue;
+      device->second->applyBypassOverride();
+    }
+  }
+}
+
+/**
+ * Write the checkpoint to a temporary file renamed over 'fileName', so a
+ * restart never sees a partial checkpoint.
+ */
+void EngineCheckpoint::write(std::string fileName) {
+  std::stringstream errorStream;
+
+  EngineCheckpointHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = CHECKPOINT_MAGIC;
+  header.version = CHECKPOINT_VERSION;
+  header.bypassCount = _bypasses.size();
+  header.destinationCount = _destinations.size();
+  header.digitalLatchCount = _digitalLatches.size();
+  header.analogLatchCount = _analogLatches.size();
+  header.size = sizeof(header) +
+    _bypasses.size() * sizeof(EngineCheckpointBypass) +
+    _destinations.size() * sizeof(EngineCheckpointDestination) +
+    (_digitalLatches.size() + _analogLatches.size()) * sizeof(EngineCheckpointLatch);
+  header.hash = hash();
+  header.time = _time;
+  header.fwFingerprint = _fwFingerprint;
+  header.fpgaVersion = _fpgaVersion;
+  strncpy(header.gitHash, _gitHash.c_str(), CHECKPOINT_GIT_HASH_SIZE - 1);
+  strncpy(header.dbMd5sum, _dbMd5sum.c_str(), DB_IMAGE_MD5SUM_SIZE - 1);
+
+  std::stringstream tmpName;
+  tmpName << fileName << ".tmp." << getpid();
+  std::ofstream out(tmpName.str().c_str(), std::ios::binary | std::ios::trunc);
+  if (!out) {
+    errorStream << "ERROR: Failed to create engine checkpoint " << tmpName.str()
+                << " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (!_bypasses.empty()) {
+    out.write(reinterpret_cast<const char *>(&_bypasses[0]),
+              _bypasses.size() * sizeof(EngineCheckpointBypass));
+  }
+  if (!_destinations.empty()) {
+    out.write(reinterpret_cast<const char *>(&_destinations[0]),
+              _destinations.size() * sizeof(EngineCheckpointDestination));
+  }
+  if (!_digitalLatches.empty()) {
+    out.write(reinterpret_cast<const char *>(&_digitalLatches[0]),
+              _digitalLatches.size() * sizeof(EngineCheckpointLatch));
+  }
+  if (!_analogLatches.empty()) {
+    out.write(reinterpret_cast<const char *>(&_analogLatches[0]),
+              _analogLatches.size() * sizeof(EngineCheckpointLatch));
+  }
+  out.close();
+
+  if (!out || rename(tmpName.str().c_str(), fileName.c_str()) != 0) {
+    unlink(tmpName.str().c_str());
+    errorStream << "ERROR: Failed to write engine checkpoint " << fileName;
+    throw(CentralNodeException(errorStream.str()));
+  }
+}
+
+template<class T>
+static void readRecords(const std::vector<char> &data, size_t &offset, uint32_t count, std::vector<T> &records) {
+  records.resize(count);
+  if (count > 0) {
+    memcpy(&records[0], &data[offset], count * sizeof(T));
+  }
+  offset += count * sizeof(T);
+}
+
+/**
+ * Read a checkpoint written by write(), throws an exception if the file
+ * can't be read or is not a valid checkpoint.
+ */
+void EngineCheckpoint::read(std::string fileName) {
+  std::stringstream errorStream;
+
+  std::ifstream in(fileName.c_str(), std::ios::binary);
+  if (!in) {
+    errorStream << "ERROR: Failed to open engine checkpoint " << fileName
+                << " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  std::string error;
+  EngineCheckpointHeader header;
+  if (data.size() < sizeof(EngineCheckpointHeader)) {
+    error = "too short";
+  }
+  else {
+    memcpy(&header, &data[0], sizeof(header));
+    header.gitHash[CHECKPOINT_GIT_HASH_SIZE - 1] = '\0';
+    header.dbMd5sum[DB_IMAGE_MD5SUM_SIZE - 1] = '\0';
+    if (header.magic != CHECKPOINT_MAGIC) {
+      error = "not an engine checkpoint";
+    }
+    else if (header.version != CHECKPOINT_VERSION) {
+      error = "unsupported version";
+    }
+    else if (header.size != data.size() ||
+             header.size != sizeof(header) +
+             static_cast<uint64_t>(header.bypassCount) * sizeof(EngineCheckpointBypass) +
+             static_cast<uint64_t>(header.destinationCount) * sizeof(EngineCheckpointDestination) +
+             (static_cast<uint64_t>(header.digitalLatchCount) + header.analogLatchCount) *
+             sizeof(EngineCheckpointLatch)) {
+      error = "invalid layout";
+    }
+    else if (dbImageHash(DB_IMAGE_HASH_INIT, &data[sizeof(header)], header.size - sizeof(header)) != header.hash) {
+      error = "checksum mismatch";
+    }
+  }
+
+  if (!error.empty()) {
+    errorStream << "ERROR: Invalid engine checkpoint " << fileName << " (" << error << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  size_t offset = sizeof(header);
+  readRecords(data, offset, header.bypassCount, _bypasses);
+  readRecords(data, offset, header.destinationCount, _destinations);
+  readRecords(data, offset, header.digitalLatchCount, _digitalLatches);
+  readRecords(data, offset, header.analogLatchCount, _analogLatches);
+
+  _time = header.time;
+  _fwFingerprint = header.fwFingerprint;
+  _fpgaVersion = header.fpgaVersion;
+  _gitHash = header.gitHash;
+  _dbMd5sum = header.dbMd5sum;
+}
+
+void EngineCheckpoint::show(std::ostream &os) const {
+  char timeString[64];
+  time_t t = _time;
+  strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M:%S", localtime(&t));
+
+  os << "Engine checkpoint taken " << timeString << std::endl
+     << "  Database md5sum: " << _dbMd5sum << std::endl
+     << "  Firmware: version " << _fpgaVersion << ", git hash " << _gitHash
+     << ", configuration fingerprint 0x" << std::hex << _fwFingerprint << std::dec << std::endl
+     << "  " << _bypasses.size() << " active bypasses, " << _destinations.size() << " destinations, "
+     << _digitalLatches.size() + _analogLatches.size() << " latched input values" << std::endl;
+}
@@ -0,0 +1,111 @@
+#ifndef CENTRAL_NODE_CHECKPOINT_H
+#define CENTRAL_NODE_CHECKPOINT_H
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <central_node_database_image.h>
+#include <central_node_database_tables.h>
+#include <central_node_database.h>
+#include <central_node_bypass_manager.h>
+
+/**
+ * Engine state checkpoint
+ *
+ * Durable engine state, written periodically by the engine (see
+ * Engine::setCheckpointFile()) and restored by Engine::loadConfig() when
+ * the IOC restarts:
+ *
+ *   EngineCheckpointHeader                           (offset 0)
+ *   'bypassCount' x EngineCheckpointBypass           (active bypasses)
+ *   'destinationCount' x EngineCheckpointDestination (forced/soft/max permits)
+ *   'digitalLatchCount' x EngineCheckpointLatch      (DeviceInput latched values)
+ *   'analogLatchCount' x EngineCheckpointLatch       (AnalogDevice latched values)
+ *
+ * The header also records the database (DatabaseInfo md5sum), the firmware
+ * build and the fingerprint of the firmware configuration last written
+ * (see MpsDb::getFirmwareFingerprint()). If the restored state produces the
+ * same configuration and the firmware kept running, the restart does not
+ * disable the MPS nor rewrite the application configurations.
+ */
+const uint64_t CHECKPOINT_MAGIC = 0x544E504B4353504DULL; // "MPSCKPNT"
+const uint32_t CHECKPOINT_VERSION = 1;
+const uint32_t CHECKPOINT_GIT_HASH_SIZE = 24;
+
+/**
+ * Seconds between two checks for state changes by the checkpoint thread
+ */
+const uint32_t CHECKPOINT_PERIOD = 1;
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t size;              // Total size of the checkpoint
+  uint64_t hash;              // FNV-1a hash of the checkpoint after the header
+  uint64_t time;              // Time the checkpoint was taken (time_t)
+  uint64_t fwFingerprint;     // Firmware configuration fingerprint
+  uint64_t fpgaVersion;
+  char gitHash[CHECKPOINT_GIT_HASH_SIZE];
+  char dbMd5sum[DB_IMAGE_MD5SUM_SIZE];
+  uint32_t bypassCount;
+  uint32_t destinationCount;
+  uint32_t digitalLatchCount;
+  uint32_t analogLatchCount;
+} EngineCheckpointHeader;
+
+typedef struct {
+  uint32_t type;              // BypassType
+  uint32_t deviceId;
+  uint32_t index;             // Integrator index, analog bypasses only
+  uint32_t value;
+  uint64_t until;
+} EngineCheckpointBypass;
+
+typedef struct {
+  uint32_t destinationId;
+  uint32_t forceBeamClassId;  // Beam class ids, CLEAR_BEAM_CLASS if not set
+  uint32_t softPermitId;
+  uint32_t maxPermitId;
+} EngineCheckpointDestination;
+
+typedef struct {
+  uint32_t id;
+  uint32_t latchedValue;
+} EngineCheckpointLatch;
+
+class EngineCheckpoint {
+ private:
+  time_t _time;
+  uint64_t _fwFingerprint;
+  uint64_t _fpgaVersion;
+  std::string _gitHash;
+  std::string _dbMd5sum;
+  std::vector<EngineCheckpointBypass> _bypasses;
+  std::vector<EngineCheckpointDestination> _destinations;
+  std::vector<EngineCheckpointLatch> _digitalLatches;
+  std::vector<EngineCheckpointLatch> _analogLatches;
+
+  uint64_t hash() const;
+
+ public:
+  EngineCheckpoint();
+
+  void capture(MpsDbPtr db, BypassManagerPtr bypassManager);
+  uint32_t restore(MpsDbPtr db, BypassManagerPtr bypassManager);
+  void restoreLatches(MpsDbPtr db);
+
+  void write(std::string fileName);
+  void read(std::string fileName);
+  void show(std::ostream &os) const;
+
+  uint64_t getStateHash() const;
+  time_t getTime() const { return _time; }
+  uint64_t getFirmwareFingerprint() const { return _fwFingerprint; }
+  uint64_t getFpgaVersion() const { return _fpgaVersion; }
+  const std::string &getGitHash() const { return _gitHash; }
+  const std::string &getDbMd5sum() const { return _dbMd5sum; }
+};
+
+#endif
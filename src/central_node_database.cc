@@ -1,6 +1,5 @@
 #include <yaml-cpp/yaml.h>
 #include <yaml-cpp/node/parse.h>
-#include <yaml-cpp/node/emit.h>
 #include <yaml-cpp/exceptions.h>
 
 #include <central_node_database_defs.h>
@@ -9,10 +8,21 @@
 #include <central_node_database.h>
 #include <central_node_firmware.h>
 #include <central_node_engine.h>
+#include <central_node_history.h>
+#include <central_node_postmortem.h>
+#include <central_node_archive.h>
+#include <central_node_frame_tap.h>
+#include <central_node_metrics.h>
+#include <central_node_database_image.h>
+#include <central_node_database_delta.h>
+#include <central_node_database_index.h>
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <atomic>
 #include <sys/mman.h>
 
 #include <stdio.h>
@@ -23,13 +33,13 @@
   static Logger *databaseLogger;
 #endif
 
-extern TimeAverage DeviceInputUpdateTime;
-extern TimeAverage AnalogDeviceUpdateTime;
-extern TimeAverage AppCardDigitalUpdateTime;
-extern TimeAverage AppCardAnalogUpdateTime;
+extern CycleStat DeviceInputUpdateTime;
+extern CycleStat AnalogDeviceUpdateTime;
 
 std::mutex MpsDb::_mutex;
 bool MpsDb::_initialized = false;
+std::string MpsDb::_imageCacheDir = "";
+uint32_t MpsDb::_yamlLoadThreads = 0;
 
 MpsDb::MpsDb(uint32_t inputUpdateTimeout)
 :
@@ -60,15 +70,27 @@ MpsDb::MpsDb(uint32_t inputUpdateTimeout)
     _pcChangeDebug(false),
     _reloadInactive(false),
     _pcFlagsCounters(Firmware::PcChangePacketFlagsLabels.size(), 0),
-    mitigationTxTime( "Mitigation Transmission time", 360 )
+    mitigationTxTime( "Mitigation Transmission time", 360 ),
+    _fwConfigGeneration(0),
+    _fwFingerprint(0),
+    _loadedFromImage(false),
+    _loadTime(0),
+    _configureTime(0),
+    _yamlLoadThreadsUsed(0),
+    _arena(new DbArena())
 {
 #if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
   databaseLogger = Loggers::getLogger("DATABASE");
 #endif
 
+  fwUpdateTimer.setBudget(1.5 * EVALUATION_CYCLE_PERIOD);
+
   if (!_initialized) {
     _initialized = true;
 
+    // Allocate the post-mortem ring before firmware updates arrive
+    PostMortem::getInstance();
+
     // Initialize the Power class ttansition counters
     for (std::size_t i {0}; i < NUM_DESTINATIONS; ++i)
       for (std::size_t j {0}; j < (1<<POWER_CLASS_BIT_SIZE); ++j)
@@ -113,6 +135,7 @@ void MpsDb::unlatchAll() {
     for (DbAnalogDeviceMap::iterator it = analogDevices->begin();
          it != analogDevices->end(); ++it) {
       (*it).second->latchedValue = (*it).second->value; // Update value for all threshold bits
+      (*it).second->applyBypassOverride();
     }
 
     for (DbDeviceInputMap::iterator it = deviceInputs->begin();
@@ -143,7 +166,7 @@ void MpsDb::updateInputs()
 
         {
             std::lock_guard<std::mutex> lock(fwUpdateBufferMutex);
-            fwUpdateBuffer = std::move(buffer);
+            fwUpdateBuffer.swap(buffer);
         }
 
         {
@@ -159,11 +182,24 @@ void MpsDb::updateInputs()
             }
         }
 
+        // 'buffer' now holds the previous frame, and the engine is done
+        // with it - archive it and keep it (and its mitigation) in the
+        // post-mortem ring
+        if (_updateCounter > 0)
+        {
+            FrameArchiver::getInstance().push(buffer, _updateCounter - 1, _fastUpdateTimeStamp);
+            PostMortem::getInstance().record(buffer, softwareMitigationBuffer,
+                _updateCounter - 1, _fastUpdateTimeStamp);
+        }
+
         uint64_t t;
         memcpy(&t, &fwUpdateBuffer.at(8), sizeof(t));
         uint64_t diff = t - _fastUpdateTimeStamp;
         _fastUpdateTimeStamp = t;
 
+        // Stamp the history events logged while this update is processed
+        History::getInstance().setTimeStamp(t, _updateCounter);
+
         if (diff > _maxDiff)
             _maxDiff = diff;
 
@@ -179,8 +215,11 @@ void MpsDb::updateInputs()
         {
             DeviceInputUpdateTime.clear();
             AnalogDeviceUpdateTime.clear();
-            AppCardDigitalUpdateTime.clear();
-            AppCardAnalogUpdateTime.clear();
+            _appCardDigitalUpdateTime.clear();
+            _appCardAnalogUpdateTime.clear();
+            for (DbApplicationCardMap::iterator it = applicationCards->begin();
+                it != applicationCards->end(); ++it)
+                (*it).second->updateTime.clear();
             _clearUpdateTime = false;
             _inputUpdateTime.clear();
             fwUpdateTimer.clear();
@@ -193,28 +232,58 @@ void MpsDb::updateInputs()
         // If an application card has been set inactive, its logic
         // will also be set to ignored, so the FW
         // configuration will need to be reloaded
+        // One time stamp per card gives the per-card and per-type costs
         DbApplicationCardMap::iterator applicationCardIt;
+        uint64_t cardStart = CycleCounter::now();
         for (applicationCardIt = applicationCards->begin();
             applicationCardIt != applicationCards->end();
             ++applicationCardIt)
         {
-            if ((*applicationCardIt).second->updateInputs()){
+            DbApplicationCardPtr card = (*applicationCardIt).second;
+            if (card->updateInputs()){
                 _reloadInactive = true;
             }
+
+            uint64_t cardEnd = CycleCounter::now();
+            card->updateTime.add(cardEnd - cardStart);
+            if (card->isDigital())
+                _appCardDigitalUpdateTime.add(cardEnd - cardStart);
+            else
+                _appCardAnalogUpdateTime.add(cardEnd - cardStart);
+            cardStart = cardEnd;
         }
 
+        History::getInstance().flushChatter();
+
         _updateCounter++;
         _inputUpdateTime.tick();
 
+        {
+            Metrics &metrics = Metrics::getInstance();
+            metrics.set(MetricInputUpdates, _updateCounter);
+            metrics.setTime(MetricInputUpdateTime, _inputUpdateTime.getLastPeriod());
+            metrics.setTime(MetricInputUpdateTimeMax, _inputUpdateTime.getAllMaxPeriod());
+            metrics.set(MetricInputFwTimeStamp, _fastUpdateTimeStamp);
+            metrics.set(MetricInputFwPeriod, _diff);
+            metrics.set(MetricInputFwPeriodMax, _maxDiff);
+            metrics.set(MetricInputLateUpdates, _diffCount);
+            metrics.set(MetricInputUpdateQueueMax, fwUpdateQueue.get_max_size());
+            metrics.set(MetricInputMitigationQueueMax, softwareMitigationQueue.get_max_size());
+        }
+
         {
             std::lock_guard<std::mutex> lock(inputsUpdatedMutex);
             inputsUpdated = true;
         }
         inputsUpdatedCondVar.notify_one();
+
+        // Publish the frame to local tools while the engine evaluates it
+        if (FrameTap::getInstance().isOpen())
+            FrameTap::getInstance().write(fwUpdateBuffer, _updateCounter - 1, _fastUpdateTimeStamp);
     }
 }
 
-void MpsDb::configureAllowedClasses()
+void MpsDb::configureAllowedClasses(const DbIndexes &index)
 {
     LOG_TRACE("DATABASE", "Configure: AllowedClasses");
     std::stringstream errorStream;
@@ -236,24 +305,24 @@ void MpsDb::configureAllowedClasses()
         ++it)
     {
         int id = (*it).second->beamClassId;
-        DbBeamClassMap::iterator beamIt = beamClasses->find(id);
-        if (beamIt == beamClasses->end())
+        DbBeamClassPtr *beamClass = index.beamClasses.find(id);
+        if (!beamClass)
         {
             errorStream <<  "ERROR: Failed to configure database, invalid ID found for BeamClass ("
                 << id << ") for AllowedClass (" << (*it).second->id << ")";
             throw(DbException(errorStream.str()));
         }
-        (*it).second->beamClass = (*beamIt).second;
+        (*it).second->beamClass = *beamClass;
 
         id = (*it).second->beamDestinationId;
-        DbBeamDestinationMap::iterator beamDestIt = beamDestinations->find(id);
-        if (beamDestIt == beamDestinations->end())
+        DbBeamDestinationPtr *beamDestination = index.beamDestinations.find(id);
+        if (!beamDestination)
         {
             errorStream << "ERROR: Failed to configure database, invalid ID found for BeamDestinations ("
                 << id << ") for AllowedClass (" << (*it).second->id << ")";
             throw(DbException(errorStream.str()));
         }
-        (*it).second->beamDestination = (*beamDestIt).second;
+        (*it).second->beamDestination = *beamDestination;
     }
 
     // Assign AllowedClasses to FaultState or ThresholdFaultState
@@ -264,22 +333,23 @@ void MpsDb::configureAllowedClasses()
     {
         int id = (*it).second->faultStateId;
 
-        DbFaultStateMap::iterator digFaultIt = faultStates->find(id);
-        if (digFaultIt != faultStates->end())
+        DbFaultStatePtr *digFault = index.faultStates.find(id);
+        if (digFault)
         {
             // Create a map to hold deviceInput for the digitalDevice
-            if (!(*digFaultIt).second->allowedClasses)
+            if (!(*digFault)->allowedClasses)
             {
                 DbAllowedClassMap *faultAllowedClasses = new DbAllowedClassMap();
-                (*digFaultIt).second->allowedClasses = DbAllowedClassMapPtr(faultAllowedClasses);
+                (*digFault)->allowedClasses = DbAllowedClassMapPtr(faultAllowedClasses);
             }
-            (*digFaultIt).second->allowedClasses->insert(std::pair<int, DbAllowedClassPtr>((*it).second->id,
-                (*it).second));
+            // Entries come in id order, insert them at the end of the map
+            (*digFault)->allowedClasses->insert((*digFault)->allowedClasses->end(),
+                std::pair<int, DbAllowedClassPtr>((*it).second->id, (*it).second));
         }
     }
 }
 
-void MpsDb::configureDeviceTypes()
+void MpsDb::configureDeviceTypes(const DbIndexes &index)
 {
     // Compile a list of DeviceStates and assign to the proper DeviceType
     for (DbDeviceStateMap::iterator it = deviceStates->begin();
@@ -288,22 +358,22 @@ void MpsDb::configureDeviceTypes()
     {
         int id = (*it).second->deviceTypeId;
 
-        DbDeviceTypeMap::iterator deviceType = deviceTypes->find(id);
-        if (deviceType != deviceTypes->end())
+        DbDeviceTypePtr *deviceType = index.deviceTypes.find(id);
+        if (deviceType)
         {
             // Create a map to hold deviceStates for the deviceType
-            if (!(*deviceType).second->deviceStates)
+            if (!(*deviceType)->deviceStates)
             {
                 DbDeviceStateMap *deviceStates = new DbDeviceStateMap();
-                (*deviceType).second->deviceStates = DbDeviceStateMapPtr(deviceStates);
+                (*deviceType)->deviceStates = DbDeviceStateMapPtr(deviceStates);
             }
-            (*deviceType).second->deviceStates->insert(std::pair<int, DbDeviceStatePtr>((*it).second->id,
+            (*deviceType)->deviceStates->insert(std::pair<int, DbDeviceStatePtr>((*it).second->id,
                 (*it).second));
         }
     }
 }
 
-void MpsDb::configureDeviceInputs()
+void MpsDb::configureDeviceInputs(const DbIndexes &index)
 {
     LOG_TRACE("DATABASE", "Configure: DeviceInputs");
     std::stringstream errorStream;
@@ -315,51 +385,53 @@ void MpsDb::configureDeviceInputs()
     {
         int id = (*it).second->digitalDeviceId;
 
-        DbDigitalDeviceMap::iterator deviceIt = digitalDevices->find(id);
-        if (deviceIt == digitalDevices->end())
+        DbDigitalDevicePtr *device = index.digitalDevices.find(id);
+        if (!device)
         {
             std::cout << "ERROR: Failed to configure database, invalid ID found for DigitalDevice ("
                 << id << ") for DeviceInput (" << (*it).second->id << ")" << std::endl;
             //throw(DbException(errorStream.str()));
+            continue;
         }
 
         // Check if digitalDevice is evaluated in firmaware, set deviceInput->fastEvaluation
-        if ((*deviceIt).second->evaluation == FAST_EVALUATION)
+        if ((*device)->evaluation == FAST_EVALUATION)
             (*it).second->fastEvaluation = true;
         else
             (*it).second->fastEvaluation = false;
 
         // Create a map to hold deviceInput for the digitalDevice
-        if (!(*deviceIt).second->inputDevices)
+        if (!(*device)->inputDevices)
         {
             DbDeviceInputMap *deviceInputs = new DbDeviceInputMap();
-            (*deviceIt).second->inputDevices = DbDeviceInputMapPtr(deviceInputs);
+            (*device)->inputDevices = DbDeviceInputMapPtr(deviceInputs);
         }
         else
         {
             // Extra check to make sure the digitalDevice has only one input, if
             // it has evaluation set to FAST
-            if ((*deviceIt).second->evaluation == FAST_EVALUATION)
+            if ((*device)->evaluation == FAST_EVALUATION)
             {
                 std::cout << "ERROR: Failed to configure database, found DigitalDevice ("
                     << id << ") set for FAST_EVALUATION with multiple inputs. Must have single input." << std::endl;
                 //throw(DbException(errorStream.str()));
             }
         }
-        (*deviceIt).second->inputDevices->insert(std::pair<int, DbDeviceInputPtr>((*it).second->id,
-            (*it).second));
+        (*device)->inputDevices->insert((*device)->inputDevices->end(),
+            std::pair<int, DbDeviceInputPtr>((*it).second->id, (*it).second));
         LOG_TRACE("DATABASE", "Adding DeviceInput (" << (*it).second->id << ") to "
-            " DigitalDevice (" << (*deviceIt).second->id << ")");
+            " DigitalDevice (" << (*device)->id << ")");
 
         int channelId = (*it).second->channelId;
-        DbChannelMap::iterator channelIt = digitalChannels->find(channelId);
-        if (channelIt == digitalChannels->end())
+        DbChannelPtr *channel = index.digitalChannels.find(channelId);
+        if (!channel)
         {
             std::cout << "ERROR: Failed to configure database, invalid ID found for Channel ("
                 << channelId << ") for DeviceInput (" << (*it).second->id << ")" << std::endl;
             //throw(DbException(errorStream.str()));
+            continue;
         }
-        (*it).second->channel = (*channelIt).second;
+        (*it).second->channel = *channel;
     }
 
     // Set the DbDeviceType for all DbDigitaDevices
@@ -369,10 +441,10 @@ void MpsDb::configureDeviceInputs()
     {
         int typeId = (*it).second->deviceTypeId;
 
-        DbDeviceTypeMap::iterator deviceType = deviceTypes->find(typeId);
-        if (deviceType != deviceTypes->end())
+        DbDeviceTypePtr *deviceType = index.deviceTypes.find(typeId);
+        if (deviceType)
         {
-            (*it).second->deviceType = (*deviceType).second;
+            (*it).second->deviceType = *deviceType;
         }
         else
         {
@@ -383,7 +455,167 @@ void MpsDb::configureDeviceInputs()
     }
 }
 
-void MpsDb::configureFaultInputs()
+/**
+ * Add the allowed classes of one fault of a fast analog device to the
+ * device firmware configuration (destination mask per integrator and power
+ * class per threshold). The configuration of a device is the combination
+ * of all its faults, it must be reset before the first one is added.
+ */
+void MpsDb::configureFastAnalogInput(DbFaultInputPtr input, DbAnalogDevicePtr device, DbFaultPtr fault)
+{
+    std::stringstream errorStream;
+
+    if (!fault->faultStates)
+    {
+        errorStream << "ERROR: No FaultStates found for Fault (" << fault->id
+            << ") for FaultInput (" << input->id << ")";
+        throw(DbException(errorStream.str()));
+    }
+
+    // There is one DbFaultState per threshold bit, for BPMs there are
+    // 24 bits (8 for X, 8 for Y and 8 for TMIT). Other analog devices
+    // have up to 32 bits (4 integrators) - there is one destination mask
+    // per integrator
+
+    // There is a unique power class for each threshold bit (each DbFaultState)
+    // The destination masks for the thresholds for the same integrator
+    // must be and'ed together.
+
+    // Go through the DbFaultStates for this DbFault, i.e. the individual threshold bits
+    for (DbFaultStateMap::iterator faultState = fault->faultStates->begin();
+        faultState != fault->faultStates->end();
+        ++faultState)
+    {
+        // The DbDeviceState value defines which integrator the fault belongs to.
+        // Bits 0 through 7 are for the first integrator, 8 through 15 for the second,
+        // and so on.
+        uint32_t value = (*faultState).second->deviceState->value;
+        int integratorIndex = 4;
+
+        if (value & 0x000000FF) integratorIndex = 0;
+        if (value & 0x0000FF00) integratorIndex = 1;
+        if (value & 0x00FF0000) integratorIndex = 2;
+        if (value & 0xFF000000) integratorIndex = 3;
+
+        if (integratorIndex >= 4)
+        {
+            errorStream << "ERROR: Invalid deviceState value Fault (" << fault->id
+                << "), FaultInput (" << input->id << "), DeviceState ("
+                << (*faultState).second->deviceState->id << "), value=0x"
+                << std::hex << (*faultState).second->deviceState->value << std::dec;
+            throw(DbException(errorStream.str()));
+        }
+
+        uint32_t thresholdIndex = 0;
+        bool isSet = false;
+        while (!isSet)
+        {
+            if (value & 0x01)
+            {
+                isSet = true;
+            }
+            else
+            {
+                thresholdIndex++;
+                value >>= 1;
+            }
+
+            if (thresholdIndex >= sizeof(uint32_t) * 8)
+            {
+                errorStream << "ERROR: Invalid threshold bit for Fault (" << fault->id
+                    << "), FaultInput (" << input->id << "), DeviceState ("
+                    << (*faultState).second->deviceState->id << ")";
+                throw(DbException(errorStream.str()));
+            }
+        }
+
+        // Find the power classes for analog thresholds based on the AllowedClasses.
+        // Note: even though the database allows for different power classes for
+        // different destinations for the same fault, the firmware only has a single
+        // power class to apply for a 16-bit destination mask. For example:
+        // IM01B Charge Fault has one AllowedClass per destination, where
+        //   Shutter = power class 1 (destination 1)
+        //   AOM = power class 0 (destination 2)
+        // The power class for the destination mask 0x03 is power class 0 (the lowest)
+        for (DbAllowedClassMap::iterator allowedClass = (*faultState).second->allowedClasses->begin();
+            allowedClass != (*faultState).second->allowedClasses->end();
+            ++allowedClass)
+        {
+            device->fastDestinationMask[integratorIndex] |=
+                (*allowedClass).second->beamDestination->destinationMask;
+            LOG_TRACE("DATABASE", "PowerClass: integrator=" << integratorIndex
+                << " threshold index=" << thresholdIndex
+                << " current power=" << device->fastPowerClass[thresholdIndex]
+                << " power=" << (*allowedClass).second->beamClass->number
+                << " allowedClassId=" << (*allowedClass).second->id
+                << " destinationMask=0x" << std::hex << (*allowedClass).second->beamDestination->destinationMask << std::dec );
+
+            if (device->fastPowerClassInit[thresholdIndex] == 1)
+            {
+                device->fastPowerClass[thresholdIndex] =
+                (*allowedClass).second->beamClass->number;
+                device->fastPowerClassInit[thresholdIndex] = 0;
+            }
+            else
+            {
+                if ((*allowedClass).second->beamClass->number <
+                    device->fastPowerClass[thresholdIndex])
+                {
+                    device->fastPowerClass[thresholdIndex] =
+                    (*allowedClass).second->beamClass->number;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Set the firmware configuration (destination mask, power class and
+ * expected state) of a fast digital device from the allowed classes of
+ * its fault.
+ */
+void MpsDb::configureFastDigitalInput(DbFaultInputPtr input, DbDigitalDevicePtr device, DbFaultPtr fault)
+{
+    std::stringstream errorStream;
+
+    if (!fault->faultStates)
+    {
+        errorStream << "ERROR: No FaultStates found for Fault (" << fault->id
+            << ") for FaultInput (" << input->id << ")";
+        throw(DbException(errorStream.str()));
+    }
+    device->fastDestinationMask = 0;
+    device->fastPowerClass = 100;
+    device->fastExpectedState = 0;
+
+    if (fault->faultStates->size() != 1)
+    {
+        errorStream << "ERROR: DigitalDevice configured with FAST evaluation must have one fault state only."
+            << " Found " << fault->faultStates->size() << " fault states for "
+            << "device " << device->name;
+        throw(DbException(errorStream.str()));
+    }
+    DbFaultStateMap::iterator faultState = fault->faultStates->begin();
+
+    // Set the expected state as the oposite of the expected faulted value
+    // For example a faulted fast valve sets the digital input to high (0V, digital 0),
+    // the expected normal state is 1.
+    if (!(*faultState).second->deviceState->value)
+      device->fastExpectedState = 1;
+
+    //    DbAllowedClassMap::iterator allowedClass = (*faultState).second->allowedClasses->begin();
+    for (DbAllowedClassMap::iterator allowedClass = (*faultState).second->allowedClasses->begin();
+        allowedClass != (*faultState).second->allowedClasses->end();
+        ++allowedClass)
+    {
+        device->fastDestinationMask |= (*allowedClass).second->beamDestination->destinationMask;
+        if ((*allowedClass).second->beamClass->number < device->fastPowerClass)
+            device->fastPowerClass = (*allowedClass).second->beamClass->number;
+
+    }
+}
+
+void MpsDb::configureFaultInputs(const DbIndexes &index)
 {
     LOG_TRACE("DATABASE", "Configure: FaultInputs");
     std::stringstream errorStream;
@@ -396,11 +628,11 @@ void MpsDb::configureFaultInputs()
         int id = (*it).second->deviceId;
 
         // Find the DbDigitalDevice or DbAnalogDevice referenced by the FaultInput
-        DbDigitalDeviceMap::iterator deviceIt = digitalDevices->find(id);
-        if (deviceIt == digitalDevices->end())
+        DbDigitalDevicePtr *device = index.digitalDevices.find(id);
+        if (!device)
         {
-            DbAnalogDeviceMap::iterator aDeviceIt = analogDevices->find(id);
-            if (aDeviceIt == analogDevices->end())
+            DbAnalogDevicePtr *aDevice = index.analogDevices.find(id);
+            if (!aDevice)
             {
                 errorStream << "ERROR: Failed to find DigitalDevice/AnalogDevice (" << id
                     << ") for FaultInput (" << (*it).second->id << ")";
@@ -409,179 +641,38 @@ void MpsDb::configureFaultInputs()
             // Found the DbAnalogDevice, configure it
             else
             {
-                (*it).second->analogDevice = (*aDeviceIt).second;
+                (*it).second->analogDevice = *aDevice;
 
-                if ((*aDeviceIt).second->evaluation == FAST_EVALUATION)
+                if ((*aDevice)->evaluation == FAST_EVALUATION)
                 {
-                    LOG_TRACE("DATABASE", "AnalogDevice " << (*aDeviceIt).second->name
+                    LOG_TRACE("DATABASE", "AnalogDevice " << (*aDevice)->name
                         << ": Fast Evaluation");
-                    DbFaultMap::iterator faultIt = faults->find((*it).second->faultId);
-                    if (faultIt == faults->end())
+                    DbFaultPtr *fault = index.faults.find((*it).second->faultId);
+                    if (!fault)
                     {
                         errorStream << "ERROR: Failed to find Fault (" << id
                             << ") for FaultInput (" << (*it).second->id << ")";
                         throw(DbException(errorStream.str()));
                     }
-                    else
-                    {
-                        if (!(*faultIt).second->faultStates)
-                        {
-                            errorStream << "ERROR: No FaultStates found for Fault (" << (*faultIt).second->id
-                                << ") for FaultInput (" << (*it).second->id << ")";
-                            throw(DbException(errorStream.str()));
-                        }
-
-                        // There is one DbFaultState per threshold bit, for BPMs there are
-                        // 24 bits (8 for X, 8 for Y and 8 for TMIT). Other analog devices
-                        // have up to 32 bits (4 integrators) - there is one destination mask
-                        // per integrator
-
-                        // There is a unique power class for each threshold bit (each DbFaultState)
-                        // The destination masks for the thresholds for the same integrator
-                        // must be and'ed together.
-
-                        // Go through the DbFaultStates for this DbFault, i.e. the individual threshold bits
-                        for (DbFaultStateMap::iterator faultState = (*faultIt).second->faultStates->begin();
-                            faultState != (*faultIt).second->faultStates->end();
-                            ++faultState)
-                        {
-                            // The DbDeviceState value defines which integrator the fault belongs to.
-                            // Bits 0 through 7 are for the first integrator, 8 through 15 for the second,
-                            // and so on.
-                            uint32_t value = (*faultState).second->deviceState->value;
-                            int integratorIndex = 4;
-
-                            if (value & 0x000000FF) integratorIndex = 0;
-                            if (value & 0x0000FF00) integratorIndex = 1;
-                            if (value & 0x00FF0000) integratorIndex = 2;
-                            if (value & 0xFF000000) integratorIndex = 3;
-
-                            if (integratorIndex >= 4)
-                            {
-                                errorStream << "ERROR: Invalid deviceState value Fault (" << (*faultIt).second->id
-                                    << "), FaultInput (" << (*it).second->id << "), DeviceState ("
-                                    << (*faultState).second->deviceState->id << "), value=0x"
-                                    << std::hex << (*faultState).second->deviceState->value << std::dec;
-                                throw(DbException(errorStream.str()));
-                            }
-
-                            uint32_t thresholdIndex = 0;
-                            bool isSet = false;
-                            while (!isSet)
-                            {
-                                if (value & 0x01)
-                                {
-                                    isSet = true;
-                                }
-                                else
-                                {
-                                    thresholdIndex++;
-                                    value >>= 1;
-                                }
-
-                                if (thresholdIndex >= sizeof(uint32_t) * 8)
-                                {
-                                    errorStream << "ERROR: Invalid threshold bit for Fault (" << (*faultIt).second->id
-                                        << "), FaultInput (" << (*it).second->id << "), DeviceState ("
-                                        << (*faultState).second->deviceState->id << ")";
-                                    throw(DbException(errorStream.str()));
-                                }
-                            }
-
-                            // Find the power classes for analog thresholds based on the AllowedClasses.
-                            // Note: even though the database allows for different power classes for
-                            // different destinations for the same fault, the firmware only has a single
-                            // power class to apply for a 16-bit destination mask. For example:
-                            // IM01B Charge Fault has one AllowedClass per destination, where
-                            //   Shutter = power class 1 (destination 1)
-                            //   AOM = power class 0 (destination 2)
-                            // The power class for the destination mask 0x03 is power class 0 (the lowest)
-                            for (DbAllowedClassMap::iterator allowedClass = (*faultState).second->allowedClasses->begin();
-                                allowedClass != (*faultState).second->allowedClasses->end();
-                                ++allowedClass)
-                            {
-                                (*aDeviceIt).second->fastDestinationMask[integratorIndex] |=
-                                    (*allowedClass).second->beamDestination->destinationMask;
-                                LOG_TRACE("DATABASE", "PowerClass: integrator=" << integratorIndex
-                                    << " threshold index=" << thresholdIndex
-                                    << " current power=" << (*aDeviceIt).second->fastPowerClass[thresholdIndex]
-                                    << " power=" << (*allowedClass).second->beamClass->number
-                                    << " allowedClassId=" << (*allowedClass).second->id
-                                    << " destinationMask=0x" << std::hex << (*allowedClass).second->beamDestination->destinationMask << std::dec );
-
-                                if ((*aDeviceIt).second->fastPowerClassInit[thresholdIndex] == 1)
-                                {
-                                    (*aDeviceIt).second->fastPowerClass[thresholdIndex] =
-                                    (*allowedClass).second->beamClass->number;
-                                    (*aDeviceIt).second->fastPowerClassInit[thresholdIndex] = 0;
-                                }
-                                else
-                                {
-                                    if ((*allowedClass).second->beamClass->number <
-                                        (*aDeviceIt).second->fastPowerClass[thresholdIndex])
-                                    {
-                                        (*aDeviceIt).second->fastPowerClass[thresholdIndex] =
-                                        (*allowedClass).second->beamClass->number;
-                                    }
-                                }
-                            }
-                        }
-                    }
+                    configureFastAnalogInput((*it).second, *aDevice, *fault);
                 }
             }
         }
         else
         {
-            (*it).second->digitalDevice = (*deviceIt).second;
+            (*it).second->digitalDevice = *device;
             // If the DbDigitalDevice is set for fast evaluation, save a pointer to the
             // DbFaultInput
-            if ((*deviceIt).second->evaluation == FAST_EVALUATION)
+            if ((*device)->evaluation == FAST_EVALUATION)
             {
-                DbFaultMap::iterator faultIt = faults->find((*it).second->faultId);
-                if (faultIt == faults->end())
+                DbFaultPtr *fault = index.faults.find((*it).second->faultId);
+                if (!fault)
                 {
                     errorStream << "ERROR: Failed to find Fault (" << id
                         << ") for FaultInput (" << (*it).second->id << ")";
                     throw(DbException(errorStream.str()));
                 }
-                else
-                {
-                    if (!(*faultIt).second->faultStates)
-                    {
-                        errorStream << "ERROR: No FaultStates found for Fault (" << (*faultIt).second->id
-                            << ") for FaultInput (" << (*it).second->id << ")";
-                        throw(DbException(errorStream.str()));
-                    }
-                    (*deviceIt).second->fastDestinationMask = 0;
-                    (*deviceIt).second->fastPowerClass = 100;
-                    (*deviceIt).second->fastExpectedState = 0;
-
-                    if ((*faultIt).second->faultStates->size() != 1)
-                    {
-                        errorStream << "ERROR: DigitalDevice configured with FAST evaluation must have one fault state only."
-                            << " Found " << (*faultIt).second->faultStates->size() << " fault states for "
-                            << "device " << (*deviceIt).second->name;
-                        throw(DbException(errorStream.str()));
-                    }
-                    DbFaultStateMap::iterator faultState = (*faultIt).second->faultStates->begin();
-
-                    // Set the expected state as the oposite of the expected faulted value
-                    // For example a faulted fast valve sets the digital input to high (0V, digital 0),
-                    // the expected normal state is 1.
-                    if (!(*faultState).second->deviceState->value)
-                      (*deviceIt).second->fastExpectedState = 1;
-
-                    //    DbAllowedClassMap::iterator allowedClass = (*faultState).second->allowedClasses->begin();
-                    for (DbAllowedClassMap::iterator allowedClass = (*faultState).second->allowedClasses->begin();
-                        allowedClass != (*faultState).second->allowedClasses->end();
-                        ++allowedClass)
-                    {
-                        (*deviceIt).second->fastDestinationMask |= (*allowedClass).second->beamDestination->destinationMask;
-                        if ((*allowedClass).second->beamClass->number < (*deviceIt).second->fastPowerClass)
-                            (*deviceIt).second->fastPowerClass = (*allowedClass).second->beamClass->number;
-
-                    }
-                }
+                configureFastDigitalInput((*it).second, *device, *fault);
             }
         }
     }
@@ -594,8 +685,8 @@ void MpsDb::configureFaultInputs()
     {
         int id = (*it).second->faultId;
 
-        DbFaultMap::iterator faultIt = faults->find(id);
-        if (faultIt == faults->end())
+        DbFaultPtr *fault = index.faults.find(id);
+        if (!fault)
         {
             errorStream <<  "ERROR: Failed to configure database, invalid ID found for Fault ("
                 << id << ") for FaultInput (" << (*it).second->id << ")";
@@ -603,13 +694,13 @@ void MpsDb::configureFaultInputs()
         }
 
         // Create a map to hold faultInputs for the fault
-        if (!(*faultIt).second->faultInputs)
+        if (!(*fault)->faultInputs)
         {
             DbFaultInputMap *faultInputs = new DbFaultInputMap();
-            (*faultIt).second->faultInputs = DbFaultInputMapPtr(faultInputs);
+            (*fault)->faultInputs = DbFaultInputMapPtr(faultInputs);
         }
-        (*faultIt).second->faultInputs->insert(std::pair<int, DbFaultInputPtr>((*it).second->id,
-            (*it).second));
+        (*fault)->faultInputs->insert((*fault)->faultInputs->end(),
+            std::pair<int, DbFaultInputPtr>((*it).second->id, (*it).second));
     }
 
     //  std::cout << "assign evaluation" << std::endl;
@@ -653,7 +744,7 @@ void MpsDb::configureFaultInputs()
     //  std::cout << "done with faultInputs" << std::endl;
 }
 
-void MpsDb::configureFaultStates()
+void MpsDb::configureFaultStates(const DbIndexes &index)
 {
     LOG_TRACE("DATABASE", "Configure: FaultStates");
     std::stringstream errorStream;
@@ -665,8 +756,8 @@ void MpsDb::configureFaultStates()
     {
         int id = (*it).second->faultId;
 
-        DbFaultMap::iterator faultIt = faults->find(id);
-        if (faultIt == faults->end())
+        DbFaultPtr *fault = index.faults.find(id);
+        if (!fault)
         {
             errorStream << "ERROR: Failed to configure database, invalid ID found for Fault ("
                 << id << ") for FaultState (" << (*it).second->id << ")";
@@ -674,31 +765,31 @@ void MpsDb::configureFaultStates()
         }
 
         // Create a map to hold faultInputs for the fault
-        if (!(*faultIt).second->faultStates)
+        if (!(*fault)->faultStates)
         {
             DbFaultStateMap *digFaultStates = new DbFaultStateMap();
-            (*faultIt).second->faultStates = DbFaultStateMapPtr(digFaultStates);
+            (*fault)->faultStates = DbFaultStateMapPtr(digFaultStates);
         }
-        (*faultIt).second->faultStates->insert(std::pair<int, DbFaultStatePtr>((*it).second->id,
-            (*it).second));
+        (*fault)->faultStates->insert((*fault)->faultStates->end(),
+            std::pair<int, DbFaultStatePtr>((*it).second->id, (*it).second));
         LOG_TRACE("DATABASE", "Adding FaultState (" << (*it).second->id << ") to "
-            " Fault (" << (*faultIt).second->id << ", " << (*faultIt).second->name
-            << ", " << (*faultIt).second->description << ")");
+            " Fault (" << (*fault)->id << ", " << (*fault)->name
+            << ", " << (*fault)->description << ")");
 
         // If this DigitalFault is the default, then assign it to the fault:
-        if ((*it).second->defaultState && !((*faultIt).second->defaultFaultState))
-            (*faultIt).second->defaultFaultState = (*it).second;
+        if ((*it).second->defaultState && !((*fault)->defaultFaultState))
+            (*fault)->defaultFaultState = (*it).second;
 
         // DeviceState
         id = (*it).second->deviceStateId;
-        DbDeviceStateMap::iterator deviceStateIt = deviceStates->find(id);
-        if (deviceStateIt == deviceStates->end())
+        DbDeviceStatePtr *deviceState = index.deviceStates.find(id);
+        if (!deviceState)
         {
             errorStream << "ERROR: Failed to configure database, invalid ID found for DeviceState ("
                 << id << ") for FaultState (" << (*it).second->id << ")";
             throw(DbException(errorStream.str()));
         }
-        (*it).second->deviceState = (*deviceStateIt).second;
+        (*it).second->deviceState = *deviceState;
     }
 
     // After assigning all FaultStates to Faults, check if all Faults
@@ -717,7 +808,7 @@ void MpsDb::configureFaultStates()
     }
 }
 
-void MpsDb::configureAnalogDevices()
+void MpsDb::configureAnalogDevices(const DbIndexes &index)
 {
     LOG_TRACE("DATABASE", "Configure: AnalogDevices");
     std::stringstream errorStream;
@@ -728,10 +819,10 @@ void MpsDb::configureAnalogDevices()
     {
         int typeId = (*it).second->deviceTypeId;
 
-        DbDeviceTypeMap::iterator deviceType = deviceTypes->find(typeId);
-        if (deviceType != deviceTypes->end())
+        DbDeviceTypePtr *deviceType = index.deviceTypes.find(typeId);
+        if (deviceType)
         {
-            (*it).second->deviceType = (*deviceType).second;
+            (*it).second->deviceType = *deviceType;
         }
         else
         {
@@ -741,18 +832,18 @@ void MpsDb::configureAnalogDevices()
         }
 
         int channelId = (*it).second->channelId;
-        DbChannelMap::iterator channelIt = analogChannels->find(channelId);
-        if (channelIt == analogChannels->end())
+        DbChannelPtr *channel = index.analogChannels.find(channelId);
+        if (!channel)
         {
             errorStream << "ERROR: Failed to configure database, invalid ID found for Channel ("
                 << channelId << ") for AnalogDevice (" << (*it).second->id << ")";
             throw(DbException(errorStream.str()));
         }
-        (*it).second->channel = (*channelIt).second;
+        (*it).second->channel = *channel;
     }
 }
 
-void MpsDb::configureIgnoreConditions()
+void MpsDb::configureIgnoreConditions(const DbIndexes &index)
 {
     LOG_TRACE("DATABASE", "Configure: IgnoreConditions");
     std::stringstream errorStream;
@@ -765,17 +856,17 @@ void MpsDb::configureIgnoreConditions()
         uint32_t conditionId = (*ignoreCondition).second->conditionId;
             //std::cout << "conditionId=" << conditionId << " ";
 
-        DbConditionMap::iterator condition = conditions->find(conditionId);
-        if (condition != conditions->end())
+        DbConditionPtr *condition = index.conditions.find(conditionId);
+        if (condition)
         {
             // Create a map to hold IgnoreConditions
-            if (!(*condition).second->ignoreConditions)
+            if (!(*condition)->ignoreConditions)
             {
                 DbIgnoreConditionMap *ignoreConditionMap = new DbIgnoreConditionMap();
-                (*condition).second->ignoreConditions = DbIgnoreConditionMapPtr(ignoreConditionMap);
+                (*condition)->ignoreConditions = DbIgnoreConditionMapPtr(ignoreConditionMap);
             }
-            (*condition).second->ignoreConditions->
-            insert(std::pair<int, DbIgnoreConditionPtr>((*ignoreCondition).second->id, (*ignoreCondition).second));
+            (*condition)->ignoreConditions->insert((*condition)->ignoreConditions->end(),
+                std::pair<int, DbIgnoreConditionPtr>((*ignoreCondition).second->id, (*ignoreCondition).second));
         }
         else
         {
@@ -792,10 +883,10 @@ void MpsDb::configureIgnoreConditions()
 
         if (faultStateId != DbIgnoreCondition::INVALID_ID)
         {
-            DbFaultStateMap::iterator faultIt = faultStates->find(faultStateId);
-            if (faultIt != faultStates->end())
+            DbFaultStatePtr *faultState = index.faultStates.find(faultStateId);
+            if (faultState)
             {
-                (*ignoreCondition).second->faultState = (*faultIt).second;
+                (*ignoreCondition).second->faultState = *faultState;
             }
             else
             {
@@ -812,14 +903,14 @@ void MpsDb::configureIgnoreConditions()
 
         if (deviceId != DbIgnoreCondition::INVALID_ID)
         {
-            DbDigitalDeviceMap::iterator deviceIt = digitalDevices->find(deviceId);
-            if (deviceIt == digitalDevices->end())
+            DbDigitalDevicePtr *device = index.digitalDevices.find(deviceId);
+            if (!device)
             {
               // It is an analog device.  Link it to proper analog device.
-              DbAnalogDeviceMap::iterator analogDeviceIt = analogDevices->find(deviceId);
-              if (analogDeviceIt != analogDevices->end())
+              DbAnalogDevicePtr *analogDevice = index.analogDevices.find(deviceId);
+              if (analogDevice)
               {
-                  (*ignoreCondition).second->analogDevice = (*analogDeviceIt).second;
+                  (*ignoreCondition).second->analogDevice = *analogDevice;
               }
               else
               {
@@ -832,7 +923,7 @@ void MpsDb::configureIgnoreConditions()
             }
             else
             {
-              (*ignoreCondition).second->digitalDevice = (*deviceIt).second;
+              (*ignoreCondition).second->digitalDevice = *device;
             }
         }
         else
@@ -853,17 +944,17 @@ void MpsDb::configureIgnoreConditions()
     {
         uint32_t conditionId = (*conditionInput).second->conditionId;
 
-        DbConditionMap::iterator condition = conditions->find(conditionId);
-        if (condition != conditions->end())
+        DbConditionPtr *condition = index.conditions.find(conditionId);
+        if (condition)
         {
             // Create a map to hold ConditionInputs
-            if (!(*condition).second->conditionInputs)
+            if (!(*condition)->conditionInputs)
             {
                 DbConditionInputMap *conditionInputMap = new DbConditionInputMap();
-                (*condition).second->conditionInputs = DbConditionInputMapPtr(conditionInputMap);
+                (*condition)->conditionInputs = DbConditionInputMapPtr(conditionInputMap);
             }
-            (*condition).second->conditionInputs->
-            insert(std::pair<int, DbConditionInputPtr>((*conditionInput).second->id, (*conditionInput).second));
+            (*condition)->conditionInputs->insert((*condition)->conditionInputs->end(),
+                std::pair<int, DbConditionInputPtr>((*conditionInput).second->id, (*conditionInput).second));
         }
         else
         {
@@ -874,10 +965,10 @@ void MpsDb::configureIgnoreConditions()
 
         uint32_t faultStateId = (*conditionInput).second->faultStateId;
 
-        DbFaultStateMap::iterator faultIt = faultStates->find(faultStateId);
-        if (faultIt != faultStates->end())
+        DbFaultStatePtr *faultState = index.faultStates.find(faultStateId);
+        if (faultState)
         {
-            (*conditionInput).second->faultState = (*faultIt).second;
+            (*conditionInput).second->faultState = *faultState;
         }
         else
         {
@@ -894,7 +985,7 @@ void MpsDb::configureIgnoreConditions()
  * the fast rules (sent to firmware) and the buffer containing the
  * input updates received from firmware at 360 Hz.
  */
-void MpsDb::configureApplicationCards()
+void MpsDb::configureApplicationCards(const DbIndexes &index)
 {
     LOG_TRACE("DATABASE", "Configure: ApplicationCards");
     std::stringstream errorStream;
@@ -913,14 +1004,15 @@ void MpsDb::configureApplicationCards()
         aPtr = (*applicationCardIt).second;
 
         // Find its crate
-        DbCrateMap::iterator crateIt;
-        crateIt = crates->find(aPtr->crateId);
-        if (crateIt != crates->end())
-            aPtr->crate = (*crateIt).second;
+        DbCratePtr *crate = index.crates.find(aPtr->crateId);
+        if (crate)
+            aPtr->crate = *crate;
 
         // Configuration buffer
         configBuffer = fastConfigurationBuffer + aPtr->globalId * APPLICATION_CONFIG_BUFFER_SIZE_BYTES;
         aPtr->applicationConfigBuffer = reinterpret_cast<ApplicationConfigBufferBitSet *>(configBuffer);
+        configBuffer = stagedConfigurationBuffer + aPtr->globalId * APPLICATION_CONFIG_BUFFER_SIZE_BYTES;
+        aPtr->stagedConfigBuffer = reinterpret_cast<ApplicationConfigBufferBitSet *>(configBuffer);
 
         // Update buffer
         // updateBuffer = fwUpdateBuffer.getReadPtr()->at(
@@ -934,9 +1026,9 @@ void MpsDb::configureApplicationCards()
         aPtr->setUpdateBufferPtr(&fwUpdateBuffer);
 
         // Find the ApplicationType for each card
-        DbApplicationTypeMap::iterator applicationTypeIt = applicationTypes->find(aPtr->applicationTypeId);
-        if (applicationTypeIt != applicationTypes->end())
-            aPtr->applicationType = (*applicationTypeIt).second;
+        DbApplicationTypePtr *applicationType = index.applicationTypes.find(aPtr->applicationTypeId);
+        if (applicationType)
+            aPtr->applicationType = *applicationType;
         
         LOG_TRACE("DATABASE", "AppCard [" << aPtr->globalId << ", " << aPtr->name << "] config/update buffer alloc");
     }
@@ -950,10 +1042,10 @@ void MpsDb::configureApplicationCards()
         ++digitalDeviceIt)
     {
         dPtr = (*digitalDeviceIt).second;
-        applicationCardIt = applicationCards->find(dPtr->cardId);
-        if (applicationCardIt != applicationCards->end())
+        DbApplicationCardPtr *applicationCard = index.applicationCards.find(dPtr->cardId);
+        if (applicationCard)
         {
-            aPtr = (*applicationCardIt).second;
+            aPtr = *applicationCard;
             // Alloc a new map for digital devices if one is not there yet
             if (!aPtr->digitalDevices)
             {
@@ -961,13 +1053,13 @@ void MpsDb::configureApplicationCards()
                 aPtr->digitalDevices = DbDigitalDeviceMapPtr(digitalDevices);
             }
             // Once the map is there, add the digital device
-            aPtr->digitalDevices->insert(std::pair<int, DbDigitalDevicePtr>(dPtr->id, dPtr));
+            aPtr->digitalDevices->insert(aPtr->digitalDevices->end(),
+                std::pair<int, DbDigitalDevicePtr>(dPtr->id, dPtr));
             LOG_TRACE("DATABASE", "AppCard [" << aPtr->globalId << ", " << aPtr->name << "], DigitalDevice: " << dPtr->name);
         }
     }
 
     // Do the same for analog devices
-    DbAnalogDeviceMap::iterator analogDeviceIt;
     DbAnalogDevicePtr adPtr;
 
     for (DbAnalogDeviceMap::iterator analogDeviceIt = analogDevices->begin();
@@ -975,10 +1067,10 @@ void MpsDb::configureApplicationCards()
         ++analogDeviceIt)
     {
         adPtr = (*analogDeviceIt).second;
-        DbApplicationCardMap::iterator applicationCardIt = applicationCards->find(adPtr->cardId);
-        if (applicationCardIt != applicationCards->end())
+        DbApplicationCardPtr *applicationCard = index.applicationCards.find(adPtr->cardId);
+        if (applicationCard)
         {
-            aPtr = (*applicationCardIt).second;
+            aPtr = *applicationCard;
             // Alloc a new map for analog devices if one is not there yet
             if (aPtr->digitalDevices)
             {
@@ -995,7 +1087,8 @@ void MpsDb::configureApplicationCards()
             }
 
             // Once the map is there, add the analog device
-            aPtr->analogDevices->insert(std::pair<int, DbAnalogDevicePtr>(adPtr->id, adPtr));
+            aPtr->analogDevices->insert(aPtr->analogDevices->end(),
+                std::pair<int, DbAnalogDevicePtr>(adPtr->id, adPtr));
             LOG_TRACE("DATABASE", "AppCard [" << aPtr->globalId << ", " << aPtr->name << "], AnalogDevice: " << adPtr->name);
             adPtr->numChannelsCard = aPtr->applicationType->analogChannelCount;
         }
@@ -1020,14 +1113,15 @@ void MpsDb::configureApplicationCards()
 	             deviceInput != dPtr->inputDevices->end(); ++deviceInput) {
             if (!(*deviceInput).second->configured) {
               uint32_t diCard = (*deviceInput).second->channel->cardId;
-              DbApplicationCardMap::iterator applicationCardIt = applicationCards->find(diCard);
-              if (applicationCardIt != applicationCards->end())
+              DbApplicationCardPtr *applicationCard = index.applicationCards.find(diCard);
+              if (applicationCard)
               {
-                aPtr = (*applicationCardIt).second;
+                aPtr = *applicationCard;
                 std::vector<uint8_t>* buff = aPtr->getFwUpdateBuffer();
                 size_t                lowBufOff = aPtr->getWasLowBufferOffset();
                 size_t                highBufOff = aPtr->getWasHighBufferOffset();
-                (*deviceInput).second->setUpdateBuffers(buff, lowBufOff, highBufOff);
+                (*deviceInput).second->setUpdateBuffers(buff, lowBufOff, highBufOff, &aPtr->bypassOverride);
+                (*deviceInput).second->configureBypassOverride();
 	              (*deviceInput).second->configured = true;
                 std::cout << "INFO: Device Input for " << dPtr->name << " configured!" << std::endl;
               }
@@ -1058,6 +1152,42 @@ void MpsDb::clearMitigationBuffer()
     mit_buffer_t( NUM_DESTINATIONS/8, 0 ).swap(softwareMitigationBuffer);
 }
 
+/**
+ * Build the id indexes of the tables referenced by foreign keys, used by the
+ * configure*() methods instead of searching the maps.
+ */
+void MpsDb::buildIndexes(DbIndexes &index)
+{
+    index.crates.build(crates);
+    index.applicationTypes.build(applicationTypes);
+    index.applicationCards.build(applicationCards);
+    index.digitalChannels.build(digitalChannels);
+    index.analogChannels.build(analogChannels);
+    index.deviceTypes.build(deviceTypes);
+    index.deviceStates.build(deviceStates);
+    index.digitalDevices.build(digitalDevices);
+    index.faults.build(faults);
+    index.faultStates.build(faultStates);
+    index.analogDevices.build(analogDevices);
+    index.beamDestinations.build(beamDestinations);
+    index.beamClasses.build(beamClasses);
+    index.conditions.build(conditions);
+}
+
+/**
+ * Record the time taken by a configure() step, since 'start', and restart
+ * the step clock.
+ */
+static void configureStepDone(std::vector<DbConfigureTime> &times, std::string name, uint64_t &start)
+{
+    uint64_t now = CycleCounter::now();
+    DbConfigureTime time;
+    time.name = name;
+    time.time = CycleCounter::toNs(now - start) / 1e9;
+    times.push_back(time);
+    start = now;
+}
+
 /**
  * After the YAML database file is loaded this method must be called to resolve
  * references between tables. In the YAML table entries there is a reference to
@@ -1065,18 +1195,68 @@ void MpsDb::clearMitigationBuffer()
  * actual item referenced by the foreign key and saves a pointer to the
  * referenced element for direct access. This allows the engine to evaluate
  * faults without having to search for entries.
+ *
+ * The foreign keys are resolved with the DbIndexes (id to entry vectors)
+ * built once at the beginning. The time taken by each step is kept for
+ * showConfigureTimes().
  */
 void MpsDb::configure()
 {
-    configureAllowedClasses();
-    configureDeviceTypes();
-    configureDeviceInputs();
-    configureFaultStates();
-    configureAnalogDevices();
-    configureFaultInputs();
-    configureIgnoreConditions();
-    configureApplicationCards();
+    uint64_t start = CycleCounter::now();
+    uint64_t step = start;
+    DbIndexes index;
+    DbArenaScope scope(_arena, "Configure");
+
+    _configureTimes.clear();
+    buildIndexes(index);
+    configureStepDone(_configureTimes, "Indexes", step);
+    configureAllowedClasses(index);
+    configureStepDone(_configureTimes, "AllowedClasses", step);
+    configureDeviceTypes(index);
+    configureStepDone(_configureTimes, "DeviceTypes", step);
+    configureDeviceInputs(index);
+    configureStepDone(_configureTimes, "DeviceInputs", step);
+    configureFaultStates(index);
+    configureStepDone(_configureTimes, "FaultStates", step);
+    configureAnalogDevices(index);
+    configureStepDone(_configureTimes, "AnalogDevices", step);
+    configureFaultInputs(index);
+    configureStepDone(_configureTimes, "FaultInputs", step);
+    configureIgnoreConditions(index);
+    configureStepDone(_configureTimes, "IgnoreConditions", step);
+    configureApplicationCards(index);
+    configureStepDone(_configureTimes, "ApplicationCards", step);
     configureBeamDestinations();
+    configureStepDone(_configureTimes, "BeamDestinations", step);
+    _arena->seal();
+    configureStepDone(_configureTimes, "SealArena", step);
+
+    _configureTime = CycleCounter::toNs(CycleCounter::now() - start) / 1e9;
+}
+
+/**
+ * Print the memory used by the loaded database, per table (see DbArena)
+ */
+void MpsDb::showMemory()
+{
+    _arena->showMemory();
+}
+
+void MpsDb::showConfigureTimes()
+{
+    std::cout << "Configure time:" << std::endl;
+    for (std::vector<DbConfigureTime>::iterator it = _configureTimes.begin();
+        it != _configureTimes.end();
+        ++it)
+    {
+        std::cout << "  " << std::left << std::setw(18) << it->name << std::right
+                  << std::fixed << std::setprecision(3) << std::setw(12)
+                  << it->time * 1e3 << " ms" << std::endl;
+    }
+    std::cout << "  " << std::left << std::setw(18) << "Total" << std::right
+              << std::setw(12) << _configureTime * 1e3 << " ms" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
 }
 
 bool MpsDb::getDbReload() {
@@ -1213,161 +1393,957 @@ void MpsDb::writeFirmwareConfiguration(bool enableTimeout)
 
     // Firmware command to actually switch to the new configuration
     Firmware::getInstance().switchConfig();
+
+    _fwConfigGeneration++;
+    _fwFingerprint = computeFirmwareFingerprint();
 }
 
-void MpsDb::setName(std::string yamlFileName)
+/**
+ * Hash of the firmware configuration as written by the last
+ * writeFirmwareConfiguration()/writeStagedFirmwareConfiguration(): the
+ * configuration buffer and timeout enable of each application card, and
+ * the timing check parameters of the beam classes.
+ *
+ * Must be called with the database mutex held.
+ */
+uint64_t MpsDb::computeFirmwareFingerprint()
 {
-    name = yamlFileName;
+    uint64_t hash = DB_IMAGE_HASH_INIT;
+
+    for (DbApplicationCardMap::iterator card = applicationCards->begin();
+        card != applicationCards->end();
+        ++card)
+    {
+        uint32_t globalId = (*card).second->globalId;
+        uint32_t timeoutEnable = Firmware::getInstance().getAppTimeoutEnable(globalId);
+        hash = dbImageHash(hash, &globalId, sizeof(globalId));
+        hash = dbImageHash(hash, &timeoutEnable, sizeof(timeoutEnable));
+        hash = dbImageHash(hash, fastConfigurationBuffer + globalId * APPLICATION_CONFIG_BUFFER_SIZE_BYTES,
+            APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES);
+    }
+
+    for (DbBeamClassMap::iterator beamClass = beamClasses->begin();
+        beamClass != beamClasses->end();
+        ++beamClass)
+    {
+        uint32_t timing[4] = { (*beamClass).second->number, (*beamClass).second->integrationWindow,
+                               (*beamClass).second->minPeriod, (*beamClass).second->totalCharge };
+        hash = dbImageHash(hash, timing, sizeof(timing));
+    }
+
+    return hash;
 }
 
 /**
- * The MPS database YAML file is composed of several "tables"/"set of entries".
- * This method opens each table as a YAML::Node and loads all entry contents
- * into the MpsDb maps. Each maps uses the MPS database id as key.
+ * Used on a warm restart: build the configuration of all application
+ * cards (as writeFirmwareConfiguration(true) would) without writing it,
+ * and compare its fingerprint with the one of the configuration the
+ * firmware is running. If they match the configuration is considered
+ * written and true is returned, otherwise the caller must write it.
+ *
+ * Must be called with the database mutex held.
  */
-int MpsDb::load(std::string yamlFileName)
+bool MpsDb::matchFirmwareConfiguration(uint64_t fingerprint)
 {
-    std::stringstream errorStream;
-    YAML::Node doc;
-    std::vector<YAML::Node> nodes;
+    for (DbApplicationCardMap::iterator card = applicationCards->begin();
+        card != applicationCards->end();
+        ++card)
+    {
+        (*card).second->writeConfiguration(true);
+    }
 
-    LOG_TRACE("DATABASE", "Loading YAML from file " << yamlFileName);
-    try
+    if (computeFirmwareFingerprint() != fingerprint)
+        return false;
+
+    _fwConfigGeneration++;
+    _fwFingerprint = fingerprint;
+    return true;
+}
+
+/**
+ * Build the configuration for the specified application cards (by card id)
+ * as it should be after the bypasses expiring at or before 'expiredBy' are
+ * gone. The configuration is only written to the staged buffer, the live
+ * configuration buffer (and the fingerprint computed from it) is left as is
+ * until writeStagedFirmwareConfiguration() sends it to the firmware.
+ *
+ * Must be called with the database mutex held.
+ */
+void MpsDb::stageFirmwareConfiguration(const std::set<uint32_t> &cardIds, time_t expiredBy)
+{
+    for (std::set<uint32_t>::const_iterator id = cardIds.begin();
+        id != cardIds.end();
+        ++id)
     {
-        nodes = YAML::LoadAllFromFile(yamlFileName);
+        DbApplicationCardMap::iterator card = applicationCards->find(*id);
+        if (card != applicationCards->end())
+            (*card).second->stageConfiguration(expiredBy);
     }
-    catch (YAML::BadFile &e)
+}
+
+/**
+ * Copy the configuration previously staged for the specified application
+ * cards to the configuration buffer, send it and switch the firmware to it. Configuration for the other cards
+ * is not touched.
+ *
+ * Must be called with the database mutex held.
+ */
+void MpsDb::writeStagedFirmwareConfiguration(const std::set<uint32_t> &cardIds)
+{
+    LOG_TRACE("DATABASE", "Writing staged config to firmware, num applications: " << cardIds.size());
+    for (std::set<uint32_t>::const_iterator id = cardIds.begin();
+        id != cardIds.end();
+        ++id)
     {
-        errorStream << "ERROR: Please check if YAML file is readable";
-        throw(DbException(errorStream.str()));
+        DbApplicationCardMap::iterator card = applicationCards->find(*id);
+        if (card == applicationCards->end())
+            continue;
+
+        uint32_t offset = (*card).second->globalId * APPLICATION_CONFIG_BUFFER_SIZE_BYTES;
+        memcpy(fastConfigurationBuffer + offset, stagedConfigurationBuffer + offset,
+            APPLICATION_CONFIG_BUFFER_SIZE_BYTES);
+        Firmware::getInstance().writeConfig((*card).second->globalId, fastConfigurationBuffer + offset,
+            APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES);
     }
-    catch (...)
+
+    Firmware::getInstance().switchConfig();
+    _fwFingerprint = computeFirmwareFingerprint();
+}
+
+/**
+ * Check if the entry with the given database id exists in the table
+ * (DbImageTableId) of the loaded database.
+ */
+static bool hasDeltaEntry(MpsDb *db, uint32_t table, uint32_t id)
+{
+    switch (table)
     {
-        errorStream << "ERROR: Failed to load YAML file ("
-            << yamlFileName << ")";
+    case DbImageCrate: return db->crates && db->crates->count(id);
+    case DbImageApplicationType: return db->applicationTypes && db->applicationTypes->count(id);
+    case DbImageApplicationCard: return db->applicationCards && db->applicationCards->count(id);
+    case DbImageDigitalChannel: return db->digitalChannels && db->digitalChannels->count(id);
+    case DbImageAnalogChannel: return db->analogChannels && db->analogChannels->count(id);
+    case DbImageDeviceType: return db->deviceTypes && db->deviceTypes->count(id);
+    case DbImageDeviceState: return db->deviceStates && db->deviceStates->count(id);
+    case DbImageDigitalDevice: return db->digitalDevices && db->digitalDevices->count(id);
+    case DbImageDeviceInput: return db->deviceInputs && db->deviceInputs->count(id);
+    case DbImageFault: return db->faults && db->faults->count(id);
+    case DbImageFaultInput: return db->faultInputs && db->faultInputs->count(id);
+    case DbImageFaultState: return db->faultStates && db->faultStates->count(id);
+    case DbImageAnalogDevice: return db->analogDevices && db->analogDevices->count(id);
+    case DbImageBeamDestination: return db->beamDestinations && db->beamDestinations->count(id);
+    case DbImageBeamClass: return db->beamClasses && db->beamClasses->count(id);
+    case DbImageAllowedClass: return db->allowedClasses && db->allowedClasses->count(id);
+    case DbImageCondition: return db->conditions && db->conditions->count(id);
+    case DbImageIgnoreCondition: return db->ignoreConditions && db->ignoreConditions->count(id);
+    case DbImageConditionInput: return db->conditionInputs && db->conditionInputs->count(id);
+    case DbImageDatabaseInfo: return db->databaseInfo && db->databaseInfo->count(id);
+    default: return false;
+    }
+}
+
+/**
+ * Apply a database delta (see MpsDbDelta) to the loaded database, without
+ * reloading it. The delta must have been computed from the loaded version
+ * and contain only changes that can be patched in place, otherwise a
+ * DbException is thrown and the database is left untouched.
+ *
+ * Only the entries in the delta are changed. Allowed classes are moved
+ * between fault states, and the firmware configuration of the fast devices
+ * of the affected faults is computed again. Ignore conditions are moved
+ * between conditions. The application cards whose configuration changed
+ * are added to 'cardIds', the caller sends them to the firmware with
+ * stageFirmwareConfiguration() and writeStagedFirmwareConfiguration().
+ *
+ * Must be called with the database mutex held, between evaluation cycles.
+ */
+void MpsDb::applyDelta(const MpsDbDelta &delta, std::set<uint32_t> &cardIds)
+{
+    std::stringstream errorStream;
+    std::string reason;
+
+    if (!delta.isPatchable(reason))
+    {
+        errorStream << "ERROR: Database delta can't be applied: " << reason;
         throw(DbException(errorStream.str()));
     }
 
-    LOG_TRACE("DATABASE", "Parsing YAML");
-    for (std::vector<YAML::Node>::iterator node = nodes.begin();
-        node != nodes.end();
-        ++node)
+    std::string md5sum;
+    if (databaseInfo && !databaseInfo->empty())
+        md5sum = databaseInfo->begin()->second->md5sum;
+
+    if (md5sum != delta.getFromMd5sum())
     {
-        std::string s = YAML::Dump(*node);
-        size_t found = s.find(":");
-        if (found == std::string::npos)
-        {
-            errorStream << "ERROR: Can't find Node name in YAML file ("
-                << yamlFileName << ")";
-            throw(DbException(errorStream.str()));
-        }
-        std::string nodeName = s.substr(0, found);
+        errorStream << "ERROR: Database delta is for database " << delta.getFromMd5sum()
+            << ", the loaded database is " << md5sum;
+        throw(DbException(errorStream.str()));
+    }
 
-        LOG_TRACE("DATABASE", "Parsing \"" << nodeName << "\"");
+    const std::vector<DbDeltaRow> &rows = delta.getRows();
 
-        if (nodeName == "Crate")
-        {
-            crates = (*node).as<DbCrateMapPtr>();
-        }
-        else if (nodeName == "ApplicationType")
+    // Check all the references before changing anything
+    for (std::vector<DbDeltaRow>::const_iterator row = rows.begin(); row != rows.end(); ++row)
+    {
+        uint32_t missingTable = DB_IMAGE_TABLE_COUNT;
+        uint32_t missingId = 0;
+
+        if (row->kind != DbDeltaAdded && !hasDeltaEntry(this, row->table, row->id))
         {
-            applicationTypes = (*node).as<DbApplicationTypeMapPtr>();
+            missingTable = row->table;
+            missingId = row->id;
         }
-        else if (nodeName == "ApplicationCard")
+        else if (row->kind != DbDeltaRemoved && row->table == DbImageAllowedClass)
         {
-            applicationCards = (*node).as<DbApplicationCardMapPtr>();
+            uint32_t refTable[3] = { DbImageBeamClass, DbImageFaultState, DbImageBeamDestination };
+            for (uint32_t i = 0; i < 3; ++i)
+            {
+                if (!hasDeltaEntry(this, refTable[i], delta.getWord(*row, i + 1)))
+                {
+                    missingTable = refTable[i];
+                    missingId = delta.getWord(*row, i + 1);
+                }
+            }
         }
-        else if (nodeName == "DigitalChannel")
+        else if (row->kind != DbDeltaRemoved && row->table == DbImageIgnoreCondition)
         {
-            digitalChannels = (*node).as<DbChannelMapPtr>();
+            uint32_t conditionId = delta.getWord(*row, 1);
+            uint32_t faultStateId = delta.getWord(*row, 2);
+            uint32_t deviceId = delta.getWord(*row, 3);
+
+            if (!hasDeltaEntry(this, DbImageCondition, conditionId))
+            {
+                missingTable = DbImageCondition;
+                missingId = conditionId;
+            }
+            else if (faultStateId != DbIgnoreCondition::INVALID_ID &&
+                     !hasDeltaEntry(this, DbImageFaultState, faultStateId))
+            {
+                missingTable = DbImageFaultState;
+                missingId = faultStateId;
+            }
+            else if (deviceId != DbIgnoreCondition::INVALID_ID &&
+                     !hasDeltaEntry(this, DbImageDigitalDevice, deviceId) &&
+                     !hasDeltaEntry(this, DbImageAnalogDevice, deviceId))
+            {
+                missingTable = DbImageAnalogDevice;
+                missingId = deviceId;
+            }
+            else if (faultStateId == DbIgnoreCondition::INVALID_ID &&
+                     deviceId == DbIgnoreCondition::INVALID_ID)
+            {
+                errorStream << "ERROR: Database delta can't be applied, no FaultState or Device"
+                    << " for IgnoreCondition (" << row->id << ")";
+                throw(DbException(errorStream.str()));
+            }
         }
-        else if (nodeName == "AnalogChannel")
+
+        if (missingTable != DB_IMAGE_TABLE_COUNT)
         {
-            analogChannels = (*node).as<DbChannelMapPtr>();
+            errorStream << "ERROR: Database delta can't be applied, "
+                << MpsDbImage::getTableName(missingTable) << " (" << missingId
+                << ") not found for " << MpsDbImage::getTableName(row->table)
+                << " (" << row->id << ")";
+            throw(DbException(errorStream.str()));
         }
-        else if (nodeName == "DeviceType")
+    }
+
+    // New entries and strings go to the database arena
+    DbArenaScope scope(_arena, "Delta");
+    std::set<uint32_t> faultIds; // Faults whose allowed classes changed
+
+    for (std::vector<DbDeltaRow>::const_iterator row = rows.begin(); row != rows.end(); ++row)
+    {
+        LOG_TRACE("DATABASE", "Delta: " << MpsDbImage::getTableName(row->table)
+            << " (" << row->id << ") kind=" << row->kind);
+
+        switch (row->table)
         {
-            deviceTypes = (*node).as<DbDeviceTypeMapPtr>();
+        case DbImageAllowedClass:
+            if (row->kind != DbDeltaAdded)
+            {
+                DbAllowedClassPtr allowedClass = allowedClasses->find(row->id)->second;
+                DbFaultStateMap::iterator faultState = faultStates->find(allowedClass->faultStateId);
+                if (faultState != faultStates->end())
+                {
+                    if ((*faultState).second->allowedClasses)
+                        (*faultState).second->allowedClasses->erase(row->id);
+                    faultIds.insert((*faultState).second->faultId);
+                }
+                allowedClasses->erase(row->id);
+            }
+            if (row->kind != DbDeltaRemoved)
+            {
+                DbAllowedClassPtr allowedClass = dbArenaNew<DbAllowedClass>();
+                allowedClass->id = row->id;
+                allowedClass->beamClassId = delta.getWord(*row, 1);
+                allowedClass->faultStateId = delta.getWord(*row, 2);
+                allowedClass->beamDestinationId = delta.getWord(*row, 3);
+                allowedClass->beamClass = beamClasses->find(allowedClass->beamClassId)->second;
+                allowedClass->beamDestination = beamDestinations->find(allowedClass->beamDestinationId)->second;
+                allowedClasses->insert(std::pair<int, DbAllowedClassPtr>(row->id, allowedClass));
+
+                DbFaultStatePtr faultState = faultStates->find(allowedClass->faultStateId)->second;
+                if (!faultState->allowedClasses)
+                    faultState->allowedClasses = dbArenaNew<DbAllowedClassMap>();
+                faultState->allowedClasses->insert(std::pair<int, DbAllowedClassPtr>(row->id, allowedClass));
+                faultIds.insert(faultState->faultId);
+            }
+            break;
+
+        case DbImageIgnoreCondition:
+            if (row->kind != DbDeltaAdded)
+            {
+                DbIgnoreConditionPtr ignoreCondition = ignoreConditions->find(row->id)->second;
+
+                // The ignored flags are only cleared by the engine for whole
+                // devices, clear the integrator this condition was ignoring
+                if (ignoreCondition->analogDevice)
+                {
+                    if (ignoreCondition->faultState && ignoreCondition->faultState->deviceState)
+                    {
+                        int integrator = ignoreCondition->faultState->deviceState->getIntegrator();
+                        ignoreCondition->analogDevice->ignoredIntegrator[integrator] = false;
+                    }
+                    cardIds.insert(ignoreCondition->analogDevice->cardId);
+                }
+
+                DbConditionMap::iterator condition = conditions->find(ignoreCondition->conditionId);
+                if (condition != conditions->end() && (*condition).second->ignoreConditions)
+                    (*condition).second->ignoreConditions->erase(row->id);
+                ignoreConditions->erase(row->id);
+            }
+            if (row->kind != DbDeltaRemoved)
+            {
+                DbIgnoreConditionPtr ignoreCondition = dbArenaNew<DbIgnoreCondition>();
+                ignoreCondition->id = row->id;
+                ignoreCondition->conditionId = delta.getWord(*row, 1);
+                ignoreCondition->faultStateId = delta.getWord(*row, 2);
+                ignoreCondition->deviceId = delta.getWord(*row, 3);
+
+                if (ignoreCondition->faultStateId != DbIgnoreCondition::INVALID_ID)
+                    ignoreCondition->faultState = faultStates->find(ignoreCondition->faultStateId)->second;
+
+                if (ignoreCondition->deviceId != DbIgnoreCondition::INVALID_ID)
+                {
+                    DbDigitalDeviceMap::iterator device = digitalDevices->find(ignoreCondition->deviceId);
+                    if (device != digitalDevices->end())
+                    {
+                        ignoreCondition->digitalDevice = (*device).second;
+                    }
+                    else
+                    {
+                        ignoreCondition->analogDevice = analogDevices->find(ignoreCondition->deviceId)->second;
+                        cardIds.insert(ignoreCondition->analogDevice->cardId);
+                    }
+                }
+
+                DbConditionPtr condition = conditions->find(ignoreCondition->conditionId)->second;
+                if (!condition->ignoreConditions)
+                    condition->ignoreConditions = dbArenaNew<DbIgnoreConditionMap>();
+                condition->ignoreConditions->insert(std::pair<int, DbIgnoreConditionPtr>(row->id, ignoreCondition));
+                ignoreConditions->insert(std::pair<int, DbIgnoreConditionPtr>(row->id, ignoreCondition));
+            }
+            break;
+
+        case DbImageCondition:
+            {
+                DbConditionPtr condition = conditions->find(row->id)->second;
+                condition->name = delta.getString(*row, 1);
+                condition->description = delta.getString(*row, 2);
+                condition->mask = delta.getWord(*row, 3);
+            }
+            break;
+
+        case DbImageDatabaseInfo:
+            if (row->kind == DbDeltaRemoved)
+            {
+                databaseInfo->erase(row->id);
+            }
+            else
+            {
+                if (!databaseInfo)
+                    databaseInfo = dbArenaNew<DbInfoMap>();
+                if (!databaseInfo->count(row->id))
+                    databaseInfo->insert(std::pair<int, DbInfoPtr>(row->id, dbArenaNew<DbInfo>()));
+                DbInfoPtr dbInfo = databaseInfo->find(row->id)->second;
+                dbInfo->source = delta.getString(*row, 0);
+                dbInfo->user = delta.getString(*row, 1);
+                dbInfo->date = delta.getString(*row, 2);
+                dbInfo->md5sum = delta.getString(*row, 3);
+            }
+            break;
+
+        // Text only changes
+        case DbImageApplicationType:
+            applicationTypes->find(row->id)->second->description = delta.getString(*row, 6);
+            break;
+        case DbImageApplicationCard:
+            applicationCards->find(row->id)->second->name = delta.getString(*row, 6);
+            applicationCards->find(row->id)->second->description = delta.getString(*row, 7);
+            break;
+        case DbImageDigitalChannel:
+            digitalChannels->find(row->id)->second->name = delta.getString(*row, 3);
+            break;
+        case DbImageAnalogChannel:
+            analogChannels->find(row->id)->second->name = delta.getString(*row, 3);
+            break;
+        case DbImageDeviceType:
+            deviceTypes->find(row->id)->second->name = delta.getString(*row, 1);
+            break;
+        case DbImageDeviceState:
+            deviceStates->find(row->id)->second->name = delta.getString(*row, 4);
+            break;
+        case DbImageDigitalDevice:
+            digitalDevices->find(row->id)->second->name = delta.getString(*row, 2);
+            digitalDevices->find(row->id)->second->description = delta.getString(*row, 3);
+            break;
+        case DbImageFault:
+            faults->find(row->id)->second->name = delta.getString(*row, 1);
+            faults->find(row->id)->second->description = delta.getString(*row, 2);
+            break;
+        case DbImageAnalogDevice:
+            analogDevices->find(row->id)->second->name = delta.getString(*row, 3);
+            analogDevices->find(row->id)->second->description = delta.getString(*row, 4);
+            break;
+        case DbImageBeamDestination:
+            beamDestinations->find(row->id)->second->name = delta.getString(*row, 1);
+            break;
+        case DbImageBeamClass:
+            beamClasses->find(row->id)->second->name = delta.getString(*row, 1);
+            beamClasses->find(row->id)->second->description = delta.getString(*row, 6);
+            break;
+        default:
+            break;
         }
-        else if (nodeName == "DeviceState")
+    }
+
+    // Configure again the fast devices of the faults whose allowed classes
+    // changed. An analog device may have several faults, its configuration
+    // is rebuilt from all of them.
+    std::set<DbAnalogDevicePtr> fastAnalogDevices;
+    for (std::set<uint32_t>::iterator faultId = faultIds.begin(); faultId != faultIds.end(); ++faultId)
+    {
+        DbFaultMap::iterator fault = faults->find(*faultId);
+        if (fault == faults->end() || !(*fault).second->faultInputs)
+            continue;
+
+        for (DbFaultInputMap::iterator input = (*fault).second->faultInputs->begin();
+            input != (*fault).second->faultInputs->end();
+            ++input)
         {
-            deviceStates = (*node).as<DbDeviceStateMapPtr>();
+            if ((*input).second->analogDevice &&
+                (*input).second->analogDevice->evaluation == FAST_EVALUATION)
+            {
+                fastAnalogDevices.insert((*input).second->analogDevice);
+            }
+            else if ((*input).second->digitalDevice &&
+                     (*input).second->digitalDevice->evaluation == FAST_EVALUATION)
+            {
+                configureFastDigitalInput((*input).second, (*input).second->digitalDevice, (*fault).second);
+                cardIds.insert((*input).second->digitalDevice->cardId);
+            }
         }
-        else if (nodeName == "DigitalDevice")
+    }
+
+    for (std::set<DbAnalogDevicePtr>::iterator device = fastAnalogDevices.begin();
+        device != fastAnalogDevices.end();
+        ++device)
+    {
+        for (uint32_t i = 0; i < ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL; ++i)
+            (*device)->fastDestinationMask[i] = 0;
+
+        for (uint32_t i = 0; i < ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL * ANALOG_CHANNEL_INTEGRATORS_SIZE; ++i)
         {
-            digitalDevices = (*node).as<DbDigitalDeviceMapPtr>();
+            (*device)->fastPowerClass[i] = 0;
+            (*device)->fastPowerClassInit[i] = 1;
         }
-        else if (nodeName == "DeviceInput")
+
+        for (DbFaultInputMap::iterator input = faultInputs->begin();
+            input != faultInputs->end();
+            ++input)
         {
-            deviceInputs = (*node).as<DbDeviceInputMapPtr>();
+            if ((*input).second->analogDevice != *device)
+                continue;
+
+            DbFaultMap::iterator fault = faults->find((*input).second->faultId);
+            if (fault != faults->end())
+                configureFastAnalogInput((*input).second, *device, (*fault).second);
         }
-        else if (nodeName == "Fault")
+        cardIds.insert((*device)->cardId);
+    }
+
+    // Card configurations staged before the delta (see BypassManager) are stale
+    _fwConfigGeneration++;
+
+    LOG_TRACE("DATABASE", "Delta applied: " << rows.size() << " rows, "
+        << faultIds.size() << " faults, " << cardIds.size() << " applications");
+}
+
+void MpsDb::setName(std::string yamlFileName)
+{
+    name = yamlFileName;
+}
+
+/**
+ * Directory of the compiled database images created by load(), empty to
+ * disable the image cache (default). The directory must be private to the
+ * engine user (see MpsDbImage::checkCacheDir()).
+ */
+void MpsDb::setImageCacheDir(std::string dir)
+{
+    _imageCacheDir = dir;
+}
+
+/**
+ * Load the database tables from a YAML file or from a compiled image
+ * (see central_node_database_image.h).
+ *
+ * For a YAML file, if an image compiled from the same file is found in the
+ * image cache directory it is loaded instead of parsing the YAML. Otherwise
+ * the YAML is parsed and the image is written to the cache for the next
+ * load.
+ */
+int MpsDb::load(std::string fileName)
+{
+    uint64_t start = CycleCounter::now();
+
+    _arena = DbArenaPtr(new DbArena());
+    _loadedFromImage = false;
+    if (MpsDbImage::isImage(fileName))
+    {
+        LOG_TRACE("DATABASE", "Loading compiled database image from file " << fileName);
+        MpsDbImage::read(this, fileName);
+        _loadedFromImage = true;
+    }
+    else
+    {
+        std::string cacheFileName = "";
+        DbImageSource source;
+        if (!_imageCacheDir.empty())
         {
-            faults = (*node).as<DbFaultMapPtr>();
+            source = MpsDbImage::scanSource(fileName);
+            if (!source.md5sum.empty())
+            {
+                try
+                {
+                    MpsDbImage::checkCacheDir(_imageCacheDir);
+                    cacheFileName = MpsDbImage::getCacheFileName(_imageCacheDir, source.md5sum);
+                }
+                catch (DbException &e)
+                {
+                    std::cout << "WARNING: Ignoring database image cache: " << e.what() << std::endl;
+                }
+            }
         }
-        else if (nodeName == "FaultInput")
+
+        if (!cacheFileName.empty() && MpsDbImage::matches(cacheFileName, source))
         {
-            faultInputs = (*node).as<DbFaultInputMapPtr>();
+            try
+            {
+                LOG_TRACE("DATABASE", "Loading cached database image " << cacheFileName);
+                MpsDbImage::read(this, cacheFileName, true);
+                _loadedFromImage = true;
+            }
+            catch (DbException &e)
+            {
+                std::cout << "WARNING: Ignoring database image cache: " << e.what() << std::endl;
+            }
         }
-        else if (nodeName == "FaultState")
+
+        if (!_loadedFromImage)
         {
-            faultStates = (*node).as<DbFaultStateMapPtr>();
+            loadYaml(fileName);
+
+            if (!cacheFileName.empty())
+            {
+                try
+                {
+                    MpsDbImage::write(this, cacheFileName, source);
+                }
+                catch (DbException &e)
+                {
+                    std::cout << "WARNING: Failed to cache database image: " << e.what() << std::endl;
+                }
+            }
         }
-        else if (nodeName == "AnalogDevice")
+    }
+
+    setName(fileName);
+    _loadTime = CycleCounter::toNs(CycleCounter::now() - start) / 1e9;
+
+    return 0;
+}
+
+/**
+ * One document (table) of the MPS database YAML file, parsed and converted
+ * by a loadYaml() worker thread.
+ */
+class DbYamlTable
+{
+public:
+    std::string text;             // Document text
+    uint32_t line;                // Line of the document in the file
+    boost::shared_ptr<void> map;  // Converted Db*Map, NULL if not loaded
+    std::string error;            // Parse or conversion error
+    DbYamlTableTime time;
+};
+
+/**
+ * Tables of a YAML file, shared by the loadYaml() worker threads. Each
+ * worker takes the next table not yet taken.
+ */
+class DbYamlLoad
+{
+public:
+    std::string fileName;
+    DbArenaPtr arena;
+    std::vector<DbYamlTable> tables;
+    std::atomic<uint32_t> next;
+};
+
+/**
+ * Split the YAML file in documents, at each '---' line. Comments and
+ * directives before the first '---' are kept with the first document.
+ * The MPS database files have no multi-line strings, so a line starting
+ * with '---' is always a document start.
+ */
+static void splitYamlDocuments(const std::string &text, std::vector<DbYamlTable> &tables)
+{
+    size_t begin = 0;
+    uint32_t beginLine = 1;
+    uint32_t line = 1;
+    bool content = false;
+
+    for (size_t pos = 0; pos < text.size(); ++line)
+    {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos)
+            end = text.size();
+
+        if (text.compare(pos, 3, "---") == 0 &&
+            (pos + 3 == end || isspace(text[pos + 3])))
         {
-            analogDevices = (*node).as<DbAnalogDeviceMapPtr>();
+            if (content)
+            {
+                DbYamlTable table;
+                table.text = text.substr(begin, pos - begin);
+                table.line = beginLine;
+                tables.push_back(table);
+                begin = pos;
+                beginLine = line;
+            }
+            content = true;
         }
-        else if (nodeName == "BeamDestination")
+        else if (pos != end && text[pos] != '#' && text[pos] != '%' && text[pos] != '\r')
         {
-            beamDestinations = (*node).as<DbBeamDestinationMapPtr>();
+            content = true;
         }
-        else if (nodeName == "MitigationDevice")
-        {
-            // Not implemented
+
+        pos = end + 1;
+    }
+
+    if (content)
+    {
+        DbYamlTable table;
+        table.text = text.substr(begin);
+        table.line = beginLine;
+        tables.push_back(table);
+    }
+}
+
+template<class MapPtrType>
+static void convertYamlTable(const YAML::Node &node, DbYamlTable &table)
+{
+    MapPtrType map = node.as<MapPtrType>();
+    table.time.rows = map->size();
+    table.map = map;
+}
+
+template<class MapType>
+static boost::shared_ptr<MapType> getYamlTable(const DbYamlTable &table)
+{
+    return boost::static_pointer_cast<MapType>(table.map);
+}
+
+/**
+ * Parse one document of the YAML file, find the table name (the top level
+ * key) and convert it to the matching Db* map. Errors are kept in the
+ * table and reported by loadYaml() once all the workers are done.
+ */
+static void loadYamlTable(const std::string &fileName, DbArenaPtr arena, DbYamlTable &table)
+{
+    std::stringstream errorStream;
+    YAML::Node node;
+
+    uint64_t start = CycleCounter::now();
+    try
+    {
+        node = YAML::Load(table.text);
+    }
+    catch (YAML::Exception &e)
+    {
+        errorStream << "ERROR: Failed to load YAML file ("
+            << fileName << ")";
+        if (!e.mark.is_null())
+            errorStream << ", line " << table.line + e.mark.line;
+        errorStream << ": " << e.msg;
+        table.error = errorStream.str();
+        return;
+    }
+    std::string().swap(table.text);
+
+    uint64_t parsed = CycleCounter::now();
+    table.time.parseTime = CycleCounter::toNs(parsed - start) / 1e9;
+
+    if (node.IsNull())
+        return;
+
+    if (!node.IsMap() || node.size() == 0 || !node.begin()->first.IsScalar())
+    {
+        errorStream << "ERROR: Can't find Node name in YAML file ("
+            << fileName << "), line " << table.line;
+        table.error = errorStream.str();
+        return;
+    }
+    std::string &name = table.time.name;
+    name = node.begin()->first.as<std::string>();
+
+    try
+    {
+        DbArenaScope scope(arena, name);
+        if (name == "Crate")
+            convertYamlTable<DbCrateMapPtr>(node, table);
+        else if (name == "ApplicationType")
+            convertYamlTable<DbApplicationTypeMapPtr>(node, table);
+        else if (name == "ApplicationCard")
+            convertYamlTable<DbApplicationCardMapPtr>(node, table);
+        else if (name == "DigitalChannel" || name == "AnalogChannel")
+            convertYamlTable<DbChannelMapPtr>(node, table);
+        else if (name == "DeviceType")
+            convertYamlTable<DbDeviceTypeMapPtr>(node, table);
+        else if (name == "DeviceState")
+            convertYamlTable<DbDeviceStateMapPtr>(node, table);
+        else if (name == "DigitalDevice")
+            convertYamlTable<DbDigitalDeviceMapPtr>(node, table);
+        else if (name == "DeviceInput")
+            convertYamlTable<DbDeviceInputMapPtr>(node, table);
+        else if (name == "Fault")
+            convertYamlTable<DbFaultMapPtr>(node, table);
+        else if (name == "FaultInput")
+            convertYamlTable<DbFaultInputMapPtr>(node, table);
+        else if (name == "FaultState")
+            convertYamlTable<DbFaultStateMapPtr>(node, table);
+        else if (name == "AnalogDevice")
+            convertYamlTable<DbAnalogDeviceMapPtr>(node, table);
+        else if (name == "BeamDestination")
+            convertYamlTable<DbBeamDestinationMapPtr>(node, table);
+        else if (name == "BeamClass")
+            convertYamlTable<DbBeamClassMapPtr>(node, table);
+        else if (name == "AllowedClass")
+            convertYamlTable<DbAllowedClassMapPtr>(node, table);
+        else if (name == "Condition")
+            convertYamlTable<DbConditionMapPtr>(node, table);
+        else if (name == "IgnoreCondition")
+            convertYamlTable<DbIgnoreConditionMapPtr>(node, table);
+        else if (name == "ConditionInput")
+            convertYamlTable<DbConditionInputMapPtr>(node, table);
+        else if (name == "DatabaseInfo")
+            convertYamlTable<DbInfoMapPtr>(node, table);
+        else if (name != "MitigationDevice" && name != "LinkNode")
+        {
+            // MitigationDevice is not implemented, and LinkNode is known
+            // but not needed by the central node engine
+            errorStream << "ERROR: Unknown YAML node name ("
+                << name << ")";
+            table.error = errorStream.str();
         }
+    }
+    catch (DbException &e)
+    {
+        table.error = e.what();
+    }
+    catch (YAML::Exception &e)
+    {
+        errorStream << "ERROR: Failed to convert " << name
+            << " in YAML file (" << fileName << "): " << e.msg;
+        table.error = errorStream.str();
+    }
+    catch (std::exception &e)
+    {
+        errorStream << "ERROR: Failed to convert " << name
+            << " in YAML file (" << fileName << "): " << e.what();
+        table.error = errorStream.str();
+    }
+
+    table.time.convertTime = CycleCounter::toNs(CycleCounter::now() - parsed) / 1e9;
+}
+
+static void loadYamlTables(DbYamlLoad *load)
+{
+    for (uint32_t i = load->next++; i < load->tables.size(); i = load->next++)
+    {
+        loadYamlTable(load->fileName, load->arena, load->tables[i]);
+    }
+}
+
+/**
+ * Number of threads used by loadYaml(), 0 for one thread per core.
+ */
+void MpsDb::setYamlLoadThreads(uint32_t threads)
+{
+    _yamlLoadThreads = threads;
+}
+
+/**
+ * The MPS database YAML file is composed of several "tables"/"set of entries",
+ * one per YAML document. The file is split in documents, and each document
+ * is parsed and converted to its MpsDb map by a pool of worker threads (the
+ * tables are independent, they are only linked by configure()). The maps use
+ * the MPS database id as key.
+ *
+ * The maps are assigned in file order once all tables are loaded, and the
+ * first error in file order is thrown.
+ */
+void MpsDb::loadYaml(std::string yamlFileName)
+{
+    std::stringstream errorStream;
+    DbYamlLoad load;
+
+    LOG_TRACE("DATABASE", "Loading YAML from file " << yamlFileName);
+    std::ifstream file(yamlFileName.c_str(), std::ios::binary);
+    if (!file.is_open())
+    {
+        errorStream << "ERROR: Please check if YAML file is readable";
+        throw(DbException(errorStream.str()));
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (file.bad())
+    {
+        errorStream << "ERROR: Failed to load YAML file ("
+            << yamlFileName << ")";
+        throw(DbException(errorStream.str()));
+    }
+
+    load.fileName = yamlFileName;
+    load.arena = _arena;
+    load.next = 0;
+    splitYamlDocuments(text, load.tables);
+    std::string().swap(text);
+
+    uint32_t threads = _yamlLoadThreads;
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads > load.tables.size())
+        threads = load.tables.size();
+    if (threads == 0)
+        threads = 1;
+
+    LOG_TRACE("DATABASE", "Parsing " << load.tables.size() << " YAML tables with "
+        << threads << " threads");
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < threads; ++i)
+        workers.push_back(std::thread(loadYamlTables, &load));
+    loadYamlTables(&load);
+    for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+        it->join();
+
+    _yamlLoadThreadsUsed = threads;
+    _yamlTableTimes.clear();
+    for (std::vector<DbYamlTable>::iterator table = load.tables.begin();
+        table != load.tables.end();
+        ++table)
+    {
+        if (!table->error.empty())
+            throw(DbException(table->error));
+    }
+
+    for (std::vector<DbYamlTable>::iterator table = load.tables.begin();
+        table != load.tables.end();
+        ++table)
+    {
+        const std::string &nodeName = table->time.name;
+        if (!table->map)
+            continue;
+
+        _yamlTableTimes.push_back(table->time);
+
+        if (nodeName == "Crate")
+            crates = getYamlTable<DbCrateMap>(*table);
+        else if (nodeName == "ApplicationType")
+            applicationTypes = getYamlTable<DbApplicationTypeMap>(*table);
+        else if (nodeName == "ApplicationCard")
+            applicationCards = getYamlTable<DbApplicationCardMap>(*table);
+        else if (nodeName == "DigitalChannel")
+            digitalChannels = getYamlTable<DbChannelMap>(*table);
+        else if (nodeName == "AnalogChannel")
+            analogChannels = getYamlTable<DbChannelMap>(*table);
+        else if (nodeName == "DeviceType")
+            deviceTypes = getYamlTable<DbDeviceTypeMap>(*table);
+        else if (nodeName == "DeviceState")
+            deviceStates = getYamlTable<DbDeviceStateMap>(*table);
+        else if (nodeName == "DigitalDevice")
+            digitalDevices = getYamlTable<DbDigitalDeviceMap>(*table);
+        else if (nodeName == "DeviceInput")
+            deviceInputs = getYamlTable<DbDeviceInputMap>(*table);
+        else if (nodeName == "Fault")
+            faults = getYamlTable<DbFaultMap>(*table);
+        else if (nodeName == "FaultInput")
+            faultInputs = getYamlTable<DbFaultInputMap>(*table);
+        else if (nodeName == "FaultState")
+            faultStates = getYamlTable<DbFaultStateMap>(*table);
+        else if (nodeName == "AnalogDevice")
+            analogDevices = getYamlTable<DbAnalogDeviceMap>(*table);
+        else if (nodeName == "BeamDestination")
+            beamDestinations = getYamlTable<DbBeamDestinationMap>(*table);
         else if (nodeName == "BeamClass")
-        {
-            beamClasses = (*node).as<DbBeamClassMapPtr>();
-        }
+            beamClasses = getYamlTable<DbBeamClassMap>(*table);
         else if (nodeName == "AllowedClass")
-        {
-            allowedClasses = (*node).as<DbAllowedClassMapPtr>();
-        }
+            allowedClasses = getYamlTable<DbAllowedClassMap>(*table);
         else if (nodeName == "Condition")
-        {
-            conditions = (*node).as<DbConditionMapPtr>();
-        }
+            conditions = getYamlTable<DbConditionMap>(*table);
         else if (nodeName == "IgnoreCondition")
-        {
-            ignoreConditions = (*node).as<DbIgnoreConditionMapPtr>();
-        }
+            ignoreConditions = getYamlTable<DbIgnoreConditionMap>(*table);
         else if (nodeName == "ConditionInput")
-        {
-            conditionInputs = (*node).as<DbConditionInputMapPtr>();
-        }
+            conditionInputs = getYamlTable<DbConditionInputMap>(*table);
         else if (nodeName == "DatabaseInfo")
-        {
-            databaseInfo = (*node).as<DbInfoMapPtr>();
-        }
-        else
-        {
-            // Do not raise exception if the YAML node is known, but
-            // does not need to be loaded by central node engine
-            if (nodeName != "LinkNode")
-            {
-                errorStream << "ERROR: Unknown YAML node name ("
-                    << nodeName << ")";
-                throw(DbException(errorStream.str()));
-            }
-        }
+            databaseInfo = getYamlTable<DbInfoMap>(*table);
     }
 
-    setName(yamlFileName);
-
     // Zero out the buffer that holds the firmware configuration
     //  memset(fastConfigurationBuffer, 0, NUM_APPLICATIONS * APPLICATION_CONFIG_BUFFER_SIZE);
+}
 
-    return 0;
+/**
+ * Print the time taken to parse and convert each table of the YAML file by
+ * the last loadYaml(). The parse and convert times of the tables add up to
+ * more than the load time when several threads are used.
+ */
+void MpsDb::showYamlLoadTimes()
+{
+    double parseTime = 0;
+    double convertTime = 0;
+
+    std::cout << "YAML tables (" << _yamlTableTimes.size() << " tables, "
+              << _yamlLoadThreadsUsed << " threads):" << std::endl;
+    std::cout << "  " << std::left << std::setw(18) << "Table" << std::right
+              << std::setw(10) << "Rows" << std::setw(14) << "Parse [ms]"
+              << std::setw(14) << "Convert [ms]" << std::endl;
+    for (std::vector<DbYamlTableTime>::iterator it = _yamlTableTimes.begin();
+        it != _yamlTableTimes.end();
+        ++it)
+    {
+        std::cout << "  " << std::left << std::setw(18) << it->name << std::right
+                  << std::setw(10) << it->rows << std::fixed << std::setprecision(1)
+                  << std::setw(14) << it->parseTime * 1e3
+                  << std::setw(14) << it->convertTime * 1e3 << std::endl;
+        parseTime += it->parseTime;
+        convertTime += it->convertTime;
+    }
+    std::cout << "  " << std::left << std::setw(28) << "Total" << std::right
+              << std::setw(14) << parseTime * 1e3
+              << std::setw(14) << convertTime * 1e3 << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
 }
 
 /**
@@ -1520,6 +2496,13 @@ void MpsDb::showInfo()
     std::cout << "Update counter: " << _updateCounter << std::endl;
     std::cout << "Input update timeout " << _inputUpdateTimeout << " usec" << std::endl;
     std::cout << "Total devices configured: " << getTotalDeviceCount() << std::endl;
+    std::cout << "Loaded from " << (_loadedFromImage ? "compiled image" : "YAML")
+              << " in " << _loadTime * 1e3 << " ms, configured in "
+              << _configureTime * 1e3 << " ms" << std::endl;
+    if (!_loadedFromImage)
+        showYamlLoadTimes();
+    showConfigureTimes();
+    showMemory();
     printPCChangeInfo();
 
     printMap<DbInfoMapPtr, DbInfoMap::iterator>
@@ -1528,10 +2511,13 @@ void MpsDb::showInfo()
     _inputUpdateTime.show();
     fwUpdateTimer.show();
     mitigationTxTime.show();
-    AnalogDeviceUpdateTime.show();
-    DeviceInputUpdateTime.show();
-    AppCardDigitalUpdateTime.show();
-    AppCardAnalogUpdateTime.show();
+    std::cout << "Per input costs sampled 1 in " << CycleCounter::getSampling()
+              << (CycleCounter::usingTsc() ? " (TSC)" : " (CLOCK_MONOTONIC)") << std::endl;
+    AnalogDeviceUpdateTime.show("Analog Device update time");
+    DeviceInputUpdateTime.show("Device Input update time");
+    _appCardDigitalUpdateTime.show("Application Card (digital) update time");
+    _appCardAnalogUpdateTime.show("Application Card (analog) update time");
+    showSlowestCards(5);
 
     std::cout << "Max TimeStamp diff    : " << _maxDiff << std::endl;
     _maxDiff = 0;
@@ -1542,6 +2528,31 @@ void MpsDb::showInfo()
     std::cout << "Update Queue max size : " << fwUpdateQueue.get_max_size() << std::endl;
 }
 
+static bool compareCardUpdateTime(const DbApplicationCardPtr& a, const DbApplicationCardPtr& b)
+{
+    return a->updateTime.getMaxNs() > b->updateTime.getMaxNs();
+}
+
+/**
+ * Print the application cards with the highest maximum update time.
+ */
+void MpsDb::showSlowestCards(uint32_t count)
+{
+    std::vector<DbApplicationCardPtr> cards;
+    for (DbApplicationCardMap::iterator it = applicationCards->begin();
+        it != applicationCards->end(); ++it)
+        cards.push_back((*it).second);
+
+    uint32_t shown = std::min<size_t>(count, cards.size());
+    std::partial_sort(cards.begin(), cards.begin() + shown, cards.end(), compareCardUpdateTime);
+
+    std::cout << "--- Slowest application cards ---" << std::endl;
+    for (uint32_t i = 0; i < shown; ++i)
+        std::cout << cards[i]->name << " (Id: " << cards[i]->id << "): average "
+                  << cards[i]->updateTime.getMeanNs() / 1e3 << " us, maximum "
+                  << cards[i]->updateTime.getMaxNs() / 1e3 << " us" << std::endl;
+}
+
 void MpsDb::printPCChangeLastPacketInfo() const
 {
     std::cout << "Tag        : "   << _pcChangeTag << std::endl;
@@ -1724,6 +2735,10 @@ void MpsDb::fwUpdateReader()
         fwUpdateQueue.push(buffer);
         fwUpdateTimer.tick();
         fwUpdateTimer.start();
+
+        Metrics::getInstance().add(MetricFwUpdateFrames);
+        Metrics::getInstance().set(MetricFwUpdateTimeouts, _updateTimeoutCounter);
+        Metrics::getInstance().set(MetricFwUpdateLate, fwUpdateTimer.getBudgetViolations());
     }
 }
 
@@ -1734,6 +2749,10 @@ void MpsDb::fwPCChangeReader()
     // 1k buffer, more than enough for "pc_change_t".
     uint8_t buffer[1024];
 
+    // Last valid power class word, to detect firmware trips
+    uint64_t previousPowerClass { 0 };
+    bool havePreviousPowerClass { false };
+
     while(run)
     {
         int64_t got {0};
@@ -1796,12 +2815,25 @@ void MpsDb::fwPCChangeReader()
             if (!(errors & 0x01))
             {
                 uint64_t pcw { _pcChangePowerClass };
+                uint64_t previousPcw { previousPowerClass };
+                bool decreased { false };
                 for (std::size_t dest {0}; dest < NUM_DESTINATIONS; ++dest)
                 {
                     uint8_t pc { static_cast<uint8_t>( pcw & ( (1<<POWER_CLASS_BIT_SIZE) - 1) ) };
+                    uint8_t previousPc { static_cast<uint8_t>( previousPcw & ( (1<<POWER_CLASS_BIT_SIZE) - 1) ) };
                     ++_pcCounters[dest][pc];
+                    if (havePreviousPowerClass && pc < previousPc)
+                        decreased = true;
                     pcw >>= POWER_CLASS_BIT_SIZE;
+                    previousPcw >>= POWER_CLASS_BIT_SIZE;
                 }
+
+                // Firmware lowered the power class of a destination (trip)
+                if (decreased)
+                    PostMortem::getInstance().trigger(PostMortemFirmwareTrip);
+
+                previousPowerClass = _pcChangePowerClass;
+                havePreviousPowerClass = true;
             }
 
             // Print the received packet content if the debug flag is set
@@ -1828,6 +2860,13 @@ void MpsDb::fwPCChangeReader()
             // Increment bad size counter
             ++_pcChangeBadSizeCounter;
         }
+
+        Metrics &metrics = Metrics::getInstance();
+        metrics.set(MetricPcChangePackets, _pcChangeCounter);
+        metrics.set(MetricPcChangeLost, _pcChangeLossCounter);
+        metrics.set(MetricPcChangeOutOfOrder, _pcChangeOutOrderCounter);
+        metrics.set(MetricPcChangeSameTag, _pcChangeSameTagCounter);
+        metrics.set(MetricPcChangeBadSize, _pcChangeBadSizeCounter);
     }
 
     std::cout << "FW Power Class Change reader interrupted" << std::endl;
@@ -1860,6 +2899,11 @@ void MpsDb::mitigationWriter()
         mitigationTxTime.start();
         Firmware::getInstance().writeMitigation(*p);
         mitigationTxTime.tick();
+
+        Metrics &metrics = Metrics::getInstance();
+        metrics.add(MetricMitigationWrites);
+        metrics.setTime(MetricMitigationTxTime, mitigationTxTime.getLastPeriod());
+        metrics.setTime(MetricMitigationTxTimeMax, mitigationTxTime.getAllMaxPeriod());
     }
 }
 
@@ -2,6 +2,7 @@
 #define CENTRAL_NODE_DATABASE_H
 
 #include <map>
+#include <set>
 #include <exception>
 #include <iostream>
 #include <bitset>
@@ -21,20 +22,45 @@
 #include <thread>
 #include <mutex>
 
+/**
+ * Time taken to load one table (YAML document) of the database file
+ */
+typedef struct {
+  std::string name;
+  uint32_t rows;
+  double parseTime;    // Seconds to parse the document text
+  double convertTime;  // Seconds to convert the document to Db* objects
+} DbYamlTableTime;
+
+/**
+ * Time taken by one step of MpsDb::configure()
+ */
+typedef struct {
+  std::string name;
+  double time;         // Seconds
+} DbConfigureTime;
+
+class DbIndexes;
+class MpsDbDelta;
+
 /**
  * Class containing all YAML MPS configuration
  */
 class MpsDb {
  private:
   void setName(std::string yamlFileName);
-  void configureAllowedClasses();
-  void configureDeviceInputs();
-  void configureDeviceTypes();
-  void configureFaultInputs();
-  void configureFaultStates();
-  void configureAnalogDevices();
-  void configureIgnoreConditions();
-  void configureApplicationCards();
+  void loadYaml(std::string yamlFileName);
+  void buildIndexes(DbIndexes &index);
+  void configureAllowedClasses(const DbIndexes &index);
+  void configureDeviceInputs(const DbIndexes &index);
+  void configureDeviceTypes(const DbIndexes &index);
+  void configureFaultInputs(const DbIndexes &index);
+  void configureFastAnalogInput(DbFaultInputPtr input, DbAnalogDevicePtr device, DbFaultPtr fault);
+  void configureFastDigitalInput(DbFaultInputPtr input, DbDigitalDevicePtr device, DbFaultPtr fault);
+  void configureFaultStates(const DbIndexes &index);
+  void configureAnalogDevices(const DbIndexes &index);
+  void configureIgnoreConditions(const DbIndexes &index);
+  void configureApplicationCards(const DbIndexes &index);
   void configureBeamDestinations();
 
   /**
@@ -46,6 +72,14 @@ class MpsDb {
    */
   uint8_t fastConfigurationBuffer[NUM_APPLICATIONS * APPLICATION_CONFIG_BUFFER_SIZE_BYTES];
 
+  /**
+   * Application configurations built ahead of time (see
+   * stageFirmwareConfiguration()), same layout as fastConfigurationBuffer.
+   * They are copied to fastConfigurationBuffer only when written to the
+   * firmware, so the fingerprint always matches the running configuration.
+   */
+  uint8_t stagedConfigurationBuffer[NUM_APPLICATIONS * APPLICATION_CONFIG_BUFFER_SIZE_BYTES];
+
   /**
    * Memory that receives input updates from firmware/hardware. There are
    * up to 384 inputs bits per application, 2-bit per input indicating
@@ -65,7 +99,7 @@ class MpsDb {
   update_queue_t  fwUpdateQueue;
   std::mutex      fwUpdateBufferMutex;
 
-  static const uint32_t fwUpdateBuferSize = APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES + NUM_APPLICATIONS * APPLICATION_UPDATE_BUFFER_INPUTS_SIZE_BYTES;
+  static const uint32_t fwUpdateBuferSize = FW_UPDATE_BUFFER_SIZE_BYTES;
 
   boost::atomic<bool>     run;
 
@@ -102,6 +136,8 @@ class MpsDb {
   mit_queue_t  softwareMitigationQueue;
 
   Timer<double> _inputUpdateTime;
+  CycleStat _appCardDigitalUpdateTime;
+  CycleStat _appCardAnalogUpdateTime;
   bool _clearUpdateTime;
 
   Timer<double> fwUpdateTimer;
@@ -137,6 +173,33 @@ class MpsDb {
 
   Timer<double> mitigationTxTime;
 
+  // Incremented every time the full firmware configuration is written. Used
+  // to detect if card configurations staged ahead of time became stale.
+  uint32_t _fwConfigGeneration;
+
+  // Fingerprint of the configuration last written to the firmware, see
+  // computeFirmwareFingerprint()
+  uint64_t _fwFingerprint;
+  uint64_t computeFirmwareFingerprint();
+
+  // Directory of the compiled database images, see load()
+  static std::string _imageCacheDir;
+
+  bool   _loadedFromImage;
+  double _loadTime;       // Seconds taken by load()
+  double _configureTime;  // Seconds taken by configure()
+
+  // Number of threads converting the YAML tables, 0 for one per core
+  static uint32_t _yamlLoadThreads;
+
+  uint32_t _yamlLoadThreadsUsed;
+  std::vector<DbYamlTableTime> _yamlTableTimes;
+  std::vector<DbConfigureTime> _configureTimes;
+
+  // Memory of the entries, maps and strings of the loaded database,
+  // replaced by each load() (see DbArena)
+  DbArenaPtr _arena;
+
  public:
   DbBeamClassPtr lowestBeamClass;
   DbCrateMapPtr crates;
@@ -161,6 +224,8 @@ class MpsDb {
   DbInfoMapPtr databaseInfo;
 
   friend class FirmwareTest;
+  friend class ScalingBench;
+  friend class EngineBench;
   friend class Engine;
 
   // Name of the loaded YAML file
@@ -171,9 +236,22 @@ class MpsDb {
 
   MpsDb(uint32_t inputUpdateTimeout=3500);
   ~MpsDb();
-  int load(std::string yamlFile);
+  int load(std::string fileName);
   void configure();
 
+  static void setImageCacheDir(std::string dir);
+  bool isLoadedFromImage() const { return _loadedFromImage; };
+  double getLoadTime() const { return _loadTime; };
+  double getConfigureTime() const { return _configureTime; };
+
+  static void setYamlLoadThreads(uint32_t threads);
+  const std::vector<DbYamlTableTime> &getYamlTableTimes() const { return _yamlTableTimes; };
+  void showYamlLoadTimes();
+  const std::vector<DbConfigureTime> &getConfigureTimes() const { return _configureTimes; };
+  void showConfigureTimes();
+  DbArenaPtr getArena() const { return _arena; };
+  void showMemory();
+
   std::mutex *getMutex() { return &_mutex; };
 
   void showFastUpdateBuffer(uint32_t begin, uint32_t size);
@@ -181,6 +259,7 @@ class MpsDb {
   void showFault(DbFaultPtr fault);
   void showMitigation();
   void showInfo();
+  void showSlowestCards(uint32_t count);
   void printPCChangeInfo() const;
   void PCChangeSetDebug(bool debug);
   void printPCCounters() const;
@@ -189,6 +268,12 @@ class MpsDb {
   void softPermitDestination(uint32_t beamDestinationId, uint32_t beamClassId=CLEAR_BEAM_CLASS);
   void setMaxPermit(uint32_t beamClassId=6);
   void writeFirmwareConfiguration(bool enableTimeout = false);
+  void stageFirmwareConfiguration(const std::set<uint32_t> &cardIds, time_t expiredBy);
+  void writeStagedFirmwareConfiguration(const std::set<uint32_t> &cardIds);
+  void applyDelta(const MpsDbDelta &delta, std::set<uint32_t> &cardIds);
+  uint32_t getFwConfigGeneration() const { return _fwConfigGeneration; };
+  uint64_t getFirmwareFingerprint() const { return _fwFingerprint; };
+  bool matchFirmwareConfiguration(uint64_t fingerprint);
   void unlatchAll();
   void unlatchAllFaults();
   void clearMitigationBuffer();
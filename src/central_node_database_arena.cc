@@ -0,0 +1,362 @@
+#include <central_node_database_arena.h>
+
+#include <errno.h>
+#include <unistd.h>
+#include <iomanip>
+#include <sstream>
+#include <sys/mman.h>
+
+/**
+ * Empty string, used by default constructed DbStrings. The length is
+ * stored in front of the characters as for the interned strings.
+ */
+static const struct {
+  uint32_t size;
+  char str[4];
+} emptyString = { 0, "" };
+
+__thread DbArenaScope *DbArenaScope::_current = NULL;
+
+DbString::DbString() : _str(emptyString.str) {
+}
+
+DbString::DbString(const char *s) : _str(emptyString.str) {
+  *this = s;
+}
+
+DbString::DbString(const std::string &s) : _str(emptyString.str) {
+  *this = s;
+}
+
+DbString &DbString::operator=(const char *s) {
+  size_t size = strlen(s);
+  if (size == 0) {
+    _str = emptyString.str;
+    return *this;
+  }
+
+  DbArenaScope *scope = DbArenaScope::current();
+  DbArena *arena = scope ? scope->getArena().get() : DbArena::getDefault();
+  *this = arena->intern(s, size);
+  return *this;
+}
+
+DbString &DbString::operator=(const std::string &s) {
+  if (s.empty()) {
+    _str = emptyString.str;
+    return *this;
+  }
+
+  DbArenaScope *scope = DbArenaScope::current();
+  DbArena *arena = scope ? scope->getArena().get() : DbArena::getDefault();
+  *this = arena->intern(s.data(), s.size());
+  return *this;
+}
+
+std::ostream & operator<<(std::ostream &os, const DbString &s) {
+  os.write(s.c_str(), s.size());
+  return os;
+}
+
+DbArena::DbArena() : _regionCount(0), _stringCount(0), _stringBytes(0), _stringLookups(0),
+                     _sealed(false), _locked(false) {
+  _stringRegion = getRegion("Strings");
+}
+
+DbArena::~DbArena() {
+  for (std::vector<std::pair<char *, size_t> >::iterator it = _chunks.begin(); it != _chunks.end(); ++it) {
+    munmap(it->first, it->second);
+  }
+}
+
+/**
+ * Process wide arena for the strings assigned outside a DbArenaScope.
+ */
+DbArena *DbArena::getDefault() {
+  static DbArena *arena = new DbArena();
+  return arena;
+}
+
+/**
+ * Returns the index of the region with the given name, creating it if
+ * needed.
+ */
+uint32_t DbArena::getRegion(const std::string &name) {
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  for (uint32_t i = 0; i < _regionCount; ++i) {
+    if (_regions[i].name == name) {
+      return i;
+    }
+  }
+
+  if (_regionCount == DB_ARENA_MAX_REGIONS) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Too many database arena regions (" << name << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _regions[_regionCount].name = name;
+  return _regionCount++;
+}
+
+/**
+ * Map a new chunk. Chunks created after the arena is sealed are locked
+ * right away.
+ */
+char *DbArena::allocateChunk(size_t size) {
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size = (size + pageSize - 1) / pageSize * pageSize;
+
+  void *chunk = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (chunk == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+
+  std::unique_lock<std::mutex> lock(_chunkMutex);
+  _chunks.push_back(std::make_pair(static_cast<char *>(chunk), size));
+  if (_locked && mlock(chunk, size) != 0) {
+    _locked = false;
+  }
+
+  return static_cast<char *>(chunk);
+}
+
+/**
+ * Bump allocation in the current chunk of the region, the caller holds
+ * the region lock (the intern index lock for the string region).
+ */
+void *DbArena::allocateLocked(DbArenaRegion &region, size_t size, size_t align) {
+  char *p = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(region.next) + align - 1) & ~(uintptr_t)(align - 1));
+
+  if (region.next == NULL || p + size > region.end) {
+    size_t chunkSize = region.chunkSize;
+    if (chunkSize < DB_ARENA_MAX_CHUNK_SIZE) {
+      region.chunkSize *= 2;
+    }
+    if (chunkSize < size + align) {
+      chunkSize = size + align;
+    }
+
+    char *chunk = allocateChunk(chunkSize);
+    region.next = chunk;
+    region.end = chunk + chunkSize;
+    region.reserved += chunkSize;
+    p = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(chunk) + align - 1) & ~(uintptr_t)(align - 1));
+  }
+
+  region.next = p + size;
+  region.used += size;
+  region.allocations++;
+
+  return p;
+}
+
+/**
+ * Allocate from the region, or from the heap once the arena is sealed
+ * (see deallocate()).
+ */
+void *DbArena::allocate(uint32_t region, size_t size, size_t align) {
+  if (_sealed) {
+    return ::operator new(size);
+  }
+
+  std::unique_lock<std::mutex> lock(_regions[region].mutex);
+  return allocateLocked(_regions[region], size, align);
+}
+
+/**
+ * Free a block returned by allocate(). Heap blocks (allocated after the
+ * arena was sealed) are deleted, arena blocks are released with the
+ * arena.
+ */
+void DbArena::deallocate(void *p) {
+  if (!_sealed || contains(p)) {
+    return;
+  }
+  ::operator delete(p);
+}
+
+/**
+ * Check if a block belongs to one of the arena chunks.
+ */
+bool DbArena::contains(const void *p) {
+  const char *c = static_cast<const char *>(p);
+  std::unique_lock<std::mutex> lock(_chunkMutex);
+  for (std::vector<std::pair<char *, size_t> >::iterator it = _chunks.begin(); it != _chunks.end(); ++it) {
+    if (c >= it->first && c < it->first + it->second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Returns the pool entry for the given string, adding it if needed. Once
+ * the arena is sealed strings are no longer looked up, each one gets a
+ * new entry.
+ */
+DbString DbArena::intern(const char *s, size_t size) {
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  // Temporary pool entry for the lookup: length word followed by the text
+  std::vector<uint32_t> key((size + 1 + sizeof(uint32_t) * 2 - 1) / sizeof(uint32_t));
+  key[0] = size;
+  memcpy(&key[1], s, size);
+  DbString keyString;
+  keyString._str = reinterpret_cast<const char *>(&key[1]);
+
+  _stringLookups++;
+  if (!_sealed) {
+    std::set<DbString, DbStringLess>::iterator it = _strings.find(keyString);
+    if (it != _strings.end()) {
+      return *it;
+    }
+  }
+
+  char *entry = static_cast<char *>(allocateLocked(_regions[_stringRegion], sizeof(uint32_t) + size + 1,
+                                                   __alignof__(uint32_t)));
+  *reinterpret_cast<uint32_t *>(entry) = size;
+  memcpy(entry + sizeof(uint32_t), s, size);
+  entry[sizeof(uint32_t) + size] = '\0';
+
+  DbString string;
+  string._str = entry + sizeof(uint32_t);
+  if (!_sealed) {
+    _strings.insert(string);
+  }
+  _stringCount++;
+  _stringBytes += size + 1;
+
+  return string;
+}
+
+/**
+ * Unmap the pages past the last allocation of a region, the rest of its
+ * last chunk is not used once the database is loaded. The caller holds
+ * the region and chunk list locks.
+ */
+void DbArena::trimLocked(DbArenaRegion &region) {
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  char *tail = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(region.next) + pageSize - 1) & ~(uintptr_t)(pageSize - 1));
+  if (region.next == NULL || tail >= region.end) {
+    return;
+  }
+
+  for (std::vector<std::pair<char *, size_t> >::iterator it = _chunks.begin(); it != _chunks.end(); ++it) {
+    if (tail > it->first && tail < it->first + it->second) {
+      size_t size = it->first + it->second - tail;
+      munmap(tail, size);
+      it->second -= size;
+      region.reserved -= std::min(region.reserved, size);
+      region.end = tail;
+      return;
+    }
+  }
+}
+
+/**
+ * Called once the database is loaded and configured: drop the intern
+ * index and the unused end of the regions, then lock all chunks in
+ * memory, which also faults them in. If they can't be locked
+ * (RLIMIT_MEMLOCK) the chunks are prefaulted page by page instead.
+ */
+void DbArena::seal() {
+  std::set<DbString, DbStringLess> strings;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _sealed = true;
+    _strings.swap(strings);
+  }
+
+  // Same lock order as allocate(): region, then chunk list
+  for (uint32_t i = 0; i < _regionCount; ++i) {
+    std::unique_lock<std::mutex> regionLock(i == _stringRegion ? _mutex : _regions[i].mutex);
+    std::unique_lock<std::mutex> lock(_chunkMutex);
+    trimLocked(_regions[i]);
+  }
+
+  std::unique_lock<std::mutex> lock(_chunkMutex);
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  _locked = true;
+  for (std::vector<std::pair<char *, size_t> >::iterator it = _chunks.begin(); it != _chunks.end(); ++it) {
+    if (mlock(it->first, it->second) == 0) {
+      continue;
+    }
+
+    if (_locked) {
+      std::cerr << "WARN: DbArena::seal() failed to lock database memory ("
+                << strerror(errno) << "), prefaulting it" << std::endl;
+    }
+    _locked = false;
+    for (size_t offset = 0; offset < it->second; offset += pageSize) {
+      volatile char *page = it->first + offset;
+      *page = *page;
+    }
+  }
+}
+
+size_t DbArena::getUsedBytes() {
+  size_t used = 0;
+  for (uint32_t i = 0; i < _regionCount; ++i) {
+    used += _regions[i].used;
+  }
+  return used;
+}
+
+size_t DbArena::getReservedBytes() {
+  std::unique_lock<std::mutex> lock(_chunkMutex);
+  size_t reserved = 0;
+  for (std::vector<std::pair<char *, size_t> >::iterator it = _chunks.begin(); it != _chunks.end(); ++it) {
+    reserved += it->second;
+  }
+  return reserved;
+}
+
+/**
+ * Memory accounting per region: number of allocations (entries, map nodes
+ * and reference counts, or strings), bytes used and bytes of the chunks
+ * mapped for the region.
+ */
+void DbArena::showMemory() {
+  std::cout << "Database memory (" << _chunks.size() << " chunks"
+            << (_sealed ? ", sealed" : "") << (_locked ? ", locked" : "") << "):" << std::endl;
+  std::cout << "  " << std::left << std::setw(18) << "Region" << std::right
+            << std::setw(12) << "Allocations" << std::setw(14) << "Used [kB]"
+            << std::setw(14) << "Mapped [kB]" << std::endl;
+
+  uint64_t allocations = 0;
+  size_t used = 0;
+  size_t reserved = 0;
+  std::cout << std::fixed << std::setprecision(1);
+  for (uint32_t i = 0; i < _regionCount; ++i) {
+    DbArenaRegion &region = _regions[i];
+    if (region.allocations == 0) {
+      continue;
+    }
+    std::cout << "  " << std::left << std::setw(18) << region.name << std::right
+              << std::setw(12) << region.allocations
+              << std::setw(14) << region.used / 1024.0
+              << std::setw(14) << region.reserved / 1024.0 << std::endl;
+    allocations += region.allocations;
+    used += region.used;
+    reserved += region.reserved;
+  }
+  std::cout << "  " << std::left << std::setw(18) << "Total" << std::right
+            << std::setw(12) << allocations
+            << std::setw(14) << used / 1024.0
+            << std::setw(14) << reserved / 1024.0 << std::endl;
+  std::cout << "  Strings: " << _stringCount << " stored (" << _stringBytes / 1024.0
+            << " kB), " << _stringLookups << " interned" << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+  std::cout << std::setprecision(6);
+}
+
+DbArenaScope::DbArenaScope(DbArenaPtr arena, const std::string &region) :
+  _arena(arena), _region(arena->getRegion(region)), _previous(_current) {
+  _current = this;
+}
+
+DbArenaScope::~DbArenaScope() {
+  _current = _previous;
+}
@@ -0,0 +1,281 @@
+#ifndef CENTRAL_NODE_DATABASE_ARENA_H
+#define CENTRAL_NODE_DATABASE_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <exception>
+#include <central_node_exception.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+/**
+ * Size of the first chunk of each arena region. The following chunks of
+ * a region double in size up to DB_ARENA_MAX_CHUNK_SIZE, so small tables
+ * use little memory and large tables few chunks.
+ */
+const size_t DB_ARENA_MIN_CHUNK_SIZE = 64 * 1024;
+const size_t DB_ARENA_MAX_CHUNK_SIZE = 4 * 1024 * 1024;
+const uint32_t DB_ARENA_MAX_REGIONS = 32;
+
+class DbArena;
+typedef boost::shared_ptr<DbArena> DbArenaPtr;
+
+/**
+ * Database string (entry name or description), interned in the string
+ * pool of the DbArena of the database being loaded. Equal strings of the
+ * same database share the pool entry, and a DbString is a single pointer
+ * to it (the length is stored in front of the characters).
+ *
+ * Strings assigned outside a DbArenaScope (e.g. objects built by tests)
+ * are interned in a process wide pool that is never freed.
+ */
+class DbString {
+ public:
+  DbString();
+  explicit DbString(const char *s);
+  explicit DbString(const std::string &s);
+  DbString &operator=(const char *s);
+  DbString &operator=(const std::string &s);
+
+  const char *c_str() const { return _str; }
+  uint32_t size() const { return reinterpret_cast<const uint32_t *>(_str)[-1]; }
+  bool empty() const { return size() == 0; }
+  std::string str() const { return std::string(_str, size()); }
+  operator std::string() const { return str(); }
+
+  bool operator==(const DbString &other) const {
+    return _str == other._str || (size() == other.size() && memcmp(_str, other._str, size()) == 0);
+  }
+  bool operator==(const std::string &other) const {
+    return size() == other.size() && memcmp(_str, other.data(), size()) == 0;
+  }
+  bool operator==(const char *other) const { return strcmp(_str, other) == 0; }
+  bool operator!=(const DbString &other) const { return !(*this == other); }
+  bool operator!=(const std::string &other) const { return !(*this == other); }
+  bool operator!=(const char *other) const { return !(*this == other); }
+
+  friend std::ostream & operator<<(std::ostream &os, const DbString &s);
+
+ private:
+  friend class DbArena;
+  const char *_str;
+};
+
+/**
+ * Orders DbStrings by content, used by the DbArena intern index.
+ */
+class DbStringLess {
+ public:
+  bool operator()(const DbString &a, const DbString &b) const {
+    int diff = memcmp(a.c_str(), b.c_str(), std::min(a.size(), b.size()));
+    return diff < 0 || (diff == 0 && a.size() < b.size());
+  }
+};
+
+/**
+ * One named part of a DbArena, usually the entries (and map nodes) of one
+ * database table. Each region bumps through its own chunks, so the entries
+ * of a table are contiguous and tables loaded by different threads do not
+ * share a lock.
+ */
+class DbArenaRegion {
+ public:
+  std::string name;
+  std::mutex mutex;
+  char *next;
+  char *end;
+  size_t chunkSize;
+  uint64_t allocations;
+  size_t used;
+  size_t reserved;
+
+  DbArenaRegion() : next(NULL), end(NULL), chunkSize(DB_ARENA_MIN_CHUNK_SIZE),
+    allocations(0), used(0), reserved(0) {}
+};
+
+/**
+ * Memory of one loaded MpsDb. All Db* entries, the nodes of the Db* maps
+ * and the entry strings are allocated from the arena while a DbArenaScope
+ * is active (see MpsDb::load() and MpsDb::configure()).
+ *
+ * Memory is never returned to the arena: deallocations of arena blocks
+ * are ignored and the chunks are unmapped together when the arena is
+ * destroyed, which happens when the last entry or map referencing it is
+ * released (every DbArenaAllocator holds a reference).
+ *
+ * Once the database is configured the arena is sealed: its chunks are
+ * prefaulted and locked in memory, and the intern index (only needed
+ * while loading) is released. Entries and map nodes allocated after that
+ * (e.g. by MpsDb::applyDelta()) come from the heap and are freed when
+ * released, so updates do not keep growing the locked arena. Strings
+ * interned after the seal are still stored in the arena.
+ */
+class DbArena {
+ public:
+  DbArena();
+  ~DbArena();
+
+  uint32_t getRegion(const std::string &name);
+  void *allocate(uint32_t region, size_t size, size_t align);
+  void deallocate(void *p);
+  bool contains(const void *p);
+  DbString intern(const char *s, size_t size);
+  void seal();
+
+  bool isSealed() const { return _sealed; }
+  bool isLocked() const { return _locked; }
+  size_t getUsedBytes();
+  size_t getReservedBytes();
+
+  void showMemory();
+
+  static DbArena *getDefault();
+
+ private:
+  DbArenaRegion _regions[DB_ARENA_MAX_REGIONS];
+  uint32_t _regionCount;
+  uint32_t _stringRegion;
+  std::mutex _mutex; // Protects the region list and the intern index
+
+  std::mutex _chunkMutex; // Protects the chunk list
+  std::vector<std::pair<char *, size_t> > _chunks;
+  std::set<DbString, DbStringLess> _strings;
+  uint64_t _stringCount;
+  uint64_t _stringBytes;
+  uint64_t _stringLookups;
+
+  std::atomic<bool> _sealed;
+  bool _locked;
+
+  char *allocateChunk(size_t size);
+  void *allocateLocked(DbArenaRegion &region, size_t size, size_t align);
+  void trimLocked(DbArenaRegion &region);
+};
+
+/**
+ * Selects the arena region used by the DbArenaAllocators created by this
+ * thread while the scope is alive. Scopes may be nested, the previous
+ * scope is restored when the inner one is destroyed.
+ */
+class DbArenaScope {
+ public:
+  DbArenaScope(DbArenaPtr arena, const std::string &region);
+  ~DbArenaScope();
+
+  DbArenaPtr getArena() const { return _arena; }
+  uint32_t getRegion() const { return _region; }
+
+  static DbArenaScope *current() { return _current; }
+
+ private:
+  DbArenaPtr _arena;
+  uint32_t _region;
+  DbArenaScope *_previous;
+
+  static __thread DbArenaScope *_current;
+};
+
+/**
+ * Allocator for the Db* entries and maps. A default constructed allocator
+ * uses the region of the current DbArenaScope, or the heap if there is
+ * none; copies (and rebinds) keep the same region.
+ */
+template<class T>
+class DbArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template<class U>
+  struct rebind {
+    typedef DbArenaAllocator<U> other;
+  };
+
+  DbArenaAllocator() : _region(0) {
+    DbArenaScope *scope = DbArenaScope::current();
+    if (scope) {
+      _arena = scope->getArena();
+      _region = scope->getRegion();
+    }
+  }
+
+  template<class U>
+  DbArenaAllocator(const DbArenaAllocator<U> &other) :
+    _arena(other._arena), _region(other._region) {
+  }
+
+  pointer allocate(size_type n, const void * = 0) {
+    if (!_arena) {
+      return static_cast<pointer>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<pointer>(_arena->allocate(_region, n * sizeof(T), __alignof__(T)));
+  }
+
+  void deallocate(pointer p, size_type) {
+    if (!_arena) {
+      ::operator delete(p);
+    }
+    else {
+      _arena->deallocate(p);
+    }
+  }
+
+  void construct(pointer p, const T &value) { new (p) T(value); }
+  void destroy(pointer p) { p->~T(); }
+  size_type max_size() const { return size_t(-1) / sizeof(T); }
+  pointer address(reference r) const { return &r; }
+  const_pointer address(const_reference r) const { return &r; }
+
+  template<class U>
+  bool operator==(const DbArenaAllocator<U> &other) const {
+    return _arena == other._arena && _region == other._region;
+  }
+
+  template<class U>
+  bool operator!=(const DbArenaAllocator<U> &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  template<class U> friend class DbArenaAllocator;
+
+  DbArenaPtr _arena;
+  uint32_t _region;
+};
+
+/**
+ * Map of database entries by id, with nodes allocated from the arena.
+ */
+template<class EntryPtr>
+class DbArenaMap {
+ public:
+  typedef std::map<uint32_t, EntryPtr, std::less<uint32_t>,
+                   DbArenaAllocator<std::pair<const uint32_t, EntryPtr> > > type;
+};
+
+/**
+ * Creates a database entry in the current arena region; the entry and its
+ * reference count share one allocation.
+ */
+template<class T>
+boost::shared_ptr<T> dbArenaNew() {
+  return boost::allocate_shared<T>(DbArenaAllocator<T>());
+}
+
+#endif
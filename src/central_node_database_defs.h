@@ -65,6 +65,15 @@ const uint32_t APPLICATION_UPDATE_BUFFER_INPUTS_SIZE =
   (APPLICATION_UPDATE_BUFFER_64BITS + APPLICATION_UPDATE_BUFFER_128BITS) * 2;
 const uint32_t APPLICATION_UPDATE_BUFFER_INPUTS_SIZE_BYTES = APPLICATION_UPDATE_BUFFER_INPUTS_SIZE / 8;
 
+// Size of a whole firmware update frame (header plus all applications)
+const uint32_t FW_UPDATE_BUFFER_SIZE_BYTES =
+  APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES +
+  NUM_APPLICATIONS * APPLICATION_UPDATE_BUFFER_INPUTS_SIZE_BYTES;
+
+// Nominal period of the firmware updates / evaluation cycle (360 Hz),
+// used as the budget for the cycle timers
+const double EVALUATION_CYCLE_PERIOD = 1.0 / 360;
+
 const uint32_t POWER_CLASS_BIT_SIZE = 4;
 const uint32_t DESTINATION_MASK_BIT_SIZE = 16;
 const uint32_t NUM_DESTINATIONS = 16;
@@ -0,0 +1,381 @@
+#include <central_node_database_delta.h>
+#include <central_node_database_tables.h>
+#include <central_node_database.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <map>
+
+static const char *kindName[] = { "added", "removed", "modified" };
+
+/**
+ * Rows of one table of an encoded database, by id. DatabaseInfo rows have
+ * no id field, they are keyed by row index.
+ */
+typedef std::map<uint32_t, const uint32_t *> DbDeltaRowMap;
+
+static void mapRows(const DbImageWriter &w, uint32_t firstTable, uint32_t lastTable,
+                    uint32_t table, DbDeltaRowMap &rows) {
+  const std::vector<DbImageTable> &tables = w.getTables();
+  for (uint32_t t = firstTable; t < lastTable; ++t) {
+    if (tables[t].table != table || tables[t].rowCount == 0) {
+      continue;
+    }
+    const uint32_t *word = &w.getWords()[0] + tables[t].offset;
+    for (uint32_t i = 0; i < tables[t].rowCount; ++i, word += tables[t].fieldCount) {
+      rows[table == DbImageDatabaseInfo ? i : word[0]] = word;
+    }
+  }
+}
+
+static std::string getMd5sum(MpsDb *db) {
+  if (db->databaseInfo && !db->databaseInfo->empty()) {
+    return db->databaseInfo->begin()->second->md5sum;
+  }
+  return "";
+}
+
+MpsDbDelta::MpsDbDelta() {
+}
+
+/**
+ * Compute the delta from database 'from' to database 'to', both loaded
+ * (not necessarily configured). Both versions are encoded in the same
+ * DbImageWriter so their rows, strings included, are compared word by
+ * word.
+ */
+void MpsDbDelta::diff(MpsDb *from, MpsDb *to) {
+  DbImageWriter w;
+  MpsDbImage::encode(from, w);
+  uint32_t fromTables = w.getTables().size();
+  MpsDbImage::encode(to, w);
+  uint32_t toTables = w.getTables().size();
+
+  _fromMd5sum = getMd5sum(from);
+  _toMd5sum = getMd5sum(to);
+  _rows.clear();
+
+  // New rows are encoded again in a writer of their own, so the delta
+  // only keeps the strings it uses
+  DbImageWriter out;
+  for (uint32_t table = 0; table < DB_IMAGE_TABLE_COUNT; ++table) {
+    DbDeltaRowMap fromRows;
+    DbDeltaRowMap toRows;
+    mapRows(w, 0, fromTables, table, fromRows);
+    mapRows(w, fromTables, toTables, table, toRows);
+
+    uint32_t fieldCount = MpsDbImage::getFieldCount(table);
+    bool begun = false;
+    DbDeltaRowMap::iterator f = fromRows.begin();
+    DbDeltaRowMap::iterator t = toRows.begin();
+    while (f != fromRows.end() || t != toRows.end()) {
+      DbDeltaRow row;
+      row.table = table;
+      row.changedFields = 0;
+      row.offset = 0;
+
+      const uint32_t *newRow = NULL;
+      if (t == toRows.end() || (f != fromRows.end() && f->first < t->first)) {
+        row.kind = DbDeltaRemoved;
+        row.id = f->first;
+        ++f;
+      }
+      else if (f == fromRows.end() || t->first < f->first) {
+        row.kind = DbDeltaAdded;
+        row.id = t->first;
+        newRow = t->second;
+        ++t;
+      }
+      else {
+        for (uint32_t i = 0; i < fieldCount; ++i) {
+          if (f->second[i] != t->second[i]) {
+            row.changedFields |= 1 << i;
+          }
+        }
+        row.kind = DbDeltaModified;
+        row.id = t->first;
+        newRow = t->second;
+        ++f;
+        ++t;
+        if (row.changedFields == 0) {
+          continue;
+        }
+      }
+
+      if (newRow) {
+        if (!begun) {
+          out.begin(static_cast<DbImageTableId>(table));
+          begun = true;
+        }
+        row.offset = out.getWords().size();
+        uint32_t stringFields = MpsDbImage::getStringFields(table);
+        for (uint32_t i = 0; i < fieldCount; ++i) {
+          if (stringFields & (1 << i)) {
+            out.put(std::string(w.getPool().c_str() + newRow[i]));
+          }
+          else {
+            out.put(newRow[i]);
+          }
+        }
+      }
+      _rows.push_back(row);
+    }
+    if (begun) {
+      out.end();
+    }
+  }
+
+  _words = out.getWords();
+  _pool = out.getPool();
+}
+
+/**
+ * Write the delta to a temporary file and rename it, as for the images.
+ */
+void MpsDbDelta::write(std::string fileName) {
+  std::stringstream errorStream;
+
+  DbDeltaHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = DB_DELTA_MAGIC;
+  header.version = DB_DELTA_VERSION;
+  header.rowCount = _rows.size();
+  header.rowOffset = sizeof(DbDeltaHeader);
+  header.wordOffset = header.rowOffset + _rows.size() * sizeof(DbDeltaRow);
+  header.wordCount = _words.size();
+  header.stringOffset = header.wordOffset + _words.size() * sizeof(uint32_t);
+  header.stringSize = _pool.size();
+  header.size = header.stringOffset + header.stringSize;
+  strncpy(header.fromMd5sum, _fromMd5sum.c_str(), DB_IMAGE_MD5SUM_SIZE - 1);
+  strncpy(header.toMd5sum, _toMd5sum.c_str(), DB_IMAGE_MD5SUM_SIZE - 1);
+
+  header.hash = DB_IMAGE_HASH_INIT;
+  if (!_rows.empty()) {
+    header.hash = dbImageHash(header.hash, &_rows[0], _rows.size() * sizeof(DbDeltaRow));
+  }
+  if (!_words.empty()) {
+    header.hash = dbImageHash(header.hash, &_words[0], _words.size() * sizeof(uint32_t));
+  }
+  header.hash = dbImageHash(header.hash, _pool.data(), _pool.size());
+
+  std::stringstream tmpName;
+  tmpName << fileName << ".tmp." << getpid();
+  std::ofstream out(tmpName.str().c_str(), std::ios::binary | std::ios::trunc);
+  if (!out) {
+    errorStream << "ERROR: Failed to create database delta " << tmpName.str()
+                << " (" << strerror(errno) << ")";
+    throw(DbException(errorStream.str()));
+  }
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (!_rows.empty()) {
+    out.write(reinterpret_cast<const char *>(&_rows[0]), _rows.size() * sizeof(DbDeltaRow));
+  }
+  if (!_words.empty()) {
+    out.write(reinterpret_cast<const char *>(&_words[0]), _words.size() * sizeof(uint32_t));
+  }
+  out.write(_pool.data(), _pool.size());
+  out.close();
+
+  if (!out || rename(tmpName.str().c_str(), fileName.c_str()) != 0) {
+    unlink(tmpName.str().c_str());
+    errorStream << "ERROR: Failed to write database delta " << fileName;
+    throw(DbException(errorStream.str()));
+  }
+}
+
+/**
+ * Read and validate a delta file. The delta is left untouched if the file
+ * is invalid.
+ */
+void MpsDbDelta::read(std::string fileName) {
+  std::stringstream errorStream;
+
+  std::ifstream in(fileName.c_str(), std::ios::binary);
+  if (!in) {
+    errorStream << "ERROR: Failed to open database delta " << fileName
+                << " (" << strerror(errno) << ")";
+    throw(DbException(errorStream.str()));
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  std::string error;
+  DbDeltaHeader header;
+  if (data.size() < sizeof(DbDeltaHeader)) {
+    error = "too short";
+  }
+  else {
+    memcpy(&header, &data[0], sizeof(header));
+    header.fromMd5sum[DB_IMAGE_MD5SUM_SIZE - 1] = '\0';
+    header.toMd5sum[DB_IMAGE_MD5SUM_SIZE - 1] = '\0';
+    if (header.magic != DB_DELTA_MAGIC) {
+      error = "not a database delta";
+    }
+    else if (header.version != DB_DELTA_VERSION) {
+      error = "unsupported version";
+    }
+    else if (header.size != data.size() || header.rowOffset != sizeof(DbDeltaHeader) ||
+             header.wordOffset != header.rowOffset + static_cast<uint64_t>(header.rowCount) * sizeof(DbDeltaRow) ||
+             header.stringOffset != header.wordOffset + static_cast<uint64_t>(header.wordCount) * sizeof(uint32_t) ||
+             static_cast<uint64_t>(header.stringOffset) + header.stringSize != header.size ||
+             header.stringSize == 0 || data[header.size - 1] != '\0') {
+      error = "invalid layout";
+    }
+    else if (dbImageHash(DB_IMAGE_HASH_INIT, &data[sizeof(DbDeltaHeader)], header.size - sizeof(DbDeltaHeader)) != header.hash) {
+      error = "checksum mismatch";
+    }
+  }
+
+  std::vector<DbDeltaRow> rows;
+  std::vector<uint32_t> words;
+  if (error.empty()) {
+    rows.resize(header.rowCount);
+    words.resize(header.wordCount);
+    if (!rows.empty()) {
+      memcpy(&rows[0], &data[header.rowOffset], rows.size() * sizeof(DbDeltaRow));
+    }
+    if (!words.empty()) {
+      memcpy(&words[0], &data[header.wordOffset], words.size() * sizeof(uint32_t));
+    }
+  }
+
+  for (uint32_t i = 0; error.empty() && i < rows.size(); ++i) {
+    const DbDeltaRow &row = rows[i];
+    uint32_t fieldCount = MpsDbImage::getFieldCount(row.table);
+    if (row.table >= DB_IMAGE_TABLE_COUNT || row.kind > DbDeltaModified) {
+      error = "invalid row";
+      break;
+    }
+    if (row.kind == DbDeltaRemoved) {
+      continue;
+    }
+    if (static_cast<uint64_t>(row.offset) + fieldCount > words.size()) {
+      error = "invalid row";
+      break;
+    }
+    uint32_t stringFields = MpsDbImage::getStringFields(row.table);
+    for (uint32_t f = 0; f < fieldCount; ++f) {
+      if ((stringFields & (1 << f)) && words[row.offset + f] >= header.stringSize) {
+        error = "invalid string reference";
+      }
+    }
+  }
+
+  if (!error.empty()) {
+    errorStream << "ERROR: Database delta " << fileName << ": " << error;
+    throw(DbException(errorStream.str()));
+  }
+
+  _fromMd5sum = header.fromMd5sum;
+  _toMd5sum = header.toMd5sum;
+  _rows.swap(rows);
+  _words.swap(words);
+  _pool.assign(&data[header.stringOffset], header.stringSize);
+}
+
+uint32_t MpsDbDelta::getWord(const DbDeltaRow &row, uint32_t field) const {
+  return _words[row.offset + field];
+}
+
+std::string MpsDbDelta::getString(const DbDeltaRow &row, uint32_t field) const {
+  return std::string(_pool.c_str() + _words[row.offset + field]);
+}
+
+/**
+ * Check if the delta can be applied to the live database. If not, 'reason'
+ * tells about the first change that requires the database to be reloaded.
+ *
+ * Allowed classes and ignore conditions may be added, removed or modified.
+ * Conditions may be modified (mask and text). For all other tables only
+ * the text fields of existing rows may change.
+ */
+bool MpsDbDelta::isPatchable(std::string &reason) const {
+  for (std::vector<DbDeltaRow>::const_iterator row = _rows.begin(); row != _rows.end(); ++row) {
+    switch (row->table) {
+    case DbImageAllowedClass:
+    case DbImageIgnoreCondition:
+    case DbImageDatabaseInfo:
+      continue;
+    case DbImageCondition:
+      if (row->kind == DbDeltaModified) {
+        continue;
+      }
+      break;
+    default:
+      if (row->kind == DbDeltaModified &&
+          (row->changedFields & ~MpsDbImage::getStringFields(row->table)) == 0) {
+        continue;
+      }
+      break;
+    }
+
+    std::stringstream s;
+    s << MpsDbImage::getTableName(row->table) << " " << row->id << " " << kindName[row->kind];
+    if (row->kind == DbDeltaModified) {
+      s << " (fields 0x" << std::hex << row->changedFields << std::dec << ")";
+    }
+
+    switch (row->table) {
+    case DbImageCrate:
+    case DbImageApplicationType:
+    case DbImageApplicationCard:
+      s << ": application card topology changed";
+      break;
+    case DbImageDigitalChannel:
+    case DbImageAnalogChannel:
+    case DbImageDeviceInput:
+    case DbImageDigitalDevice:
+    case DbImageAnalogDevice:
+      s << ": device inputs changed, bypass slots are assigned at load time";
+      break;
+    case DbImageBeamDestination:
+    case DbImageBeamClass:
+      s << ": beam destinations and classes are fixed at load time";
+      break;
+    default:
+      s << ": fault topology changed";
+      break;
+    }
+    s << ", the database must be reloaded";
+    reason = s.str();
+    return false;
+  }
+
+  reason = "";
+  return true;
+}
+
+void MpsDbDelta::show(std::ostream &os) const {
+  os << "Database delta " << (_fromMd5sum.empty() ? "(no md5sum)" : _fromMd5sum)
+     << " -> " << (_toMd5sum.empty() ? "(no md5sum)" : _toMd5sum)
+     << ": " << _rows.size() << " rows" << std::endl;
+
+  uint32_t count[DB_IMAGE_TABLE_COUNT][3];
+  memset(count, 0, sizeof(count));
+  for (std::vector<DbDeltaRow>::const_iterator row = _rows.begin(); row != _rows.end(); ++row) {
+    count[row->table][row->kind]++;
+  }
+
+  for (uint32_t table = 0; table < DB_IMAGE_TABLE_COUNT; ++table) {
+    if (count[table][DbDeltaAdded] + count[table][DbDeltaRemoved] + count[table][DbDeltaModified] == 0) {
+      continue;
+    }
+    os << "  " << MpsDbImage::getTableName(table) << ": "
+       << count[table][DbDeltaAdded] << " added, "
+       << count[table][DbDeltaRemoved] << " removed, "
+       << count[table][DbDeltaModified] << " modified" << std::endl;
+  }
+
+  std::string reason;
+  if (isPatchable(reason)) {
+    os << "Can be applied in place" << std::endl;
+  }
+  else {
+    os << "Can't be applied in place: " << reason << std::endl;
+  }
+}
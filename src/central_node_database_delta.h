@@ -0,0 +1,96 @@
+#ifndef CENTRAL_NODE_DATABASE_DELTA_H
+#define CENTRAL_NODE_DATABASE_DELTA_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <central_node_database_image.h>
+
+class MpsDb;
+
+/**
+ * MPS database delta
+ *
+ * Rows added, removed and modified between two versions of the database,
+ * computed by MpsDbDelta::diff() from the compiled image encoding of both
+ * versions (see MpsDbImage). A delta is applied to the live database by
+ * Engine::applyDelta() at a cycle boundary, without reloading it.
+ *
+ *   DbDeltaHeader                                    (offset 0)
+ *   'rowCount' x DbDeltaRow                          (offset 'rowOffset')
+ *   new row values, 'wordCount' uint32_t words       (offset 'wordOffset')
+ *   string pool, NUL terminated strings              (offset 'stringOffset')
+ *
+ * Rows are identified by table and database id (the first field of the
+ * row, the row index for DatabaseInfo). Added and modified rows carry the
+ * new row, encoded as in the image; 'changedFields' has bit n set when
+ * field n of a modified row differs.
+ *
+ * Only some changes can be applied in place, see isPatchable(): allowed
+ * classes, ignore conditions, condition masks and the text fields (names,
+ * descriptions) of any table. Anything that changes the application
+ * cards, the devices or their inputs (and so the bypass slots) requires
+ * the database to be reloaded.
+ */
+const uint64_t DB_DELTA_MAGIC = 0x41544C454453504DULL; // "MPSDELTA"
+const uint32_t DB_DELTA_VERSION = 1;
+const char DB_DELTA_EXTENSION[] = ".mpsdelta";
+
+enum DbDeltaKind {
+  DbDeltaAdded = 0,
+  DbDeltaRemoved,
+  DbDeltaModified
+};
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t size;              // Total size of the delta
+  uint32_t rowCount;
+  uint32_t rowOffset;
+  uint32_t wordOffset;
+  uint32_t wordCount;
+  uint32_t stringOffset;
+  uint32_t stringSize;
+  uint64_t hash;              // FNV-1a hash of the delta after the header
+  char fromMd5sum[DB_IMAGE_MD5SUM_SIZE]; // DatabaseInfo md5sum of the old version
+  char toMd5sum[DB_IMAGE_MD5SUM_SIZE];   // DatabaseInfo md5sum of the new version
+} DbDeltaHeader;
+
+typedef struct {
+  uint32_t table;             // DbImageTableId
+  uint32_t kind;              // DbDeltaKind
+  uint32_t id;
+  uint32_t changedFields;     // Modified rows only
+  uint32_t offset;            // First word of the new row, unused for removed rows
+} DbDeltaRow;
+
+class MpsDbDelta {
+ private:
+  std::string _fromMd5sum;
+  std::string _toMd5sum;
+  std::vector<DbDeltaRow> _rows;
+  std::vector<uint32_t> _words;
+  std::string _pool;
+
+ public:
+  MpsDbDelta();
+
+  void diff(MpsDb *from, MpsDb *to);
+  void write(std::string fileName);
+  void read(std::string fileName);
+
+  bool isPatchable(std::string &reason) const;
+  void show(std::ostream &os) const;
+
+  bool empty() const { return _rows.empty(); }
+  const std::string &getFromMd5sum() const { return _fromMd5sum; }
+  const std::string &getToMd5sum() const { return _toMd5sum; }
+  const std::vector<DbDeltaRow> &getRows() const { return _rows; }
+
+  uint32_t getWord(const DbDeltaRow &row, uint32_t field) const;
+  std::string getString(const DbDeltaRow &row, uint32_t field) const;
+};
+
+#endif
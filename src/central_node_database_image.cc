@@ -0,0 +1,1014 @@
+#include <central_node_database_image.h>
+#include <central_node_database_tables.h>
+#include <central_node_database.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Row layout of each table, in DbImageTableId order: number of uint32_t
+ * words, which of them are string pool offsets (bit n set for field n)
+ * and the table name. Must match the put()/get() sequences below, a
+ * change to any row layout requires a new DB_IMAGE_VERSION.
+ */
+typedef struct {
+  uint32_t fieldCount;
+  uint32_t stringFields;
+  const char *name;       // Table name, also the arena region of its entries
+} DbImageRowLayout;
+
+static const DbImageRowLayout rowLayout[DB_IMAGE_TABLE_COUNT] = {
+  { 4, 0x00, "Crate" },
+  { 7, 0x40, "ApplicationType" }, // description
+  { 8, 0xC0, "ApplicationCard" }, // name, description
+  { 4, 0x08, "DigitalChannel" }, // name
+  { 4, 0x08, "AnalogChannel" }, // name
+  { 3, 0x02, "DeviceType" }, // name
+  { 5, 0x10, "DeviceState" }, // name
+  { 6, 0x0C, "DigitalDevice" }, // name, description
+  { 6, 0x00, "DeviceInput" },
+  { 3, 0x06, "Fault" }, // name, description
+  { 4, 0x00, "FaultInput" },
+  { 4, 0x00, "FaultState" },
+  { 7, 0x18, "AnalogDevice" }, // name, description
+  { 3, 0x02, "BeamDestination" }, // name
+  { 7, 0x42, "BeamClass" }, // name, description
+  { 4, 0x00, "AllowedClass" },
+  { 4, 0x06, "Condition" }, // name, description
+  { 4, 0x00, "IgnoreCondition" },
+  { 4, 0x00, "ConditionInput" },
+  { 4, 0x0F, "DatabaseInfo" }, // source, user, date, md5sum
+};
+
+uint64_t dbImageHash(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *byte = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ byte[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+/*
+ * DbImageWriter
+ */
+
+DbImageWriter::DbImageWriter() : _tableStart(0) {
+  // Offset 0 is the empty string
+  _pool.push_back('\0');
+  _strings[""] = 0;
+}
+
+void DbImageWriter::begin(DbImageTableId table) {
+  DbImageTable t;
+  t.table = table;
+  t.fieldCount = rowLayout[table].fieldCount;
+  t.rowCount = 0;
+  t.offset = 0;
+  _tables.push_back(t);
+  _tableStart = _words.size();
+}
+
+void DbImageWriter::put(uint32_t value) {
+  _words.push_back(value);
+}
+
+void DbImageWriter::put(const std::string &s) {
+  std::map<std::string, uint32_t>::iterator it = _strings.find(s);
+  if (it != _strings.end()) {
+    _words.push_back(it->second);
+    return;
+  }
+  uint32_t offset = _pool.size();
+  _pool.append(s.c_str(), s.size() + 1);
+  _strings[s] = offset;
+  _words.push_back(offset);
+}
+
+void DbImageWriter::end() {
+  DbImageTable &t = _tables.back();
+  uint32_t words = _words.size() - _tableStart;
+  if (words % t.fieldCount != 0) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Database image table " << t.table << " has incomplete rows";
+    throw(DbException(errorStream.str()));
+  }
+  t.rowCount = words / t.fieldCount;
+  t.offset = _tableStart; // In words, fixed up by write()
+}
+
+/**
+ * Write the whole buffer, returns false on error.
+ */
+static bool writeAll(int fd, const void *data, size_t size) {
+  const char *p = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = ::write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+/**
+ * Cache directories and cached images must not be replaceable by another
+ * user: owned by the effective uid, not group or world writable.
+ */
+static bool isPrivate(const struct stat &st) {
+  return st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/**
+ * Write the image to a temporary file and rename it, so a concurrent
+ * reader (e.g. another IOC sharing the cache directory) never sees a
+ * partial image. The temporary file is created with mkstemp(), a file
+ * or symbolic link planted with a guessable name is never opened.
+ */
+void DbImageWriter::write(std::string fileName, const DbImageSource &source) {
+  std::stringstream errorStream;
+
+  DbImageHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = DB_IMAGE_MAGIC;
+  header.version = DB_IMAGE_VERSION;
+  header.tableCount = _tables.size();
+  header.tableOffset = sizeof(DbImageHeader);
+  uint32_t rowOffset = header.tableOffset + _tables.size() * sizeof(DbImageTable);
+  header.stringOffset = rowOffset + _words.size() * sizeof(uint32_t);
+  header.stringSize = _pool.size();
+  header.size = header.stringOffset + header.stringSize;
+  header.sourceSize = source.size;
+  header.sourceHash = source.hash;
+  strncpy(header.md5sum, source.md5sum.c_str(), DB_IMAGE_MD5SUM_SIZE - 1);
+
+  for (std::vector<DbImageTable>::iterator t = _tables.begin(); t != _tables.end(); ++t) {
+    t->offset = rowOffset + t->offset * sizeof(uint32_t);
+  }
+
+  header.imageHash = DB_IMAGE_HASH_INIT;
+  if (!_tables.empty()) {
+    header.imageHash = dbImageHash(header.imageHash, &_tables[0], _tables.size() * sizeof(DbImageTable));
+  }
+  if (!_words.empty()) {
+    header.imageHash = dbImageHash(header.imageHash, &_words[0], _words.size() * sizeof(uint32_t));
+  }
+  header.imageHash = dbImageHash(header.imageHash, _pool.data(), _pool.size());
+
+  std::vector<char> tmpName(fileName.begin(), fileName.end());
+  const char suffix[] = ".tmp.XXXXXX";
+  tmpName.insert(tmpName.end(), suffix, suffix + sizeof(suffix));
+  int fd = mkstemp(&tmpName[0]);
+  if (fd < 0) {
+    errorStream << "ERROR: Failed to create database image " << &tmpName[0]
+		<< " (" << strerror(errno) << ")";
+    throw(DbException(errorStream.str()));
+  }
+
+  // mkstemp() creates the file 0600, images are read-only for the others
+  bool ok = fchmod(fd, 0644) == 0 && writeAll(fd, &header, sizeof(header));
+  if (ok && !_tables.empty()) {
+    ok = writeAll(fd, &_tables[0], _tables.size() * sizeof(DbImageTable));
+  }
+  if (ok && !_words.empty()) {
+    ok = writeAll(fd, &_words[0], _words.size() * sizeof(uint32_t));
+  }
+  ok = ok && writeAll(fd, _pool.data(), _pool.size());
+  ok = close(fd) == 0 && ok;
+
+  if (!ok || rename(&tmpName[0], fileName.c_str()) != 0) {
+    errorStream << "ERROR: Failed to write database image " << fileName
+		<< " (" << strerror(errno) << ")";
+    unlink(&tmpName[0]);
+    throw(DbException(errorStream.str()));
+  }
+}
+
+/**
+ * Sequential access to the rows of one table in a mapped image.
+ */
+class DbImageRows {
+ private:
+  const uint32_t *_word;
+  const char *_pool;
+
+ public:
+  DbImageRows(const uint8_t *base, const DbImageHeader *header, const DbImageTable *table) :
+    _word(reinterpret_cast<const uint32_t *>(base + table->offset)),
+    _pool(reinterpret_cast<const char *>(base + header->stringOffset)) {
+  }
+
+  uint32_t get() {
+    return *_word++;
+  }
+
+  std::string getString() {
+    return std::string(_pool + *_word++);
+  }
+};
+
+/*
+ * Per table encoding. Each write*() and read*() pair must use the same
+ * field order, described by rowLayout.
+ */
+
+static void writeCrates(DbImageWriter &w, DbCrateMapPtr crates) {
+  w.begin(DbImageCrate);
+  for (DbCrateMap::iterator it = crates->begin(); it != crates->end(); ++it) {
+    DbCratePtr crate = it->second;
+    w.put(crate->id);
+    w.put(crate->crate_id);
+    w.put(crate->numSlots);
+    w.put(crate->shelfNumber);
+  }
+  w.end();
+}
+
+static DbCrateMapPtr readCrates(DbImageRows r, uint32_t count) {
+  DbCrateMapPtr crates = dbArenaNew<DbCrateMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbCratePtr crate = dbArenaNew<DbCrate>();
+    crate->id = r.get();
+    crate->crate_id = r.get();
+    crate->numSlots = r.get();
+    crate->shelfNumber = r.get();
+    crates->insert(std::pair<int, DbCratePtr>(crate->id, crate));
+  }
+  return crates;
+}
+
+static void writeApplicationTypes(DbImageWriter &w, DbApplicationTypeMapPtr appTypes) {
+  w.begin(DbImageApplicationType);
+  for (DbApplicationTypeMap::iterator it = appTypes->begin(); it != appTypes->end(); ++it) {
+    DbApplicationTypePtr appType = it->second;
+    w.put(appType->id);
+    w.put(appType->number);
+    w.put(appType->analogChannelCount);
+    w.put(appType->analogChannelSize);
+    w.put(appType->digitalChannelCount);
+    w.put(appType->digitalChannelSize);
+    w.put(appType->description);
+  }
+  w.end();
+}
+
+static DbApplicationTypeMapPtr readApplicationTypes(DbImageRows r, uint32_t count) {
+  DbApplicationTypeMapPtr appTypes = dbArenaNew<DbApplicationTypeMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbApplicationTypePtr appType = dbArenaNew<DbApplicationType>();
+    appType->id = r.get();
+    appType->number = r.get();
+    appType->analogChannelCount = r.get();
+    appType->analogChannelSize = r.get();
+    appType->digitalChannelCount = r.get();
+    appType->digitalChannelSize = r.get();
+    appType->description = r.getString();
+    appTypes->insert(std::pair<int, DbApplicationTypePtr>(appType->id, appType));
+  }
+  return appTypes;
+}
+
+static void writeApplicationCards(DbImageWriter &w, DbApplicationCardMapPtr appCards) {
+  w.begin(DbImageApplicationCard);
+  for (DbApplicationCardMap::iterator it = appCards->begin(); it != appCards->end(); ++it) {
+    DbApplicationCardPtr appCard = it->second;
+    w.put(appCard->id);
+    w.put(appCard->number);
+    w.put(appCard->crateId);
+    w.put(appCard->slotNumber);
+    w.put(appCard->applicationTypeId);
+    w.put(appCard->globalId);
+    w.put(appCard->name);
+    w.put(appCard->description);
+  }
+  w.end();
+}
+
+static DbApplicationCardMapPtr readApplicationCards(DbImageRows r, uint32_t count) {
+  DbApplicationCardMapPtr appCards = dbArenaNew<DbApplicationCardMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbApplicationCardPtr appCard = dbArenaNew<DbApplicationCard>();
+    appCard->id = r.get();
+    appCard->number = r.get();
+    appCard->crateId = r.get();
+    appCard->slotNumber = r.get();
+    appCard->applicationTypeId = r.get();
+    appCard->globalId = r.get();
+    appCard->name = r.getString();
+    appCard->description = r.getString();
+    appCards->insert(std::pair<int, DbApplicationCardPtr>(appCard->id, appCard));
+  }
+  return appCards;
+}
+
+static void writeChannels(DbImageWriter &w, DbImageTableId table, DbChannelMapPtr channels) {
+  w.begin(table);
+  for (DbChannelMap::iterator it = channels->begin(); it != channels->end(); ++it) {
+    DbChannelPtr channel = it->second;
+    w.put(channel->id);
+    w.put(channel->number);
+    w.put(channel->cardId);
+    w.put(channel->name);
+  }
+  w.end();
+}
+
+static DbChannelMapPtr readChannels(DbImageRows r, uint32_t count) {
+  DbChannelMapPtr channels = dbArenaNew<DbChannelMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbChannelPtr channel = dbArenaNew<DbChannel>();
+    channel->id = r.get();
+    channel->number = r.get();
+    channel->cardId = r.get();
+    channel->name = r.getString();
+    channels->insert(std::pair<int, DbChannelPtr>(channel->id, channel));
+  }
+  return channels;
+}
+
+static void writeDeviceTypes(DbImageWriter &w, DbDeviceTypeMapPtr deviceTypes) {
+  w.begin(DbImageDeviceType);
+  for (DbDeviceTypeMap::iterator it = deviceTypes->begin(); it != deviceTypes->end(); ++it) {
+    DbDeviceTypePtr deviceType = it->second;
+    w.put(deviceType->id);
+    w.put(deviceType->name);
+    w.put(deviceType->numIntegrators);
+  }
+  w.end();
+}
+
+static DbDeviceTypeMapPtr readDeviceTypes(DbImageRows r, uint32_t count) {
+  DbDeviceTypeMapPtr deviceTypes = dbArenaNew<DbDeviceTypeMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbDeviceTypePtr deviceType = dbArenaNew<DbDeviceType>();
+    deviceType->id = r.get();
+    deviceType->name = r.getString();
+    deviceType->numIntegrators = r.get();
+    deviceTypes->insert(std::pair<int, DbDeviceTypePtr>(deviceType->id, deviceType));
+  }
+  return deviceTypes;
+}
+
+static void writeDeviceStates(DbImageWriter &w, DbDeviceStateMapPtr deviceStates) {
+  w.begin(DbImageDeviceState);
+  for (DbDeviceStateMap::iterator it = deviceStates->begin(); it != deviceStates->end(); ++it) {
+    DbDeviceStatePtr deviceState = it->second;
+    w.put(deviceState->id);
+    w.put(deviceState->value);
+    w.put(deviceState->mask);
+    w.put(deviceState->deviceTypeId);
+    w.put(deviceState->name);
+  }
+  w.end();
+}
+
+static DbDeviceStateMapPtr readDeviceStates(DbImageRows r, uint32_t count) {
+  DbDeviceStateMapPtr deviceStates = dbArenaNew<DbDeviceStateMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbDeviceStatePtr deviceState = dbArenaNew<DbDeviceState>();
+    deviceState->id = r.get();
+    deviceState->value = r.get();
+    deviceState->mask = r.get();
+    deviceState->deviceTypeId = r.get();
+    deviceState->name = r.getString();
+    deviceStates->insert(std::pair<int, DbDeviceStatePtr>(deviceState->id, deviceState));
+  }
+  return deviceStates;
+}
+
+static void writeDigitalDevices(DbImageWriter &w, DbDigitalDeviceMapPtr digitalDevices) {
+  w.begin(DbImageDigitalDevice);
+  for (DbDigitalDeviceMap::iterator it = digitalDevices->begin(); it != digitalDevices->end(); ++it) {
+    DbDigitalDevicePtr digitalDevice = it->second;
+    w.put(digitalDevice->id);
+    w.put(digitalDevice->deviceTypeId);
+    w.put(digitalDevice->name);
+    w.put(digitalDevice->description);
+    w.put(digitalDevice->evaluation);
+    w.put(digitalDevice->cardId);
+  }
+  w.end();
+}
+
+static DbDigitalDeviceMapPtr readDigitalDevices(DbImageRows r, uint32_t count) {
+  DbDigitalDeviceMapPtr digitalDevices = dbArenaNew<DbDigitalDeviceMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbDigitalDevicePtr digitalDevice = dbArenaNew<DbDigitalDevice>();
+    digitalDevice->id = r.get();
+    digitalDevice->deviceTypeId = r.get();
+    digitalDevice->name = r.getString();
+    digitalDevice->description = r.getString();
+    digitalDevice->evaluation = r.get();
+    digitalDevice->cardId = r.get();
+    digitalDevice->value = 0;
+    digitalDevices->insert(std::pair<int, DbDigitalDevicePtr>(digitalDevice->id, digitalDevice));
+  }
+  return digitalDevices;
+}
+
+static void writeDeviceInputs(DbImageWriter &w, DbDeviceInputMapPtr deviceInputs) {
+  w.begin(DbImageDeviceInput);
+  for (DbDeviceInputMap::iterator it = deviceInputs->begin(); it != deviceInputs->end(); ++it) {
+    DbDeviceInputPtr deviceInput = it->second;
+    w.put(deviceInput->id);
+    w.put(deviceInput->bitPosition);
+    w.put(deviceInput->faultValue);
+    w.put(deviceInput->digitalDeviceId);
+    w.put(deviceInput->channelId);
+    w.put(deviceInput->autoReset);
+  }
+  w.end();
+}
+
+static DbDeviceInputMapPtr readDeviceInputs(DbImageRows r, uint32_t count) {
+  DbDeviceInputMapPtr deviceInputs = dbArenaNew<DbDeviceInputMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbDeviceInputPtr deviceInput = dbArenaNew<DbDeviceInput>();
+    deviceInput->id = r.get();
+    deviceInput->bitPosition = r.get();
+    deviceInput->faultValue = r.get();
+    deviceInput->digitalDeviceId = r.get();
+    deviceInput->channelId = r.get();
+    deviceInput->autoReset = r.get();
+    deviceInput->value = 0;
+    deviceInputs->insert(std::pair<int, DbDeviceInputPtr>(deviceInput->id, deviceInput));
+  }
+  return deviceInputs;
+}
+
+static void writeFaults(DbImageWriter &w, DbFaultMapPtr faults) {
+  w.begin(DbImageFault);
+  for (DbFaultMap::iterator it = faults->begin(); it != faults->end(); ++it) {
+    DbFaultPtr fault = it->second;
+    w.put(fault->id);
+    w.put(fault->name);
+    w.put(fault->description);
+  }
+  w.end();
+}
+
+static DbFaultMapPtr readFaults(DbImageRows r, uint32_t count) {
+  DbFaultMapPtr faults = dbArenaNew<DbFaultMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbFaultPtr fault = dbArenaNew<DbFault>();
+    fault->id = r.get();
+    fault->name = r.getString();
+    fault->description = r.getString();
+    faults->insert(std::pair<int, DbFaultPtr>(fault->id, fault));
+  }
+  return faults;
+}
+
+static void writeFaultInputs(DbImageWriter &w, DbFaultInputMapPtr faultInputs) {
+  w.begin(DbImageFaultInput);
+  for (DbFaultInputMap::iterator it = faultInputs->begin(); it != faultInputs->end(); ++it) {
+    DbFaultInputPtr faultInput = it->second;
+    w.put(faultInput->id);
+    w.put(faultInput->bitPosition);
+    w.put(faultInput->deviceId);
+    w.put(faultInput->faultId);
+  }
+  w.end();
+}
+
+static DbFaultInputMapPtr readFaultInputs(DbImageRows r, uint32_t count) {
+  DbFaultInputMapPtr faultInputs = dbArenaNew<DbFaultInputMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbFaultInputPtr faultInput = dbArenaNew<DbFaultInput>();
+    faultInput->id = r.get();
+    faultInput->bitPosition = r.get();
+    faultInput->deviceId = r.get();
+    faultInput->faultId = r.get();
+    faultInputs->insert(std::pair<int, DbFaultInputPtr>(faultInput->id, faultInput));
+  }
+  return faultInputs;
+}
+
+static void writeFaultStates(DbImageWriter &w, DbFaultStateMapPtr faultStates) {
+  w.begin(DbImageFaultState);
+  for (DbFaultStateMap::iterator it = faultStates->begin(); it != faultStates->end(); ++it) {
+    DbFaultStatePtr faultState = it->second;
+    w.put(faultState->id);
+    w.put(faultState->faultId);
+    w.put(faultState->deviceStateId);
+    w.put(faultState->defaultState ? 1 : 0);
+  }
+  w.end();
+}
+
+static DbFaultStateMapPtr readFaultStates(DbImageRows r, uint32_t count) {
+  DbFaultStateMapPtr faultStates = dbArenaNew<DbFaultStateMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbFaultStatePtr faultState = dbArenaNew<DbFaultState>();
+    faultState->id = r.get();
+    faultState->faultId = r.get();
+    faultState->deviceStateId = r.get();
+    faultState->defaultState = (r.get() != 0);
+    faultStates->insert(std::pair<int, DbFaultStatePtr>(faultState->id, faultState));
+  }
+  return faultStates;
+}
+
+static void writeAnalogDevices(DbImageWriter &w, DbAnalogDeviceMapPtr analogDevices) {
+  w.begin(DbImageAnalogDevice);
+  for (DbAnalogDeviceMap::iterator it = analogDevices->begin(); it != analogDevices->end(); ++it) {
+    DbAnalogDevicePtr analogDevice = it->second;
+    w.put(analogDevice->id);
+    w.put(analogDevice->deviceTypeId);
+    w.put(analogDevice->channelId);
+    w.put(analogDevice->name);
+    w.put(analogDevice->description);
+    w.put(analogDevice->evaluation);
+    w.put(analogDevice->cardId);
+  }
+  w.end();
+}
+
+static DbAnalogDeviceMapPtr readAnalogDevices(DbImageRows r, uint32_t count) {
+  DbAnalogDeviceMapPtr analogDevices = dbArenaNew<DbAnalogDeviceMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbAnalogDevicePtr analogDevice = dbArenaNew<DbAnalogDevice>();
+    analogDevice->id = r.get();
+    analogDevice->deviceTypeId = r.get();
+    analogDevice->channelId = r.get();
+    analogDevice->name = r.getString();
+    analogDevice->description = r.getString();
+    analogDevice->evaluation = r.get();
+    analogDevice->cardId = r.get();
+    analogDevice->value = 0;
+    analogDevice->bypassMask = 0xFFFFFFFF;
+    analogDevices->insert(std::pair<int, DbAnalogDevicePtr>(analogDevice->id, analogDevice));
+  }
+  return analogDevices;
+}
+
+static void writeBeamDestinations(DbImageWriter &w, DbBeamDestinationMapPtr beamDestinations) {
+  w.begin(DbImageBeamDestination);
+  for (DbBeamDestinationMap::iterator it = beamDestinations->begin(); it != beamDestinations->end(); ++it) {
+    DbBeamDestinationPtr beamDestination = it->second;
+    w.put(beamDestination->id);
+    w.put(beamDestination->name);
+    w.put(beamDestination->destinationMask);
+  }
+  w.end();
+}
+
+static DbBeamDestinationMapPtr readBeamDestinations(DbImageRows r, uint32_t count) {
+  DbBeamDestinationMapPtr beamDestinations = dbArenaNew<DbBeamDestinationMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbBeamDestinationPtr beamDestination = dbArenaNew<DbBeamDestination>();
+    beamDestination->id = r.get();
+    beamDestination->name = r.getString();
+    beamDestination->setDestinationMask(r.get());
+    beamDestinations->insert(std::pair<int, DbBeamDestinationPtr>(beamDestination->id, beamDestination));
+  }
+  return beamDestinations;
+}
+
+static void writeBeamClasses(DbImageWriter &w, DbBeamClassMapPtr beamClasses) {
+  w.begin(DbImageBeamClass);
+  for (DbBeamClassMap::iterator it = beamClasses->begin(); it != beamClasses->end(); ++it) {
+    DbBeamClassPtr beamClass = it->second;
+    w.put(beamClass->id);
+    w.put(beamClass->name);
+    w.put(beamClass->number);
+    w.put(beamClass->minPeriod);
+    w.put(beamClass->integrationWindow);
+    w.put(beamClass->totalCharge);
+    w.put(beamClass->description);
+  }
+  w.end();
+}
+
+static DbBeamClassMapPtr readBeamClasses(DbImageRows r, uint32_t count) {
+  DbBeamClassMapPtr beamClasses = dbArenaNew<DbBeamClassMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbBeamClassPtr beamClass = dbArenaNew<DbBeamClass>();
+    beamClass->id = r.get();
+    beamClass->name = r.getString();
+    beamClass->number = r.get();
+    beamClass->minPeriod = r.get();
+    beamClass->integrationWindow = r.get();
+    beamClass->totalCharge = r.get();
+    beamClass->description = r.getString();
+    beamClasses->insert(std::pair<int, DbBeamClassPtr>(beamClass->id, beamClass));
+  }
+  return beamClasses;
+}
+
+static void writeAllowedClasses(DbImageWriter &w, DbAllowedClassMapPtr allowedClasses) {
+  w.begin(DbImageAllowedClass);
+  for (DbAllowedClassMap::iterator it = allowedClasses->begin(); it != allowedClasses->end(); ++it) {
+    DbAllowedClassPtr allowedClass = it->second;
+    w.put(allowedClass->id);
+    w.put(allowedClass->beamClassId);
+    w.put(allowedClass->faultStateId);
+    w.put(allowedClass->beamDestinationId);
+  }
+  w.end();
+}
+
+static DbAllowedClassMapPtr readAllowedClasses(DbImageRows r, uint32_t count) {
+  DbAllowedClassMapPtr allowedClasses = dbArenaNew<DbAllowedClassMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbAllowedClassPtr allowedClass = dbArenaNew<DbAllowedClass>();
+    allowedClass->id = r.get();
+    allowedClass->beamClassId = r.get();
+    allowedClass->faultStateId = r.get();
+    allowedClass->beamDestinationId = r.get();
+    allowedClasses->insert(std::pair<int, DbAllowedClassPtr>(allowedClass->id, allowedClass));
+  }
+  return allowedClasses;
+}
+
+static void writeConditions(DbImageWriter &w, DbConditionMapPtr conditions) {
+  w.begin(DbImageCondition);
+  for (DbConditionMap::iterator it = conditions->begin(); it != conditions->end(); ++it) {
+    DbConditionPtr condition = it->second;
+    w.put(condition->id);
+    w.put(condition->name);
+    w.put(condition->description);
+    w.put(condition->mask);
+  }
+  w.end();
+}
+
+static DbConditionMapPtr readConditions(DbImageRows r, uint32_t count) {
+  DbConditionMapPtr conditions = dbArenaNew<DbConditionMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbConditionPtr condition = dbArenaNew<DbCondition>();
+    condition->id = r.get();
+    condition->name = r.getString();
+    condition->description = r.getString();
+    condition->mask = r.get();
+    conditions->insert(std::pair<int, DbConditionPtr>(condition->id, condition));
+  }
+  return conditions;
+}
+
+static void writeIgnoreConditions(DbImageWriter &w, DbIgnoreConditionMapPtr ignoreConditions) {
+  w.begin(DbImageIgnoreCondition);
+  for (DbIgnoreConditionMap::iterator it = ignoreConditions->begin(); it != ignoreConditions->end(); ++it) {
+    DbIgnoreConditionPtr ignoreCondition = it->second;
+    w.put(ignoreCondition->id);
+    w.put(ignoreCondition->conditionId);
+    w.put(ignoreCondition->faultStateId);
+    w.put(ignoreCondition->deviceId);
+  }
+  w.end();
+}
+
+static DbIgnoreConditionMapPtr readIgnoreConditions(DbImageRows r, uint32_t count) {
+  DbIgnoreConditionMapPtr ignoreConditions = dbArenaNew<DbIgnoreConditionMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbIgnoreConditionPtr ignoreCondition = dbArenaNew<DbIgnoreCondition>();
+    ignoreCondition->id = r.get();
+    ignoreCondition->conditionId = r.get();
+    ignoreCondition->faultStateId = r.get();
+    ignoreCondition->deviceId = r.get();
+    ignoreConditions->insert(std::pair<int, DbIgnoreConditionPtr>(ignoreCondition->id, ignoreCondition));
+  }
+  return ignoreConditions;
+}
+
+static void writeConditionInputs(DbImageWriter &w, DbConditionInputMapPtr conditionInputs) {
+  w.begin(DbImageConditionInput);
+  for (DbConditionInputMap::iterator it = conditionInputs->begin(); it != conditionInputs->end(); ++it) {
+    DbConditionInputPtr conditionInput = it->second;
+    w.put(conditionInput->id);
+    w.put(conditionInput->bitPosition);
+    w.put(conditionInput->faultStateId);
+    w.put(conditionInput->conditionId);
+  }
+  w.end();
+}
+
+static DbConditionInputMapPtr readConditionInputs(DbImageRows r, uint32_t count) {
+  DbConditionInputMapPtr conditionInputs = dbArenaNew<DbConditionInputMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbConditionInputPtr conditionInput = dbArenaNew<DbConditionInput>();
+    conditionInput->id = r.get();
+    conditionInput->bitPosition = r.get();
+    conditionInput->faultStateId = r.get();
+    conditionInput->conditionId = r.get();
+    conditionInputs->insert(std::pair<int, DbConditionInputPtr>(conditionInput->id, conditionInput));
+  }
+  return conditionInputs;
+}
+
+static void writeDatabaseInfo(DbImageWriter &w, DbInfoMapPtr databaseInfo) {
+  w.begin(DbImageDatabaseInfo);
+  for (DbInfoMap::iterator it = databaseInfo->begin(); it != databaseInfo->end(); ++it) {
+    DbInfoPtr dbInfo = it->second;
+    w.put(dbInfo->source);
+    w.put(dbInfo->user);
+    w.put(dbInfo->date);
+    w.put(dbInfo->md5sum);
+  }
+  w.end();
+}
+
+static DbInfoMapPtr readDatabaseInfo(DbImageRows r, uint32_t count) {
+  DbInfoMapPtr databaseInfo = dbArenaNew<DbInfoMap>();
+  for (uint32_t i = 0; i < count; ++i) {
+    DbInfoPtr dbInfo = dbArenaNew<DbInfo>();
+    dbInfo->source = r.getString();
+    dbInfo->user = r.getString();
+    dbInfo->date = r.getString();
+    dbInfo->md5sum = r.getString();
+    databaseInfo->insert(std::pair<int, DbInfoPtr>(0, dbInfo));
+  }
+  return databaseInfo;
+}
+
+/*
+ * MpsDbImage
+ */
+
+/**
+ * Check if the file starts with the image magic number.
+ */
+bool MpsDbImage::isImage(std::string fileName) {
+  std::ifstream in(fileName.c_str(), std::ios::binary);
+  uint64_t magic = 0;
+  in.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  return in && magic == DB_IMAGE_MAGIC;
+}
+
+/**
+ * Compute the cache key of a YAML file without parsing it: the md5sum
+ * field of the DatabaseInfo table (empty if there is none), the file size
+ * and a hash of its contents.
+ */
+DbImageSource MpsDbImage::scanSource(std::string yamlFileName) {
+  DbImageSource source;
+  source.size = 0;
+  source.hash = DB_IMAGE_HASH_INIT;
+
+  std::ifstream in(yamlFileName.c_str(), std::ios::binary);
+  std::string line;
+  while (std::getline(in, line)) {
+    line.push_back('\n');
+    source.hash = dbImageHash(source.hash, line.data(), line.size());
+
+    if (!source.md5sum.empty()) {
+      continue;
+    }
+    size_t pos = line.find("md5sum:");
+    if (pos == std::string::npos) {
+      continue;
+    }
+    std::string value = line.substr(pos + 7);
+    size_t first = value.find_first_not_of(" \t'\"");
+    size_t last = value.find_last_not_of(" \t\r\n'\"");
+    if (first != std::string::npos && last != std::string::npos && last >= first) {
+      source.md5sum = value.substr(first, last - first + 1);
+    }
+  }
+
+  // The hash includes a '\n' after the last line even if the file does
+  // not end with one, it is still a valid key
+  struct stat st;
+  if (stat(yamlFileName.c_str(), &st) == 0) {
+    source.size = st.st_size;
+  }
+
+  return source;
+}
+
+/**
+ * Check that the image cache directory can be trusted, it is created
+ * (mode 0700) if it does not exist. Throws DbException if the directory is
+ * a symbolic link, is owned by another user or is group or world writable.
+ */
+void MpsDbImage::checkCacheDir(std::string cacheDir) {
+  std::stringstream errorStream;
+
+  if (mkdir(cacheDir.c_str(), 0700) != 0 && errno != EEXIST) {
+    errorStream << "ERROR: Failed to create database image cache " << cacheDir
+		<< " (" << strerror(errno) << ")";
+    throw(DbException(errorStream.str()));
+  }
+
+  int fd = open(cacheDir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+  if (fd < 0) {
+    errorStream << "ERROR: Failed to open database image cache " << cacheDir
+		<< " (" << strerror(errno) << ")";
+    throw(DbException(errorStream.str()));
+  }
+
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0 && isPrivate(st);
+  close(fd);
+  if (!ok) {
+    errorStream << "ERROR: Database image cache " << cacheDir
+		<< " must be owned by uid " << geteuid() << " and not be group or world writable";
+    throw(DbException(errorStream.str()));
+  }
+}
+
+std::string MpsDbImage::getCacheFileName(std::string cacheDir, std::string md5sum) {
+  return cacheDir + "/mps_" + md5sum + DB_IMAGE_EXTENSION;
+}
+
+/**
+ * Check if the image was compiled from the YAML file identified by
+ * 'source'. Only the header is read.
+ */
+bool MpsDbImage::matches(std::string fileName, const DbImageSource &source) {
+  std::ifstream in(fileName.c_str(), std::ios::binary);
+  DbImageHeader header;
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in) {
+    return false;
+  }
+  header.md5sum[DB_IMAGE_MD5SUM_SIZE - 1] = '\0';
+
+  return header.magic == DB_IMAGE_MAGIC &&
+    header.version == DB_IMAGE_VERSION &&
+    header.sourceSize == source.size &&
+    header.sourceHash == source.hash &&
+    source.md5sum == header.md5sum;
+}
+
+/**
+ * Encode the tables of a loaded (not necessarily configured) database.
+ */
+void MpsDbImage::encode(MpsDb *db, DbImageWriter &w) {
+  if (db->crates) writeCrates(w, db->crates);
+  if (db->applicationTypes) writeApplicationTypes(w, db->applicationTypes);
+  if (db->applicationCards) writeApplicationCards(w, db->applicationCards);
+  if (db->digitalChannels) writeChannels(w, DbImageDigitalChannel, db->digitalChannels);
+  if (db->analogChannels) writeChannels(w, DbImageAnalogChannel, db->analogChannels);
+  if (db->deviceTypes) writeDeviceTypes(w, db->deviceTypes);
+  if (db->deviceStates) writeDeviceStates(w, db->deviceStates);
+  if (db->digitalDevices) writeDigitalDevices(w, db->digitalDevices);
+  if (db->deviceInputs) writeDeviceInputs(w, db->deviceInputs);
+  if (db->faults) writeFaults(w, db->faults);
+  if (db->faultInputs) writeFaultInputs(w, db->faultInputs);
+  if (db->faultStates) writeFaultStates(w, db->faultStates);
+  if (db->analogDevices) writeAnalogDevices(w, db->analogDevices);
+  if (db->beamDestinations) writeBeamDestinations(w, db->beamDestinations);
+  if (db->beamClasses) writeBeamClasses(w, db->beamClasses);
+  if (db->allowedClasses) writeAllowedClasses(w, db->allowedClasses);
+  if (db->conditions) writeConditions(w, db->conditions);
+  if (db->ignoreConditions) writeIgnoreConditions(w, db->ignoreConditions);
+  if (db->conditionInputs) writeConditionInputs(w, db->conditionInputs);
+  if (db->databaseInfo) writeDatabaseInfo(w, db->databaseInfo);
+}
+
+/**
+ * Compile the tables of a loaded (not necessarily configured) database.
+ */
+void MpsDbImage::write(MpsDb *db, std::string fileName, const DbImageSource &source) {
+  DbImageWriter w;
+  encode(db, w);
+  w.write(fileName, source);
+}
+
+/**
+ * Map an image and create the MpsDb tables from it. The whole image is
+ * validated before any table is created, the MpsDb is left untouched if
+ * the image is invalid. Tables not present in the image are left unset,
+ * as when they are missing from a YAML file.
+ *
+ * A 'cached' image (found in the image cache, not given by the user) is
+ * used only if it is a regular file owned by the engine user and not
+ * group or world writable, the check is done on the mapped file.
+ */
+void MpsDbImage::read(MpsDb *db, std::string fileName, bool cached) {
+  std::stringstream errorStream;
+
+  int fd = open(fileName.c_str(), cached ? O_RDONLY | O_NOFOLLOW : O_RDONLY);
+  if (fd < 0) {
+    errorStream << "ERROR: Failed to open database image " << fileName
+		<< " (" << strerror(errno) << ")";
+    throw(DbException(errorStream.str()));
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(DbImageHeader))) {
+    close(fd);
+    errorStream << "ERROR: Database image " << fileName << " is too short";
+    throw(DbException(errorStream.str()));
+  }
+
+  if (cached && (!S_ISREG(st.st_mode) || !isPrivate(st))) {
+    close(fd);
+    errorStream << "ERROR: Database image " << fileName
+		<< " must be owned by uid " << geteuid() << " and not be group or world writable";
+    throw(DbException(errorStream.str()));
+  }
+
+  size_t mapSize = st.st_size;
+  void *map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    errorStream << "ERROR: Failed to map database image " << fileName
+		<< " (" << strerror(errno) << ")";
+    throw(DbException(errorStream.str()));
+  }
+
+  const uint8_t *base = static_cast<const uint8_t *>(map);
+  const DbImageHeader *header = reinterpret_cast<const DbImageHeader *>(base);
+  const DbImageTable *tables = reinterpret_cast<const DbImageTable *>(base + header->tableOffset);
+
+  // Validate header, table directory, rows and string references
+  std::string error;
+  if (header->magic != DB_IMAGE_MAGIC) {
+    error = "not a database image";
+  }
+  else if (header->version != DB_IMAGE_VERSION) {
+    error = "unsupported version";
+  }
+  else if (header->size > mapSize || header->tableOffset < sizeof(DbImageHeader) ||
+	   header->tableOffset + static_cast<uint64_t>(header->tableCount) * sizeof(DbImageTable) > header->stringOffset ||
+	   static_cast<uint64_t>(header->stringOffset) + header->stringSize > header->size ||
+	   header->stringSize == 0 ||
+	   base[header->stringOffset + header->stringSize - 1] != '\0') {
+    error = "invalid layout";
+  }
+  else if (dbImageHash(DB_IMAGE_HASH_INIT, base + sizeof(DbImageHeader), header->size - sizeof(DbImageHeader)) != header->imageHash) {
+    error = "checksum mismatch";
+  }
+  for (uint32_t t = 0; error.empty() && t < header->tableCount; ++t) {
+    const DbImageTable &table = tables[t];
+    if (table.table >= DB_IMAGE_TABLE_COUNT || table.fieldCount != rowLayout[table.table].fieldCount ||
+	table.offset % sizeof(uint32_t) != 0 ||
+	table.offset + static_cast<uint64_t>(table.rowCount) * table.fieldCount * sizeof(uint32_t) > header->stringOffset) {
+      error = "invalid table";
+      break;
+    }
+
+    uint32_t stringFields = rowLayout[table.table].stringFields;
+    const uint32_t *word = reinterpret_cast<const uint32_t *>(base + table.offset);
+    for (uint32_t i = 0; error.empty() && i < table.rowCount * table.fieldCount; ++i) {
+      if ((stringFields & (1 << (i % table.fieldCount))) && word[i] >= header->stringSize) {
+	error = "invalid string reference";
+      }
+    }
+  }
+
+  if (!error.empty()) {
+    munmap(map, mapSize);
+    errorStream << "ERROR: Database image " << fileName << ": " << error;
+    throw(DbException(errorStream.str()));
+  }
+
+  for (uint32_t t = 0; t < header->tableCount; ++t) {
+    const DbImageTable &table = tables[t];
+    DbImageRows r(base, header, &table);
+    uint32_t count = table.rowCount;
+    DbArenaScope scope(db->getArena(), rowLayout[table.table].name);
+
+    switch (table.table) {
+    case DbImageCrate: db->crates = readCrates(r, count); break;
+    case DbImageApplicationType: db->applicationTypes = readApplicationTypes(r, count); break;
+    case DbImageApplicationCard: db->applicationCards = readApplicationCards(r, count); break;
+    case DbImageDigitalChannel: db->digitalChannels = readChannels(r, count); break;
+    case DbImageAnalogChannel: db->analogChannels = readChannels(r, count); break;
+    case DbImageDeviceType: db->deviceTypes = readDeviceTypes(r, count); break;
+    case DbImageDeviceState: db->deviceStates = readDeviceStates(r, count); break;
+    case DbImageDigitalDevice: db->digitalDevices = readDigitalDevices(r, count); break;
+    case DbImageDeviceInput: db->deviceInputs = readDeviceInputs(r, count); break;
+    case DbImageFault: db->faults = readFaults(r, count); break;
+    case DbImageFaultInput: db->faultInputs = readFaultInputs(r, count); break;
+    case DbImageFaultState: db->faultStates = readFaultStates(r, count); break;
+    case DbImageAnalogDevice: db->analogDevices = readAnalogDevices(r, count); break;
+    case DbImageBeamDestination: db->beamDestinations = readBeamDestinations(r, count); break;
+    case DbImageBeamClass: db->beamClasses = readBeamClasses(r, count); break;
+    case DbImageAllowedClass: db->allowedClasses = readAllowedClasses(r, count); break;
+    case DbImageCondition: db->conditions = readConditions(r, count); break;
+    case DbImageIgnoreCondition: db->ignoreConditions = readIgnoreConditions(r, count); break;
+    case DbImageConditionInput: db->conditionInputs = readConditionInputs(r, count); break;
+    case DbImageDatabaseInfo: db->databaseInfo = readDatabaseInfo(r, count); break;
+    default: break;
+    }
+  }
+
+  munmap(map, mapSize);
+}
+
+const char *MpsDbImage::getTableName(uint32_t table) {
+  return table < DB_IMAGE_TABLE_COUNT ? rowLayout[table].name : "Unknown";
+}
+
+uint32_t MpsDbImage::getFieldCount(uint32_t table) {
+  return table < DB_IMAGE_TABLE_COUNT ? rowLayout[table].fieldCount : 0;
+}
+
+uint32_t MpsDbImage::getStringFields(uint32_t table) {
+  return table < DB_IMAGE_TABLE_COUNT ? rowLayout[table].stringFields : 0;
+}
@@ -0,0 +1,160 @@
+#ifndef CENTRAL_NODE_DATABASE_IMAGE_H
+#define CENTRAL_NODE_DATABASE_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+
+class MpsDb;
+
+/**
+ * Compiled MPS database image
+ *
+ * Binary form of the tables loaded from the MPS database YAML file, so a
+ * database can be loaded with a single mmap() instead of parsing the
+ * YAML. Images are produced offline by central_node_db_compile, or
+ * automatically by MpsDb::load() in the image cache directory.
+ *
+ *   DbImageHeader                                    (offset 0)
+ *   'tableCount' x DbImageTable                      (offset 'tableOffset')
+ *   rows, 'rowCount' x 'fieldCount' uint32_t words   (offset of each table)
+ *   string pool, NUL terminated strings              (offset 'stringOffset')
+ *
+ * All offsets are relative to the start of the image, which can be mapped
+ * anywhere. Each table is a dense array of fixed size rows, in database id
+ * order. Numeric fields are stored as is, strings as an offset in the
+ * string pool (identical strings are stored once), booleans as 0/1.
+ *
+ * Only the fields read from the YAML file are stored, the references
+ * between tables are still resolved by MpsDb::configure().
+ *
+ * The image cache is keyed on the DatabaseInfo md5sum of the YAML file
+ * (mps_<md5sum>.mpsdb). The size and hash of the YAML file are also kept
+ * in the header, a cached image is used only if they match, so an edited
+ * YAML file with a stale md5sum is parsed again. A damaged image (hash
+ * mismatch) is rejected and the YAML file is parsed.
+ *
+ * The hashes only detect damage, anyone can compute them for a forged
+ * image. The cache is therefore disabled unless a directory is configured
+ * (MpsDb::setImageCacheDir()), and the directory and the cached images
+ * must be owned by the engine user and not be group or world writable.
+ */
+const uint64_t DB_IMAGE_MAGIC = 0x474D49424453504DULL; // "MPSDBIMG"
+const uint32_t DB_IMAGE_VERSION = 1;
+const uint32_t DB_IMAGE_MD5SUM_SIZE = 64;
+const char DB_IMAGE_EXTENSION[] = ".mpsdb";
+
+/**
+ * Tables in the image, one per MpsDb map
+ */
+enum DbImageTableId {
+  DbImageCrate = 0,
+  DbImageApplicationType,
+  DbImageApplicationCard,
+  DbImageDigitalChannel,
+  DbImageAnalogChannel,
+  DbImageDeviceType,
+  DbImageDeviceState,
+  DbImageDigitalDevice,
+  DbImageDeviceInput,
+  DbImageFault,
+  DbImageFaultInput,
+  DbImageFaultState,
+  DbImageAnalogDevice,
+  DbImageBeamDestination,
+  DbImageBeamClass,
+  DbImageAllowedClass,
+  DbImageCondition,
+  DbImageIgnoreCondition,
+  DbImageConditionInput,
+  DbImageDatabaseInfo,
+
+  DB_IMAGE_TABLE_COUNT
+};
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t size;              // Total size of the image
+  uint32_t tableCount;
+  uint32_t tableOffset;
+  uint32_t stringOffset;
+  uint32_t stringSize;
+  uint64_t sourceSize;        // Size of the YAML file the image was compiled from
+  uint64_t sourceHash;        // FNV-1a hash of the YAML file contents
+  uint64_t imageHash;         // FNV-1a hash of the image after the header
+  char md5sum[DB_IMAGE_MD5SUM_SIZE]; // DatabaseInfo md5sum, empty if none
+} DbImageHeader;
+
+typedef struct {
+  uint32_t table;             // DbImageTableId
+  uint32_t fieldCount;        // 32-bit words per row
+  uint32_t rowCount;
+  uint32_t offset;            // Offset of the first row
+} DbImageTable;
+
+/**
+ * Identification of a YAML file, used as the image cache key
+ */
+typedef struct {
+  std::string md5sum;
+  uint64_t size;
+  uint64_t hash;
+} DbImageSource;
+
+/**
+ * Builds an image in memory: rows of all tables and the string pool.
+ * Tables of several databases may be encoded in the same writer (see
+ * MpsDbDelta), identical strings then have the same pool offset and rows
+ * can be compared word by word.
+ */
+class DbImageWriter {
+ private:
+  std::vector<uint32_t> _words;
+  std::vector<DbImageTable> _tables;
+  std::map<std::string, uint32_t> _strings;
+  std::string _pool;
+  uint32_t _tableStart;
+
+ public:
+  DbImageWriter();
+
+  void begin(DbImageTableId table);
+  void put(uint32_t value);
+  void put(const std::string &s);
+  void end();
+
+  // Offsets of the encoded tables are in words until write() is called
+  const std::vector<DbImageTable> &getTables() const { return _tables; }
+  const std::vector<uint32_t> &getWords() const { return _words; }
+  const std::string &getPool() const { return _pool; }
+
+  void write(std::string fileName, const DbImageSource &source);
+};
+
+class MpsDbImage {
+ public:
+  static bool isImage(std::string fileName);
+  static DbImageSource scanSource(std::string yamlFileName);
+  static void checkCacheDir(std::string cacheDir);
+  static std::string getCacheFileName(std::string cacheDir, std::string md5sum);
+  static bool matches(std::string fileName, const DbImageSource &source);
+
+  static void encode(MpsDb *db, DbImageWriter &w);
+  static void write(MpsDb *db, std::string fileName, const DbImageSource &source);
+  static void read(MpsDb *db, std::string fileName, bool cached = false);
+
+  static const char *getTableName(uint32_t table);
+  static uint32_t getFieldCount(uint32_t table);
+  static uint32_t getStringFields(uint32_t table);
+};
+
+/**
+ * FNV-1a hash used for the image and YAML file checksums
+ */
+const uint64_t DB_IMAGE_HASH_INIT = 0xCBF29CE484222325ULL;
+uint64_t dbImageHash(uint64_t hash, const void *data, size_t size);
+
+#endif
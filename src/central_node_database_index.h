@@ -0,0 +1,101 @@
+#ifndef CENTRAL_NODE_DATABASE_INDEX_H
+#define CENTRAL_NODE_DATABASE_INDEX_H
+
+#include <central_node_database_tables.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Densest id range indexed with a vector: the largest id may be up to
+ * DB_INDEX_MAX_SPARSENESS times the number of entries (plus
+ * DB_INDEX_MIN_SIZE). Tables with larger ids are looked up in the map.
+ */
+const uint32_t DB_INDEX_MAX_SPARSENESS = 4;
+const uint32_t DB_INDEX_MIN_SIZE = 1024;
+
+/**
+ * Id to entry lookup table for one of the MpsDb maps, used to resolve the
+ * foreign keys in MpsDb::configure().
+ *
+ * The database ids are small integers, mostly contiguous, so the index is
+ * a vector of pointers to the map entries with the id as position, and a
+ * lookup is a bounds check and an array access. The index points into the
+ * map, it is valid as long as no entry is added to or removed from it.
+ */
+template<class MapType>
+class DbIndex {
+ public:
+  typedef typename MapType::mapped_type EntryPtr;
+  typedef boost::shared_ptr<MapType> MapPtr;
+
+ private:
+  MapPtr _map;
+  std::vector<EntryPtr *> _index;
+  bool _dense;
+
+ public:
+  DbIndex() : _dense(true) {
+  }
+
+  DbIndex(MapPtr map) : _dense(true) {
+    build(map);
+  }
+
+  void build(MapPtr map) {
+    _map = map;
+    _index.clear();
+    _dense = true;
+    if (!_map || _map->empty()) {
+      return;
+    }
+
+    uint64_t maxId = _map->rbegin()->first;
+    if (maxId > (uint64_t) _map->size() * DB_INDEX_MAX_SPARSENESS + DB_INDEX_MIN_SIZE) {
+      _dense = false;
+      return;
+    }
+
+    _index.resize(maxId + 1, NULL);
+    for (typename MapType::iterator it = _map->begin(); it != _map->end(); ++it) {
+      _index[it->first] = &it->second;
+    }
+  }
+
+  /**
+   * Returns the entry with the given id, or NULL if there is none
+   */
+  EntryPtr *find(uint32_t id) const {
+    if (_dense) {
+      return id < _index.size() ? _index[id] : NULL;
+    }
+
+    typename MapType::iterator it = _map->find(id);
+    return it != _map->end() ? &it->second : NULL;
+  }
+
+  bool isDense() const { return _dense; };
+};
+
+/**
+ * Indexes of the MpsDb maps referenced by foreign keys, built once by
+ * MpsDb::configure() after the maps are loaded.
+ */
+class DbIndexes {
+ public:
+  DbIndex<DbCrateMap> crates;
+  DbIndex<DbApplicationTypeMap> applicationTypes;
+  DbIndex<DbApplicationCardMap> applicationCards;
+  DbIndex<DbChannelMap> digitalChannels;
+  DbIndex<DbChannelMap> analogChannels;
+  DbIndex<DbDeviceTypeMap> deviceTypes;
+  DbIndex<DbDeviceStateMap> deviceStates;
+  DbIndex<DbDigitalDeviceMap> digitalDevices;
+  DbIndex<DbFaultMap> faults;
+  DbIndex<DbFaultStateMap> faultStates;
+  DbIndex<DbAnalogDeviceMap> analogDevices;
+  DbIndex<DbBeamDestinationMap> beamDestinations;
+  DbIndex<DbBeamClassMap> beamClasses;
+  DbIndex<DbConditionMap> conditions;
+};
+
+#endif
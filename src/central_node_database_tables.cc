@@ -127,11 +127,13 @@ DbDeviceInput::DbDeviceInput() : DbEntry(),
 				 bitPosition(999), channelId(999), faultValue(0),
 				 digitalDeviceId(999), value(0), previousValue(0),
 				 latchedValue(0), invalidValueCount(0),
+				 evaluationValue(0),
 				 fastEvaluation(false), autoReset(0) {
 }
 
 void DbDeviceInput::unlatch() {
   latchedValue = value;
+  applyBypassOverride();
 }
 
 std::ostream & operator<<(std::ostream &os, DbDeviceInput * const deviceInput) {
@@ -233,6 +235,7 @@ uint32_t DbAnalogDevice::unlatch(uint32_t mask) {
 
   // Copy the current threshold bit value to the latchedValue
   latchedValue &= (currentBitValue & ~mask);
+  applyBypassOverride();
 
   return currentBitValue;
 }
@@ -417,6 +420,91 @@ std::ostream & operator<<(std::ostream &os, DbBeamClass * const beamClass) {
 DbBeamDestination::DbBeamDestination() : DbEntry(), name("") {
 }
 
+/**
+ * Set the destination mask and the derived softwareMitigationBuffer masks,
+ * index and bit shift.
+ */
+void DbBeamDestination::setDestinationMask(uint16_t mask) {
+  destinationMask = mask;
+
+  // Find the device position in the softwareMitigationBuffer (32-bit array)
+  // Each mitigation device defines has a 4-bit power class, the
+  // position tells in which byte it falls based on the
+  // destination mask
+
+  // Destination mask
+  // [16 15 14 13 12 11 10 09][08 07 06 05 04 03 02 01]
+  softwareMitigationBufferIndex = 1; // when FW is fixed this goes back to index 0
+  bitShift = 0;
+  buffer0DestinationMask = 0;
+  buffer1DestinationMask = 0;
+  if ((destinationMask & 0x1) > 0) {
+    buffer1DestinationMask |= 0x0000000F;
+  }
+  if ((destinationMask & 0x2) > 0) {
+    buffer1DestinationMask |= 0x000000F0;
+  }
+  if ((destinationMask & 0x4) > 0) {
+    buffer1DestinationMask |= 0x00000F00;
+  }
+  if ((destinationMask & 0x8) > 0) {
+    buffer1DestinationMask |= 0x0000F000;
+  }
+  if ((destinationMask & 0x10) > 0) {
+    buffer1DestinationMask |= 0x000F0000;
+  }
+  if ((destinationMask & 0x20) > 0) {
+    buffer1DestinationMask |= 0x00F00000;
+  }
+  if ((destinationMask & 0x40) > 0) {
+    buffer1DestinationMask |= 0x0F000000;
+  }
+  if ((destinationMask & 0x80) > 0) {
+    buffer1DestinationMask |= 0xF0000000;
+  }
+  if ((destinationMask & 0x100) > 0) {
+    buffer0DestinationMask |= 0x0000000F;
+  }
+  if ((destinationMask & 0x200) > 0) {
+    buffer0DestinationMask |= 0x000000F0;
+  }
+  if ((destinationMask & 0x400) > 0) {
+    buffer0DestinationMask |= 0x00000F00;
+  }
+  if ((destinationMask & 0x800) > 0) {
+    buffer0DestinationMask |= 0x0000F000;
+  }
+  if ((destinationMask & 0x1000) > 0) {
+    buffer0DestinationMask |= 0x000F0000;
+  }
+  if ((destinationMask & 0x2000) > 0) {
+    buffer0DestinationMask |= 0x00F00000;
+  }
+  if ((destinationMask & 0x4000) > 0) {
+    buffer0DestinationMask |= 0x0F000000;
+  }
+  if ((destinationMask & 0x8000) > 0) {
+    buffer0DestinationMask |= 0xF0000000;
+  }
+  if ((mask & 0xFF00) > 0) {
+    // softwareMitigationBufferIndex = 1; // if destination bit set from 8 to 15, use second mitigation position
+    softwareMitigationBufferIndex = 0; // when FW is fixed this goes back to index 1
+    mask >>= 8;
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    if (mask & 1) {
+      mask = 0;
+    }
+    else {
+      if (mask > 0) {
+        bitShift += 4;
+        mask >>= 1;
+      }
+    }
+  }
+}
+
 std::ostream & operator<<(std::ostream &os, DbBeamDestination * const beamDestination) {
   os << "id[" << beamDestination->id << "]; "
      << "name[" << beamDestination->name << "]; "
@@ -476,7 +564,7 @@ std::ostream & operator<<(std::ostream &os, DbFaultState * const digitalFault) {
   return os;
 }
 
-DbFault::DbFault() : DbEntry(), name(""), description(""), faulted(true), ignored(false), evaluation(SLOW_EVALUATION), value(0) {
+DbFault::DbFault() : DbEntry(), faulted(true), ignored(false), evaluation(SLOW_EVALUATION), value(0) {
 }
 
 std::ostream & operator<<(std::ostream &os, DbFault * const fault) {
@@ -551,7 +639,7 @@ std::ostream & operator<<(std::ostream &os, DbIgnoreCondition * const input) {
   return os;
 }
 
-DbCondition::DbCondition() : DbEntry(), name(""), description(""), mask(0), state(false) {
+DbCondition::DbCondition() : DbEntry(), mask(0), state(false) {
 }
 
 std::ostream & operator<<(std::ostream &os, DbCondition * const fault) {
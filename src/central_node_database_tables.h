@@ -6,11 +6,13 @@
 #include <iostream>
 #include <bitset>
 #include <central_node_database_defs.h>
+#include <central_node_database_arena.h>
 #include <central_node_exception.h>
 #include <central_node_bypass.h>
 #include <central_node_history.h>
 #include <stdint.h>
 #include <time_util.h>
+#include "cycle_counter.h"
 
 #include <boost/shared_ptr.hpp>
 
@@ -52,7 +54,7 @@ class DbCrate : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbCrate> DbCratePtr;
-typedef std::map<uint32_t, DbCratePtr> DbCrateMap;
+typedef DbArenaMap<DbCratePtr>::type DbCrateMap;
 typedef boost::shared_ptr<DbCrateMap> DbCrateMapPtr;
 
 /**
@@ -70,7 +72,7 @@ class DbInfo {
 };
 
 typedef boost::shared_ptr<DbInfo> DbInfoPtr;
-typedef std::map<uint32_t, DbInfoPtr> DbInfoMap;
+typedef DbArenaMap<DbInfoPtr>::type DbInfoMap;
 typedef boost::shared_ptr<DbInfoMap> DbInfoMapPtr;
 
 /**
@@ -83,14 +85,14 @@ class DbApplicationType : public DbEntry {
   uint32_t analogChannelSize;
   uint32_t digitalChannelCount;
   uint32_t digitalChannelSize;
-  std::string description;
+  DbString description;
 
   DbApplicationType();
   friend std::ostream & operator<<(std::ostream &os, DbApplicationType * const appType);
 };
 
 typedef boost::shared_ptr<DbApplicationType> DbApplicationTypePtr;
-typedef std::map<uint32_t, DbApplicationTypePtr> DbApplicationTypeMap;
+typedef DbArenaMap<DbApplicationTypePtr>::type DbApplicationTypeMap;
 typedef boost::shared_ptr<DbApplicationTypeMap> DbApplicationTypeMapPtr;
 
 /**
@@ -100,14 +102,14 @@ class DbChannel : public DbEntry {
  public:
   uint32_t number;
   uint32_t cardId;
-  std::string name;
+  DbString name;
 
   DbChannel();
   friend std::ostream & operator<<(std::ostream &os, DbChannel * const channel);
 };
 
 typedef boost::shared_ptr<DbChannel> DbChannelPtr;
-typedef std::map<uint32_t, DbChannelPtr> DbChannelMap;
+typedef DbArenaMap<DbChannelPtr>::type DbChannelMap;
 typedef boost::shared_ptr<DbChannelMap> DbChannelMapPtr;
 
 /**
@@ -118,7 +120,7 @@ class DbDeviceState : public DbEntry {
   uint32_t deviceTypeId;
   uint32_t value;
   uint32_t mask;
-  std::string name;
+  DbString name;
 
   DbDeviceState();
   int getIntegrator();
@@ -126,24 +128,68 @@ class DbDeviceState : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbDeviceState> DbDeviceStatePtr;
-typedef std::map<uint32_t, DbDeviceStatePtr> DbDeviceStateMap;
+typedef DbArenaMap<DbDeviceStatePtr>::type DbDeviceStateMap;
 typedef boost::shared_ptr<DbDeviceStateMap> DbDeviceStateMapPtr;
 
+/**
+ * Bypass overrides for the inputs of one application card. They are
+ * applied to the latched input values when the inputs are decoded:
+ *
+ *   evaluationValue = (latchedValue & ~force) | (forceValue & force)
+ *
+ * Digital cards use one bit per channel (bit N is channel N). Analog cards
+ * use one threshold word per channel, bypassed thresholds are forced to
+ * zero (not exceeded). The masks are recomputed by the Engine only when
+ * a bypass changes.
+ */
+class BypassOverride {
+ public:
+  uint64_t force;
+  uint64_t forceValue;
+  uint32_t analogForce[APP_CARD_MAX_ANALOG_CHANNELS];
+
+  BypassOverride() { clear(); };
+  void clear() {
+    force = 0;
+    forceValue = 0;
+    for (uint32_t i = 0; i < APP_CARD_MAX_ANALOG_CHANNELS; ++i) {
+      analogForce[i] = 0;
+    }
+  };
+};
+
 class DbApplicationCardInput {
  public:
-  DbApplicationCardInput() : fwUpdateBuffer(NULL),  wasLowBufferOffset(999), wasHighBufferOffset(888) {};
+  DbApplicationCardInput() : fwUpdateBuffer(NULL),  wasLowBufferOffset(999), wasHighBufferOffset(888), bypassOverride(NULL),
+                             decodeOverride(&noBypassOverride), overrideChannel(0) {};
   ApplicationUpdateBufferBitSetHalf* getWasLowBuffer();
   ApplicationUpdateBufferBitSetHalf* getWasHighBuffer();
 
-  void setUpdateBuffers(std::vector<uint8_t>* bufPtr, const size_t wasLowBufferOff, const size_t wasHighBufferOff);
+  void setUpdateBuffers(std::vector<uint8_t>* bufPtr, const size_t wasLowBufferOff, const size_t wasHighBufferOff,
+                        BypassOverride* bypassOverridePtr = NULL);
 
   uint32_t getWasLow(int channel);
   uint32_t getWasHigh(int channel);
 
+  BypassOverride* getBypassOverride() { return bypassOverride; };
+
  private:
   std::vector<uint8_t>* fwUpdateBuffer;
   size_t                wasLowBufferOffset;
   size_t                wasHighBufferOffset;
+
+ protected:
+  // Overrides of the card this input is read from
+  BypassOverride*       bypassOverride;
+
+  // Overrides applied by the decode and the channel of this input in them,
+  // cached by configureBypassOverride() so the decode does not check for
+  // an override nor look up the channel. Inputs without an override use
+  // noBypassOverride, which forces nothing.
+  const BypassOverride* decodeOverride;
+  uint32_t              overrideChannel;
+
+  static const BypassOverride noBypassOverride;
 };
 
 /**
@@ -151,7 +197,7 @@ class DbApplicationCardInput {
  */
 class DbDeviceType : public DbEntry {
  public:
-  std::string name;
+  DbString name;
   uint32_t numIntegrators; // number of 8-bit threshold comparators coming from device
 
   DbDeviceStateMapPtr deviceStates;
@@ -161,7 +207,7 @@ class DbDeviceType : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbDeviceType> DbDeviceTypePtr;
-typedef std::map<uint32_t, DbDeviceTypePtr> DbDeviceTypeMap;
+typedef DbArenaMap<DbDeviceTypePtr>::type DbDeviceTypeMap;
 typedef boost::shared_ptr<DbDeviceTypeMap> DbDeviceTypeMapPtr;
 
 /**
@@ -190,6 +236,10 @@ class DbDeviceInput : public DbEntry, public DbApplicationCardInput {
   // Pouint32_ter to the bypass for this input
   InputBypassPtr bypass;
 
+  // Latched value with the card bypass override applied - this is the
+  // value used by the fault evaluation
+  uint32_t evaluationValue;
+
   // Pointer to the Channel connected to the device
   DbChannelPtr channel;
 
@@ -204,17 +254,19 @@ class DbDeviceInput : public DbEntry, public DbApplicationCardInput {
   void unlatch();
   void update(uint32_t v);
   void update();
+  void configureBypassOverride();
+  void applyBypassOverride();
 
   friend std::ostream & operator<<(std::ostream &os, DbDeviceInput * const deviceInput);
 };
 
 typedef boost::shared_ptr<DbDeviceInput> DbDeviceInputPtr;
-typedef std::map<uint32_t, DbDeviceInputPtr> DbDeviceInputMap;
+typedef DbArenaMap<DbDeviceInputPtr>::type DbDeviceInputMap;
 typedef boost::shared_ptr<DbDeviceInputMap> DbDeviceInputMapPtr;
 
 class DbFaultState;
 typedef boost::shared_ptr<DbFaultState> DbFaultStatePtr;
-typedef std::map<uint32_t, DbFaultStatePtr> DbFaultStateMap;
+typedef DbArenaMap<DbFaultStatePtr>::type DbFaultStateMap;
 typedef boost::shared_ptr<DbFaultStateMap> DbFaultStateMapPtr;
 
 /**
@@ -224,8 +276,6 @@ class DbDigitalDevice : public DbEntry {
  public:
   uint32_t deviceTypeId;
   uint32_t value; // calculated from the DeviceInputs for this device
-  std::string name;
-  std::string description;
   uint32_t evaluation;
   uint32_t cardId; // Application Card ID
   // Faults from this devices are bypassed when ignored==true
@@ -253,6 +303,10 @@ class DbDigitalDevice : public DbEntry {
   // the firmware will apply the fastPowerClass/fastDestinationMask
   uint8_t fastExpectedState;
 
+  // Only used for display, kept after the evaluation state
+  DbString name;
+  DbString description;
+
   DbDigitalDevice();
 
   void update(uint32_t v) {
@@ -263,7 +317,7 @@ class DbDigitalDevice : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbDigitalDevice> DbDigitalDevicePtr;
-typedef std::map<uint32_t, DbDigitalDevicePtr> DbDigitalDeviceMap;
+typedef DbArenaMap<DbDigitalDevicePtr>::type DbDigitalDeviceMap;
 typedef boost::shared_ptr<DbDigitalDeviceMap> DbDigitalDeviceMapPtr;
 
 
@@ -274,8 +328,6 @@ class DbAnalogDevice : public DbEntry, public DbApplicationCardInput {
  public:
   uint32_t deviceTypeId;
   uint32_t channelId;
-  std::string name;
-  std::string description;
   uint32_t evaluation;
   uint32_t cardId; // Application Card ID
 
@@ -318,12 +370,16 @@ class DbAnalogDevice : public DbEntry, public DbApplicationCardInput {
   InputBypassPtr bypass[ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL];
 
   // Bypass mask composed from all active threshold bypasses. This value gets updated
-  // whenever a threshold bypass becomes valid or expires. The BypassManager changes this
-  // mask directly. The Engine always does a bitwise AND between this mask and the value read
-  // from firmware. If a threshold is bypassed the bypassMask is 0 at the threshold position,
-  // and 1 otherwise.
+  // by the Engine thread whenever the published bypass state changes (see
+  // Engine::updateBypassView()), and its complement is the analog force mask of the
+  // card for this channel. If a threshold is bypassed the bypassMask is 0 at the
+  // threshold position, and 1 otherwise.
   uint32_t bypassMask;
 
+  // Latched value with the card bypass override applied - this is the
+  // value used by the fault evaluation
+  uint32_t evaluationValue;
+
   /**
    * These fields get populated when the database is loaded, they are
    * used to configure the central node firmware with fast fault
@@ -340,11 +396,17 @@ class DbAnalogDevice : public DbEntry, public DbApplicationCardInput {
   uint16_t fastPowerClass[ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL * ANALOG_CHANNEL_INTEGRATORS_SIZE];
   uint16_t fastPowerClassInit[ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL * ANALOG_CHANNEL_INTEGRATORS_SIZE];
 
+  // Only used for display, kept after the evaluation state
+  DbString name;
+  DbString description;
+
   DbAnalogDevice();
 
   uint32_t unlatch(uint32_t mask);
   void update(uint32_t v);
   void update();
+  void configureBypassOverride();
+  void applyBypassOverride();
 
   //  void setUpdateBuffer(ApplicationUpdateBufferBitSet *buffer);
 
@@ -352,7 +414,7 @@ class DbAnalogDevice : public DbEntry, public DbApplicationCardInput {
 };
 
 typedef boost::shared_ptr<DbAnalogDevice> DbAnalogDevicePtr;
-typedef std::map<uint32_t, DbAnalogDevicePtr> DbAnalogDeviceMap;
+typedef DbArenaMap<DbAnalogDevicePtr>::type DbAnalogDeviceMap;
 typedef boost::shared_ptr<DbAnalogDeviceMap> DbAnalogDeviceMapPtr;
 
 
@@ -367,8 +429,8 @@ class DbApplicationCard : public DbEntry {
   uint32_t applicationTypeId;
   // Unique application ID, identifies the card were digital/analog signas are coming from
   uint32_t globalId;
-  std::string name;
-  std::string description;
+  DbString name;
+  DbString description;
   bool online; // True if received non-zero update last 360Hz update period
   bool hasInputs; //True if number of inputs > 0
   bool active; //True when the application card is active, mode irrelevant
@@ -382,6 +444,10 @@ class DbApplicationCard : public DbEntry {
   // Memory containing firmware configuration buffer
   ApplicationConfigBufferBitSet *applicationConfigBuffer;
 
+  // Configuration built ahead of time by stageConfiguration(), copied to
+  // applicationConfigBuffer when it is written to the firmware
+  ApplicationConfigBufferBitSet *stagedConfigBuffer;
+
   // Input updates - for debugging only
   ApplicationUpdateBufferBitSet *applicationUpdateBuffer;
   ApplicationUpdateBufferFullBitSet *applicationUpdateBufferFull;
@@ -393,6 +459,12 @@ class DbApplicationCard : public DbEntry {
   DbAnalogDeviceMapPtr analogDevices;
   DbDigitalDeviceMapPtr digitalDevices;
 
+  // Bypass overrides for the inputs read from this card
+  BypassOverride bypassOverride;
+
+  // Time spent updating the inputs of this card (input update thread)
+  CycleStat updateTime;
+
   void setUpdateBufferPtr(std::vector<uint8_t>* p);
   ApplicationUpdateBufferBitSetHalf* getWasLowBuffer();
   ApplicationUpdateBufferBitSetHalf* getWasHighBuffer();
@@ -400,8 +472,10 @@ class DbApplicationCard : public DbEntry {
   DbApplicationCard();
 
   void writeConfiguration(bool enableTimeout = false);
-  void writeDigitalConfiguration();
-  void writeAnalogConfiguration();
+  void stageConfiguration(time_t expiredBy);
+  bool writeConfigurationBuffer(ApplicationConfigBufferBitSet *buffer, time_t expiredBy);
+  void writeDigitalConfiguration(ApplicationConfigBufferBitSet *buffer, time_t expiredBy = 0);
+  void writeAnalogConfiguration(ApplicationConfigBufferBitSet *buffer, time_t expiredBy = 0);
 
   void printAnalogConfiguration();
 
@@ -423,7 +497,7 @@ class DbApplicationCard : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbApplicationCard> DbApplicationCardPtr;
-typedef std::map<uint32_t, DbApplicationCardPtr> DbApplicationCardMap;
+typedef DbArenaMap<DbApplicationCardPtr>::type DbApplicationCardMap;
 typedef boost::shared_ptr<DbApplicationCardMap> DbApplicationCardMapPtr;
 
 /**
@@ -454,7 +528,7 @@ class DbFaultInput : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbFaultInput> DbFaultInputPtr;
-typedef std::map<uint32_t, DbFaultInputPtr> DbFaultInputMap;
+typedef DbArenaMap<DbFaultInputPtr>::type DbFaultInputMap;
 typedef boost::shared_ptr<DbFaultInputMap> DbFaultInputMapPtr;
 
 
@@ -464,8 +538,8 @@ typedef boost::shared_ptr<DbFaultInputMap> DbFaultInputMapPtr;
 class DbBeamClass : public DbEntry {
  public:
   uint32_t number;
-  std::string name;
-  std::string description;
+  DbString name;
+  DbString description;
   uint32_t integrationWindow;
   uint32_t minPeriod;
   uint32_t totalCharge;
@@ -475,7 +549,7 @@ class DbBeamClass : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbBeamClass>     DbBeamClassPtr;
-typedef std::map<uint32_t, DbBeamClassPtr> DbBeamClassMap;
+typedef DbArenaMap<DbBeamClassPtr>::type DbBeamClassMap;
 typedef boost::shared_ptr<DbBeamClassMap>  DbBeamClassMapPtr;
 typedef std::vector<uint32_t>              DbMitBuffer;
 
@@ -484,7 +558,7 @@ typedef std::vector<uint32_t>              DbMitBuffer;
  */
 class DbBeamDestination : public DbEntry {
  public:
-  std::string name;
+  DbString name;
   uint16_t destinationMask;
   uint32_t buffer0DestinationMask;
   uint32_t buffer1DestinationMask;
@@ -505,6 +579,8 @@ class DbBeamDestination : public DbEntry {
 
   DbBeamDestination();
 
+  void setDestinationMask(uint16_t mask);
+
   void setAllowedBeamClass() {
     uint32_t allowedClassExpand = 0;
     uint8_t shift = 0;
@@ -571,7 +647,7 @@ class DbBeamDestination : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbBeamDestination> DbBeamDestinationPtr;
-typedef std::map<uint32_t, DbBeamDestinationPtr> DbBeamDestinationMap;
+typedef DbArenaMap<DbBeamDestinationPtr>::type DbBeamDestinationMap;
 typedef boost::shared_ptr<DbBeamDestinationMap> DbBeamDestinationMapPtr;
 
 
@@ -594,7 +670,7 @@ class DbAllowedClass : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbAllowedClass> DbAllowedClassPtr;
-typedef std::map<uint32_t, DbAllowedClassPtr> DbAllowedClassMap;
+typedef DbArenaMap<DbAllowedClassPtr>::type DbAllowedClassMap;
 typedef boost::shared_ptr<DbAllowedClassMap> DbAllowedClassMapPtr;
 
 
@@ -624,9 +700,6 @@ class DbFaultState : public DbEntry {
  */
 class DbFault : public DbEntry {
  public:
-  std::string name;
-  std::string description;
-
   // Configured after loading the YAML file
   bool faulted;
   bool faultedDisplay;
@@ -644,6 +717,10 @@ class DbFault : public DbEntry {
   DbFaultStatePtr defaultFaultState; // Default fault state if no other fault is active
                                                    // the default state not necessarily is a real fault
 
+  // Only used for display, kept after the evaluation state
+  DbString name;
+  DbString description;
+
   DbFault();
 
   void update(uint32_t v) {
@@ -655,7 +732,7 @@ class DbFault : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbFault> DbFaultPtr;
-typedef std::map<uint32_t, DbFaultPtr> DbFaultMap;
+typedef DbArenaMap<DbFaultPtr>::type DbFaultMap;
 typedef boost::shared_ptr<DbFaultMap> DbFaultMapPtr;
 
 /**
@@ -678,7 +755,7 @@ class DbConditionInput : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbConditionInput> DbConditionInputPtr;
-typedef std::map<uint32_t, DbConditionInputPtr> DbConditionInputMap;
+typedef DbArenaMap<DbConditionInputPtr>::type DbConditionInputMap;
 typedef boost::shared_ptr<DbConditionInputMap> DbConditionInputMapPtr;
 
 
@@ -705,7 +782,7 @@ class DbIgnoreCondition : public DbEntry {
 };
 
 typedef boost::shared_ptr<DbIgnoreCondition> DbIgnoreConditionPtr;
-typedef std::map<uint32_t, DbIgnoreConditionPtr> DbIgnoreConditionMap;
+typedef DbArenaMap<DbIgnoreConditionPtr>::type DbIgnoreConditionMap;
 typedef boost::shared_ptr<DbIgnoreConditionMap> DbIgnoreConditionMapPtr;
 
 /**
@@ -713,8 +790,6 @@ typedef boost::shared_ptr<DbIgnoreConditionMap> DbIgnoreConditionMapPtr;
  */
 class DbCondition : public DbEntry {
  public:
-  std::string name;
-  std::string description;
   uint32_t mask;
 
   // Configured after loading the YAML file
@@ -722,12 +797,16 @@ class DbCondition : public DbEntry {
   bool state; // State is true when condition is met
   DbIgnoreConditionMapPtr ignoreConditions;
 
+  // Only used for display, kept after the evaluation state
+  DbString name;
+  DbString description;
+
   DbCondition();
   friend std::ostream & operator<<(std::ostream &os, DbCondition * const fault);
 };
 
 typedef boost::shared_ptr<DbCondition> DbConditionPtr;
-typedef std::map<uint32_t, DbConditionPtr> DbConditionMap;
+typedef DbArenaMap<DbConditionPtr>::type DbConditionMap;
 typedef boost::shared_ptr<DbConditionMap> DbConditionMapPtr;
 
 #endif
@@ -1,11 +1,17 @@
 #include <central_node_engine.h>
 #include <central_node_firmware.h>
 #include <central_node_history.h>
+#include <central_node_postmortem.h>
+#include <central_node_archive.h>
+#include <central_node_frame_tap.h>
+#include <central_node_metrics.h>
+#include <central_node_database_delta.h>
 
 #include <stdio.h>
 #include <stdint.h>
 #include <sched.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include <log.h>
 #include <log_wrapper.h>
@@ -41,7 +47,17 @@ Engine::Engine()
     _setFaultIgnoreTimer( "setFaultIgnoreTimer", 720 ),
     _mitigateTimer( "mitigateTimer", 720 ),
     _setAllowedBeamClassTimer( "setAllowedBeamClassTimer", 720 ),
-    hb( Firmware::getInstance().getRoot(), 3500, 720 )
+    hb( Firmware::getInstance().getRoot(), 3500, 720 ),
+    _bypassSequence(0),
+    _bypassViewValid(false),
+    _bypassViewUpdates(0),
+    _bypassViewRetries(0),
+    _checkpointThread(NULL),
+    _checkpointRun(false),
+    _checkpointHash(0),
+    _checkpointCount(0),
+    _warmRestart(false),
+    _keepFirmwareEnabled(false)
 {
 #if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
     engineLogger = Loggers::getLogger("ENGINE");
@@ -54,6 +70,11 @@ Engine::Engine()
     Engine::_startTime = 0;
     Engine::_inputUpdateFailCounter = 0;
 
+    // Evaluation must complete within one cycle, count the cycles that
+    // come late (more than half a period)
+    _checkFaultTime.setBudget(EVALUATION_CYCLE_PERIOD);
+    _evaluationCycleTime.setBudget(1.5 * EVALUATION_CYCLE_PERIOD);
+
     // Lock memory
     if(mlockall(MCL_CURRENT|MCL_FUTURE) == -1)
     {
@@ -67,9 +88,19 @@ Engine::~Engine()
 #if defined(LOG_ENABLED)
     //  Firmware::getInstance().showStats();
 #endif
-    // Stop the MPS before quitting
-    Firmware::getInstance().setSoftwareEnable(false);
-    Firmware::getInstance().setEnable(false);
+    // Stop the MPS before quitting, unless the next run is going to
+    // resume with the same configuration (see prepareWarmRestart())
+    if (!_keepFirmwareEnabled)
+    {
+        Firmware::getInstance().setSoftwareEnable(false);
+        Firmware::getInstance().setEnable(false);
+    }
+
+    if (_checkpointThread)
+    {
+        _checkpointRun = false;
+        _checkpointThread->join();
+    }
 
     _checkFaultTime.show();
 
@@ -134,6 +165,46 @@ int Engine::reloadConfigFromIgnore()
     return 0;
 }
 
+/**
+ * Apply a database delta file (see MpsDbDelta, built by central_node_db_diff)
+ * to the loaded database. The engine lock is held, so the delta is applied
+ * between two evaluation cycles, and only the configuration of the
+ * affected application cards is written to the firmware.
+ *
+ * Throws an exception with the reason if the delta can't be applied in
+ * place (e.g. new application cards or devices), in which case the
+ * database is not changed and must be reloaded instead.
+ */
+int Engine::applyDelta(std::string deltaFileName)
+{
+    if (!_mpsDb)
+    {
+        _errorStream.str(std::string());
+        _errorStream << "ERROR: No database loaded, can't apply delta " << deltaFileName;
+        throw(EngineException(_errorStream.str()));
+    }
+
+    MpsDbDelta delta;
+    delta.read(deltaFileName);
+
+    std::set<uint32_t> cardIds;
+    {
+        std::unique_lock<std::mutex> engineLock(_mutex);
+        std::unique_lock<std::mutex> lock(*_mpsDb->getMutex());
+
+        _mpsDb->applyDelta(delta, cardIds);
+        _mpsDb->stageFirmwareConfiguration(cardIds, 0);
+        _mpsDb->writeStagedFirmwareConfiguration(cardIds);
+    }
+
+    std::cout << "INFO: Database delta " << deltaFileName << " applied ("
+              << delta.getRows().size() << " rows, " << cardIds.size()
+              << " applications reconfigured), database is now "
+              << delta.getToMd5sum() << std::endl;
+
+    return 0;
+}
+
 int Engine::loadConfig(std::string yamlFileName, uint32_t inputUpdateTimeout)
 {
     if (_mpsDb)
@@ -145,9 +216,22 @@ int Engine::loadConfig(std::string yamlFileName, uint32_t inputUpdateTimeout)
     std::cout << "INFO: Engine::loadConfig(" << yamlFileName << ")" << std::endl;
     std::unique_lock<std::mutex> engineLock(_mutex);
 
+    // State saved by the previous run. If the firmware is still running
+    // the configuration written by that run it is left enabled, until
+    // the configuration of the new database is known to be the same.
+    EngineCheckpoint checkpoint;
+    bool restore = readCheckpoint(checkpoint);
+    bool firmwareRunning = restore &&
+        Firmware::getInstance().getEnable() &&
+        Firmware::getInstance().fpgaVersion == checkpoint.getFpgaVersion() &&
+        checkpoint.getGitHash() == Firmware::getInstance().gitHashString;
+
     // First stop the MPS
-    Firmware::getInstance().setSoftwareEnable(false);
-    Firmware::getInstance().setEnable(false);
+    if (!firmwareRunning)
+    {
+        Firmware::getInstance().setSoftwareEnable(false);
+        Firmware::getInstance().setEnable(false);
+    }
 
     // If updateThread active, then stop it first - the _mpsDb check will prevents
     // a database from being reloaded, no need to stop the updateThread
@@ -206,6 +290,11 @@ int Engine::loadConfig(std::string yamlFileName, uint32_t inputUpdateTimeout)
 
         LOG_TRACE("ENGINE", "MPS Database configured from YAML");
 
+        std::cout << "INFO: Database loaded from "
+                  << (mpsDb->isLoadedFromImage() ? "compiled image" : "YAML")
+                  << " in " << mpsDb->getLoadTime() * 1e3 << " ms, configured in "
+                  << mpsDb->getConfigureTime() * 1e3 << " ms" << std::endl;
+
         // Assign bypass to each digital/analog input
         try
         {
@@ -223,6 +312,40 @@ int Engine::loadConfig(std::string yamlFileName, uint32_t inputUpdateTimeout)
         // successfully, assign to _mpsDb shared_ptr
         _mpsDb = mpsDb;//shared_ptr<MpsDb>(db);
 
+        // Chatter filter state for the inputs of this database
+        uint32_t maxDeviceInputId = 0;
+        uint32_t maxAnalogDeviceId = 0;
+        if (_mpsDb->deviceInputs && !_mpsDb->deviceInputs->empty())
+            maxDeviceInputId = _mpsDb->deviceInputs->rbegin()->first;
+        if (_mpsDb->analogDevices && !_mpsDb->analogDevices->empty())
+            maxAnalogDeviceId = _mpsDb->analogDevices->rbegin()->first;
+        History::getInstance().setChatterInputs(maxDeviceInputId, maxAnalogDeviceId);
+
+        // The checkpoint state only applies to the database it was taken with
+        std::string md5sum;
+        if (_mpsDb->databaseInfo && !_mpsDb->databaseInfo->empty())
+            md5sum = _mpsDb->databaseInfo->begin()->second->md5sum;
+        if (restore && checkpoint.getDbMd5sum() != md5sum)
+        {
+            std::cout << "INFO: Engine checkpoint taken with another database ("
+                      << checkpoint.getDbMd5sum() << "), not restored" << std::endl;
+            restore = false;
+        }
+
+        if (restore)
+        {
+            uint32_t bypasses = checkpoint.restore(_mpsDb, _bypassManager);
+            std::cout << "INFO: Restored engine checkpoint, " << bypasses
+                      << " bypasses still active" << std::endl;
+        }
+
+        // Bypass state must be copied to the new database inputs
+        _bypassViewValid = false;
+        updateBypassView();
+
+        if (restore)
+            checkpoint.restoreLatches(_mpsDb);
+
         // Find the lowest/highest BeamClasses - used when checking faults
         uint32_t num = 0;
         uint32_t lowNum = 100;
@@ -243,7 +366,38 @@ int Engine::loadConfig(std::string yamlFileName, uint32_t inputUpdateTimeout)
             }
         }
 
-        _mpsDb->writeFirmwareConfiguration(true);
+        // Only the configuration registers of the applications in the
+        // database are created, the others are never written
+        std::set<uint32_t> appIds;
+        for (DbApplicationCardMap::iterator card = _mpsDb->applicationCards->begin();
+            card != _mpsDb->applicationCards->end();
+            ++card)
+        {
+            appIds.insert((*card).second->globalId);
+        }
+        Firmware::getInstance().createConfigRegisters(appIds);
+
+        // Warm restart: the firmware is still running the configuration
+        // built from the same database and state, don't write it again
+        _warmRestart = restore && firmwareRunning &&
+            _mpsDb->matchFirmwareConfiguration(checkpoint.getFirmwareFingerprint());
+        if (_warmRestart)
+        {
+            std::cout << "INFO: Warm restart, firmware configuration unchanged since "
+                      << "the checkpoint, MPS left enabled" << std::endl;
+        }
+        else
+        {
+            if (firmwareRunning)
+            {
+                std::cout << "INFO: Firmware configuration changed since the checkpoint, "
+                          << "stopping the MPS to write it" << std::endl;
+                Firmware::getInstance().setSoftwareEnable(false);
+                Firmware::getInstance().setEnable(false);
+            }
+            _mpsDb->writeFirmwareConfiguration(true);
+        }
+        Firmware::getInstance().showStartupTimes();
     }
 
     LOG_TRACE("ENGINE", "Lowest beam class found: " << _lowestBeamClass->number);
@@ -256,9 +410,125 @@ int Engine::loadConfig(std::string yamlFileName, uint32_t inputUpdateTimeout)
 
     startUpdateThread();
 
+    if (!_checkpointFileName.empty() && !_checkpointThread)
+    {
+        _checkpointRun = true;
+        _checkpointThread = new std::thread(&Engine::checkpointThread, this);
+    }
+
     return 0;
 }
 
+/**
+ * Enable the engine state checkpoint, must be called before loadConfig().
+ * The active bypasses, the forced/soft/max permits, the latched input
+ * values and the fingerprint of the firmware configuration are saved to
+ * 'fileName' whenever they change (checked every CHECKPOINT_PERIOD
+ * seconds), and restored by loadConfig() on the next start.
+ */
+void Engine::setCheckpointFile(std::string fileName)
+{
+    _checkpointFileName = fileName;
+}
+
+/**
+ * Returns false if there is no checkpoint to restore.
+ */
+bool Engine::readCheckpoint(EngineCheckpoint &checkpoint)
+{
+    if (_checkpointFileName.empty())
+        return false;
+
+    if (access(_checkpointFileName.c_str(), F_OK) != 0)
+    {
+        std::cout << "INFO: No engine checkpoint (" << _checkpointFileName
+                  << "), cold start" << std::endl;
+        return false;
+    }
+
+    try
+    {
+        checkpoint.read(_checkpointFileName);
+    }
+    catch (CentralNodeException &e)
+    {
+        std::cerr << "WARN: " << e.what() << ", cold start" << std::endl;
+        return false;
+    }
+
+    checkpoint.show(std::cout);
+    return true;
+}
+
+/**
+ * Save the engine state if it changed since the last checkpoint. Returns
+ * 0 if a checkpoint was written, 1 otherwise.
+ */
+int Engine::writeCheckpoint()
+{
+    if (_checkpointFileName.empty() || !_mpsDb || !_bypassManager)
+        return 1;
+
+    EngineCheckpoint checkpoint;
+    {
+        std::unique_lock<std::mutex> lock(*_mpsDb->getMutex());
+        checkpoint.capture(_mpsDb, _bypassManager);
+    }
+
+    std::unique_lock<std::mutex> lock(_checkpointMutex);
+    uint64_t hash = checkpoint.getStateHash();
+    if (_checkpointCount > 0 && hash == _checkpointHash)
+        return 1;
+
+    checkpoint.write(_checkpointFileName);
+    _checkpointHash = hash;
+    _checkpointCount++;
+
+    return 0;
+}
+
+/**
+ * Called before a planned IOC restart: save the state one last time and
+ * leave the MPS enabled when the engine and firmware are destroyed, so
+ * the next loadConfig() can resume without stopping the beam. Returns 1
+ * if checkpoints are not enabled.
+ */
+int Engine::prepareWarmRestart()
+{
+    if (_checkpointFileName.empty())
+        return 1;
+
+    writeCheckpoint();
+    _keepFirmwareEnabled = true;
+    Firmware::getInstance().setDisableOnExit(false);
+
+    std::cout << "INFO: Engine checkpoint saved, MPS left enabled for warm restart" << std::endl;
+    return 0;
+}
+
+void Engine::checkpointThread()
+{
+    std::cout << "INFO: Checkpoint thread started (" << _checkpointFileName << ")" << std::endl;
+
+    bool failed = false;
+    while (_checkpointRun)
+    {
+        sleep(CHECKPOINT_PERIOD);
+        try
+        {
+            writeCheckpoint();
+            failed = false;
+        }
+        catch (CentralNodeException &e)
+        {
+            // Report the first failure only
+            if (!failed)
+                std::cerr << e.what() << std::endl;
+            failed = true;
+        }
+    }
+}
+
 bool Engine::findBeamDestinations()
 {
     for (DbBeamDestinationMap::iterator it = _mpsDb->beamDestinations->begin();
@@ -355,13 +625,109 @@ bool Engine::setAllowedBeamClass()
     return true;
 }
 
+/**
+ * Pick up the bypass state published by the BypassManager. The per-card
+ * bypass override masks (and the analog device bypass masks) are only
+ * recomputed when the state table changed since the last cycle, and then
+ * applied to the already decoded inputs. If a writer is updating the table
+ * the current view is kept, and the copy is attempted again on the next
+ * cycle - the engine never waits.
+ */
+void Engine::updateBypassView()
+{
+    if (!_bypassManager)
+        return;
+
+    const BypassStateTable &table = _bypassManager->getStateTable();
+    if (_bypassViewValid && table.getSequence() == _bypassSequence)
+        return;
+
+    uint32_t sequence;
+    if (!table.read(_bypassRecords, sequence))
+    {
+        _bypassViewRetries++;
+        return;
+    }
+
+    for (DbApplicationCardMap::iterator card = _mpsDb->applicationCards->begin();
+        card != _mpsDb->applicationCards->end();
+        ++card)
+    {
+        (*card).second->bypassOverride.clear();
+    }
+
+    // Digital inputs: force the channel bit to the bypass value
+    for (DbDeviceInputMap::iterator input = _mpsDb->deviceInputs->begin();
+        input != _mpsDb->deviceInputs->end();
+        ++input)
+    {
+        InputBypassPtr bypass = (*input).second->bypass;
+        BypassOverride *bypassOverride = (*input).second->getBypassOverride();
+        if (bypass && bypassOverride && (*input).second->channel &&
+            bypass->id < _bypassRecords.size() &&
+            _bypassRecords[bypass->id].status == BYPASS_VALID)
+        {
+            uint64_t bit = static_cast<uint64_t>(1) << (*input).second->channel->number;
+            bypassOverride->force |= bit;
+            if (_bypassRecords[bypass->id].value & 0x1)
+                bypassOverride->forceValue |= bit;
+        }
+    }
+
+    // Analog devices: force the bypassed integrator thresholds to zero
+    for (DbAnalogDeviceMap::iterator device = _mpsDb->analogDevices->begin();
+        device != _mpsDb->analogDevices->end();
+        ++device)
+    {
+        uint32_t mask = 0xFFFFFFFF;
+        for (uint32_t i = 0; i < ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL; ++i)
+        {
+            InputBypassPtr bypass = (*device).second->bypass[i];
+            if (bypass && bypass->id < _bypassRecords.size() &&
+                _bypassRecords[bypass->id].status == BYPASS_VALID)
+            {
+                // zero the bypassed integrator thresholds
+                mask &= ~(0xFF << (i * ANALOG_CHANNEL_INTEGRATORS_SIZE));
+            }
+        }
+        (*device).second->bypassMask = mask;
+
+        BypassOverride *bypassOverride = (*device).second->getBypassOverride();
+        if (bypassOverride && (*device).second->channel &&
+            (*device).second->channel->number < APP_CARD_MAX_ANALOG_CHANNELS)
+        {
+            bypassOverride->analogForce[(*device).second->channel->number] = ~mask;
+        }
+    }
+
+    // The inputs for this cycle were decoded with the previous masks
+    for (DbDeviceInputMap::iterator input = _mpsDb->deviceInputs->begin();
+        input != _mpsDb->deviceInputs->end();
+        ++input)
+    {
+        (*input).second->applyBypassOverride();
+    }
+
+    for (DbAnalogDeviceMap::iterator device = _mpsDb->analogDevices->begin();
+        device != _mpsDb->analogDevices->end();
+        ++device)
+    {
+        (*device).second->applyBypassOverride();
+    }
+
+    _bypassSequence = sequence;
+    _bypassViewValid = true;
+    _bypassViewUpdates++;
+}
+
 /**
  * First goes through the list of DigitalDevices and updates the current state.
  * Second updates the FaultStates for each Fault.
  * At the end of this method all Digital Faults will have updated values,
  * i.e. the field 'faulted' gets updated based on the current machine state.
  *
- * TODO: bypass mask and values accessed by multiple threads
+ * Bypasses are not checked here, the input values used already have the
+ * card bypass overrides applied (see updateBypassView()).
  */
 void Engine::evaluateFaults()
 {
@@ -389,19 +755,11 @@ void Engine::evaluateFaults()
                 input != (*device).second->inputDevices->end();
                 ++input)
             {
-                uint32_t inputValue = 0;
-                // Check if the input has a valid bypass value
-                if ((*input).second->bypass->status == BYPASS_VALID)
-                {
-                    inputValue = (*input).second->bypass->value;
-                    LOG_TRACE("ENGINE", (*device).second->name << " bypassing input value to "
-                        << (*input).second->bypass->value << " (actual value is "
-                        << (*input).second->latchedValue << ")");
-                }
-                else
-                {
-                    inputValue = (*input).second->latchedValue;
-                }
+                // Latched value with the bypass already applied when decoded
+                uint32_t inputValue = (*input).second->evaluationValue;
+                LOG_TRACE("ENGINE", (*device).second->name << " input value "
+                    << inputValue << " (latched value is "
+                    << (*input).second->latchedValue << ")");
 
                 inputValue <<= (*input).second->bitPosition;
                 deviceValue |= inputValue;
@@ -439,12 +797,12 @@ void Engine::evaluateFaults()
             }
             else
             {
-                // Check if there is an active bypass for analog device
+                // Bypassed thresholds were already cleared when decoded
                 LOG_TRACE("ENGINE", (*input).second->analogDevice->name << " bypassMask=" << std::hex <<
                     (*input).second->analogDevice->bypassMask << ", value=" <<
                     (*input).second->analogDevice->value << std::dec);
 
-                inputValue = (*input).second->analogDevice->latchedValue & (*input).second->analogDevice->bypassMask;
+                inputValue = (*input).second->analogDevice->evaluationValue;
             }
 
             faultValue |= (inputValue << (*input).second->bitPosition);
@@ -758,6 +1116,7 @@ int Engine::checkFaults()
     {
         std::unique_lock<std::mutex> lock(*_mpsDb->getMutex());
         _mpsDb->clearMitigationBuffer();
+        updateBypassView();
         setTentativeBeamClass();
         evaluateFaults();
         breakAnalogIgnore();
@@ -851,12 +1210,26 @@ void Engine::showStats()
 
         std::cout << "Reload latch: " << Engine::_linacFwLatch << std::endl;
         std::cout << "Reload Config Count: " << Engine::_reloadCount << std::endl;
+        std::cout << "Bypass view updates: " << _bypassViewUpdates
+            << " (retried " << _bypassViewRetries << " times)" << std::endl;
+        if (!_checkpointFileName.empty())
+            std::cout << "Checkpoint: " << _checkpointCount << " written to "
+                << _checkpointFileName << (_warmRestart ? " (warm restart)" : "") << std::endl;
 
         std::cout << "Counter: " << Engine::_updateCounter << std::endl;
         std::cout << "Input Update Fail Counter: " << Engine::_inputUpdateFailCounter
             << " (timed out waiting on FW 360Hz updates)" << std::endl;
         std::cout << "Started at " << ctime(&Engine::_startTime) << std::endl;
         std::cout << &History::getInstance() << std::endl;
+        std::cout << &PostMortem::getInstance() << std::endl;
+        if (FrameArchiver::getInstance().isRunning())
+            std::cout << &FrameArchiver::getInstance() << std::endl;
+        if (FrameTap::getInstance().isOpen())
+            std::cout << &FrameTap::getInstance() << std::endl;
+        if (Metrics::getInstance().isOpen())
+            std::cout << &Metrics::getInstance() << std::endl;
+        if (_bypassManager)
+            _bypassManager->showStats();
         _debugCounter = 0;
     }
     else
@@ -1014,7 +1387,12 @@ void Engine::engineThread()
         Firmware::getInstance().setTimingCheckEnable(true);
     }
 
-    Firmware::getInstance().clearAll();
+    // On a warm restart the MPS kept running: only clear the software
+    // errors caused by the restart, the firmware latches are kept
+    if (_warmRestart)
+        Firmware::getInstance().swErrClear();
+    else
+        Firmware::getInstance().clearAll();
 
 
     time_t before = time(0);
@@ -1077,6 +1455,23 @@ void Engine::engineThread()
 
             Engine::getInstance()._evaluationCycleTime.tick();
 
+            {
+                Metrics &metrics = Metrics::getInstance();
+                metrics.set(MetricEngineCycles, _updateCounter);
+                metrics.set(MetricEngineRate, _rate);
+                metrics.setTime(MetricEngineCheckTime, _checkFaultTime.getLastPeriod());
+                metrics.setTime(MetricEngineCheckTimeMax, _checkFaultTime.getAllMaxPeriod());
+                metrics.setTime(MetricEngineCycleTime, _evaluationCycleTime.getLastPeriod());
+                metrics.setTime(MetricEngineCycleTimeMax, _evaluationCycleTime.getAllMaxPeriod());
+                metrics.set(MetricEngineCheckOverBudget, _checkFaultTime.getBudgetViolations());
+                metrics.set(MetricEngineCycleOverBudget, _evaluationCycleTime.getBudgetViolations());
+                metrics.set(MetricEngineInputUpdateFail, _inputUpdateFailCounter);
+                metrics.set(MetricEngineConfigReloads, _reloadCount);
+                metrics.set(MetricHeartbeatWdErrors, hb.getWdErrorCnt());
+                metrics.setTime(MetricHeartbeatTxTimeMax, hb.getMaxTxDuration());
+                metrics.publish();
+            }
+
             // Reloads FW configuration - cause by ignore logic that
             // enables/disables faults based on fast analog devices 
             if (reload)
@@ -1093,8 +1488,11 @@ void Engine::engineThread()
         engineLock.unlock();
     }
 
-    Firmware::getInstance().setSoftwareEnable(false);
-    Firmware::getInstance().setEnable(false);
+    if (!_keepFirmwareEnabled)
+    {
+        Firmware::getInstance().setSoftwareEnable(false);
+        Firmware::getInstance().setEnable(false);
+    }
 
     std::cout << "INFO: EngineThread: Exiting..." << std::endl;
 }
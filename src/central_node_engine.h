@@ -4,6 +4,7 @@
 #include <iostream>
 #include <sstream>
 #include <thread>
+#include <atomic>
 #include <boost/shared_ptr.hpp>
 
 #include <central_node_exception.h>
@@ -11,6 +12,7 @@
 #include <central_node_database.h>
 #include <central_node_bypass.h>
 #include <central_node_bypass_manager.h>
+#include <central_node_checkpoint.h>
 #include <time_util.h>
 #include "timer.h"
 #include "buffer.h"
@@ -58,6 +60,11 @@ public:
     int loadConfig(std::string yamlFileName, uint32_t inputUpdateTimeout=3500);
     int reloadConfig();
     int reloadConfigFromIgnore();
+    int applyDelta(std::string deltaFileName);
+    void setCheckpointFile(std::string fileName);
+    int writeCheckpoint();
+    int prepareWarmRestart();
+    bool isWarmRestart() const { return _warmRestart; };
     int checkFaults();
     bool isInitialized();
     void clearSoftwareLatch();
@@ -68,6 +75,8 @@ public:
     friend class EngineTest;
     friend class BypassTest;
     friend class FirmwareTest;
+    friend class ScalingBench;
+    friend class EngineBench;
 
     void showFaults();
     void showStats();
@@ -107,11 +116,15 @@ private:
     void setTentativeBeamClass();
     bool setAllowedBeamClass();
 
+    void updateBypassView();
     void evaluateFaults();
     bool evaluateIgnoreConditions();
     void setFaultIgnore();
     void breakAnalogIgnore();
 
+    bool readCheckpoint(EngineCheckpoint &checkpoint);
+    void checkpointThread();
+
     MpsDbPtr _mpsDb;
     BypassManagerPtr _bypassManager;
 
@@ -142,6 +155,25 @@ private:
     // Heartbeat control class
     NonBlockingHeartBeat hb;
 
+    // Local copy of the bypass state published by the BypassManager, only
+    // refreshed when the state table sequence number changes
+    std::vector<BypassRecord> _bypassRecords;
+    uint32_t _bypassSequence;
+    bool _bypassViewValid;
+    uint32_t _bypassViewUpdates;
+    uint32_t _bypassViewRetries;
+
+    // Engine state checkpoint (see setCheckpointFile()), written by the
+    // checkpoint thread when the state changes
+    std::string _checkpointFileName;
+    std::thread *_checkpointThread;
+    std::atomic<bool> _checkpointRun;
+    std::mutex _checkpointMutex;
+    uint64_t _checkpointHash;
+    uint32_t _checkpointCount;
+    bool _warmRestart;          // Firmware configuration kept by loadConfig()
+    std::atomic<bool> _keepFirmwareEnabled;  // Set by prepareWarmRestart()
+
 public:
     static Engine &getInstance()
     {
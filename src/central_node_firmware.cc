@@ -3,7 +3,10 @@
 #include <central_node_engine.h>
 #include <stdint.h>
 #include <log_wrapper.h>
+#include <cycle_counter.h>
 #include <stdio.h>
+#include <atomic>
+#include <thread>
 
 #if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
 using namespace easyloggingpp;
@@ -43,7 +46,12 @@ const std::vector<std::string> Firmware::PcChangePacketFlagsLabels =
 };
 
 #ifdef FW_ENABLED
-Firmware::Firmware()
+Firmware::Firmware() :
+    _createRootTime(0),
+    _createRegistersTime(0),
+    _createConfigRegistersTime(0),
+    _configRegisterCount(0),
+    _disableOnExit(true)
 {
 #if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
     firmwareLogger = Loggers::getLogger("FIRMWARE");
@@ -60,14 +68,19 @@ Firmware::Firmware()
 
 Firmware::~Firmware()
 {
-    setSoftwareEnable(false);
-    setEnable(false);
+    if (_disableOnExit)
+    {
+        setSoftwareEnable(false);
+        setEnable(false);
+    }
 }
 
 int Firmware::createRoot(std::string yamlFileName)
 {
+    uint64_t start = CycleCounter::now();
     Hub hub = IPath::loadYamlFile(yamlFileName.c_str(), "NetIODev")->origin();
     _root = IPath::create(hub);
+    _createRootTime = CycleCounter::toNs(CycleCounter::now() - start) / 1e9;
     return 0;
 }
 
@@ -81,212 +94,193 @@ void Firmware::setRoot(Path root)
     _root = root;
 }
 
-// TODO: separate yaml loading and scalval creation into two funcs - so can call yamlloader
-int Firmware::createRegisters()
+/**
+ * Global register created by createRegisters(), only one of the handle
+ * pointers is set. Errors are kept in the register and thrown once all
+ * the workers are done.
+ */
+class FirmwareRegister
 {
-    uint8_t gitHash[21];
-
-    if (!_root)
-        return 1;
-
-    std::string base = "/mmio";
-    std::string axi = "/AmcCarrierCore/AxiVersion";
-    std::string mps = "/MpsCentralApplication";
-    std::string core = "/MpsCentralNodeCore";
-    std::string config = "/MpsCentralNodeConfig";
-
+public:
     std::string name;
+    ScalVal    *scalVal;
+    ScalVal_RO *scalValRO;
+    Command    *command;
+    Stream     *stream;
+    std::string error;
+
+    FirmwareRegister(std::string n) :
+        name(n), scalVal(NULL), scalValRO(NULL), command(NULL), stream(NULL) {};
+};
 
-    try
-    {
-        name = base + axi + "/FpgaVersion";
-        _fpgaVersionSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + axi + "/BuildStamp";
-        _buildStampSV  = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + axi + "/GitHash";
-        _gitHashSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/SwHeartbeat";
-        _swHeartbeatCmd = ICommand::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/EvalLatchClear";
-        _evalLatchClearCmd = ICommand::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/Enable";
-        _enableSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/SoftwareEnable";
-        _swEnableSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/SoftwareClear";
-        _swClearSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/SoftwareLossError";
-        _swLossErrorSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/SoftwareLossCnt";
-        _swLossCntSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/SoftwareBwidthCnt";
-        _txClkCntSV = IScalVal_RO::create (_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/BeamIntTime";
-        _beamIntTimeSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/BeamMinPeriod";
-        _beamMinPeriodSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/BeamIntCharge";
-        _beamIntChargeSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/BeamFaultReason";
-        _beamFaultReasonSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/BeamFaultEn";
-        _beamFaultEnSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/EvalLatchClear";
-        _evalLatchClearCmd = ICommand::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/MonErrClear";
-        _monErrClearCmd = ICommand::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/SwErrClear";
-        _swErrClearCmd = ICommand::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core  + "/BeamFaultClr";
-        _beamFaultClrSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/EvaluationSwPowerLevel";
-        _swMitigationSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/EvaluationFwPowerLevel";
-        _fwMitigationSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/EvaluationLatchedPowerLevel";
-        _latchedMitigationSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/EvaluationPowerLevel";
-        _mitigationSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/ConPowH";
-        _finalBCHSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/ConPowL";
-        _finalBCLSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/SwitchConfig";
-        _switchConfigCmd = ICommand::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/ToErrClear";
-        _toErrClearCmd = ICommand::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MoConcErrClear";
-        _moConcErrClearCmd = ICommand::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorReady";
-        _monitorReadySV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorRxErrCnt";
-        _monitorRxErrorCntSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorPauseCnt";
-        _monitorPauseCntSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorOvflCnt";
-        _monitorOvflCntSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorDropCnt";
-        _monitorDropCntSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorConcWdErr";
-        _monitorConcWdErrSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorConcStallErr";
-        _monitorConcStallErrSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorConcExtRxErr0";
-        _monitorConcExtRxErr0SV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/MonitorConcExtRxErr1";
-        _monitorConcExtRxErr1SV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/TimeoutEnable";
-        _timeoutEnableSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/TimeoutClear";
-        _timeoutClearSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/TimeoutTime";
-        _timeoutTimeSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/TimeoutMask";
-        _timeoutMaskSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        // Initialize timeout mask to zero
-        writeAppTimeoutMask();
-
-        name = base + mps + core + "/TimeoutErrStatus";
-        _timeoutErrStatusSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/TimeoutErrIndex";
-        _timeoutErrIndexSV = IScalVal_RO::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/TimeoutMsgVer";
-        _timeoutMsgVerSV = IScalVal::create(_root->findByName(name.c_str()));
-
-        name = base + mps + core + "/EvaluationEnable";
-        _evaluationEnableSV = IScalVal::create(_root->findByName(name.c_str()));
+class FirmwareRegisterLoad
+{
+public:
+    Path root;
+    std::vector<FirmwareRegister> registers;
+    std::atomic<uint32_t> next;
+};
 
-        name = base + mps + core + "/EvaluationTimeStamp";
-        _evaluationTimeStampSV = IScalVal_RO::create(_root->findByName(name.c_str()));
+static void addRegister(FirmwareRegisterLoad &load, std::string name, ScalVal *reg)
+{
+    load.registers.push_back(FirmwareRegister(name));
+    load.registers.back().scalVal = reg;
+}
 
-        name = base + mps + core + "/SoftwareWdTime";
-        _swWdTimeSV = IScalVal::create(_root->findByName(name.c_str()));
+static void addRegister(FirmwareRegisterLoad &load, std::string name, ScalVal_RO *reg)
+{
+    load.registers.push_back(FirmwareRegister(name));
+    load.registers.back().scalValRO = reg;
+}
 
-        name = base + mps + core + "/SoftwareBusy";
-        _swBusySV = IScalVal_RO::create(_root->findByName(name.c_str()));
+static void addRegister(FirmwareRegisterLoad &load, std::string name, Command *reg)
+{
+    load.registers.push_back(FirmwareRegister(name));
+    load.registers.back().command = reg;
+}
 
-        name = base + mps + core + "/SoftwarePause";
-        _swPauseSV = IScalVal_RO::create(_root->findByName(name.c_str()));
+static void addRegister(FirmwareRegisterLoad &load, std::string name, Stream *reg)
+{
+    load.registers.push_back(FirmwareRegister(name));
+    load.registers.back().stream = reg;
+}
 
-        name = base + mps + core + "/SoftwareWdError";
-        _swWdErrorSV = IScalVal_RO::create(_root->findByName(name.c_str()));
+/**
+ * Worker for createRegisters(). CPSW Path objects must not be shared
+ * between threads, each worker looks up its registers from its own copy
+ * of the root (the hierarchy itself is read only once loaded).
+ */
+static void createRegisterGroup(FirmwareRegisterLoad *load)
+{
+    Path root = load->root->clone();
 
-        name = base + mps + core + "/SoftwareOvflCnt";
-        _swOvflCntSV = IScalVal_RO::create(_root->findByName(name.c_str()));
+    for (uint32_t i = load->next++; i < load->registers.size(); i = load->next++)
+    {
+        FirmwareRegister &reg = load->registers[i];
+        try
+        {
+            Path path = root->findByName(reg.name.c_str());
+            if (reg.scalVal)
+                *reg.scalVal = IScalVal::create(path);
+            else if (reg.scalValRO)
+                *reg.scalValRO = IScalVal_RO::create(path);
+            else if (reg.command)
+                *reg.command = ICommand::create(path);
+            else
+                *reg.stream = IStream::create(path);
+        }
+        catch (NotFoundError &e)
+        {
+            reg.error = "ERROR: Failed to find " + reg.name;
+        }
+        catch (InterfaceNotImplementedError &e)
+        {
+            reg.error = "ERROR: Wrong interface for " + reg.name;
+        }
+        catch (CPSWError &e)
+        {
+            reg.error = "ERROR: Failed to create " + reg.name + " (" + e.getInfo() + ")";
+        }
+    }
+}
 
-        name = base + mps + core + "/TimePowH";
-        _timingBCHSV = IScalVal_RO::create(_root->findByName(name.c_str()));
+/**
+ * Create the handles of the global registers, commands and streams with
+ * FW_NUM_REGISTER_THREADS threads. The per-application configuration
+ * registers are created later, only for the applications in the database
+ * (see createConfigRegisters()).
+ */
+int Firmware::createRegisters()
+{
+    uint8_t gitHash[21];
 
-        name = base + mps + core + "/TimePowL";
-        _timingBCLSV = IScalVal_RO::create(_root->findByName(name.c_str()));
+    if (!_root)
+        return 1;
 
-        name = "/Stream0";
-        _updateStreamSV = IStream::create(_root->findByName(name.c_str()));
+    uint64_t start = CycleCounter::now();
 
-        name = "/Stream1";
-        _pcChangeStreamSV = IStream::create(_root->findByName(name.c_str()));
+    std::string base = "/mmio";
+    std::string axi = "/AmcCarrierCore/AxiVersion";
+    std::string mps = "/MpsCentralApplication";
+    std::string core = "/MpsCentralNodeCore";
 
-        // ScalVal for configuration
-        for (uint32_t i = 0; i < FW_NUM_APPLICATIONS; ++i)
-        {
-            std::stringstream appId;
-            appId << "/AppId[" << i << "]/Config";
-            name = base + mps + config + appId.str();
-            _configSV[i] = IScalVal::create(_root->findByName(name.c_str()));
-        }
-    }
-    catch (NotFoundError &e)
-    {
-        throw(CentralNodeException("ERROR: Failed to find " + name));
-    }
-    catch (InterfaceNotImplementedError &e)
-    {
-        throw(CentralNodeException("ERROR: Wrong interface for " + name));
-    }
+    FirmwareRegisterLoad load;
+    load.root = _root;
+    load.next = 0;
+
+    addRegister(load, base + axi + "/FpgaVersion", &_fpgaVersionSV);
+    addRegister(load, base + axi + "/BuildStamp", &_buildStampSV);
+    addRegister(load, base + axi + "/GitHash", &_gitHashSV);
+    addRegister(load, base + mps + core + "/SwHeartbeat", &_swHeartbeatCmd);
+    addRegister(load, base + mps + core + "/EvalLatchClear", &_evalLatchClearCmd);
+    addRegister(load, base + mps + core + "/Enable", &_enableSV);
+    addRegister(load, base + mps + core + "/SoftwareEnable", &_swEnableSV);
+    addRegister(load, base + mps + core + "/SoftwareClear", &_swClearSV);
+    addRegister(load, base + mps + core + "/SoftwareLossError", &_swLossErrorSV);
+    addRegister(load, base + mps + core + "/SoftwareLossCnt", &_swLossCntSV);
+    addRegister(load, base + mps + core + "/SoftwareBwidthCnt", &_txClkCntSV);
+    addRegister(load, base + mps + core + "/BeamIntTime", &_beamIntTimeSV);
+    addRegister(load, base + mps + core + "/BeamMinPeriod", &_beamMinPeriodSV);
+    addRegister(load, base + mps + core + "/BeamIntCharge", &_beamIntChargeSV);
+    addRegister(load, base + mps + core + "/BeamFaultReason", &_beamFaultReasonSV);
+    addRegister(load, base + mps + core + "/BeamFaultEn", &_beamFaultEnSV);
+    addRegister(load, base + mps + core + "/MonErrClear", &_monErrClearCmd);
+    addRegister(load, base + mps + core + "/SwErrClear", &_swErrClearCmd);
+    addRegister(load, base + mps + core + "/BeamFaultClr", &_beamFaultClrSV);
+    addRegister(load, base + mps + core + "/EvaluationSwPowerLevel", &_swMitigationSV);
+    addRegister(load, base + mps + core + "/EvaluationFwPowerLevel", &_fwMitigationSV);
+    addRegister(load, base + mps + core + "/EvaluationLatchedPowerLevel", &_latchedMitigationSV);
+    addRegister(load, base + mps + core + "/EvaluationPowerLevel", &_mitigationSV);
+    addRegister(load, base + mps + core + "/ConPowH", &_finalBCHSV);
+    addRegister(load, base + mps + core + "/ConPowL", &_finalBCLSV);
+    addRegister(load, base + mps + core + "/SwitchConfig", &_switchConfigCmd);
+    addRegister(load, base + mps + core + "/ToErrClear", &_toErrClearCmd);
+    addRegister(load, base + mps + core + "/MoConcErrClear", &_moConcErrClearCmd);
+    addRegister(load, base + mps + core + "/MonitorReady", &_monitorReadySV);
+    addRegister(load, base + mps + core + "/MonitorRxErrCnt", &_monitorRxErrorCntSV);
+    addRegister(load, base + mps + core + "/MonitorPauseCnt", &_monitorPauseCntSV);
+    addRegister(load, base + mps + core + "/MonitorOvflCnt", &_monitorOvflCntSV);
+    addRegister(load, base + mps + core + "/MonitorDropCnt", &_monitorDropCntSV);
+    addRegister(load, base + mps + core + "/MonitorConcWdErr", &_monitorConcWdErrSV);
+    addRegister(load, base + mps + core + "/MonitorConcStallErr", &_monitorConcStallErrSV);
+    addRegister(load, base + mps + core + "/MonitorConcExtRxErr0", &_monitorConcExtRxErr0SV);
+    addRegister(load, base + mps + core + "/MonitorConcExtRxErr1", &_monitorConcExtRxErr1SV);
+    addRegister(load, base + mps + core + "/TimeoutEnable", &_timeoutEnableSV);
+    addRegister(load, base + mps + core + "/TimeoutClear", &_timeoutClearSV);
+    addRegister(load, base + mps + core + "/TimeoutTime", &_timeoutTimeSV);
+    addRegister(load, base + mps + core + "/TimeoutMask", &_timeoutMaskSV);
+    addRegister(load, base + mps + core + "/TimeoutErrStatus", &_timeoutErrStatusSV);
+    addRegister(load, base + mps + core + "/TimeoutErrIndex", &_timeoutErrIndexSV);
+    addRegister(load, base + mps + core + "/TimeoutMsgVer", &_timeoutMsgVerSV);
+    addRegister(load, base + mps + core + "/EvaluationEnable", &_evaluationEnableSV);
+    addRegister(load, base + mps + core + "/EvaluationTimeStamp", &_evaluationTimeStampSV);
+    addRegister(load, base + mps + core + "/SoftwareWdTime", &_swWdTimeSV);
+    addRegister(load, base + mps + core + "/SoftwareBusy", &_swBusySV);
+    addRegister(load, base + mps + core + "/SoftwarePause", &_swPauseSV);
+    addRegister(load, base + mps + core + "/SoftwareWdError", &_swWdErrorSV);
+    addRegister(load, base + mps + core + "/SoftwareOvflCnt", &_swOvflCntSV);
+    addRegister(load, base + mps + core + "/TimePowH", &_timingBCHSV);
+    addRegister(load, base + mps + core + "/TimePowL", &_timingBCLSV);
+    addRegister(load, "/Stream0", &_updateStreamSV);
+    addRegister(load, "/Stream1", &_pcChangeStreamSV);
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < FW_NUM_REGISTER_THREADS; ++i)
+        workers.push_back(std::thread(createRegisterGroup, &load));
+    createRegisterGroup(&load);
+    for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+        it->join();
+
+    for (std::vector<FirmwareRegister>::iterator reg = load.registers.begin();
+        reg != load.registers.end();
+        ++reg)
+    {
+        if (!reg->error.empty())
+            throw(CentralNodeException(reg->error));
+    }
+
+    // Initialize timeout mask to zero
+    writeAppTimeoutMask();
 
     if (_beamIntTimeSV->getNelms() != FW_NUM_BEAM_CLASSES)
         throw(CentralNodeException("ERROR: Invalid number of beam classes (BeamIntTime)"));
@@ -311,9 +305,74 @@ int Firmware::createRegisters()
         sprintf(&gitHashString[i], "%X", gitHash[i]);
     gitHashString[20] = 0;
 
+    _createRegistersTime = CycleCounter::toNs(CycleCounter::now() - start) / 1e9;
+    LOG_TRACE("FIRMWARE", "Created " << load.registers.size() << " registers in "
+        << _createRegistersTime * 1e3 << " ms");
+
     return 0;
 }
 
+/**
+ * Returns the configuration register of the application, creating it if
+ * needed. Only the applications of the loaded database are written, so
+ * the 1024 registers are not all created at startup.
+ */
+ScalVal Firmware::getConfigRegister(uint32_t appNumber)
+{
+    std::unique_lock<std::mutex> lock(_configMutex);
+
+    if (!_configSV[appNumber])
+    {
+        std::stringstream name;
+        name << "/mmio/MpsCentralApplication/MpsCentralNodeConfig/AppId[" << appNumber << "]/Config";
+        try
+        {
+            _configSV[appNumber] = IScalVal::create(_root->findByName(name.str().c_str()));
+        }
+        catch (NotFoundError &e)
+        {
+            throw(CentralNodeException("ERROR: Failed to find " + name.str()));
+        }
+        catch (InterfaceNotImplementedError &e)
+        {
+            throw(CentralNodeException("ERROR: Wrong interface for " + name.str()));
+        }
+        _configRegisterCount++;
+    }
+
+    return _configSV[appNumber];
+}
+
+/**
+ * Create the configuration registers of the given applications (global
+ * ids of the database application cards) ahead of the first
+ * configuration write. Other applications get theirs on first write.
+ */
+int Firmware::createConfigRegisters(const std::set<uint32_t> &appIds)
+{
+    if (!_root)
+        return 1;
+
+    uint64_t start = CycleCounter::now();
+    for (std::set<uint32_t>::const_iterator it = appIds.begin(); it != appIds.end(); ++it)
+    {
+        if (*it < FW_NUM_APPLICATIONS)
+            getConfigRegister(*it);
+    }
+    _createConfigRegistersTime += CycleCounter::toNs(CycleCounter::now() - start) / 1e9;
+
+    return 0;
+}
+
+void Firmware::showStartupTimes()
+{
+    std::cout << "INFO: Firmware root created in " << _createRootTime * 1e3
+              << " ms, registers in " << _createRegistersTime * 1e3
+              << " ms (" << FW_NUM_REGISTER_THREADS << " threads), "
+              << _configRegisterCount << " application config registers in "
+              << _createConfigRegistersTime * 1e3 << " ms" << std::endl;
+}
+
 void Firmware::writeAppTimeoutMask()
 {
     try
@@ -644,7 +703,7 @@ void Firmware::writeConfig(uint32_t appNumber, uint8_t *config, uint32_t size)
         try
         {
             LOG_TRACE("FIRMWARE", "Writing configuration for application number #" << appNumber << " data size=" << size32);
-            _configSV[appNumber]->setVal(config32, size32);
+            getConfigRegister(appNumber)->setVal(config32, size32);
         }
         catch (InvalidArgError &e)
         {
@@ -889,6 +948,10 @@ std::ostream & operator<<(std::ostream &os, Firmware * const firmware)
     os << "FPGA version=" << firmware->fpgaVersion << std::endl;
     os << "Build stamp=\"" << firmware->buildStamp << "\"" << std::endl;
     os << "Git hash=\"" << firmware->gitHashString << "\"" << std::endl;
+    os << "CreateRootTime=" << firmware->_createRootTime * 1e3 << " ms" << std::endl;
+    os << "CreateRegistersTime=" << firmware->_createRegistersTime * 1e3 << " ms" << std::endl;
+    os << "ConfigRegisters=" << firmware->_configRegisterCount << " created in "
+       << firmware->_createConfigRegistersTime * 1e3 << " ms" << std::endl;
 
     try
     {
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <sstream>
 #include <bitset>
+#include <set>
+#include <mutex>
 #include <boost/shared_ptr.hpp>
 #include <time_util.h>
 #include "timer.h"
@@ -29,6 +31,10 @@ const uint32_t FW_NUM_CONNECTIONS = 12;
 const uint32_t FW_NUM_APPLICATION_MASKS = 1024;
 const uint32_t FW_NUM_APPLICATION_MASKS_WORDS = FW_NUM_APPLICATION_MASKS/sizeof(uint32_t);
 
+// Number of threads used by createRegisters() to create the global
+// register handles
+const uint32_t FW_NUM_REGISTER_THREADS = 4;
+
 typedef std::bitset<FW_NUM_APPLICATION_MASKS> ApplicationBitMaskSet;
 
 // TODO: There is a status register, beamFaultReason. Bits 15:0 indicate a power
@@ -53,12 +59,31 @@ class Firmware {
   uint32_t _applicationTimeoutErrorBuffer[FW_NUM_APPLICATION_MASKS_WORDS];
   ApplicationBitMaskSet *_applicationTimeoutErrorBitSet;
 
+  // Startup costs, in seconds, and number of per-application
+  // configuration registers created so far
+  double _createRootTime;
+  double _createRegistersTime;
+  double _createConfigRegistersTime;
+  uint32_t _configRegisterCount;
+
+  // The MPS is disabled when the Firmware is destroyed, unless cleared
+  // for a warm restart (see Engine::prepareWarmRestart())
+  bool _disableOnExit;
+
  public:
   int createRoot(std::string yamlFileName);
   void setRoot(Path root);
   int createRegisters();
+  int createConfigRegisters(const std::set<uint32_t> &appIds);
   Path getRoot();
 
+  double getCreateRootTime() const { return _createRootTime; };
+  double getCreateRegistersTime() const { return _createRegistersTime; };
+  double getCreateConfigRegistersTime() const { return _createConfigRegistersTime; };
+  uint32_t getConfigRegisterCount() const { return _configRegisterCount; };
+  void showStartupTimes();
+  void setDisableOnExit(bool disable) { _disableOnExit = disable; };
+
   friend class FirmwareTest;
 
  protected:
@@ -71,7 +96,8 @@ class Firmware {
   ScalVal_RO _swLossErrorSV;
   ScalVal_RO _swLossCntSV;
   ScalVal_RO _txClkCntSV;
-  ScalVal    _configSV[FW_NUM_APPLICATIONS];
+  ScalVal    _configSV[FW_NUM_APPLICATIONS]; // Created on demand, see getConfigRegister()
+  std::mutex _configMutex;                   // Protects _configSV creation
   ScalVal    _swEnableSV;
   ScalVal    _swClearSV;
   ScalVal    _beamIntTimeSV;
@@ -129,6 +155,8 @@ class Firmware {
   uint32_t getUInt32(ScalVal reg);
   uint8_t getUInt8(ScalVal_RO reg);
 
+  ScalVal getConfigRegister(uint32_t appNumber);
+
 #ifndef FW_ENABLED
   int _updateSock;
   struct sockaddr_in clientaddr;
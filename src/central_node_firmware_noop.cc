@@ -1,6 +1,7 @@
 #include <central_node_firmware.h>
 #include <central_node_exception.h>
 #include <central_node_engine.h>
+#include <central_node_firmware_sim.h>
 #include <stdint.h>
 #include <log_wrapper.h>
 #include <stdio.h>
@@ -22,10 +23,13 @@ static Logger *firmwareLogger;
 
 //
 // If firmware is not used an UDP socket server is created to receive
-// simulated link node updates
+// simulated link node updates. The registers, config memory, mitigation
+// and power class change stream are modeled by the FirmwareSimulator, which
+// also replaces the UDP socket as source of updates once started.
 //
 Firmware::Firmware() :
-  _updateCounter(0) {
+  _createRootTime(0), _createRegistersTime(0), _createConfigRegistersTime(0),
+  _configRegisterCount(0), _disableOnExit(true), _updateCounter(0) {
   char *portString = getenv("CENTRAL_NODE_TEST_PORT");
   unsigned short port = 4356;
   if (portString != NULL) {
@@ -33,6 +37,17 @@ Firmware::Firmware() :
     std::cout << "INFO: Server waiting on test data using port " << port << "." << std::endl;
   }
 
+  // Create the simulator first, so it is destroyed after the Firmware
+  // (and the Engine threads using it)
+  FirmwareSimulator::getInstance();
+
+  for (uint32_t i = 0; i < FW_NUM_APPLICATION_MASKS_WORDS; ++i) {
+    _applicationTimeoutMaskBuffer[i] = 0;
+    _applicationTimeoutErrorBuffer[i] = 0;
+  }
+  _applicationTimeoutMaskBitSet = reinterpret_cast<ApplicationBitMaskSet *>(_applicationTimeoutMaskBuffer);
+  _applicationTimeoutErrorBitSet = reinterpret_cast<ApplicationBitMaskSet *>(_applicationTimeoutErrorBuffer);
+
 
   _updateSock = socket(AF_INET, SOCK_DGRAM, 0);
   if (_updateSock < 0) {
@@ -86,17 +101,46 @@ int Firmware::createRegisters() {
   return 0;
 }
 
+int Firmware::createConfigRegisters(const std::set<uint32_t> &/* appIds */) {
+  return 0;
+}
+
+ScalVal Firmware::getConfigRegister(uint32_t appNumber) {
+  return _configSV[appNumber];
+}
+
+void Firmware::showStartupTimes() {
+}
+
 void Firmware::writeAppTimeoutMask() {
+  FirmwareSimulator::getInstance().writeTimeoutMask(*_applicationTimeoutMaskBitSet);
 }
 
 void Firmware::setAppTimeoutEnable(uint32_t appId, bool enable, bool writeFW) {
+  if (appId >= FW_NUM_APPLICATION_MASKS) {
+    return;
+  }
+
+  _applicationTimeoutMaskBitSet->set(appId, enable);
+
+  if (writeFW) {
+    writeAppTimeoutMask();
+  }
 }
 
 void Firmware::getAppTimeoutStatus() {
+  FirmwareSimulator::getInstance().readTimeoutStatus(*_applicationTimeoutErrorBitSet);
+}
+
+bool Firmware::getAppTimeoutEnable(uint32_t appId) {
+  return _applicationTimeoutMaskBitSet->test(appId);
 }
 
 bool Firmware::getAppTimeoutStatus(uint32_t appId) {
-  return false;
+  if (appId < FW_NUM_APPLICATION_MASKS) {
+    return (*_applicationTimeoutErrorBitSet)[appId];
+  }
+  return true;
 }
 
 void Firmware::setBoolU64(ScalVal reg, bool enable) {
@@ -123,102 +167,138 @@ uint8_t Firmware::getUInt8(ScalVal_RO reg) {
 }
 
 bool Firmware::getEnable() {
-  return false;
+  return FirmwareSimulator::getInstance().getRegister(FwSimEnable);
 }
 
 uint32_t Firmware::getSoftwareClockCount() {
-  return 0;
+  return FirmwareSimulator::getInstance().getSoftwareClockCount();
 }
 
 uint8_t Firmware::getSoftwareLossError() {
-  return 0;
+  return FirmwareSimulator::getInstance().getSoftwareLossError();
 }
 
 uint32_t Firmware::getSoftwareLossCount() {
-  return 0;
+  return FirmwareSimulator::getInstance().getSoftwareLossCount();
 }
 
 void Firmware::setEvaluationEnable(bool enable) {
+  FirmwareSimulator::getInstance().setRegister(FwSimEvaluationEnable, enable);
 }
 
 bool Firmware::getEvaluationEnable() {
-  return false;
+  return FirmwareSimulator::getInstance().getRegister(FwSimEvaluationEnable);
 }
 
 void Firmware::setTimeoutEnable(bool enable) {
+  FirmwareSimulator::getInstance().setRegister(FwSimTimeoutEnable, enable);
 }
 
 bool Firmware::getTimeoutEnable() {
-  return 0;
+  return FirmwareSimulator::getInstance().getRegister(FwSimTimeoutEnable);
 }
 
 void Firmware::setTimingCheckEnable(bool enable) {
+  FirmwareSimulator::getInstance().setRegister(FwSimTimingCheckEnable, enable);
 }
 
 bool Firmware::getTimingCheckEnable() {
-  return false;
+  return FirmwareSimulator::getInstance().getRegister(FwSimTimingCheckEnable);
 }
 
 uint32_t Firmware::getFaultReason() {
-  return 0;
+  return FirmwareSimulator::getInstance().getFaultReason();
 }
 
 void Firmware::getFirmwareMitigation(uint32_t *fwMitigation) {
-  fwMitigation[0] = 0;
-  fwMitigation[1] = 0;
+  FirmwareSimulator::getInstance().getFirmwareMitigation(fwMitigation);
 }
 
 void Firmware::getSoftwareMitigation(uint32_t *swMitigation) {
-  swMitigation[0] = 0;
-  swMitigation[1] = 0;
+  FirmwareSimulator::getInstance().getSoftwareMitigation(swMitigation);
 }
 
 void Firmware::getMitigation(uint32_t *mitigation) {
-  mitigation[0] = 0;
-  mitigation[1] = 0;
+  FirmwareSimulator::getInstance().getMitigation(mitigation);
+}
+
+void Firmware::getFinalBcH(uint32_t *finalBcH) {
+  uint32_t mitigation[2];
+  FirmwareSimulator::getInstance().getMitigation(mitigation);
+  *finalBcH = mitigation[1];
+}
+
+void Firmware::getFinalBcL(uint32_t *finalBcL) {
+  uint32_t mitigation[2];
+  FirmwareSimulator::getInstance().getMitigation(mitigation);
+  *finalBcL = mitigation[0];
+}
+
+// There is no timing (BSA) power class in the simulator, the final
+// power class is used instead
+void Firmware::getTimingBcH(uint32_t *timingBcH) {
+  getFinalBcH(timingBcH);
+}
+
+void Firmware::getTimingBcL(uint32_t *timingBcL) {
+  getFinalBcL(timingBcL);
 }
 
 void Firmware::getLatchedMitigation(uint32_t *latchedMitigation) {
-  latchedMitigation[0] = 0;
-  latchedMitigation[1] = 0;
+  FirmwareSimulator::getInstance().getLatchedMitigation(latchedMitigation);
 }
 
 void Firmware::extractMitigation(uint32_t *compressed, uint8_t *expanded) {
-  for (int i = 0; i < 16; ++i) {
-    expanded[i] = 0;
+  for (int i = 0; i < 8; ++i) {
+    expanded[i] = (uint8_t)((compressed[0] >> (4 * i)) & 0xF);
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    expanded[i+8] = (uint8_t)((compressed[1] >> (4 * i)) & 0xF);
   }
 }
 
 bool Firmware::heartbeat() {
-  return false;
+  FirmwareSimulator::getInstance().heartbeat();
+  return true;
 }
 
 bool Firmware::evalLatchClear() {
-  return false;
+  FirmwareSimulator::getInstance().evalLatchClear();
+  return true;
 }
 
 bool Firmware::monErrClear() {
-  return false;
+  return true;
 }
 
 bool Firmware::swErrClear() {
-  return false;
+  FirmwareSimulator::getInstance().swErrClear();
+  return true;
 }
 
 bool Firmware::toErrClear() {
-  return false;
+  FirmwareSimulator::getInstance().toErrClear();
+  return true;
 }
 
 bool Firmware::moConcErrClear() {
-  return false;
+  return true;
 }
 
 bool Firmware::beamFaultClear() {
-  return false;
+  FirmwareSimulator::getInstance().beamFaultClear();
+  return true;
 }
 
+// Same command sequence as the real firmware (see central_node_firmware.cc)
 bool Firmware::clearAll() {
-  return false;
+  return evalLatchClear() ||
+    monErrClear() ||
+    swErrClear() ||
+    toErrClear() ||
+    beamFaultClear() ||
+    moConcErrClear();
 }
 
 std::ostream & operator<<(std::ostream &os, Firmware * const firmware) {
@@ -227,29 +307,37 @@ std::ostream & operator<<(std::ostream &os, Firmware * const firmware) {
     os << "Build stamp=\"" << firmware->buildStamp << "\"" << std::endl;
     os << "Git hash=\"" << firmware->gitHashString << "\"" << std::endl;
     os << "Updates received=" << firmware->_updateCounter << std::endl;
+    os << &FirmwareSimulator::getInstance();
+    return os;
 }
 
 bool Firmware::switchConfig() {
-  return false;
+  FirmwareSimulator::getInstance().switchConfig();
+  return true;
 }
 
 void Firmware::setEnable(bool enable) {
+  FirmwareSimulator::getInstance().setRegister(FwSimEnable, enable);
 }
 
 void Firmware::setSoftwareEnable(bool enable) {
+  FirmwareSimulator::getInstance().setRegister(FwSimSoftwareEnable, enable);
 }
 
 bool Firmware::getSoftwareEnable() {
-  return false;
+  return FirmwareSimulator::getInstance().getRegister(FwSimSoftwareEnable);
 }
 
 void Firmware::writeConfig(uint32_t appNumber, uint8_t *config, uint32_t size) {
+  FirmwareSimulator::getInstance().writeConfig(appNumber, config, size);
 };
 
 void Firmware::softwareClear() {
+  FirmwareSimulator::getInstance().swErrClear();
 };
 
 void Firmware::writeTimingChecking(uint32_t time[], uint32_t period[], uint32_t charge[]) {
+  FirmwareSimulator::getInstance().writeTimingChecking(time, period, charge);
 };
 
 void Firmware::showStats() {
@@ -263,6 +351,14 @@ typedef struct {
 } DatabaseInfo;
 
 uint64_t Firmware::readUpdateStream(uint8_t *buffer, uint32_t size, uint64_t timeout) {
+  if (FirmwareSimulator::getInstance().isRunning()) {
+    uint64_t n = FirmwareSimulator::getInstance().readUpdate(buffer, size, timeout);
+    if (n > 0) {
+      _updateCounter++;
+    }
+    return n;
+  }
+
   socklen_t clientlen = sizeof(clientaddr);
 
   //  std::cout << "INFO: waiting for simulated data..." << std::endl;
@@ -305,7 +401,16 @@ uint64_t Firmware::readUpdateStream(uint8_t *buffer, uint32_t size, uint64_t tim
   return n;
 };
 
+int64_t Firmware::readPCChangeStream(uint8_t *buffer, uint32_t size, uint64_t timeout) const {
+  return FirmwareSimulator::getInstance().readPCChange(buffer, size, timeout);
+}
+
 void Firmware::writeMitigation(const std::vector<uint32_t>& mitigation) {
+  FirmwareSimulator::getInstance().writeMitigation(mitigation.data());
+  if (FirmwareSimulator::getInstance().isRunning()) {
+    return;
+  }
+
   uint32_t swapMitigation[2];
   swapMitigation[0] = mitigation[1];
   swapMitigation[1] = mitigation[0];
@@ -0,0 +1,737 @@
+#include <central_node_firmware_sim.h>
+#include <central_node_exception.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+static bool stepBefore(const FirmwareSimStep &a, const FirmwareSimStep &b) {
+  return a.frame < b.frame;
+}
+
+FirmwareSimulator::FirmwareSimulator() :
+  _generatorThread(NULL), _run(false), _rate(FW_SIM_DEFAULT_RATE),
+  _inputs(FW_NUM_APPLICATIONS * FW_SIM_INPUT_BYTES, 0),
+  _nextStep(0), _stallFrames(0),
+  _frameNumber(0), _framesSent(0), _framesRead(0), _framesDropped(0), _framesStalled(0),
+  _waitingRead(false),
+  _activeBank(0), _pendingTiming(false), _configWrites(0), _configSwitches(0),
+  _faultReason(0), _mitigationWrites(0), _mitigationWritten(false),
+  _pcChangeTag(0), _pcChangeFlags(0), _pcChangePowerClass(0), _pcChangeSent(0), _pcChangeDropped(0),
+  _wdTime(FW_SIM_DEFAULT_WD_TIME), _heartbeats(0), _wdError(false), _wdErrorCount(0),
+  _swLossError(false), _swLossCount(0) {
+  for (uint32_t i = 0; i < FW_SIM_REGISTER_COUNT; ++i) {
+    _registers[i] = false;
+  }
+  // The engine never writes the global timeout enable, on by default
+  _registers[FwSimTimeoutEnable] = true;
+
+  for (uint32_t bank = 0; bank < 2; ++bank) {
+    _config[bank].resize(FW_NUM_APPLICATIONS * APPLICATION_CONFIG_BUFFER_SIZE_BYTES, 0);
+  }
+  memset(_timing, 0, sizeof(_timing));
+
+  // No firmware fault: the firmware allows the highest power class
+  for (uint32_t i = 0; i < FW_NUM_BEAM_DESTINATIONS; ++i) {
+    _firmwareClass[i] = FW_NUM_BEAM_CLASSES - 1;
+    _softwareClass[i] = 0;
+    _finalClass[i] = _firmwareClass[i];
+    _latchedClass[i] = _firmwareClass[i];
+  }
+}
+
+FirmwareSimulator::~FirmwareSimulator() {
+  stop();
+}
+
+/**
+ * Start the frame generator, one frame every 1/rate s. With rate 0 the
+ * next frame is generated as soon as the engine has read the previous
+ * one and written its mitigation (or after FW_SIM_LOCK_STEP_TIMEOUT ms).
+ */
+void FirmwareSimulator::start(uint32_t rate) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _rate = rate;
+  if (_generatorThread != NULL) {
+    return;
+  }
+
+  _run = true;
+  _frameNumber = 0;
+  _nextStep = 0;
+  _frames.clear();
+  _waitingRead = false;
+  _mitigationWritten = true;
+  _generatorThread = new std::thread(&FirmwareSimulator::generatorThread, this);
+  if (pthread_setname_np(_generatorThread->native_handle(), "FwSimulator")) {
+    perror("pthread_setname_np failed for FwSimulator thread");
+  }
+  std::cout << "INFO: Firmware simulator started (" << rate << " Hz)" << std::endl;
+}
+
+void FirmwareSimulator::stop() {
+  std::thread *thread;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    thread = _generatorThread;
+    _generatorThread = NULL;
+    _run = false;
+    _frameRead.notify_all();
+  }
+
+  if (thread != NULL) {
+    thread->join();
+    delete thread;
+  }
+}
+
+bool FirmwareSimulator::isRunning() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _generatorThread != NULL;
+}
+
+void FirmwareSimulator::generatorThread() {
+  std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  while (_run) {
+    if (_rate > 0) {
+      std::chrono::nanoseconds period(1000000000ULL / _rate);
+      next += period;
+      // Don't try to catch up after a long pause, send from now on
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (now > next + 10 * period) {
+        next = now;
+      }
+      lock.unlock();
+      std::this_thread::sleep_until(next);
+      lock.lock();
+    }
+    else {
+      std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(FW_SIM_LOCK_STEP_TIMEOUT);
+      while (_run && (_waitingRead || !_mitigationWritten || !isSoftwareEnabled())) {
+        if (_frameRead.wait_until(lock, deadline) == std::cv_status::timeout) {
+          break;
+        }
+      }
+    }
+
+    if (_run) {
+      generateFrame();
+    }
+  }
+}
+
+/**
+ * Generate the next frame, called with the mutex held
+ */
+void FirmwareSimulator::generateFrame() {
+  applySteps();
+
+  if (_registers[FwSimTimeoutEnable]) {
+    _timeoutStatus |= _timeoutMask & _silent;
+  }
+
+  // The updates are streamed only while the software is enabled
+  if (_stallFrames > 0 || !isSoftwareEnabled()) {
+    if (_stallFrames > 0) {
+      _stallFrames--;
+      _framesStalled++;
+    }
+    checkSoftware(false);
+    updateMitigation();
+    _frameNumber++;
+    return;
+  }
+
+  std::vector<uint8_t> frame(FW_UPDATE_BUFFER_SIZE_BYTES, 0);
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t timestamp = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+  memcpy(&frame[APPLICATION_UPDATE_BUFFER_HEADER_ZEROES_SIZE_BYTES], &timestamp, sizeof(timestamp));
+
+  for (uint32_t app = 0; app < FW_NUM_APPLICATIONS; ++app) {
+    if (_silent[app]) {
+      continue;
+    }
+    uint8_t *wasLow = &frame[APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES + app * APPLICATION_UPDATE_BUFFER_INPUTS_SIZE_BYTES];
+    uint8_t *wasHigh = wasLow + FW_SIM_INPUT_BYTES;
+    const uint8_t *inputs = &_inputs[app * FW_SIM_INPUT_BYTES];
+    for (uint32_t i = 0; i < FW_SIM_INPUT_BYTES; ++i) {
+      wasLow[i] = ~inputs[i];
+      wasHigh[i] = inputs[i];
+    }
+  }
+
+  if (_frames.size() >= FW_SIM_FRAME_QUEUE_SIZE) {
+    _frames.pop_front();
+    _framesDropped++;
+  }
+  _frames.push_back(std::vector<uint8_t>());
+  _frames.back().swap(frame);
+  _framesSent++;
+  _waitingRead = true;
+
+  checkSoftware(true);
+  updateMitigation();
+  _frameNumber++;
+  _frameReady.notify_one();
+}
+
+void FirmwareSimulator::applyStep(const FirmwareSimStep &step) {
+  switch (step.type) {
+  case FwSimStepInput:
+    if (step.id < FW_NUM_APPLICATIONS && step.index < FW_SIM_INPUT_BITS) {
+      uint8_t &byte = _inputs[step.id * FW_SIM_INPUT_BYTES + step.index / 8];
+      uint8_t mask = 1 << (step.index % 8);
+      byte = step.value ? (byte | mask) : (byte & ~mask);
+    }
+    break;
+  case FwSimStepSilent:
+    if (step.id < FW_NUM_APPLICATIONS) {
+      _silent.set(step.id, step.value != 0);
+    }
+    break;
+  case FwSimStepClass:
+    if (step.id < FW_NUM_BEAM_DESTINATIONS && step.value < FW_NUM_BEAM_CLASSES) {
+      _firmwareClass[step.id] = step.value;
+    }
+    break;
+  case FwSimStepReason:
+    _faultReason |= step.value;
+    break;
+  case FwSimStepStall:
+    _stallFrames = step.value;
+    break;
+  }
+}
+
+void FirmwareSimulator::applySteps() {
+  while (_nextStep < _steps.size() && _steps[_nextStep].frame <= _frameNumber) {
+    applyStep(_steps[_nextStep]);
+    _nextStep++;
+  }
+}
+
+/**
+ * Software loss (no mitigation written for the previous frame) and
+ * watchdog (no heartbeat within the watchdog time) checks, while the
+ * software is enabled. The watchdog is armed by the first heartbeat, the
+ * software loss check starts with the second frame.
+ */
+void FirmwareSimulator::checkSoftware(bool frameSent) {
+  if (!isSoftwareEnabled()) {
+    return;
+  }
+
+  if (_heartbeats > 0 && !_wdError) {
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - _lastHeartbeat).count();
+    if (elapsed > _wdTime) {
+      _wdError = true;
+      _wdErrorCount++;
+    }
+  }
+
+  if (frameSent) {
+    if (!_mitigationWritten) {
+      _swLossError = true;
+      _swLossCount++;
+    }
+    _mitigationWritten = false;
+  }
+}
+
+/**
+ * Compute the final and latched power classes, and queue a power class
+ * change message if they or the status flags changed
+ */
+void FirmwareSimulator::updateMitigation() {
+  bool software = isSoftwareEnabled();
+  bool softwareError = software && (_wdError || _swLossError);
+  uint64_t powerClass = 0;
+
+  for (uint32_t i = 0; i < FW_NUM_BEAM_DESTINATIONS; ++i) {
+    uint8_t finalClass = _firmwareClass[i];
+    if (software && _softwareClass[i] < finalClass) {
+      finalClass = _softwareClass[i];
+    }
+    if (softwareError) {
+      finalClass = 0;
+    }
+    _finalClass[i] = finalClass;
+    if (finalClass < _latchedClass[i]) {
+      _latchedClass[i] = finalClass;
+    }
+    powerClass |= static_cast<uint64_t>(finalClass) << (i * POWER_CLASS_BIT_SIZE);
+  }
+
+  uint16_t flags = getFlags();
+  if (_pcChangeSent > 0 && powerClass == _pcChangePowerClass && flags == _pcChangeFlags) {
+    return;
+  }
+
+  Firmware::pc_change_t message;
+  memset(&message, 0, sizeof(message));
+  message.tag = ++_pcChangeTag;
+  message.flags = flags;
+  message.timeStamp = static_cast<uint16_t>(_frameNumber);
+  message.powerClass = powerClass;
+
+  if (_pcChanges.size() >= FW_SIM_PC_CHANGE_QUEUE_SIZE) {
+    _pcChanges.pop_front();
+    _pcChangeDropped++;
+  }
+  _pcChanges.push_back(message);
+  _pcChangeSent++;
+  _pcChangePowerClass = powerClass;
+  _pcChangeFlags = flags;
+  _pcChangeReady.notify_one();
+}
+
+/**
+ * Power class change message flags, a cleared bit is an error (see
+ * Firmware::PcChangePacketFlagsLabels)
+ */
+uint16_t FirmwareSimulator::getFlags() const {
+  uint16_t flags = Firmware::PcChangePacketFlagsMask;
+  if (_timeoutStatus.any()) {
+    flags &= ~(1 << 12);
+  }
+  if (_wdError || _swLossError) {
+    flags &= ~(1 << 13);
+  }
+  if (!_registers[FwSimEnable]) {
+    flags &= ~(1 << 14);
+  }
+  return flags;
+}
+
+void FirmwareSimulator::compress(const uint8_t *classes, uint32_t *mitigation) const {
+  mitigation[0] = 0;
+  mitigation[1] = 0;
+  for (uint32_t i = 0; i < FW_NUM_BEAM_DESTINATIONS; ++i) {
+    mitigation[i / 8] |= static_cast<uint32_t>(classes[i]) << ((i % 8) * POWER_CLASS_BIT_SIZE);
+  }
+}
+
+/**
+ * Read the next update frame, waits up to 'timeout' us. Returns the
+ * number of bytes read, 0 on timeout.
+ */
+uint64_t FirmwareSimulator::readUpdate(uint8_t *buffer, uint32_t size, uint64_t timeout) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+    std::chrono::microseconds(timeout);
+
+  while (_frames.empty()) {
+    if (_frameReady.wait_until(lock, deadline) == std::cv_status::timeout && _frames.empty()) {
+      return 0;
+    }
+  }
+
+  std::vector<uint8_t> &frame = _frames.front();
+  uint32_t count = std::min(size, static_cast<uint32_t>(frame.size()));
+  memcpy(buffer, &frame[0], count);
+  _frames.pop_front();
+  _framesRead++;
+  _waitingRead = false;
+  _frameRead.notify_one();
+
+  return count;
+}
+
+/**
+ * Read the next power class change message, waits up to 'timeout' us.
+ * Returns the number of bytes read, 0 on timeout.
+ */
+int64_t FirmwareSimulator::readPCChange(uint8_t *buffer, uint32_t size, uint64_t timeout) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+    std::chrono::microseconds(timeout);
+
+  while (_pcChanges.empty()) {
+    if (_pcChangeReady.wait_until(lock, deadline) == std::cv_status::timeout && _pcChanges.empty()) {
+      return 0;
+    }
+  }
+
+  uint32_t count = std::min(size, static_cast<uint32_t>(sizeof(Firmware::pc_change_t)));
+  memcpy(buffer, &_pcChanges.front(), count);
+  _pcChanges.pop_front();
+
+  return count;
+}
+
+void FirmwareSimulator::loadScenario(std::string fileName) {
+  std::ifstream file(fileName.c_str());
+  if (!file.is_open()) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to open simulation scenario " << fileName;
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  std::vector<FirmwareSimStep> steps;
+  std::string line;
+  uint32_t lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    size_t comment = line.find('#');
+    if (comment != std::string::npos) {
+      line.erase(comment);
+    }
+
+    std::stringstream fields(line);
+    std::string action;
+    FirmwareSimStep step;
+    memset(&step, 0, sizeof(step));
+    if (!(fields >> step.frame)) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        continue;
+      }
+      action = "";
+    }
+    else {
+      fields >> action;
+    }
+
+    bool valid = false;
+    if (action == "input") {
+      step.type = FwSimStepInput;
+      valid = (fields >> step.id >> step.index >> step.value) &&
+        step.id < FW_NUM_APPLICATIONS && step.index < FW_SIM_INPUT_BITS && step.value <= 1;
+    }
+    else if (action == "silent") {
+      step.type = FwSimStepSilent;
+      valid = (fields >> step.id >> step.value) && step.id < FW_NUM_APPLICATIONS && step.value <= 1;
+    }
+    else if (action == "class") {
+      step.type = FwSimStepClass;
+      valid = (fields >> step.id >> step.value) &&
+        step.id < FW_NUM_BEAM_DESTINATIONS && step.value < FW_NUM_BEAM_CLASSES;
+    }
+    else if (action == "reason") {
+      step.type = FwSimStepReason;
+      valid = static_cast<bool>(fields >> std::hex >> step.value);
+    }
+    else if (action == "stall") {
+      step.type = FwSimStepStall;
+      valid = static_cast<bool>(fields >> step.value);
+    }
+
+    if (!valid) {
+      std::stringstream errorStream;
+      errorStream << "ERROR: Invalid simulation scenario step in " << fileName
+                  << ", line " << lineNumber << ": " << line;
+      throw(CentralNodeException(errorStream.str()));
+    }
+    steps.push_back(step);
+  }
+
+  for (size_t i = 0; i < steps.size(); ++i) {
+    addStep(steps[i]);
+  }
+}
+
+void FirmwareSimulator::addStep(const FirmwareSimStep &step) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _steps.push_back(step);
+  std::stable_sort(_steps.begin() + _nextStep, _steps.end(), stepBefore);
+}
+
+void FirmwareSimulator::clearScenario() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _steps.clear();
+  _nextStep = 0;
+}
+
+void FirmwareSimulator::setInput(uint32_t appId, uint32_t bit, bool value) {
+  FirmwareSimStep step = { 0, FwSimStepInput, appId, bit, value };
+  std::unique_lock<std::mutex> lock(_mutex);
+  applyStep(step);
+}
+
+void FirmwareSimulator::setAppSilent(uint32_t appId, bool silent) {
+  FirmwareSimStep step = { 0, FwSimStepSilent, appId, 0, silent };
+  std::unique_lock<std::mutex> lock(_mutex);
+  applyStep(step);
+}
+
+void FirmwareSimulator::setFirmwareClass(uint32_t destination, uint32_t powerClass) {
+  FirmwareSimStep step = { 0, FwSimStepClass, destination, 0, powerClass };
+  std::unique_lock<std::mutex> lock(_mutex);
+  applyStep(step);
+  updateMitigation();
+}
+
+void FirmwareSimulator::setFaultReason(uint32_t reason) {
+  FirmwareSimStep step = { 0, FwSimStepReason, 0, 0, reason };
+  std::unique_lock<std::mutex> lock(_mutex);
+  applyStep(step);
+}
+
+void FirmwareSimulator::stall(uint32_t frames) {
+  FirmwareSimStep step = { 0, FwSimStepStall, 0, 0, frames };
+  std::unique_lock<std::mutex> lock(_mutex);
+  applyStep(step);
+}
+
+void FirmwareSimulator::setRegister(FirmwareSimRegister reg, bool value) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  bool wasEnabled = isSoftwareEnabled();
+  _registers[reg] = value;
+
+  // Restart the software checks when the software is enabled
+  if (!wasEnabled && isSoftwareEnabled()) {
+    _heartbeats = 0;
+    _mitigationWritten = true;
+  }
+  updateMitigation();
+  _frameRead.notify_one();
+}
+
+bool FirmwareSimulator::getRegister(FirmwareSimRegister reg) const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _registers[reg];
+}
+
+/**
+ * Write the configuration of an application to the staged bank, it is
+ * used by the firmware after the next switchConfig()
+ */
+void FirmwareSimulator::writeConfig(uint32_t appId, const uint8_t *config, uint32_t size) {
+  if (appId >= FW_NUM_APPLICATIONS) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  size = std::min(size, APPLICATION_CONFIG_BUFFER_SIZE_BYTES);
+  memcpy(&_config[_activeBank ^ 1][appId * APPLICATION_CONFIG_BUFFER_SIZE_BYTES], config, size);
+  _pendingConfig.set(appId);
+  _configWrites++;
+}
+
+/**
+ * Swap the banks. The applications written since the previous switch are
+ * copied back to the new staged bank, so both banks are the same again.
+ */
+void FirmwareSimulator::switchConfig() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _activeBank ^= 1;
+  for (uint32_t app = 0; app < FW_NUM_APPLICATIONS; ++app) {
+    if (_pendingConfig[app]) {
+      memcpy(&_config[_activeBank ^ 1][app * APPLICATION_CONFIG_BUFFER_SIZE_BYTES],
+             &_config[_activeBank][app * APPLICATION_CONFIG_BUFFER_SIZE_BYTES],
+             APPLICATION_CONFIG_BUFFER_SIZE_BYTES);
+    }
+  }
+  if (_pendingTiming) {
+    memcpy(_timing[_activeBank ^ 1], _timing[_activeBank], sizeof(_timing[0]));
+  }
+  _pendingConfig.reset();
+  _pendingTiming = false;
+  _configSwitches++;
+}
+
+bool FirmwareSimulator::readConfig(uint32_t appId, uint8_t *config, uint32_t size, bool active) const {
+  if (appId >= FW_NUM_APPLICATIONS) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  uint32_t bank = active ? _activeBank : _activeBank ^ 1;
+  size = std::min(size, APPLICATION_CONFIG_BUFFER_SIZE_BYTES);
+  memcpy(config, &_config[bank][appId * APPLICATION_CONFIG_BUFFER_SIZE_BYTES], size);
+  return true;
+}
+
+void FirmwareSimulator::writeTimingChecking(const uint32_t time[], const uint32_t period[],
+                                            const uint32_t charge[]) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  uint32_t bank = _activeBank ^ 1;
+  memcpy(_timing[bank][0], time, sizeof(_timing[bank][0]));
+  memcpy(_timing[bank][1], period, sizeof(_timing[bank][1]));
+  memcpy(_timing[bank][2], charge, sizeof(_timing[bank][2]));
+  _pendingTiming = true;
+}
+
+void FirmwareSimulator::writeTimeoutMask(const ApplicationBitMaskSet &mask) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _timeoutMask = mask;
+}
+
+void FirmwareSimulator::readTimeoutStatus(ApplicationBitMaskSet &status) const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  status = _timeoutStatus;
+}
+
+void FirmwareSimulator::writeMitigation(const uint32_t *mitigation) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  for (uint32_t i = 0; i < 8; ++i) {
+    _softwareClass[i] = (mitigation[1] >> (i * POWER_CLASS_BIT_SIZE)) & 0xF;
+    _softwareClass[i + 8] = (mitigation[0] >> (i * POWER_CLASS_BIT_SIZE)) & 0xF;
+  }
+  _mitigationWrites++;
+  _mitigationWritten = true;
+  updateMitigation();
+  _frameRead.notify_one();
+}
+
+void FirmwareSimulator::getFirmwareMitigation(uint32_t *mitigation) const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  compress(_firmwareClass, mitigation);
+}
+
+void FirmwareSimulator::getSoftwareMitigation(uint32_t *mitigation) const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  compress(_softwareClass, mitigation);
+}
+
+void FirmwareSimulator::getMitigation(uint32_t *mitigation) const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  compress(_finalClass, mitigation);
+}
+
+void FirmwareSimulator::getLatchedMitigation(uint32_t *mitigation) const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  compress(_latchedClass, mitigation);
+}
+
+uint32_t FirmwareSimulator::getFaultReason() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _faultReason;
+}
+
+void FirmwareSimulator::heartbeat() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _heartbeats++;
+  _lastHeartbeat = std::chrono::steady_clock::now();
+}
+
+void FirmwareSimulator::setWatchdogTime(uint32_t time) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _wdTime = time;
+}
+
+uint32_t FirmwareSimulator::getWatchdogTime() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _wdTime;
+}
+
+bool FirmwareSimulator::getWatchdogError() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _wdError;
+}
+
+uint8_t FirmwareSimulator::getSoftwareLossError() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _swLossError ? 1 : 0;
+}
+
+uint32_t FirmwareSimulator::getSoftwareLossCount() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _swLossCount;
+}
+
+uint32_t FirmwareSimulator::getSoftwareClockCount() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return static_cast<uint32_t>(_framesSent);
+}
+
+void FirmwareSimulator::evalLatchClear() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  for (uint32_t i = 0; i < FW_NUM_BEAM_DESTINATIONS; ++i) {
+    _latchedClass[i] = _finalClass[i];
+  }
+}
+
+void FirmwareSimulator::swErrClear() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _wdError = false;
+  _swLossError = false;
+  updateMitigation();
+}
+
+void FirmwareSimulator::toErrClear() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _timeoutStatus.reset();
+  updateMitigation();
+}
+
+void FirmwareSimulator::beamFaultClear() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _faultReason = 0;
+}
+
+uint64_t FirmwareSimulator::getFramesSent() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _framesSent;
+}
+
+uint64_t FirmwareSimulator::getFramesDropped() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _framesDropped;
+}
+
+uint32_t FirmwareSimulator::getMitigationWrites() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _mitigationWrites;
+}
+
+uint32_t FirmwareSimulator::getConfigSwitches() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _configSwitches;
+}
+
+uint32_t FirmwareSimulator::getPendingConfigCount() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _pendingConfig.count();
+}
+
+uint32_t FirmwareSimulator::getPCChangeCount() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _pcChangeSent;
+}
+
+uint32_t FirmwareSimulator::getWatchdogErrorCount() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _wdErrorCount;
+}
+
+std::ostream & operator<<(std::ostream &os, FirmwareSimulator * const simulator) {
+  std::unique_lock<std::mutex> lock(simulator->_mutex);
+  uint32_t mitigation[2];
+
+  os << "=== Firmware Simulator ===" << std::endl;
+  os << "Generator: " << (simulator->_generatorThread != NULL ? "running" : "stopped");
+  if (simulator->_rate > 0) {
+    os << " at " << simulator->_rate << " Hz" << std::endl;
+  }
+  else {
+    os << " in lock step with the engine" << std::endl;
+  }
+  os << "Frames: sent=" << simulator->_framesSent << " read=" << simulator->_framesRead
+     << " dropped=" << simulator->_framesDropped << " stalled=" << simulator->_framesStalled << std::endl;
+  os << "Scenario steps: " << simulator->_nextStep << "/" << simulator->_steps.size() << " applied" << std::endl;
+  os << "Silent applications: " << simulator->_silent.count() << std::endl;
+  os << "Config: writes=" << simulator->_configWrites << " switches=" << simulator->_configSwitches
+     << " pending=" << simulator->_pendingConfig.count() << std::endl;
+  os << "App timeouts: enabled=" << simulator->_timeoutMask.count()
+     << " errors=" << simulator->_timeoutStatus.count() << std::endl;
+  simulator->compress(simulator->_finalClass, mitigation);
+  os << "Mitigation: final=0x" << std::hex << mitigation[1] << "_" << mitigation[0];
+  simulator->compress(simulator->_latchedClass, mitigation);
+  os << " latched=0x" << mitigation[1] << "_" << mitigation[0] << std::dec
+     << " writes=" << simulator->_mitigationWrites << std::endl;
+  os << "PC change messages: sent=" << simulator->_pcChangeSent
+     << " dropped=" << simulator->_pcChangeDropped << std::endl;
+  os << "Heartbeats: " << simulator->_heartbeats << " (watchdog " << simulator->_wdTime
+     << " us, error=" << simulator->_wdError << ", " << simulator->_wdErrorCount << " errors)" << std::endl;
+  os << "Software loss: error=" << simulator->_swLossError << " count=" << simulator->_swLossCount << std::endl;
+
+  return os;
+}
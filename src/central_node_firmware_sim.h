@@ -0,0 +1,256 @@
+#ifndef CENTRAL_NODE_FIRMWARE_SIM_H
+#define CENTRAL_NODE_FIRMWARE_SIM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <bitset>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <central_node_database_defs.h>
+#include <central_node_firmware.h>
+
+/**
+ * In-process model of the central node firmware
+ *
+ * The no-op Firmware (build without FW_ENABLED) keeps its registers here
+ * instead of returning 0. Once started, the simulator also replaces the
+ * UDP socket as the source of the update frames:
+ *
+ *  - frame generator: one update frame every 1/rate s (360 Hz by default,
+ *    see start()), or in lock step with the engine when the rate is 0.
+ *    As with the firmware, frames are only sent while both the Enable and
+ *    SoftwareEnable registers are set
+ *  - inputs: wasLow/wasHigh bits of each application, set by a scenario
+ *    (see loadScenario()) or directly with setInput(). A silent
+ *    application sends no bits (both zero), as when its link is down
+ *  - config memory: writeConfig() goes to the staged bank, switchConfig()
+ *    makes the staged configuration of all applications active at once
+ *  - app timeouts: a silent application with its bit set in the timeout
+ *    mask (as written by writeTimeoutMask()) latches its timeout error
+ *    bit, cleared by toErrClear()
+ *  - mitigation: the final power class of each destination is the lowest
+ *    of the firmware class (set by the scenario, the firmware fault logic
+ *    is not modeled) and of the software mitigation. The latched
+ *    mitigation keeps the lowest class since evalLatchClear()
+ *  - power class change stream: a pc_change_t message is queued each time
+ *    the final power classes or the status flags change
+ *  - software loss and watchdog: a frame without a software mitigation
+ *    write since the previous one counts as a software loss, and no
+ *    heartbeat within the watchdog time sets the watchdog error. Both are
+ *    latched until swErrClear() and force all destinations to class 0
+ *
+ * The software mitigation is written in the register order (destinations
+ * 0-7 in the second word, see DbBeamDestination), the read back values
+ * are in extractMitigation() order (destinations 0-7 in the first word).
+ */
+const uint32_t FW_SIM_DEFAULT_RATE = 360;
+
+// Frames generated but not read yet, the oldest are dropped
+const uint32_t FW_SIM_FRAME_QUEUE_SIZE = 8;
+
+// Power class change messages not read yet, the oldest are dropped
+const uint32_t FW_SIM_PC_CHANGE_QUEUE_SIZE = 64;
+
+// Default software watchdog time (us), same as the engine heartbeat
+const uint32_t FW_SIM_DEFAULT_WD_TIME = 3500;
+
+// Lock step mode (rate 0): longest wait (ms) for the engine to read the
+// previous frame and write its mitigation
+const uint32_t FW_SIM_LOCK_STEP_TIMEOUT = 100;
+
+// Input bits (wasLow or wasHigh) sent by each application
+const uint32_t FW_SIM_INPUT_BITS = APPLICATION_UPDATE_BUFFER_INPUTS_SIZE / 2;
+const uint32_t FW_SIM_INPUT_BYTES = FW_SIM_INPUT_BITS / 8;
+
+/**
+ * Single bit registers
+ */
+enum FirmwareSimRegister {
+  FwSimEnable = 0,
+  FwSimSoftwareEnable,
+  FwSimTimingCheckEnable,
+  FwSimEvaluationEnable,
+  FwSimTimeoutEnable,
+
+  FW_SIM_REGISTER_COUNT
+};
+
+/**
+ * Scenario steps, one per line in a scenario file:
+ *
+ *   # comment
+ *   <frame> input <appId> <bit> <0|1>      wasHigh (1) or wasLow (0) input bit
+ *   <frame> silent <appId> <0|1>           application stops/resumes sending
+ *   <frame> class <destination> <class>    firmware power class
+ *   <frame> reason <mask>                  beam fault reason bits
+ *   <frame> stall <frames>                 no frames sent for <frames> periods
+ *
+ * Frame numbers count from start(), steps are applied before the frame
+ * with the same number is generated.
+ */
+enum FirmwareSimStepType {
+  FwSimStepInput = 0,
+  FwSimStepSilent,
+  FwSimStepClass,
+  FwSimStepReason,
+  FwSimStepStall
+};
+
+typedef struct {
+  uint64_t frame;
+  FirmwareSimStepType type;
+  uint32_t id;
+  uint32_t index;
+  uint32_t value;
+} FirmwareSimStep;
+
+class FirmwareSimulator {
+ private:
+  FirmwareSimulator();
+  FirmwareSimulator(FirmwareSimulator const &);
+  ~FirmwareSimulator();
+  void operator=(FirmwareSimulator const &);
+
+  mutable std::mutex _mutex;
+  std::condition_variable _frameReady;
+  std::condition_variable _frameRead;
+  std::condition_variable _pcChangeReady;
+  std::thread *_generatorThread;
+  bool _run;
+  uint32_t _rate;
+
+  bool _registers[FW_SIM_REGISTER_COUNT];
+
+  // Inputs and scenario
+  std::vector<uint8_t> _inputs;                 // wasHigh bits, FW_SIM_INPUT_BYTES per application
+  ApplicationBitMaskSet _silent;
+  std::vector<FirmwareSimStep> _steps;          // Sorted by frame
+  size_t _nextStep;
+  uint32_t _stallFrames;
+
+  // Frames
+  std::deque< std::vector<uint8_t> > _frames;
+  uint64_t _frameNumber;
+  uint64_t _framesSent;
+  uint64_t _framesRead;
+  uint64_t _framesDropped;
+  uint64_t _framesStalled;
+  bool _waitingRead;                            // Lock step: last frame not read yet
+
+  // Config memory
+  std::vector<uint8_t> _config[2];
+  uint32_t _activeBank;
+  ApplicationBitMaskSet _pendingConfig;
+  uint32_t _timing[2][3][FW_NUM_BEAM_CLASSES];  // Bank, time/period/charge, beam class
+  bool _pendingTiming;
+  uint32_t _configWrites;
+  uint32_t _configSwitches;
+
+  // Application timeouts
+  ApplicationBitMaskSet _timeoutMask;
+  ApplicationBitMaskSet _timeoutStatus;
+
+  // Mitigation, one power class per destination
+  uint8_t _firmwareClass[FW_NUM_BEAM_DESTINATIONS];
+  uint8_t _softwareClass[FW_NUM_BEAM_DESTINATIONS];
+  uint8_t _finalClass[FW_NUM_BEAM_DESTINATIONS];
+  uint8_t _latchedClass[FW_NUM_BEAM_DESTINATIONS];
+  uint32_t _faultReason;
+  uint32_t _mitigationWrites;
+  bool _mitigationWritten;                      // Since the previous frame
+
+  // Power class change stream
+  std::deque<Firmware::pc_change_t> _pcChanges;
+  uint16_t _pcChangeTag;
+  uint16_t _pcChangeFlags;
+  uint64_t _pcChangePowerClass;
+  uint32_t _pcChangeSent;
+  uint32_t _pcChangeDropped;
+
+  // Software loss and watchdog
+  uint32_t _wdTime;                             // us
+  uint64_t _heartbeats;
+  std::chrono::steady_clock::time_point _lastHeartbeat;
+  bool _wdError;
+  uint32_t _wdErrorCount;
+  bool _swLossError;
+  uint32_t _swLossCount;
+
+  void generatorThread();
+  void generateFrame();
+  void applyStep(const FirmwareSimStep &step);
+  void applySteps();
+  void checkSoftware(bool frameSent);
+  void updateMitigation();
+  uint16_t getFlags() const;
+  bool isSoftwareEnabled() const { return _registers[FwSimEnable] && _registers[FwSimSoftwareEnable]; }
+  void compress(const uint8_t *classes, uint32_t *mitigation) const;
+
+ public:
+  static FirmwareSimulator &getInstance() {
+    static FirmwareSimulator instance;
+    return instance;
+  }
+
+  void start(uint32_t rate = FW_SIM_DEFAULT_RATE);
+  void stop();
+  bool isRunning() const;
+  uint64_t readUpdate(uint8_t *buffer, uint32_t size, uint64_t timeout);
+  int64_t readPCChange(uint8_t *buffer, uint32_t size, uint64_t timeout);
+
+  void loadScenario(std::string fileName);
+  void addStep(const FirmwareSimStep &step);
+  void clearScenario();
+  void setInput(uint32_t appId, uint32_t bit, bool value);
+  void setAppSilent(uint32_t appId, bool silent);
+  void setFirmwareClass(uint32_t destination, uint32_t powerClass);
+  void setFaultReason(uint32_t reason);
+  void stall(uint32_t frames);
+
+  void setRegister(FirmwareSimRegister reg, bool value);
+  bool getRegister(FirmwareSimRegister reg) const;
+
+  void writeConfig(uint32_t appId, const uint8_t *config, uint32_t size);
+  void switchConfig();
+  bool readConfig(uint32_t appId, uint8_t *config, uint32_t size, bool active = true) const;
+  void writeTimingChecking(const uint32_t time[], const uint32_t period[], const uint32_t charge[]);
+  void writeTimeoutMask(const ApplicationBitMaskSet &mask);
+  void readTimeoutStatus(ApplicationBitMaskSet &status) const;
+
+  void writeMitigation(const uint32_t *mitigation);
+  void getFirmwareMitigation(uint32_t *mitigation) const;
+  void getSoftwareMitigation(uint32_t *mitigation) const;
+  void getMitigation(uint32_t *mitigation) const;
+  void getLatchedMitigation(uint32_t *mitigation) const;
+  uint32_t getFaultReason() const;
+
+  void heartbeat();
+  void setWatchdogTime(uint32_t time);
+  uint32_t getWatchdogTime() const;
+  bool getWatchdogError() const;
+  uint8_t getSoftwareLossError() const;
+  uint32_t getSoftwareLossCount() const;
+  uint32_t getSoftwareClockCount() const;
+
+  void evalLatchClear();
+  void swErrClear();
+  void toErrClear();
+  void beamFaultClear();
+
+  uint64_t getFramesSent() const;
+  uint64_t getFramesDropped() const;
+  uint32_t getMitigationWrites() const;
+  uint32_t getConfigSwitches() const;
+  uint32_t getPendingConfigCount() const;
+  uint32_t getPCChangeCount() const;
+  uint32_t getWatchdogErrorCount() const;
+
+  friend std::ostream & operator<<(std::ostream &os, FirmwareSimulator * const simulator);
+};
+
+#endif
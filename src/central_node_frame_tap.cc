@@ -0,0 +1,281 @@
+#include <central_node_frame_tap.h>
+#include <central_node_exception.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * FrameTap (writer)
+ */
+
+FrameTap::FrameTap() : _map(NULL), _mapSize(0), _header(NULL), _writeIndex(0) {
+}
+
+FrameTap::~FrameTap() {
+  close();
+}
+
+/**
+ * Create the shared memory segment. An existing segment with the same name
+ * is replaced (readers still attached to it see no new frames and must
+ * reopen).
+ */
+void FrameTap::open(std::string name, uint32_t slots, uint32_t frameSize) {
+  if (slots == 0 || frameSize == 0) {
+    throw(CentralNodeException("ERROR: Invalid frame tap configuration"));
+  }
+
+  close();
+  shm_unlink(name.c_str());
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_EXCL, 0644);
+  if (fd < 0) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to create frame tap shared memory " << name
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  uint32_t slotSize = ((sizeof(FrameTapSlot) + frameSize + 63) / 64) * 64;
+  _mapSize = FRAME_TAP_HEADER_SIZE + static_cast<size_t>(slots) * slotSize;
+  if (ftruncate(fd, _mapSize) != 0) {
+    ::close(fd);
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to size frame tap shared memory " << name
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _map = mmap(NULL, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  ::close(fd);
+  if (_map == MAP_FAILED) {
+    _map = NULL;
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to map frame tap shared memory " << name
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  // Written from the input update thread, keep it resident
+  if (mlock(_map, _mapSize) != 0) {
+    perror("FrameTap mlock");
+  }
+
+  _name = name;
+  _header = static_cast<FrameTapHeader *>(_map);
+  _header->version = FRAME_TAP_VERSION;
+  _header->frameSize = frameSize;
+  _header->slotCount = slots;
+  _header->slotSize = slotSize;
+  _header->writeIndex.store(0);
+  _writeIndex = 0;
+  std::atomic_thread_fence(std::memory_order_release);
+  _header->magic = FRAME_TAP_MAGIC;
+
+  std::cout << "INFO: Frame tap " << name << " ready (" << slots << " frames)" << std::endl;
+}
+
+/**
+ * Unmap the segment. The segment itself is left in place so the last
+ * frames can still be inspected, it is replaced by the next open().
+ */
+void FrameTap::close() {
+  if (_map != NULL) {
+    munmap(_map, _mapSize);
+    _map = NULL;
+    _header = NULL;
+  }
+}
+
+/**
+ * Publish a frame. Called by the input update thread only.
+ */
+void FrameTap::write(const std::vector<uint8_t> &frame, uint64_t cycle, uint64_t timestamp) {
+  if (_map == NULL) {
+    return;
+  }
+
+  uint8_t *base = static_cast<uint8_t *>(_map) + FRAME_TAP_HEADER_SIZE +
+    (_writeIndex % _header->slotCount) * _header->slotSize;
+  FrameTapSlot *slot = reinterpret_cast<FrameTapSlot *>(base);
+  size_t size = frame.size() < _header->frameSize ? frame.size() : _header->frameSize;
+
+  slot->sequence.store(2 * _writeIndex + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->cycle = cycle;
+  slot->timestamp = timestamp;
+  memcpy(base + sizeof(FrameTapSlot), frame.data(), size);
+  slot->sequence.store(2 * _writeIndex + 2, std::memory_order_release);
+
+  _writeIndex++;
+  _header->writeIndex.store(_writeIndex, std::memory_order_release);
+}
+
+std::ostream & operator<<(std::ostream &os, FrameTap * const tap) {
+  os << "=== Frame tap ===" << std::endl;
+  if (tap->_map == NULL) {
+    os << "  not open" << std::endl;
+  }
+  else {
+    os << "  " << tap->_name << ": " << tap->_writeIndex << " frames written ("
+       << tap->_header->slotCount << " slots)" << std::endl;
+  }
+  return os;
+}
+
+/*
+ * FrameTapReader (client)
+ */
+
+FrameTapReader::FrameTapReader() : _map(NULL), _mapSize(0), _header(NULL), _nextIndex(UINT64_MAX) {
+}
+
+FrameTapReader::~FrameTapReader() {
+  close();
+}
+
+void FrameTapReader::open(std::string name) {
+  close();
+
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to open frame tap " << name
+		<< " (" << strerror(errno) << ") - is the engine running with the frame tap enabled?";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  struct stat st;
+  FrameTapHeader header;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < FRAME_TAP_HEADER_SIZE ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      header.magic != FRAME_TAP_MAGIC || header.version != FRAME_TAP_VERSION ||
+      static_cast<size_t>(st.st_size) < FRAME_TAP_HEADER_SIZE +
+      static_cast<size_t>(header.slotCount) * header.slotSize) {
+    ::close(fd);
+    std::stringstream errorStream;
+    errorStream << "ERROR: " << name << " is not a valid frame tap";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _mapSize = st.st_size;
+  void *map = mmap(NULL, _mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to map frame tap " << name << " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _map = map;
+  _header = static_cast<const FrameTapHeader *>(_map);
+  _nextIndex = UINT64_MAX;
+}
+
+void FrameTapReader::close() {
+  if (_map != NULL) {
+    munmap(const_cast<void *>(_map), _mapSize);
+    _map = NULL;
+    _header = NULL;
+  }
+}
+
+const FrameTapSlot *FrameTapReader::getSlot(uint64_t index) const {
+  return reinterpret_cast<const FrameTapSlot *>(static_cast<const uint8_t *>(_map) +
+						FRAME_TAP_HEADER_SIZE +
+						(index % _header->slotCount) * _header->slotSize);
+}
+
+uint64_t FrameTapReader::getWriteIndex() const {
+  return _header->writeIndex.load(std::memory_order_acquire);
+}
+
+/**
+ * Copy frame number 'index'.
+ */
+FrameTapReader::ReadStatus FrameTapReader::read(uint64_t index, FrameTapFrame &frame) const {
+  const FrameTapSlot *slot = getSlot(index);
+  uint64_t expected = 2 * index + 2;
+
+  uint64_t before = slot->sequence.load(std::memory_order_acquire);
+  if (before < expected) {
+    return FrameNotReady;
+  }
+  if (before > expected) {
+    return FrameLost;
+  }
+
+  frame.index = index;
+  frame.cycle = slot->cycle;
+  frame.timestamp = slot->timestamp;
+  frame.data.resize(_header->frameSize);
+  memcpy(frame.data.data(), reinterpret_cast<const uint8_t *>(slot) + sizeof(FrameTapSlot),
+	 _header->frameSize);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot->sequence.load(std::memory_order_relaxed) != before) {
+    return FrameLost;
+  }
+
+  return FrameRead;
+}
+
+/**
+ * Copy the frame after the one returned by the previous call (the first
+ * call waits for the next frame written). Returns false if there is no new
+ * frame yet. 'lost' is the number of frames skipped because the reader
+ * fell behind - the reader then resumes from the most recent frame.
+ */
+bool FrameTapReader::next(FrameTapFrame &frame, uint64_t &lost) {
+  lost = 0;
+  uint64_t writeIndex = getWriteIndex();
+
+  if (_nextIndex == UINT64_MAX) {
+    _nextIndex = writeIndex;
+  }
+
+  while (_nextIndex < writeIndex) {
+    if (writeIndex - _nextIndex >= _header->slotCount) {
+      lost += writeIndex - 1 - _nextIndex;
+      _nextIndex = writeIndex - 1;
+    }
+
+    ReadStatus status = read(_nextIndex, frame);
+    if (status == FrameRead) {
+      _nextIndex++;
+      return true;
+    }
+    if (status == FrameNotReady) {
+      return false;
+    }
+
+    // Overwritten while copying - catch up
+    lost++;
+    _nextIndex++;
+    writeIndex = getWriteIndex();
+  }
+
+  return false;
+}
+
+/**
+ * Copy the most recent frame (for sampling readers).
+ */
+bool FrameTapReader::latest(FrameTapFrame &frame) const {
+  for (int retry = 0; retry < 3; ++retry) {
+    uint64_t writeIndex = getWriteIndex();
+    if (writeIndex == 0) {
+      return false;
+    }
+    if (read(writeIndex - 1, frame) == FrameRead) {
+      return true;
+    }
+  }
+  return false;
+}
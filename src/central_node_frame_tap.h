@@ -0,0 +1,144 @@
+#ifndef CENTRAL_NODE_FRAME_TAP_H
+#define CENTRAL_NODE_FRAME_TAP_H
+
+#include <central_node_database_defs.h>
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+
+/**
+ * Shared memory frame tap
+ *
+ * The engine publishes every firmware update frame in a POSIX shared
+ * memory segment (default name FRAME_TAP_DEFAULT_NAME) holding a ring of
+ * the most recent frames, so local tools can follow the inputs at full
+ * rate without touching the engine:
+ *
+ *   FrameTapHeader                              (first 4 KB)
+ *   'slotCount' x slots of 'slotSize' bytes:
+ *     FrameTapSlot
+ *     uint8_t data['frameSize']
+ *
+ * Frame number 'n' (counting from 0 since the engine started) goes into
+ * slot n % slotCount. Each slot has its own sequence lock: while frame n
+ * is being written the slot sequence is 2n + 1, once written it is
+ * 2n + 2. The header writeIndex is the number of frames completely
+ * written. A reader copying frame n checks the slot sequence is 2n + 2
+ * before and after the copy - any other value means the frame was not
+ * written yet, or was overwritten because the reader fell behind.
+ *
+ * The writer never waits for readers, readers never write to the segment.
+ */
+const char FRAME_TAP_DEFAULT_NAME[] = "/central_node_frames";
+const uint64_t FRAME_TAP_MAGIC = 0x5041544D4152464DULL; // "MFRAMTAP"
+const uint32_t FRAME_TAP_VERSION = 1;
+const uint32_t FRAME_TAP_DEFAULT_SLOTS = 64;
+const uint32_t FRAME_TAP_HEADER_SIZE = 4096;
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t frameSize;
+  uint32_t slotCount;
+  uint32_t slotSize;
+  std::atomic<uint64_t> writeIndex;
+} FrameTapHeader;
+
+typedef struct {
+  std::atomic<uint64_t> sequence;
+  uint64_t cycle;
+  uint64_t timestamp;
+  uint64_t reserved;
+} FrameTapSlot;
+
+/**
+ * Frame copied out of the tap by a reader
+ */
+struct FrameTapFrame {
+  uint64_t index;
+  uint64_t cycle;
+  uint64_t timestamp;
+  std::vector<uint8_t> data;
+};
+
+/**
+ * Writer side, used by the engine input update thread.
+ */
+class FrameTap {
+ private:
+  FrameTap();
+  FrameTap(FrameTap const &);
+  void operator=(FrameTap const &);
+
+  std::string _name;
+  void *_map;
+  size_t _mapSize;
+  FrameTapHeader *_header;
+  uint64_t _writeIndex;
+
+ public:
+  ~FrameTap();
+
+  void open(std::string name = FRAME_TAP_DEFAULT_NAME,
+	    uint32_t slots = FRAME_TAP_DEFAULT_SLOTS,
+	    uint32_t frameSize = FW_UPDATE_BUFFER_SIZE_BYTES);
+  void close();
+  bool isOpen() const { return _map != NULL; }
+
+  void write(const std::vector<uint8_t> &frame, uint64_t cycle, uint64_t timestamp);
+
+  static FrameTap &getInstance() {
+    static FrameTap instance;
+    return instance;
+  }
+
+  friend std::ostream & operator<<(std::ostream &os, FrameTap * const tap);
+};
+
+/**
+ * Client side. Maps the segment read-only, any number of readers can be
+ * attached. Typical use, following every frame:
+ *
+ *   FrameTapReader reader;
+ *   reader.open();
+ *   FrameTapFrame frame;
+ *   uint64_t lost;
+ *   while (true) {
+ *     if (reader.next(frame, lost)) { ... } else { usleep(1000); }
+ *   }
+ */
+class FrameTapReader {
+ private:
+  const void *_map;
+  size_t _mapSize;
+  const FrameTapHeader *_header;
+  uint64_t _nextIndex;
+
+  const FrameTapSlot *getSlot(uint64_t index) const;
+
+ public:
+  enum ReadStatus {
+    FrameRead,
+    FrameNotReady,   // Not written yet
+    FrameLost,       // Overwritten before (or while) it was copied
+  };
+
+  FrameTapReader();
+  ~FrameTapReader();
+
+  void open(std::string name = FRAME_TAP_DEFAULT_NAME);
+  void close();
+
+  uint32_t getFrameSize() const { return _header->frameSize; }
+  uint32_t getSlotCount() const { return _header->slotCount; }
+  uint64_t getWriteIndex() const;
+
+  ReadStatus read(uint64_t index, FrameTapFrame &frame) const;
+  bool next(FrameTapFrame &frame, uint64_t &lost);
+  bool latest(FrameTapFrame &frame) const;
+};
+
+#endif
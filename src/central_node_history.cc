@@ -8,8 +8,32 @@
 #include <errno.h>
 #include <sstream>
 #include <netdb.h>
+#include <time.h>
 
-History::History() : _counter(0), _done(false), enabled(true) {
+History::History() : _counter(0), _batchCounter(0), _maxBatch(0),
+  _datagramCounter(0), _bytesSent(0), _done(false),
+  _protocolVersion(1), _eventsPerDatagram(HIST_V2_DEFAULT_EVENTS), _sequence(0),
+  _deviceChatter(DeviceInputSummaryType), _analogChatter(AnalogDeviceSummaryType),
+  _timestamp(0), _cycle(0),
+  enabled(true) {
+  _chatterSummaries.reserve(HIST_SEND_BATCH_SIZE);
+  for (uint32_t i = 0; i < HIST_MESSAGE_TYPES; ++i) {
+    _dropped[i].store(0);
+  }
+}
+
+const char *History::typeName(uint32_t type) {
+  switch (type) {
+  case FaultStateType: return "FaultState";
+  case BypassStateType: return "BypassState";
+  case BypassValueType: return "BypassValue";
+  case MitigationType: return "Mitigation";
+  case DeviceInputType: return "DeviceInput";
+  case AnalogDeviceType: return "AnalogDevice";
+  case DeviceInputSummaryType: return "DeviceInputSummary";
+  case AnalogDeviceSummaryType: return "AnalogDeviceSummary";
+  default: return "Unknown";
+  }
 }
 
 void History::startSenderThread(std::string serverName, int port) {
@@ -45,7 +69,56 @@ void History::startSenderThread(std::string serverName, int port) {
 
 }
 
+/**
+ * Select the wire protocol: 1 sends each message in its own datagram, 2
+ * packs up to 'eventsPerDatagram' timestamped events in each datagram (see
+ * central_node_history_protocol.h). Must be called before
+ * startSenderThread().
+ */
+void History::setProtocolVersion(uint32_t version, uint32_t eventsPerDatagram) {
+  if (version != 1 && version != HIST_V2_VERSION) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Invalid MPS history protocol version " << version;
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  if (eventsPerDatagram == 0 || eventsPerDatagram > HIST_V2_MAX_EVENTS) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Invalid number of events per history datagram ("
+		<< eventsPerDatagram << ", maximum is " << HIST_V2_MAX_EVENTS << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _protocolVersion = version;
+  _eventsPerDatagram = eventsPerDatagram;
+  if (_protocolVersion == HIST_V2_VERSION) {
+    _datagramBuffer.resize(HIST_SEND_BATCH_SIZE * HIST_V2_MAX_DATAGRAM_SIZE);
+  }
+}
+
+/**
+ * Set the firmware timestamp and cycle number of the update being
+ * processed, called by the input update thread once per firmware update.
+ * Events logged from other threads get the stamp of the latest update.
+ */
+void History::setTimeStamp(uint64_t timestamp, uint64_t cycle) {
+  _timestamp.store(timestamp, std::memory_order_relaxed);
+  _cycle.store(cycle, std::memory_order_relaxed);
+}
+
+/**
+ * Keep a local copy of all events in a memory-mapped ring file (see
+ * HistoryJournal). Must be called before startSenderThread().
+ */
+void History::openJournal(std::string fileName, uint64_t capacity) {
+  _journal.open(fileName, capacity);
+  std::cout << "INFO: MPS History journal " << fileName << " ("
+	    << _journal.getCapacity() << " events, "
+	    << _journal.getWritePosition() << " previously written)" << std::endl;
+}
+
 int History::log(HistoryMessageType type, uint32_t id, uint32_t oldValue, uint32_t newValue, uint32_t aux) {
+  Message message;
   message.id = id;
   message.oldValue = oldValue;
   message.newValue = newValue;
@@ -63,14 +136,85 @@ int History::logMitigation(uint32_t id, uint32_t oldValue, uint32_t newValue, ui
   return log(MitigationType, id, oldValue, newValue, allowedClass);
 }
 
+static uint64_t chatterClock() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Digital and analog input messages go through the chatter filter, they
+ * are not queued while the input is chattering (see flushChatter()).
+ */
 int History::logDeviceInput(uint32_t id, uint32_t oldValue, uint32_t newValue) {
+  if (!enabled) {
+    return 1;
+  }
+  if (!_deviceChatter.check(id, newValue, chatterClock())) {
+    return 0;
+  }
   return log(DeviceInputType, id, oldValue, newValue, 0);
 }
 
 int History::logAnalogDevice(uint32_t id, uint32_t oldValue, uint32_t newValue) {
+  if (!enabled) {
+    return 1;
+  }
+  if (!_analogChatter.check(id, newValue, chatterClock())) {
+    return 0;
+  }
   return log(AnalogDeviceType, id, oldValue, newValue, 0);
 }
 
+/**
+ * Configure the chatter filter for digital and analog inputs: an input
+ * with more than 'transitions' transitions within 'windowMs' has its
+ * messages replaced by a summary every 'summaryMs'. 'transitions' set to
+ * zero disables the filter (default). The summary messages are only
+ * defined by protocol version 2, must be called after
+ * setProtocolVersion().
+ */
+void History::setChatterFilter(uint32_t transitions, uint32_t windowMs, uint32_t summaryMs) {
+  if (transitions > 0 && _protocolVersion != HIST_V2_VERSION) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: MPS history chatter filter requires protocol version "
+		<< static_cast<uint32_t>(HIST_V2_VERSION) << " (summary messages)";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _deviceChatter.configure(transitions, windowMs, summaryMs);
+  _analogChatter.configure(transitions, windowMs, summaryMs);
+}
+
+/**
+ * Size the chatter filter for the inputs of the loaded database (largest
+ * digital input and analog device ids), so the input update thread does
+ * not allocate memory.
+ */
+void History::setChatterInputs(uint32_t maxDeviceInputId, uint32_t maxAnalogDeviceId) {
+  _deviceChatter.setMaxId(maxDeviceInputId);
+  _analogChatter.setMaxId(maxAnalogDeviceId);
+}
+
+/**
+ * Queue the summaries of the chattering inputs that are due, called once
+ * per firmware update by the input update thread after all inputs were
+ * updated. Filter settings changed since the last call are applied here.
+ */
+void History::flushChatter() {
+  if (!_deviceChatter.isFlushDue() && !_analogChatter.isFlushDue()) {
+    return;
+  }
+
+  uint64_t now = chatterClock();
+  _chatterSummaries.clear();
+  _deviceChatter.flush(now, _chatterSummaries);
+  _analogChatter.flush(now, _chatterSummaries);
+  if (!_chatterSummaries.empty()) {
+    add(_chatterSummaries);
+  }
+}
+
 int History::logBypassState(uint32_t id, uint32_t oldValue, uint32_t newValue, uint16_t index) {
   return log(BypassStateType, id, oldValue, newValue, index);
 }
@@ -79,23 +223,48 @@ int History::logBypassValue(uint32_t id, uint32_t oldValue, uint32_t newValue) {
   return log(BypassValueType, id, oldValue, newValue, 0);
 }
 
+/**
+ * Queue a message for the sender thread. Safe to call from any thread,
+ * never blocks. Returns 1 if the message was dropped (queue full).
+ */
 int History::add(Message &message) {
   if (!enabled) {
     return 1;
   }
 
-  {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if (_histQueue.size() >= HIST_QUEUE_MAX_SIZE) {
-      return 1;
+  HistoryEvent event;
+  event.message = message;
+  event.timestamp = _timestamp.load(std::memory_order_relaxed);
+  event.cycle = _cycle.load(std::memory_order_relaxed);
+
+  if (!_ring.push(event)) {
+    if (message.type < HIST_MESSAGE_TYPES) {
+      _dropped[message.type].fetch_add(1, std::memory_order_relaxed);
     }
-    _histQueue.push_back(message);
-    _condVar.notify_all();
+    return 1;
   }
 
   return 0;
 }
 
+/**
+ * Queue a batch of messages. Messages that don't fit in the queue are
+ * dropped. Returns the number of dropped messages.
+ */
+int History::add(std::vector<Message> &messages) {
+  if (!enabled) {
+    return messages.size();
+  }
+
+  int dropped = 0;
+  for (std::vector<Message>::iterator it = messages.begin();
+       it != messages.end(); ++it) {
+    dropped += add(*it);
+  }
+
+  return dropped;
+}
+
 void History::stopSenderThread() {
   std::cout << "INFO: Stopping history thread" << std::endl;
   _done = true;
@@ -103,19 +272,35 @@ void History::stopSenderThread() {
   std::cout << "INFO: Join history thread" << std::endl;
 }
 
+/**
+ * Send the queued messages, in batches of up to HIST_SEND_BATCH_SIZE. If
+ * the journal is open the messages are appended to it before being sent.
+ * Sleeps for HIST_SEND_IDLE_USEC if the queue is empty. Returns 1 when the
+ * sender thread must exit.
+ */
 int History::sendFront() {
-  std::unique_lock<std::mutex> lock(_mutex);
-  _condVar.wait_for(lock, std::chrono::milliseconds(200));
+  HistoryEvent events[HIST_SEND_BATCH_SIZE];
+
   if (_done) {
     return 1;
   }
-  else {
-    while (_histQueue.size() > 0) {
-      send(_histQueue.front());
-      _histQueue.pop_front();
-    }
+
+  uint32_t count = _ring.pop(events, HIST_SEND_BATCH_SIZE);
+  if (count == 0) {
+    usleep(HIST_SEND_IDLE_USEC);
     return 0;
   }
+
+  while (count > 0) {
+    _journal.append(events, count);
+    send(events, count);
+    if (count < HIST_SEND_BATCH_SIZE) {
+      break;
+    }
+    count = _ring.pop(events, HIST_SEND_BATCH_SIZE);
+  }
+
+  return 0;
 }
 
 int History::send(Message &message) {
@@ -131,11 +316,165 @@ int History::send(Message &message) {
   }
   else {
     _counter++;
+    _datagramCounter++;
+    _bytesSent += n;
+  }
+
+  return 0;
+}
+
+static uint32_t putVarint(uint8_t *buffer, uint64_t value) {
+  uint32_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  buffer[size++] = static_cast<uint8_t>(value);
+  return size;
+}
+
+static uint64_t zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+/**
+ * Encode events into a single protocol v2 datagram. At most 'maxEvents'
+ * events are encoded, fewer if the datagram would exceed 'size' bytes.
+ * Returns the datagram size, the number of encoded events is returned in
+ * 'encoded'.
+ */
+uint32_t History::encodeV2(uint8_t *buffer, uint32_t size, uint32_t sequence,
+			   const HistoryEvent *events, uint32_t count,
+			   uint32_t maxEvents, uint32_t &encoded) {
+  HistoryHeaderV2 header;
+  uint32_t length = sizeof(HistoryHeaderV2);
+  uint32_t previousId = 0;
+
+  encoded = 0;
+  if (count == 0 || size < sizeof(HistoryHeaderV2) + HIST_V2_MAX_EVENT_SIZE) {
+    return 0;
+  }
+
+  if (maxEvents > HIST_V2_MAX_EVENTS) {
+    maxEvents = HIST_V2_MAX_EVENTS;
+  }
+
+  while (encoded < count && encoded < maxEvents &&
+	 length + HIST_V2_MAX_EVENT_SIZE <= size) {
+    const HistoryEvent &event = events[encoded];
+    buffer[length++] = static_cast<uint8_t>(event.message.type);
+    length += putVarint(&buffer[length],
+			zigzag(static_cast<int64_t>(event.message.id) - previousId));
+    length += putVarint(&buffer[length], event.message.oldValue);
+    length += putVarint(&buffer[length], event.message.newValue);
+    length += putVarint(&buffer[length], event.message.aux);
+    length += putVarint(&buffer[length],
+			zigzag(static_cast<int64_t>(event.timestamp - events[0].timestamp)));
+    length += putVarint(&buffer[length],
+			zigzag(static_cast<int64_t>(event.cycle - events[0].cycle)));
+    previousId = event.message.id;
+    encoded++;
+  }
+
+  header.magic = HIST_V2_MAGIC;
+  header.version = HIST_V2_VERSION;
+  header.count = encoded;
+  header.sequence = sequence;
+  header.timestamp = events[0].timestamp;
+  header.cycle = events[0].cycle;
+  memcpy(buffer, &header, sizeof(header));
+
+  return length;
+}
+
+/**
+ * Send a batch of events with a single sendmmsg() call. With protocol v1
+ * each event goes out as its own Message datagram, with protocol v2 the
+ * events are packed into as few datagrams as possible.
+ */
+int History::send(HistoryEvent *events, uint32_t count) {
+  if (!enabled) {
+    return 1;
+  }
+
+  Message messages[HIST_SEND_BATCH_SIZE];
+  struct iovec vectors[HIST_SEND_BATCH_SIZE];
+  uint32_t eventCounts[HIST_SEND_BATCH_SIZE];
+  uint32_t datagrams = 0;
+
+  if (count > HIST_SEND_BATCH_SIZE) {
+    count = HIST_SEND_BATCH_SIZE;
+  }
+
+  if (_protocolVersion == HIST_V2_VERSION) {
+    uint32_t done = 0;
+    while (done < count) {
+      uint8_t *buffer = &_datagramBuffer[datagrams * HIST_V2_MAX_DATAGRAM_SIZE];
+      uint32_t encoded;
+      vectors[datagrams].iov_base = buffer;
+      vectors[datagrams].iov_len = encodeV2(buffer, HIST_V2_MAX_DATAGRAM_SIZE, _sequence++,
+					    &events[done], count - done,
+					    _eventsPerDatagram, encoded);
+      eventCounts[datagrams] = encoded;
+      datagrams++;
+      done += encoded;
+    }
+  }
+  else {
+    for (uint32_t i = 0; i < count; ++i) {
+      messages[i] = events[i].message;
+      vectors[i].iov_base = &messages[i];
+      vectors[i].iov_len = sizeof(Message);
+      eventCounts[i] = 1;
+    }
+    datagrams = count;
+  }
+
+  sendDatagrams(vectors, eventCounts, datagrams);
+
+  _batchCounter++;
+  if (count > _maxBatch) {
+    _maxBatch = count;
   }
 
   return 0;
 }
 
+/**
+ * Send the datagrams with sendmmsg(), retrying until all are sent or an
+ * error is returned. Returns the number of datagrams sent.
+ */
+uint32_t History::sendDatagrams(struct iovec *vectors, uint32_t *eventCounts, uint32_t count) {
+  struct mmsghdr headers[HIST_SEND_BATCH_SIZE];
+
+  memset(headers, 0, sizeof(headers));
+  for (uint32_t i = 0; i < count; ++i) {
+    headers[i].msg_hdr.msg_name = &serveraddr;
+    headers[i].msg_hdr.msg_namelen = serverlen;
+    headers[i].msg_hdr.msg_iov = &vectors[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  uint32_t sent = 0;
+  while (sent < count) {
+    int n = sendmmsg(sock, &headers[sent], count - sent, 0);
+    if (n <= 0) {
+      perror("HistorySend");
+      std::cerr << "ERROR: Failed to send " << count - sent
+		<< " history datagrams (returned " << n << ")" << std::endl;
+      break;
+    }
+    for (int i = 0; i < n; ++i) {
+      _counter += eventCounts[sent + i];
+      _bytesSent += headers[sent + i].msg_len;
+    }
+    _datagramCounter += n;
+    sent += n;
+  }
+
+  return sent;
+}
+
 void History::senderThread() {
   if (History::getInstance().enabled) {
 
@@ -2,21 +2,39 @@
 #define CENTRAL_NODE_HISTORY_H
 
 #include <central_node_history_protocol.h>
+#include <central_node_history_ring.h>
+#include <central_node_history_journal.h>
+#include <central_node_history_chatter.h>
 
 #include <iostream>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <list>
+#include <atomic>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
-typedef std::list<Message> HistoryQueue;
+/**
+ * Maximum number of messages sent with a single sendmmsg() call
+ */
+const uint32_t HIST_SEND_BATCH_SIZE = 64;
 
-const uint32_t HIST_QUEUE_MAX_SIZE = 100;
+/**
+ * Sender thread sleep time when there are no queued messages
+ */
+const uint32_t HIST_SEND_IDLE_USEC = 10000;
+
+/**
+ * Default number of events packed in a protocol v2 datagram
+ */
+const uint32_t HIST_V2_DEFAULT_EVENTS = 32;
+
+/**
+ * Number of message types (HistoryMessageType values start at 1)
+ */
+const uint32_t HIST_MESSAGE_TYPES = AnalogDeviceSummaryType + 1;
 
 class History {
  private:
@@ -24,21 +42,55 @@ class History {
   History(History const &);
   void operator=(History const &);
   std::thread *_senderThread;
-  std::mutex _mutex;
-  std::condition_variable _condVar;
-  HistoryQueue _histQueue;
-  Message message;
+  HistoryRing _ring;
   int sock;
   int serverlen;
   struct sockaddr_in serveraddr;
   uint32_t _counter;
-  bool _done;
+  uint32_t _batchCounter;
+  uint32_t _maxBatch;
+  uint32_t _datagramCounter;
+  uint64_t _bytesSent;
+  std::atomic<bool> _done;
+
+  // Wire protocol (1 or 2), set before starting the sender thread
+  uint32_t _protocolVersion;
+  uint32_t _eventsPerDatagram;
+  uint32_t _sequence;
+  std::vector<uint8_t> _datagramBuffer;
+
+  // Optional local copy of all events, written by the sender thread
+  HistoryJournal _journal;
+
+  // Rate limiting of digital/analog input messages, fault and mitigation
+  // messages are never filtered
+  HistoryChatterFilter _deviceChatter;
+  HistoryChatterFilter _analogChatter;
+  std::vector<Message> _chatterSummaries;
+
+  // Timestamp/cycle of the firmware update being processed, stamped on
+  // every event when it is queued
+  std::atomic<uint64_t> _timestamp;
+  std::atomic<uint64_t> _cycle;
+
+  // Messages dropped because the ring was full, per HistoryMessageType
+  std::atomic<uint32_t> _dropped[HIST_MESSAGE_TYPES];
+
+  static const char *typeName(uint32_t type);
 
  public:
   bool enabled;
 
   void startSenderThread(std::string serverName = "lcls-dev3", int port = 3356);
   void stopSenderThread();
+  void setProtocolVersion(uint32_t version, uint32_t eventsPerDatagram = HIST_V2_DEFAULT_EVENTS);
+  uint32_t getProtocolVersion() const { return _protocolVersion; }
+  void setTimeStamp(uint64_t timestamp, uint64_t cycle);
+  void openJournal(std::string fileName, uint64_t capacity = HIST_JOURNAL_DEFAULT_RECORDS);
+  void setChatterFilter(uint32_t transitions, uint32_t windowMs = HIST_CHATTER_WINDOW_MS,
+			uint32_t summaryMs = HIST_CHATTER_SUMMARY_MS);
+  void setChatterInputs(uint32_t maxDeviceInputId, uint32_t maxAnalogDeviceId);
+  void flushChatter();
 
   int log(HistoryMessageType type, uint32_t id, uint32_t oldValue, uint32_t newValue, uint32_t aux);
 
@@ -49,18 +101,60 @@ class History {
   int logBypassState(uint32_t id, uint32_t oldValue, uint32_t newValue, uint16_t index);
   int logBypassValue(uint32_t id, uint32_t oldValue, uint32_t newValue);
   int add(Message &message);
+  int add(std::vector<Message> &messages);
   int send(Message &message);
+  int send(HistoryEvent *events, uint32_t count);
+  uint32_t sendDatagrams(struct iovec *vectors, uint32_t *eventCounts, uint32_t count);
   int sendFront();
   void senderThread();
 
+  static uint32_t encodeV2(uint8_t *buffer, uint32_t size, uint32_t sequence,
+			   const HistoryEvent *events, uint32_t count,
+			   uint32_t maxEvents, uint32_t &encoded);
+
   static History &getInstance() {
     static History instance;
     return instance;
   }
 
+  friend class EngineBench;
+
   friend std::ostream & operator<<(std::ostream &os, History * const history) {
     os << "=== History ===" << std::endl;
+    os << "  protocol version: " << history->_protocolVersion;
+    if (history->_protocolVersion == HIST_V2_VERSION) {
+      os << " (up to " << history->_eventsPerDatagram << " events/datagram)";
+    }
+    os << std::endl;
     os << "  messages sent: " << history->_counter << std::endl;
+    os << "  datagrams sent: " << history->_datagramCounter
+       << " (" << history->_bytesSent << " bytes)" << std::endl;
+    if (history->_journal.isOpen()) {
+      os << "  journal: " << history->_journal.getWritePosition() << " events written (capacity "
+	 << history->_journal.getCapacity() << ")" << std::endl;
+    }
+    os << "  send batches: " << history->_batchCounter
+       << " (max " << history->_maxBatch << " messages)" << std::endl;
+    os << "  queued: " << history->_ring.size() << "/" << HIST_RING_SIZE << std::endl;
+    os << "  chatter filter: ";
+    if (history->_deviceChatter.isEnabled()) {
+      os << "enabled" << std::endl;
+    }
+    else {
+      os << "disabled" << std::endl;
+    }
+    os << "    digital inputs: " << history->_deviceChatter.getChatteringCount() << " chattering, "
+       << history->_deviceChatter.episodes << " episodes, "
+       << history->_deviceChatter.suppressedCount << " transitions suppressed, "
+       << history->_deviceChatter.summaryCount << " summaries" << std::endl;
+    os << "    analog devices: " << history->_analogChatter.getChatteringCount() << " chattering, "
+       << history->_analogChatter.episodes << " episodes, "
+       << history->_analogChatter.suppressedCount << " transitions suppressed, "
+       << history->_analogChatter.summaryCount << " summaries" << std::endl;
+    os << "  dropped (queue full):" << std::endl;
+    for (uint32_t i = 1; i < HIST_MESSAGE_TYPES; ++i) {
+      os << "    " << typeName(i) << ": " << history->_dropped[i].load() << std::endl;
+    }
 
     return os;
   }
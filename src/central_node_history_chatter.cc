@@ -0,0 +1,165 @@
+#include <central_node_history_chatter.h>
+
+#include <string.h>
+
+HistoryChatterFilter::HistoryChatterFilter(HistoryMessageType summaryType) :
+  summaryType(summaryType),
+  transitions(0),
+  windowMs(HIST_CHATTER_WINDOW_MS),
+  summaryMs(HIST_CHATTER_SUMMARY_MS),
+  pendingChange(false), enabled(false), pendingResize(false),
+  pendingTransitions(0),
+  pendingWindowMs(HIST_CHATTER_WINDOW_MS),
+  pendingSummaryMs(HIST_CHATTER_SUMMARY_MS),
+  episodes(0), suppressedCount(0), summaryCount(0) {
+}
+
+/**
+ * Change the filter settings, 'transitions' set to zero disables the
+ * filter. The settings are applied by the next flush(), inputs chattering
+ * at that time get a final summary and go back to normal logging.
+ */
+void HistoryChatterFilter::configure(uint32_t transitions, uint32_t windowMs, uint32_t summaryMs) {
+  std::unique_lock<std::mutex> lock(pendingMutex);
+  pendingTransitions = transitions;
+  pendingWindowMs = windowMs;
+  pendingSummaryMs = summaryMs;
+  enabled = transitions > 0;
+  pendingChange = true;
+}
+
+/**
+ * Allocate the state of inputs 0 to 'maxId', called when a database is
+ * loaded. Transitions of inputs with larger ids are not filtered.
+ */
+void HistoryChatterFilter::setMaxId(uint32_t maxId) {
+  HistoryChatterState initial;
+  memset(&initial, 0, sizeof(initial));
+
+  std::unique_lock<std::mutex> lock(pendingMutex);
+  pendingStates.assign(maxId + 1, initial);
+  pendingChatteringIds.clear();
+  pendingChatteringIds.reserve(maxId + 1);
+  pendingResize = true;
+  pendingChange = true;
+}
+
+/**
+ * Swap in the settings and state table requested by configure() and
+ * setMaxId(). Nothing is done if the other thread is holding the lock,
+ * the change is applied on the next flush().
+ */
+void HistoryChatterFilter::applyPending(uint64_t now, std::vector<Message> &summaries) {
+  std::unique_lock<std::mutex> lock(pendingMutex, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+
+  for (size_t i = 0; i < chatteringIds.size(); ++i) {
+    HistoryChatterState &state = states[chatteringIds[i]];
+    summarize(chatteringIds[i], state, now, summaries);
+    state.chattering = false;
+    state.windowStart = now;
+    state.windowCount = 0;
+  }
+  chatteringIds.clear();
+
+  transitions = pendingTransitions;
+  windowMs = pendingWindowMs;
+  summaryMs = pendingSummaryMs;
+  if (pendingResize) {
+    states.swap(pendingStates);
+    chatteringIds.swap(pendingChatteringIds);
+    pendingResize = false;
+  }
+  pendingChange = false;
+}
+
+/**
+ * Account for a transition of input 'id' to 'value' at time 'now' (ms).
+ * Returns true if the transition must be logged, false if it is folded
+ * into the next summary.
+ */
+bool HistoryChatterFilter::check(uint32_t id, uint32_t value, uint64_t now) {
+  if (transitions == 0 || id >= states.size()) {
+    return true;
+  }
+
+  HistoryChatterState &state = states[id];
+  state.lastValue = value;
+  state.lastTransition = now;
+
+  if (!state.chattering) {
+    if (now - state.windowStart > windowMs) {
+      state.windowStart = now;
+      state.windowCount = 0;
+    }
+    state.windowCount++;
+    if (state.windowCount <= transitions) {
+      return true;
+    }
+
+    // Capacity reserved by setMaxId(), an id is only listed once
+    state.chattering = true;
+    state.suppressed = 0;
+    state.firstSuppressed = now;
+    state.lastSummary = now;
+    chatteringIds.push_back(id);
+    episodes++;
+  }
+
+  if (state.suppressed == 0) {
+    state.firstSuppressed = now;
+  }
+  state.suppressed++;
+  suppressedCount++;
+
+  return false;
+}
+
+void HistoryChatterFilter::summarize(uint32_t id, HistoryChatterState &state, uint64_t now,
+				     std::vector<Message> &summaries) {
+  if (state.suppressed > 0) {
+    Message summary;
+    summary.type = summaryType;
+    summary.id = id;
+    summary.oldValue = state.suppressed;
+    summary.newValue = state.lastValue;
+    summary.aux = state.lastTransition - state.firstSuppressed;
+    summaries.push_back(summary);
+    summaryCount++;
+  }
+  state.suppressed = 0;
+  state.lastSummary = now;
+}
+
+/**
+ * Generate the summaries that are due at time 'now' (ms), and return the
+ * inputs that have been quiet for a whole window to normal logging. Only
+ * the chattering inputs are visited.
+ */
+void HistoryChatterFilter::flush(uint64_t now, std::vector<Message> &summaries) {
+  if (pendingChange) {
+    applyPending(now, summaries);
+  }
+
+  for (size_t i = 0; i < chatteringIds.size(); ) {
+    uint32_t id = chatteringIds[i];
+    HistoryChatterState &state = states[id];
+
+    if (now - state.lastTransition > windowMs) {
+      summarize(id, state, now, summaries);
+      state.chattering = false;
+      state.windowStart = now;
+      state.windowCount = 0;
+      chatteringIds[i] = chatteringIds.back();
+      chatteringIds.pop_back();
+      continue;
+    }
+
+    if (now - state.lastSummary >= summaryMs) {
+      summarize(id, state, now, summaries);
+    }
+    ++i;
+  }
+}
@@ -0,0 +1,91 @@
+#ifndef CENTRAL_NODE_HISTORY_CHATTER_H
+#define CENTRAL_NODE_HISTORY_CHATTER_H
+
+#include <central_node_history_protocol.h>
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+/**
+ * Suggested chatter filter settings (the filter is disabled unless
+ * configured): an input with more than 20 transitions within one second
+ * is chattering, its transitions are summarized once per second until it
+ * has been quiet for one second.
+ */
+const uint32_t HIST_CHATTER_TRANSITIONS = 20;
+const uint32_t HIST_CHATTER_WINDOW_MS = 1000;
+const uint32_t HIST_CHATTER_SUMMARY_MS = 1000;
+
+/**
+ * Chatter state of one input
+ */
+typedef struct {
+  uint64_t windowStart;     // Start of the current counting window (ms)
+  uint32_t windowCount;     // Transitions in the current window
+  bool chattering;
+  uint32_t suppressed;      // Transitions since the last summary
+  uint32_t lastValue;
+  uint64_t firstSuppressed; // Time of the first transition since the last summary (ms)
+  uint64_t lastTransition;  // Time of the latest transition (ms)
+  uint64_t lastSummary;     // Time of the last summary (ms)
+} HistoryChatterState;
+
+/**
+ * Per-id rate limiting of the history messages of one input type (digital
+ * inputs or analog devices). Once an input has more than 'transitions'
+ * transitions within 'windowMs' it is marked chattering: its transitions
+ * are no longer logged one by one but folded into a summary message sent
+ * every 'summaryMs' (type 'summaryType', see
+ * central_node_history_protocol.h). The input goes back to normal logging
+ * after 'windowMs' without transitions, with a final summary.
+ *
+ * check() and flush() must be called from the same thread (the input
+ * update thread), they do not allocate memory. configure() and setMaxId()
+ * may be called from any thread, the change is applied by the next flush().
+ */
+class HistoryChatterFilter {
+ private:
+  HistoryMessageType summaryType;
+  std::vector<HistoryChatterState> states; // Indexed by input id
+  std::vector<uint32_t> chatteringIds;
+  uint32_t transitions;
+  uint32_t windowMs;
+  uint32_t summaryMs;
+
+  // Settings and state table requested by configure()/setMaxId(), swapped
+  // in by flush(). The table replaced by the last swap is kept here until
+  // the next setMaxId(), so it is not freed by the input update thread.
+  std::mutex pendingMutex;
+  std::atomic<bool> pendingChange;
+  std::atomic<bool> enabled;
+  bool pendingResize;
+  std::vector<HistoryChatterState> pendingStates;
+  std::vector<uint32_t> pendingChatteringIds;
+  uint32_t pendingTransitions;
+  uint32_t pendingWindowMs;
+  uint32_t pendingSummaryMs;
+
+  void summarize(uint32_t id, HistoryChatterState &state, uint64_t now, std::vector<Message> &summaries);
+  void applyPending(uint64_t now, std::vector<Message> &summaries);
+
+ public:
+  // Statistics
+  uint32_t episodes;             // Times an input started chattering
+  uint32_t suppressedCount;      // Transitions folded into summaries
+  uint32_t summaryCount;         // Summary messages generated
+
+  HistoryChatterFilter(HistoryMessageType summaryType);
+
+  void configure(uint32_t transitions, uint32_t windowMs, uint32_t summaryMs);
+  void setMaxId(uint32_t maxId);
+  bool isEnabled() const { return enabled; }
+  bool isFlushDue() const { return pendingChange || !chatteringIds.empty(); }
+  uint32_t getChatteringCount() const { return chatteringIds.size(); }
+
+  bool check(uint32_t id, uint32_t value, uint64_t now);
+  void flush(uint64_t now, std::vector<Message> &summaries);
+};
+
+#endif
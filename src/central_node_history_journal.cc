@@ -0,0 +1,247 @@
+#include <central_node_history_journal.h>
+#include <central_node_exception.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sstream>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+HistoryJournal::HistoryJournal() :
+  fd(-1), map(NULL), mapSize(0), readOnly(false),
+  header(NULL), records(NULL), position(0) {
+}
+
+HistoryJournal::~HistoryJournal() {
+  close();
+}
+
+void HistoryJournal::unmap() {
+  if (map != NULL) {
+    munmap(map, mapSize);
+    map = NULL;
+  }
+  header = NULL;
+  records = NULL;
+}
+
+void HistoryJournal::close() {
+  unmap();
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+/**
+ * Create (or reopen) the journal file with room for 'capacity' records.
+ * An existing file written with a different capacity or format is
+ * reinitialized.
+ */
+void HistoryJournal::open(std::string fileName, uint64_t capacity) {
+  if (capacity == 0) {
+    throw(CentralNodeException("ERROR: MPS history journal capacity must be greater than zero"));
+  }
+
+  close();
+  readOnly = false;
+
+  fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to open MPS history journal " << fileName
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  mapSize = HIST_JOURNAL_HEADER_SIZE + capacity * sizeof(HistoryJournalRecord);
+
+  struct stat st;
+  bool reuse = false;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == mapSize) {
+    HistoryJournalHeader existing;
+    if (pread(fd, &existing, sizeof(existing), 0) == sizeof(existing) &&
+	existing.magic == HIST_JOURNAL_MAGIC &&
+	existing.version == HIST_JOURNAL_VERSION &&
+	existing.recordSize == sizeof(HistoryJournalRecord) &&
+	existing.capacity == capacity) {
+      reuse = true;
+    }
+  }
+
+  if (!reuse) {
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, mapSize) != 0) {
+      std::stringstream errorStream;
+      errorStream << "ERROR: Failed to resize MPS history journal " << fileName
+		  << " (" << strerror(errno) << ")";
+      close();
+      throw(CentralNodeException(errorStream.str()));
+    }
+  }
+
+  // MAP_POPULATE so appending does not page fault on first use of each page
+  map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  if (map == MAP_FAILED) {
+    map = NULL;
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to map MPS history journal " << fileName
+		<< " (" << strerror(errno) << ")";
+    close();
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  header = static_cast<HistoryJournalHeader *>(map);
+  records = reinterpret_cast<HistoryJournalRecord *>(static_cast<uint8_t *>(map) + HIST_JOURNAL_HEADER_SIZE);
+
+  if (reuse) {
+    position = recoverPosition();
+  }
+  else {
+    // The new file is all zeros (no records)
+    header->version = HIST_JOURNAL_VERSION;
+    header->recordSize = sizeof(HistoryJournalRecord);
+    header->capacity = capacity;
+    header->writePosition.store(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = HIST_JOURNAL_MAGIC;
+    position = 0;
+  }
+}
+
+/**
+ * Open an existing journal for reading (e.g. by the dump tool, while the
+ * engine may still be writing to it).
+ */
+void HistoryJournal::openReadOnly(std::string fileName) {
+  close();
+  readOnly = true;
+
+  fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to open MPS history journal " << fileName
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  HistoryJournalHeader existing;
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      pread(fd, &existing, sizeof(existing), 0) != sizeof(existing) ||
+      existing.magic != HIST_JOURNAL_MAGIC ||
+      existing.version != HIST_JOURNAL_VERSION ||
+      existing.recordSize != sizeof(HistoryJournalRecord) ||
+      static_cast<uint64_t>(st.st_size) != HIST_JOURNAL_HEADER_SIZE + existing.capacity * sizeof(HistoryJournalRecord)) {
+    close();
+    std::stringstream errorStream;
+    errorStream << "ERROR: " << fileName << " is not a valid MPS history journal";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  mapSize = st.st_size;
+  map = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    map = NULL;
+    close();
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to map MPS history journal " << fileName;
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  header = static_cast<HistoryJournalHeader *>(map);
+  records = reinterpret_cast<HistoryJournalRecord *>(static_cast<uint8_t *>(map) + HIST_JOURNAL_HEADER_SIZE);
+  position = recoverPosition();
+}
+
+/**
+ * The writePosition in the header is only updated after each batch, the
+ * records themselves tell how far the previous writer got.
+ */
+uint64_t HistoryJournal::recoverPosition() {
+  uint64_t last = header->writePosition.load(std::memory_order_acquire);
+  for (uint64_t i = 0; i < header->capacity; ++i) {
+    uint64_t sequence = records[i].sequence.load(std::memory_order_acquire);
+    if (sequence > last) {
+      last = sequence;
+    }
+  }
+  return last;
+}
+
+uint64_t HistoryJournal::getCapacity() const {
+  return header != NULL ? header->capacity : 0;
+}
+
+/**
+ * Append events to the journal, overwriting the oldest records when the
+ * ring is full. Called only by the history sender thread.
+ */
+void HistoryJournal::append(const HistoryEvent *events, uint32_t count) {
+  if (map == NULL || readOnly) {
+    return;
+  }
+
+  uint64_t capacity = header->capacity;
+  for (uint32_t i = 0; i < count; ++i) {
+    HistoryJournalRecord &record = records[position % capacity];
+    record.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    record.timestamp = events[i].timestamp;
+    record.cycle = events[i].cycle;
+    record.message = events[i].message;
+    record.sequence.store(position + 1, std::memory_order_release);
+    position++;
+  }
+
+  header->writePosition.store(position, std::memory_order_release);
+}
+
+/**
+ * Copy all valid records, oldest first. 'sequences' gets the position of
+ * each event in the journal (gaps are records lost to a crash or being
+ * written while the journal was read).
+ */
+void HistoryJournal::getEvents(std::vector<HistoryEvent> &events, std::vector<uint64_t> &sequences) const {
+  std::vector<std::pair<uint64_t, HistoryEvent> > valid;
+
+  events.clear();
+  sequences.clear();
+  if (map == NULL) {
+    return;
+  }
+
+  uint64_t capacity = header->capacity;
+  for (uint64_t i = 0; i < capacity; ++i) {
+    uint64_t sequence = records[i].sequence.load(std::memory_order_acquire);
+    if (sequence == 0 || (sequence - 1) % capacity != i) {
+      continue;
+    }
+
+    HistoryEvent event;
+    event.timestamp = records[i].timestamp;
+    event.cycle = records[i].cycle;
+    event.message = records[i].message;
+
+    // Discard the record if it was overwritten while being copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (records[i].sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+    valid.push_back(std::make_pair(sequence, event));
+  }
+
+  std::sort(valid.begin(), valid.end(),
+	    [](const std::pair<uint64_t, HistoryEvent> &a, const std::pair<uint64_t, HistoryEvent> &b) {
+	      return a.first < b.first;
+	    });
+
+  events.reserve(valid.size());
+  sequences.reserve(valid.size());
+  for (size_t i = 0; i < valid.size(); ++i) {
+    sequences.push_back(valid[i].first - 1);
+    events.push_back(valid[i].second);
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef CENTRAL_NODE_HISTORY_JOURNAL_H
+#define CENTRAL_NODE_HISTORY_JOURNAL_H
+
+#include <central_node_history_protocol.h>
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+const uint64_t HIST_JOURNAL_MAGIC = 0x4C4E524A5354484DULL; // "MHTSJRNL"
+const uint32_t HIST_JOURNAL_VERSION = 1;
+const uint64_t HIST_JOURNAL_DEFAULT_RECORDS = 1 << 20;
+
+/**
+ * Journal file header, at the start of the file (one page).
+ */
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t capacity;                      // Number of records in the ring
+  std::atomic<uint64_t> writePosition;    // Number of records ever written
+} HistoryJournalHeader;
+
+const uint32_t HIST_JOURNAL_HEADER_SIZE = 4096;
+
+/**
+ * One event in the journal. 'sequence' is the position of the record
+ * plus one (0 means the slot was never written, or is being written).
+ */
+typedef struct {
+  std::atomic<uint64_t> sequence;
+  uint64_t timestamp;
+  uint64_t cycle;
+  Message message;
+  uint32_t reserved;
+} HistoryJournalRecord;
+
+/**
+ * Local copy of all history events in a fixed-size memory-mapped ring
+ * file, for post-mortem analysis when the history server is unreachable.
+ *
+ * Only the history sender thread appends to the journal. The file is
+ * mapped shared, so records are in the page cache as soon as they are
+ * written and survive a crash of the process without any fsync(). When the
+ * ring is full the oldest records are overwritten.
+ *
+ * A record is invalidated (sequence set to 0) before its fields are
+ * overwritten and gets its new sequence number only after all fields are
+ * written, a crash in the middle of an append leaves at most one empty
+ * slot, never a record with mixed contents. Reopening an existing journal
+ * with the same capacity continues after its last record.
+ */
+class HistoryJournal {
+ private:
+  int fd;
+  void *map;
+  size_t mapSize;
+  bool readOnly;
+  HistoryJournalHeader *header;
+  HistoryJournalRecord *records;
+  uint64_t position;
+
+  void unmap();
+  uint64_t recoverPosition();
+
+ public:
+  HistoryJournal();
+  ~HistoryJournal();
+
+  void open(std::string fileName, uint64_t capacity = HIST_JOURNAL_DEFAULT_RECORDS);
+  void openReadOnly(std::string fileName);
+  void close();
+  bool isOpen() const { return map != NULL; }
+
+  void append(const HistoryEvent *events, uint32_t count);
+
+  uint64_t getCapacity() const;
+  uint64_t getWritePosition() const { return position; }
+  void getEvents(std::vector<HistoryEvent> &events, std::vector<uint64_t> &sequences) const;
+};
+
+#endif
@@ -1,5 +1,5 @@
 #ifndef CENTRAL_NODE_HISTORY_PROTOCOL_H
-#define CENTRAL_NODE_HISTORY_PROTOROL_H
+#define CENTRAL_NODE_HISTORY_PROTOCOL_H
 
 #include <stdint.h>
 #include <iostream>
@@ -11,8 +11,21 @@ enum HistoryMessageType {
   MitigationType,     // Change in allowed beam class for mitigation device
   DeviceInputType,    // Change in digital input
   AnalogDeviceType,   // Change in analog device threshold status
+  DeviceInputSummaryType,  // Transitions of a chattering digital input (see below)
+  AnalogDeviceSummaryType, // Transitions of a chattering analog device
 };
 
+/*
+ * Summary messages replace the DeviceInputType/AnalogDeviceType messages
+ * of an input while it is chattering (too many transitions, see
+ * HistoryChatterFilter). They are only sent with protocol version 2, the
+ * filter is disabled otherwise. Fields:
+ *   id       - input/analog device id
+ *   oldValue - number of transitions summarized
+ *   newValue - value after the last transition
+ *   aux      - time between the first and last transition (ms)
+ */
+
 typedef struct {
   HistoryMessageType type;
   uint32_t id;        // MPS database ID for the Fault/Input/Mitigation
@@ -28,5 +41,52 @@ typedef struct {
   }
 } Message;
 
+/**
+ * History message with the firmware timestamp and the cycle (firmware
+ * update number) when it was logged. These are kept by the sender queue,
+ * only protocol v2 puts the timestamp and cycle on the wire.
+ */
+typedef struct {
+  Message message;
+  uint64_t timestamp;
+  uint64_t cycle;
+} HistoryEvent;
+
+/**
+ * Protocol v2 - multiple events per datagram
+ *
+ * Each datagram starts with a HistoryHeaderV2 followed by 'count' events.
+ * The header has the sequence number of the datagram (incremented by one
+ * for each datagram, gaps mean lost datagrams) and the timestamp/cycle of
+ * the first event. Events are encoded as:
+ *
+ *   uint8_t type
+ *   varint  zigzag(id - id of previous event in the datagram, 0 for the first)
+ *   varint  oldValue
+ *   varint  newValue
+ *   varint  aux
+ *   varint  zigzag(timestamp - header timestamp)
+ *   varint  zigzag(cycle - header cycle)
+ *
+ * Varints are little endian base-128 (7 bits per byte, MSB set on all but
+ * the last byte), zigzag maps signed n to (n << 1) ^ (n >> 63). All header
+ * fields are little endian. A v1 datagram is a single 20 byte Message, a v2
+ * datagram is told apart by its size and the magic number.
+ */
+const uint16_t HIST_V2_MAGIC = 0x4832;
+const uint8_t HIST_V2_VERSION = 2;
+const uint32_t HIST_V2_MAX_DATAGRAM_SIZE = 1400;
+const uint32_t HIST_V2_MAX_EVENT_SIZE = 1 + 5 * 4 + 10 * 2;
+const uint32_t HIST_V2_MAX_EVENTS = 255;
+
+typedef struct __attribute__((packed)) {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t count;      // Number of events in the datagram
+  uint32_t sequence;
+  uint64_t timestamp; // Firmware timestamp of the first event
+  uint64_t cycle;     // Cycle number of the first event
+} HistoryHeaderV2;
+
 
 #endif
@@ -0,0 +1,77 @@
+#include <central_node_history_ring.h>
+
+HistoryRing::HistoryRing() : enqueuePosition(0), dequeuePosition(0) {
+  for (uint32_t i = 0; i < HIST_RING_SIZE; ++i) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * Add an event to the ring. May be called from any thread. Returns false
+ * if the ring is full.
+ */
+bool HistoryRing::push(const HistoryEvent &event) {
+  uint64_t position = enqueuePosition.load(std::memory_order_relaxed);
+  HistorySlot *slot;
+
+  while (true) {
+    slot = &slots[position & HIST_RING_MASK];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+    if (diff == 0) {
+      // Slot is free at this lap - try to reserve it
+      if (enqueuePosition.compare_exchange_weak(position, position + 1,
+						std::memory_order_relaxed)) {
+	break;
+      }
+      // Another producer got it, 'position' was reloaded by the CAS
+    }
+    else if (diff < 0) {
+      // Slot still holds a message from the previous lap
+      return false;
+    }
+    else {
+      position = enqueuePosition.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->event = event;
+  slot->sequence.store(position + 1, std::memory_order_release);
+
+  return true;
+}
+
+/**
+ * Move up to 'maxEvents' published events into 'events'. Must only be
+ * called from the consumer thread. Returns the number of events copied.
+ */
+uint32_t HistoryRing::pop(HistoryEvent *events, uint32_t maxEvents) {
+  uint32_t count = 0;
+  uint64_t position = dequeuePosition.load(std::memory_order_relaxed);
+
+  while (count < maxEvents) {
+    HistorySlot *slot = &slots[position & HIST_RING_MASK];
+    if (slot->sequence.load(std::memory_order_acquire) != position + 1) {
+      // Empty, or the producer that reserved this slot has not finished yet
+      break;
+    }
+    events[count++] = slot->event;
+    slot->sequence.store(position + HIST_RING_SIZE, std::memory_order_release);
+    position++;
+  }
+  dequeuePosition.store(position, std::memory_order_relaxed);
+
+  return count;
+}
+
+/**
+ * Approximate number of queued events (for statistics only).
+ */
+uint32_t HistoryRing::size() const {
+  uint64_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+  uint64_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+  if (enqueued < dequeued) {
+    return 0;
+  }
+  return enqueued - dequeued;
+}
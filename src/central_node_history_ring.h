@@ -0,0 +1,49 @@
+#ifndef CENTRAL_NODE_HISTORY_RING_H
+#define CENTRAL_NODE_HISTORY_RING_H
+
+#include <central_node_history_protocol.h>
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Ring size (number of events), must be a power of two.
+ */
+const uint32_t HIST_RING_SIZE = 4096;
+const uint32_t HIST_RING_MASK = HIST_RING_SIZE - 1;
+
+/**
+ * One event in the ring. Each slot takes a full cache line so producers
+ * writing neighbouring slots do not share lines.
+ */
+struct alignas(64) HistorySlot {
+  std::atomic<uint64_t> sequence;
+  HistoryEvent event;
+};
+
+/**
+ * Fixed-size multi-producer single-consumer message ring. The storage is
+ * allocated once, push() and pop() never allocate, lock or block.
+ *
+ * Each slot carries a sequence number. A producer reserves the slot at
+ * the current enqueue position with a compare-and-swap, copies its message
+ * and then publishes it by advancing the slot sequence. The consumer (the
+ * history sender thread) reads slots in order and hands them back to the
+ * producers by advancing the sequence by one lap. A producer that finds its
+ * slot not yet consumed reports the ring as full and the message is
+ * dropped, it never waits for the consumer.
+ */
+class HistoryRing {
+ private:
+  HistorySlot slots[HIST_RING_SIZE];
+  alignas(64) std::atomic<uint64_t> enqueuePosition;
+  alignas(64) std::atomic<uint64_t> dequeuePosition;
+
+ public:
+  HistoryRing();
+
+  bool push(const HistoryEvent &event);
+  uint32_t pop(HistoryEvent *events, uint32_t maxEvents);
+  uint32_t size() const;
+};
+
+#endif
@@ -17,10 +17,11 @@ using namespace easyloggingpp;
 static Logger *databaseLogger ;
 #endif
 
-TimeAverage DeviceInputUpdateTime(5, "Device Input update time");
-TimeAverage AnalogDeviceUpdateTime(5, "Analog Device update time");
-TimeAverage AppCardDigitalUpdateTime(5, "Application Card (digital) update time");
-TimeAverage AppCardAnalogUpdateTime(5, "Application Card (analog) update time");
+// Sampled cost of single input updates (see CycleCounter::sample())
+CycleStat DeviceInputUpdateTime;
+CycleStat AnalogDeviceUpdateTime;
+
+const BypassOverride DbApplicationCardInput::noBypassOverride;
 
 ApplicationUpdateBufferBitSetHalf* DbApplicationCardInput::getWasLowBuffer()
 {
@@ -46,11 +47,13 @@ uint32_t DbApplicationCardInput::getWasHigh(int channel) {
   return (*getWasHighBuffer())[channel];
 }
 
-void DbApplicationCardInput::setUpdateBuffers(std::vector<uint8_t>* bufPtr, const size_t wasLowBufferOff, const size_t wasHighBufferOff)
+void DbApplicationCardInput::setUpdateBuffers(std::vector<uint8_t>* bufPtr, const size_t wasLowBufferOff, const size_t wasHighBufferOff,
+                                              BypassOverride* bypassOverridePtr)
 {
     fwUpdateBuffer      = bufPtr;
     wasLowBufferOffset  = wasLowBufferOff;
     wasHighBufferOffset = wasHighBufferOff;
+    bypassOverride      = bypassOverridePtr;
 }
 
 // void DbDeviceInput::setUpdateBuffer(ApplicationUpdateBufferBitSet *buffer) {
@@ -66,6 +69,33 @@ void DbDeviceInput::update(uint32_t v) {
   if (v == faultValue) {
     latchedValue = faultValue;
   }
+
+  applyBypassOverride();
+}
+
+/**
+ * Select the card override bit of this input, called when the update
+ * buffers are configured.
+ */
+void DbDeviceInput::configureBypassOverride() {
+  if (bypassOverride && channel) {
+    decodeOverride = bypassOverride;
+    overrideChannel = channel->number;
+  }
+  else {
+    decodeOverride = &noBypassOverride;
+    overrideChannel = 0;
+  }
+}
+
+/**
+ * Compute the value used by the fault evaluation from the latched value and
+ * the card bypass override for this input channel.
+ */
+void DbDeviceInput::applyBypassOverride() {
+  uint32_t force = (decodeOverride->force >> overrideChannel) & 0x1;
+  uint32_t forceValue = (decodeOverride->forceValue >> overrideChannel) & 0x1;
+  evaluationValue = (latchedValue & ~force) | (forceValue & force);
 }
 
 // Update its value from the applicationUpdateBuffer
@@ -74,7 +104,8 @@ void DbDeviceInput::update() {
   uint32_t wasHigh;
   uint32_t newValue = 0;
 
-  DeviceInputUpdateTime.start();
+  bool sample = CycleCounter::sample();
+  uint64_t start = sample ? CycleCounter::now() : 0;
 
   if (getWasLowBuffer()) {
     previousValue = value;
@@ -110,6 +141,8 @@ void DbDeviceInput::update() {
       latchedValue = value;
     }
 
+    applyBypassOverride();
+
     if (previousValue != value) {
       History::getInstance().logDeviceInput(id, previousValue, value);
     }
@@ -118,13 +151,15 @@ void DbDeviceInput::update() {
     throw(DbException("ERROR: DbDeviceInput::update() - no applicationUpdateBuffer set"));
   }
 
-  DeviceInputUpdateTime.end();
+  if (sample) {
+    DeviceInputUpdateTime.add(CycleCounter::now() - start);
+  }
 }
 
 DbAnalogDevice::DbAnalogDevice() : DbEntry(), deviceTypeId(-1), channelId(-1),
 				   value(0), previousValue(0),
 				   invalidValueCount(0), ignored(false),
-				   bypassMask(0xFFFFFFFF) {
+				   bypassMask(0xFFFFFFFF), evaluationValue(0) {
   for (uint32_t i = 0; i < ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL; ++i) {
     fastDestinationMask[i] = 0;
     ignoredIntegrator[i] = false;
@@ -150,6 +185,33 @@ void DbAnalogDevice::update(uint32_t v) {
   if ((value | latchedValue) != latchedValue) {
     latchedValue |= value;
   }
+
+  applyBypassOverride();
+}
+
+/**
+ * Select the card override word of this channel, called when the update
+ * buffers are configured.
+ */
+void DbAnalogDevice::configureBypassOverride() {
+  if (bypassOverride && channel && channel->number < APP_CARD_MAX_ANALOG_CHANNELS) {
+    decodeOverride = bypassOverride;
+    overrideChannel = channel->number;
+  }
+  else {
+    decodeOverride = &noBypassOverride;
+    overrideChannel = 0;
+  }
+}
+
+/**
+ * Compute the value used by the fault evaluation from the latched value and
+ * the card bypass override for this channel (bypassed thresholds read as
+ * not exceeded). The override word is the complement of bypassMask, which
+ * still applies to channels without an override word.
+ */
+void DbAnalogDevice::applyBypassOverride() {
+  evaluationValue = latchedValue & bypassMask & ~decodeOverride->analogForce[overrideChannel];
 }
 
 /**
@@ -170,7 +232,8 @@ void DbAnalogDevice::update() {
   uint32_t wasHigh;
   uint32_t newValue = 0;
 
-  AnalogDeviceUpdateTime.start();
+  bool sample = CycleCounter::sample();
+  uint64_t start = sample ? CycleCounter::now() : 0;
 
   if (getWasLowBuffer()) {
     previousValue = value;
@@ -232,6 +295,8 @@ void DbAnalogDevice::update() {
     value = newValue;
     //    std::cout << name << ": " <<  value << std::endl;
 
+    applyBypassOverride();
+
     if (previousValue != value) {
       History::getInstance().logAnalogDevice(id, previousValue, value);
     }
@@ -240,7 +305,9 @@ void DbAnalogDevice::update() {
     throw(DbException("ERROR: DbAnalogDevice::update() - no applicationUpdateBuffer set"));
   }
 
-  AnalogDeviceUpdateTime.end();
+  if (sample) {
+    AnalogDeviceUpdateTime.add(CycleCounter::now() - start);
+  }
 }
 
 /**
@@ -267,7 +334,8 @@ void DbApplicationCard::configureUpdateBuffers() {
 	  //	(*deviceInput).second->setUpdateBuffer(applicationUpdateBuffer);
     uint32_t diCard = (*deviceInput).second->channel->cardId;
     if (diCard == number) {
-	    (*deviceInput).second->setUpdateBuffers(fwUpdateBuffer, wasLowBufferOffset, wasHighBufferOffset);
+	    (*deviceInput).second->setUpdateBuffers(fwUpdateBuffer, wasLowBufferOffset, wasHighBufferOffset, &bypassOverride);
+	    (*deviceInput).second->configureBypassOverride();
 	    (*deviceInput).second->configured = true;
     }
     else {
@@ -283,7 +351,8 @@ void DbApplicationCard::configureUpdateBuffers() {
 	 analogDevice != analogDevices->end(); ++analogDevice) {
       //      std::cout << "A" << (*analogDevice).second->id << " ";
       //(*analogDevice).second->setUpdateBuffer(applicationUpdateBuffer);
-      (*analogDevice).second->setUpdateBuffers(fwUpdateBuffer, wasLowBufferOffset, wasHighBufferOffset);
+      (*analogDevice).second->setUpdateBuffers(fwUpdateBuffer, wasLowBufferOffset, wasHighBufferOffset, &bypassOverride);
+      (*analogDevice).second->configureBypassOverride();
     }
   }
   else {
@@ -329,7 +398,6 @@ bool DbApplicationCard::updateInputs() {
     reload = true;
   }
   if (digitalDevices) {
-    AppCardDigitalUpdateTime.start();
     for (DbDigitalDeviceMap::iterator digitalDevice = digitalDevices->begin();
 	       digitalDevice != digitalDevices->end(); ++digitalDevice) {
       (*digitalDevice).second->faultedOffline = !online; //true when it is falted offline
@@ -341,18 +409,14 @@ bool DbApplicationCard::updateInputs() {
 	      }
       }
     }
-    AppCardDigitalUpdateTime.end();
   }
   else if (analogDevices) {
-    AppCardAnalogUpdateTime.start();
-
     for (DbAnalogDeviceMap::iterator analogDevice = analogDevices->begin();
 	       analogDevice != analogDevices->end(); ++analogDevice) {
       (*analogDevice).second->update();
       (*analogDevice).second->faultedOffline = !online; //true when it is falted offline
       (*analogDevice).second->modeActive = active; //True when SC mode, false when NC mode
     }
-    AppCardAnalogUpdateTime.end();
   }
   else {
     //    throw(DbException("Can't configure update devices because there are no devices"));
@@ -363,15 +427,40 @@ bool DbApplicationCard::updateInputs() {
 }
 
 /**
- *
+ * Write the firmware configuration for this card into its configuration
+ * buffer.
  */
 void DbApplicationCard::writeConfiguration(bool enableTimeout) {
+  if (!writeConfigurationBuffer(applicationConfigBuffer, 0)) {
+    return;
+  }
+  // Enable application timeout
+  if (enableTimeout) {
+    Firmware::getInstance().setAppTimeoutEnable(globalId, true, false);
+  }
+}
+
+/**
+ * Build the firmware configuration for this card in the staged buffer, as
+ * if all bypasses expiring at or before 'expiredBy' had already expired.
+ * The configuration buffer is not touched, see
+ * MpsDb::writeStagedFirmwareConfiguration().
+ */
+void DbApplicationCard::stageConfiguration(time_t expiredBy) {
+  writeConfigurationBuffer(stagedConfigBuffer, expiredBy);
+}
+
+/**
+ * Write the digital or analog configuration into the given buffer.
+ * Returns false if the card has no devices.
+ */
+bool DbApplicationCard::writeConfigurationBuffer(ApplicationConfigBufferBitSet *buffer, time_t expiredBy) {
   if (digitalDevices) {
-    writeDigitalConfiguration();
+    writeDigitalConfiguration(buffer, expiredBy);
     hasInputs = true;
   }
   else if (analogDevices) {
-    writeAnalogConfiguration();
+    writeAnalogConfiguration(buffer, expiredBy);
     hasInputs = true;
   }
   else {
@@ -379,12 +468,8 @@ void DbApplicationCard::writeConfiguration(bool enableTimeout) {
     //    std::cerr << "WARN: No devices configured for application card " << this->name
     //	      << " (Id: " << this->id << ")" << std::endl;
     hasInputs = false;
-    return;
-  }
-  // Enable application timeout
-  if (enableTimeout) {
-    Firmware::getInstance().setAppTimeoutEnable(globalId, true, false);
   }
+  return hasInputs;
 }
 
 // Digital input configuration (total size = 1344 bits):
@@ -399,9 +484,9 @@ void DbApplicationCard::writeConfiguration(bool enableTimeout) {
 // |    M63     |    ...    |     M1     |     M0     |
 //
 // where Mxx is the mask for bit xx
-void DbApplicationCard::writeDigitalConfiguration() {
+void DbApplicationCard::writeDigitalConfiguration(ApplicationConfigBufferBitSet *buffer, time_t expiredBy) {
   // First set all bits to zero
-  applicationConfigBuffer->reset();
+  buffer->reset();
 
   std::stringstream errorStream;
   for (DbDigitalDeviceMap::iterator digitalDevice = digitalDevices->begin();
@@ -417,23 +502,23 @@ void DbApplicationCard::writeDigitalConfiguration() {
 	int channelNumber = (*deviceInput).second->channel->number;
 	int channelOffset = channelNumber * DIGITAL_CHANNEL_CONFIG_SIZE;
 	int offset = DIGITAL_CHANNEL_EXPECTED_STATE_OFFSET;
-	applicationConfigBuffer->set(channelOffset + offset, (*digitalDevice).second->fastExpectedState);
+	buffer->set(channelOffset + offset, (*digitalDevice).second->fastExpectedState);
 
 	// Write the destination mask (index 4 through 19)
 	// If bypass for device is valid leave destination mask set to zero - i.e. no mitigation
-	if ((*deviceInput).second->bypass->status != BYPASS_VALID) {
+	if (!(*deviceInput).second->bypass->isActive(expiredBy)) {
 	  offset = DIGITAL_CHANNEL_DESTINATION_MASK_OFFSET;
 	  for (uint32_t i = 0; i < DESTINATION_MASK_BIT_SIZE; ++i) {
 	    bool bit = ((*digitalDevice).second->fastDestinationMask >> i) & 0x01;
-	    applicationConfigBuffer->set(channelOffset + offset + i, bit);
+	    buffer->set(channelOffset + offset + i, bit);
 	  }
 	}
 
 	// Write the beam power class (index 0 through 3)
 	offset = DIGITAL_CHANNEL_POWER_CLASS_OFFSET;
 	for (uint32_t i = 0; i < POWER_CLASS_BIT_SIZE; ++i) {
-	  applicationConfigBuffer->set(channelOffset + offset + i,
-				 ((*digitalDevice).second->fastPowerClass >> i) & 0x01);
+	  buffer->set(channelOffset + offset + i,
+		       ((*digitalDevice).second->fastPowerClass >> i) & 0x01);
 	}
       }
       else {
@@ -474,9 +559,9 @@ void DbApplicationCard::writeDigitalConfiguration() {
 // EIC Version: there is only one integrator per channel, therefore
 // only B0 though B6 are actually used
 // ***
-void DbApplicationCard::writeAnalogConfiguration() {
+void DbApplicationCard::writeAnalogConfiguration(ApplicationConfigBufferBitSet *buffer, time_t expiredBy) {
   // First set all bits to zero
-  applicationConfigBuffer->reset();
+  buffer->reset();
 
   std::stringstream errorStream;
 
@@ -501,8 +586,8 @@ void DbApplicationCard::writeAnalogConfiguration() {
 	                         i * channelsPerCard * ANALOG_DEVICE_NUM_THRESHOLDS * POWER_CLASS_BIT_SIZE;
 	      for (uint32_t j = 0; j < ANALOG_DEVICE_NUM_THRESHOLDS; ++j) { // for each threshold
 	        for (uint32_t k = 0; k < POWER_CLASS_BIT_SIZE; ++k) { // for each power class bit
-	          applicationConfigBuffer->set(powerClassOffset + k,
-					      ((*analogDevice).second->fastPowerClass[j + i * ANALOG_DEVICE_NUM_THRESHOLDS] >> k) & 0x01);
+	          buffer->set(powerClassOffset + k,
+			       ((*analogDevice).second->fastPowerClass[j + i * ANALOG_DEVICE_NUM_THRESHOLDS] >> k) & 0x01);
 	    //std::cout << "offset=" << powerClassOffset+k << ", bit=" << (((*analogDevice).second->fastPowerClass[j] >> k) & 0x01) << std::endl;
 	        }
 	      powerClassOffset += POWER_CLASS_BIT_SIZE;
@@ -523,12 +608,12 @@ void DbApplicationCard::writeAnalogConfiguration() {
 
 	  // If bypass for the integrator is valid, set destination mask to zero - i.e. no mitigation
 	  // No mitigation also if the analogDevice is currently ignored
-	  if ((*analogDevice).second->bypass[i]->status == BYPASS_VALID ||
+	  if ((*analogDevice).second->bypass[i]->isActive(expiredBy) ||
 	      (*analogDevice).second->ignoredIntegrator[i] ||
 	      (*analogDevice).second->ignored) {
 	    bitValue = false;
 	  }
-	  applicationConfigBuffer->set(maskOffset + j, bitValue);
+	  buffer->set(maskOffset + j, bitValue);
 	  //std::cout << "offset=" << maskOffset+j << ", bit=" << bitValue << "(ignored=" << (*analogDevice).second->ignored<<  ")" << std::endl;
 	}
       }
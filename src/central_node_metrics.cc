@@ -0,0 +1,306 @@
+#include <central_node_metrics.h>
+#include <central_node_exception.h>
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct {
+  MetricId id;
+  const char *name;
+  const char *unit;
+  MetricKind kind;
+  uint32_t group;   // Writer thread, each group gets its own cache lines
+} MetricInfo;
+
+/**
+ * Descriptor table, in MetricId order.
+ */
+static const MetricInfo metricInfo[METRICS_COUNT] = {
+  { MetricEngineCycles,            "engine.cycles",              "",   MetricCounter, 0 },
+  { MetricEngineRate,              "engine.rate",                "Hz", MetricGauge,   0 },
+  { MetricEngineCheckTime,         "engine.check_time",          "ns", MetricGauge,   0 },
+  { MetricEngineCheckTimeMax,      "engine.check_time_max",      "ns", MetricGauge,   0 },
+  { MetricEngineCycleTime,         "engine.cycle_time",          "ns", MetricGauge,   0 },
+  { MetricEngineCycleTimeMax,      "engine.cycle_time_max",      "ns", MetricGauge,   0 },
+  { MetricEngineCheckOverBudget,   "engine.check_over_budget",   "",   MetricCounter, 0 },
+  { MetricEngineCycleOverBudget,   "engine.cycle_over_budget",   "",   MetricCounter, 0 },
+  { MetricEngineInputUpdateFail,   "engine.input_update_fail",   "",   MetricCounter, 0 },
+  { MetricEngineConfigReloads,     "engine.config_reloads",      "",   MetricCounter, 0 },
+  { MetricHeartbeatWdErrors,       "heartbeat.wd_errors",        "",   MetricCounter, 0 },
+  { MetricHeartbeatTxTimeMax,      "heartbeat.tx_time_max",      "ns", MetricGauge,   0 },
+
+  { MetricInputUpdates,            "input.updates",              "",   MetricCounter, 1 },
+  { MetricInputUpdateTime,         "input.update_time",          "ns", MetricGauge,   1 },
+  { MetricInputUpdateTimeMax,      "input.update_time_max",      "ns", MetricGauge,   1 },
+  { MetricInputFwTimeStamp,        "input.fw_timestamp",         "ns", MetricGauge,   1 },
+  { MetricInputFwPeriod,           "input.fw_period",            "ns", MetricGauge,   1 },
+  { MetricInputFwPeriodMax,        "input.fw_period_max",        "ns", MetricGauge,   1 },
+  { MetricInputLateUpdates,        "input.late_updates",         "",   MetricCounter, 1 },
+  { MetricInputUpdateQueueMax,     "input.update_queue_max",     "",   MetricGauge,   1 },
+  { MetricInputMitigationQueueMax, "input.mitigation_queue_max", "",   MetricGauge,   1 },
+
+  { MetricFwUpdateFrames,          "fw.update_frames",           "",   MetricCounter, 2 },
+  { MetricFwUpdateTimeouts,        "fw.update_timeouts",         "",   MetricCounter, 2 },
+  { MetricFwUpdateLate,            "fw.update_late",             "",   MetricCounter, 2 },
+
+  { MetricMitigationWrites,        "mitigation.writes",          "",   MetricCounter, 3 },
+  { MetricMitigationTxTime,        "mitigation.tx_time",         "ns", MetricGauge,   3 },
+  { MetricMitigationTxTimeMax,     "mitigation.tx_time_max",     "ns", MetricGauge,   3 },
+
+  { MetricPcChangePackets,         "pc_change.packets",          "",   MetricCounter, 4 },
+  { MetricPcChangeLost,            "pc_change.lost",             "",   MetricCounter, 4 },
+  { MetricPcChangeOutOfOrder,      "pc_change.out_of_order",     "",   MetricCounter, 4 },
+  { MetricPcChangeSameTag,         "pc_change.same_tag",         "",   MetricCounter, 4 },
+  { MetricPcChangeBadSize,         "pc_change.bad_size",         "",   MetricCounter, 4 },
+};
+
+static const uint32_t CACHE_LINE = 64;
+
+static uint32_t align(uint32_t offset) {
+  return (offset + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+/*
+ * Metrics (writer)
+ */
+
+/**
+ * Lay out the segment: header, descriptor table, then the values of each
+ * group starting on a new cache line.
+ */
+Metrics::Metrics() : _map(NULL), _mapSize(0) {
+  uint32_t offset = align(sizeof(MetricsHeader) + METRICS_COUNT * sizeof(MetricsDescriptor));
+  for (uint32_t i = 0; i < METRICS_COUNT; ++i) {
+    assert(metricInfo[i].id == i);
+    if (i > 0 && metricInfo[i].group != metricInfo[i - 1].group) {
+      offset = align(offset);
+    }
+    _offsets[i] = offset;
+    offset += sizeof(uint64_t);
+  }
+  _size = align(offset);
+
+  _base = new uint8_t[_size];
+  memset(_base, 0, _size);
+}
+
+Metrics::~Metrics() {
+  close();
+  delete [] _base;
+}
+
+/**
+ * Create the shared memory segment and move the current values into it.
+ * Must be called before the engine threads are started.
+ */
+void Metrics::open(std::string name) {
+  close();
+  shm_unlink(name.c_str());
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_EXCL, 0644);
+  if (fd < 0) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to create metrics shared memory " << name
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _mapSize = _size;
+  if (ftruncate(fd, _mapSize) != 0) {
+    ::close(fd);
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to size metrics shared memory " << name
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  void *map = mmap(NULL, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to map metrics shared memory " << name
+		<< " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+  if (mlock(map, _mapSize) != 0) {
+    perror("Metrics mlock");
+  }
+
+  uint8_t *base = static_cast<uint8_t *>(map);
+  MetricsDescriptor *descriptors = reinterpret_cast<MetricsDescriptor *>(base + sizeof(MetricsHeader));
+  for (uint32_t i = 0; i < METRICS_COUNT; ++i) {
+    strncpy(descriptors[i].name, metricInfo[i].name, METRICS_NAME_SIZE - 1);
+    strncpy(descriptors[i].unit, metricInfo[i].unit, METRICS_UNIT_SIZE - 1);
+    descriptors[i].kind = metricInfo[i].kind;
+    descriptors[i].offset = _offsets[i];
+  }
+  memcpy(base + _offsets[0], _base + _offsets[0], _size - _offsets[0]);
+
+  MetricsHeader *header = reinterpret_cast<MetricsHeader *>(base);
+  header->version = METRICS_VERSION;
+  header->descriptorCount = METRICS_COUNT;
+  header->descriptorOffset = sizeof(MetricsHeader);
+  header->descriptorSize = sizeof(MetricsDescriptor);
+  header->size = _size;
+  header->pid = getpid();
+  header->startTime = time(0);
+  header->updateCount.store(0);
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = METRICS_MAGIC;
+
+  delete [] _base;
+  _base = base;
+  _map = map;
+  _name = name;
+
+  std::cout << "INFO: Metrics published in " << name << std::endl;
+}
+
+/**
+ * Back to a private buffer. The segment is left in place (with its last
+ * values) until the next open().
+ */
+void Metrics::close() {
+  if (_map != NULL) {
+    uint8_t *base = new uint8_t[_size];
+    memcpy(base, _base, _size);
+    _base = base;
+    munmap(_map, _mapSize);
+    _map = NULL;
+  }
+}
+
+/**
+ * Called by the engine thread at the end of each cycle.
+ */
+void Metrics::publish() {
+  if (_map != NULL) {
+    MetricsHeader *header = static_cast<MetricsHeader *>(_map);
+    header->updateCount.store(header->updateCount.load(std::memory_order_relaxed) + 1,
+			      std::memory_order_release);
+  }
+}
+
+std::ostream & operator<<(std::ostream &os, Metrics * const metrics) {
+  os << "=== Metrics ===" << std::endl;
+  if (metrics->_map == NULL) {
+    os << "  not published" << std::endl;
+  }
+  else {
+    os << "  " << metrics->_name << ": " << METRICS_COUNT << " metrics, "
+       << metrics->_size << " bytes, "
+       << static_cast<MetricsHeader *>(metrics->_map)->updateCount.load() << " updates" << std::endl;
+  }
+  return os;
+}
+
+/*
+ * MetricsReader (client)
+ */
+
+MetricsReader::MetricsReader() : _map(NULL), _mapSize(0), _header(NULL), _descriptors(NULL) {
+}
+
+MetricsReader::~MetricsReader() {
+  close();
+}
+
+void MetricsReader::open(std::string name) {
+  close();
+
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to open metrics " << name
+		<< " (" << strerror(errno) << ") - is the engine running with metrics enabled?";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  struct stat st;
+  MetricsHeader header;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(MetricsHeader) ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      header.magic != METRICS_MAGIC || header.version != METRICS_VERSION ||
+      header.descriptorSize != sizeof(MetricsDescriptor) ||
+      static_cast<size_t>(st.st_size) < header.size ||
+      header.descriptorOffset + static_cast<size_t>(header.descriptorCount) * header.descriptorSize > header.size) {
+    ::close(fd);
+    std::stringstream errorStream;
+    errorStream << "ERROR: " << name << " is not a valid metrics segment";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _mapSize = header.size;
+  void *map = mmap(NULL, _mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Failed to map metrics " << name << " (" << strerror(errno) << ")";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  _map = map;
+  _header = static_cast<const MetricsHeader *>(_map);
+  _descriptors = reinterpret_cast<const MetricsDescriptor *>(static_cast<const uint8_t *>(_map) +
+							     _header->descriptorOffset);
+
+  for (uint32_t i = 0; i < _header->descriptorCount; ++i) {
+    if (_descriptors[i].offset + sizeof(uint64_t) > _mapSize) {
+      close();
+      std::stringstream errorStream;
+      errorStream << "ERROR: Invalid offset for metric " << i << " in " << name;
+      throw(CentralNodeException(errorStream.str()));
+    }
+  }
+}
+
+void MetricsReader::close() {
+  if (_map != NULL) {
+    munmap(const_cast<void *>(_map), _mapSize);
+    _map = NULL;
+    _header = NULL;
+    _descriptors = NULL;
+  }
+}
+
+uint64_t MetricsReader::getUpdateCount() const {
+  return _header->updateCount.load(std::memory_order_acquire);
+}
+
+/**
+ * Index of the named metric, -1 if the engine does not publish it.
+ */
+int MetricsReader::find(std::string name) const {
+  for (uint32_t i = 0; i < _header->descriptorCount; ++i) {
+    if (strncmp(_descriptors[i].name, name.c_str(), METRICS_NAME_SIZE) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+std::string MetricsReader::getName(uint32_t index) const {
+  return std::string(_descriptors[index].name, strnlen(_descriptors[index].name, METRICS_NAME_SIZE));
+}
+
+std::string MetricsReader::getUnit(uint32_t index) const {
+  return std::string(_descriptors[index].unit, strnlen(_descriptors[index].unit, METRICS_UNIT_SIZE));
+}
+
+MetricKind MetricsReader::getKind(uint32_t index) const {
+  return static_cast<MetricKind>(_descriptors[index].kind);
+}
+
+uint64_t MetricsReader::getValue(uint32_t index) const {
+  const std::atomic<uint64_t> *v = reinterpret_cast<const std::atomic<uint64_t> *>
+    (static_cast<const uint8_t *>(_map) + _descriptors[index].offset);
+  return v->load(std::memory_order_relaxed);
+}
@@ -0,0 +1,197 @@
+#ifndef CENTRAL_NODE_METRICS_H
+#define CENTRAL_NODE_METRICS_H
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <atomic>
+
+/**
+ * Shared memory metrics segment
+ *
+ * The real time threads publish their statistics at the end of each cycle
+ * into a fixed layout segment (POSIX shared memory, default name
+ * METRICS_DEFAULT_NAME). IOC scan threads, exporters and command line tools
+ * read it without locks or system calls, and without disturbing the
+ * engine threads.
+ *
+ *   MetricsHeader                                    (offset 0)
+ *   'descriptorCount' x MetricsDescriptor            (offset 'descriptorOffset')
+ *   values, one std::atomic<uint64_t> per metric     (offset of each in its descriptor)
+ *
+ * The layout is self-describing: readers look metrics up by name in the
+ * descriptor table, so metrics can be added without changing the version
+ * (which only changes if the header or descriptor format changes). Values
+ * written by different threads are on separate cache lines.
+ *
+ * Each value is read atomically, but there is no consistency across
+ * values. The header updateCount is incremented by the engine thread at
+ * the end of each evaluation cycle, it can be used to check the engine
+ * is alive.
+ */
+const char METRICS_DEFAULT_NAME[] = "/central_node_metrics";
+const uint64_t METRICS_MAGIC = 0x53434952544D534DULL; // "MSMTRICS"
+const uint32_t METRICS_VERSION = 1;
+const uint32_t METRICS_NAME_SIZE = 48;
+const uint32_t METRICS_UNIT_SIZE = 8;
+
+enum MetricKind {
+  MetricCounter = 0,  // Monotonic count since the engine started
+  MetricGauge = 1,    // Last (or maximum) value
+};
+
+/**
+ * Metrics published by the engine. Grouped by the thread updating them,
+ * add new metrics to the group of the writer thread (and to the
+ * descriptor table in central_node_metrics.cc).
+ */
+enum MetricId {
+  // Engine thread
+  MetricEngineCycles = 0,
+  MetricEngineRate,
+  MetricEngineCheckTime,
+  MetricEngineCheckTimeMax,
+  MetricEngineCycleTime,
+  MetricEngineCycleTimeMax,
+  MetricEngineCheckOverBudget,
+  MetricEngineCycleOverBudget,
+  MetricEngineInputUpdateFail,
+  MetricEngineConfigReloads,
+  MetricHeartbeatWdErrors,
+  MetricHeartbeatTxTimeMax,
+
+  // Input update thread
+  MetricInputUpdates,
+  MetricInputUpdateTime,
+  MetricInputUpdateTimeMax,
+  MetricInputFwTimeStamp,
+  MetricInputFwPeriod,
+  MetricInputFwPeriodMax,
+  MetricInputLateUpdates,
+  MetricInputUpdateQueueMax,
+  MetricInputMitigationQueueMax,
+
+  // Firmware update reader thread
+  MetricFwUpdateFrames,
+  MetricFwUpdateTimeouts,
+  MetricFwUpdateLate,
+
+  // Mitigation writer thread
+  MetricMitigationWrites,
+  MetricMitigationTxTime,
+  MetricMitigationTxTimeMax,
+
+  // Power class change reader thread
+  MetricPcChangePackets,
+  MetricPcChangeLost,
+  MetricPcChangeOutOfOrder,
+  MetricPcChangeSameTag,
+  MetricPcChangeBadSize,
+
+  METRICS_COUNT
+};
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t descriptorCount;
+  uint32_t descriptorOffset;
+  uint32_t descriptorSize;   // sizeof(MetricsDescriptor)
+  uint32_t size;             // Total size of the segment
+  uint32_t pid;              // Engine process
+  uint64_t startTime;        // Wall clock time the segment was created (time_t)
+  std::atomic<uint64_t> updateCount;
+} MetricsHeader;
+
+typedef struct {
+  char name[METRICS_NAME_SIZE];  // e.g. "engine.check_time", NUL terminated
+  char unit[METRICS_UNIT_SIZE];  // e.g. "ns", "Hz", empty if none
+  uint32_t kind;                 // MetricKind
+  uint32_t offset;               // Offset of the value from the start of the segment
+} MetricsDescriptor;
+
+/**
+ * Writer side. Each metric must be written by a single thread. Until
+ * open() is called the values go to a private buffer, so the threads
+ * update them unconditionally.
+ */
+class Metrics {
+ private:
+  Metrics();
+  Metrics(Metrics const &);
+  void operator=(Metrics const &);
+
+  std::string _name;
+  void *_map;
+  size_t _mapSize;
+  uint8_t *_base;                     // Segment (or private buffer) base
+  uint32_t _offsets[METRICS_COUNT];   // Offset of each value from _base
+  uint32_t _size;
+
+  std::atomic<uint64_t> &value(MetricId id) {
+    return *reinterpret_cast<std::atomic<uint64_t> *>(_base + _offsets[id]);
+  }
+
+ public:
+  ~Metrics();
+
+  void open(std::string name = METRICS_DEFAULT_NAME);
+  void close();
+  bool isOpen() const { return _map != NULL; }
+
+  void set(MetricId id, uint64_t v) {
+    value(id).store(v, std::memory_order_relaxed);
+  }
+  // Durations measured by the Timer class (seconds, negative if no
+  // measurement yet) are published in ns
+  void setTime(MetricId id, double seconds) {
+    set(id, seconds > 0 ? static_cast<uint64_t>(seconds * 1e9) : 0);
+  }
+  void add(MetricId id, uint64_t n = 1) {
+    // Single writer, no need for an atomic read-modify-write
+    std::atomic<uint64_t> &v = value(id);
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  uint64_t get(MetricId id) {
+    return value(id).load(std::memory_order_relaxed);
+  }
+  void publish();
+
+  static Metrics &getInstance() {
+    static Metrics instance;
+    return instance;
+  }
+
+  friend std::ostream & operator<<(std::ostream &os, Metrics * const metrics);
+};
+
+/**
+ * Client side, maps the segment read-only.
+ */
+class MetricsReader {
+ private:
+  const void *_map;
+  size_t _mapSize;
+  const MetricsHeader *_header;
+  const MetricsDescriptor *_descriptors;
+
+ public:
+  MetricsReader();
+  ~MetricsReader();
+
+  void open(std::string name = METRICS_DEFAULT_NAME);
+  void close();
+
+  uint32_t getCount() const { return _header->descriptorCount; }
+  uint32_t getPid() const { return _header->pid; }
+  uint64_t getStartTime() const { return _header->startTime; }
+  uint64_t getUpdateCount() const;
+
+  int find(std::string name) const;
+  std::string getName(uint32_t index) const;
+  std::string getUnit(uint32_t index) const;
+  MetricKind getKind(uint32_t index) const;
+  uint64_t getValue(uint32_t index) const;
+};
+
+#endif
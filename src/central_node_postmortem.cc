@@ -0,0 +1,284 @@
+#include <central_node_postmortem.h>
+#include <central_node_exception.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fstream>
+#include <sstream>
+
+PostMortem::PostMortem() :
+  _frameSize(0), _recorded(0),
+  _postTriggerFrames(POSTMORTEM_DEFAULT_POST_TRIGGER_FRAMES), _remaining(0),
+  _havePrevious(false), _state(Recording), _pendingTrigger(PostMortemNoTrigger),
+  _trigger(PostMortemNoTrigger), _triggerCycle(0), _triggerTime(0),
+  _directory("/tmp"), _dumpRequested(false), _done(false),
+  _ignoredTriggers(0), _dumpCount(0), _dumpErrors(0) {
+  memset(_triggerCount, 0, sizeof(_triggerCount));
+  memset(_previousMitigation, 0, sizeof(_previousMitigation));
+
+  configure(POSTMORTEM_DEFAULT_FRAMES, POSTMORTEM_DEFAULT_POST_TRIGGER_FRAMES,
+	    FW_UPDATE_BUFFER_SIZE_BYTES);
+
+  _dumpThread = new std::thread(&PostMortem::dumpThread, this);
+  if (pthread_setname_np(_dumpThread->native_handle(), "PostMortem")) {
+    perror("pthread_setname_np failed");
+  }
+}
+
+PostMortem::~PostMortem() {
+  {
+    std::lock_guard<std::mutex> lock(_dumpMutex);
+    _done = true;
+  }
+  _dumpCondVar.notify_one();
+  _dumpThread->join();
+  delete _dumpThread;
+}
+
+/**
+ * Allocate the ring for 'frames' frames of 'frameSize' bytes. Must be
+ * called before firmware updates are received.
+ *
+ * The storage allocated here only lasts until the first pass of record(),
+ * which swaps each slot with a received update frame. The frames in the
+ * ring are therefore locked in memory by the mlockall(MCL_FUTURE) of the
+ * engine and of the input update thread, not by this function.
+ */
+void PostMortem::configure(uint32_t frames, uint32_t postTriggerFrames, uint32_t frameSize) {
+  if (frames == 0 || postTriggerFrames >= frames) {
+    std::stringstream errorStream;
+    errorStream << "ERROR: Invalid post-mortem buffer size (" << frames
+		<< " frames, " << postTriggerFrames << " after trigger)";
+    throw(CentralNodeException(errorStream.str()));
+  }
+
+  std::vector<PostMortemFrame> newFrames(frames);
+  for (uint32_t i = 0; i < frames; ++i) {
+    memset(&newFrames[i].header, 0, sizeof(PostMortemFrameHeader));
+    newFrames[i].data.resize(frameSize, 0);
+  }
+
+  _frames.swap(newFrames);
+  _frameSize = frameSize;
+  _postTriggerFrames = postTriggerFrames;
+  _recorded = 0;
+  _havePrevious = false;
+  _state.store(Recording);
+}
+
+void PostMortem::setDirectory(std::string directory) {
+  std::lock_guard<std::mutex> lock(_dumpMutex);
+  _directory = directory;
+}
+
+/**
+ * Request a dump. May be called from any thread, never blocks.
+ */
+void PostMortem::trigger(PostMortemTrigger reason) {
+  if (_state.load(std::memory_order_acquire) != Recording) {
+    _ignoredTriggers++;
+    return;
+  }
+
+  uint32_t none = PostMortemNoTrigger;
+  if (!_pendingTrigger.compare_exchange_strong(none, reason)) {
+    _ignoredTriggers++;
+  }
+}
+
+/**
+ * True if the allowed power class of any destination is lower than in the
+ * previous frame.
+ */
+bool PostMortem::powerClassDecreased(const uint32_t *mitigation) const {
+  if (!_havePrevious) {
+    return false;
+  }
+
+  uint32_t mask = (1 << POWER_CLASS_BIT_SIZE) - 1;
+  for (uint32_t word = 0; word < POSTMORTEM_MITIGATION_WORDS; ++word) {
+    if (mitigation[word] == _previousMitigation[word]) {
+      continue;
+    }
+    for (uint32_t shift = 0; shift < 32; shift += POWER_CLASS_BIT_SIZE) {
+      if (((mitigation[word] >> shift) & mask) < ((_previousMitigation[word] >> shift) & mask)) {
+	return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Add an evaluated frame to the ring, called by the input update thread
+ * only. 'frame' is swapped with the oldest frame in the ring, the caller
+ * gets that storage back. Nothing is recorded (and 'frame' is left as is)
+ * while a dump is pending.
+ */
+void PostMortem::record(std::vector<uint8_t> &frame, const std::vector<uint32_t> &mitigation,
+			uint64_t cycle, uint64_t timestamp) {
+  uint32_t state = _state.load(std::memory_order_acquire);
+  if (state == Frozen || _frames.empty()) {
+    return;
+  }
+
+  PostMortemFrame &slot = _frames[_recorded % _frames.size()];
+  slot.data.swap(frame);
+  slot.header.cycle = cycle;
+  slot.header.timestamp = timestamp;
+  for (uint32_t i = 0; i < POSTMORTEM_MITIGATION_WORDS; ++i) {
+    slot.header.mitigation[i] = i < mitigation.size() ? mitigation[i] : 0;
+  }
+  _recorded++;
+
+  if (state == Recording) {
+    if (powerClassDecreased(slot.header.mitigation)) {
+      trigger(PostMortemPowerClassDecrease);
+    }
+
+    uint32_t reason = _pendingTrigger.exchange(PostMortemNoTrigger);
+    if (reason != PostMortemNoTrigger) {
+      _trigger = reason;
+      _triggerCycle = cycle;
+      _triggerTime = time(0);
+      _triggerCount[reason]++;
+      _remaining = _postTriggerFrames;
+      _state.store(Triggered, std::memory_order_release);
+      state = Triggered;
+    }
+  }
+
+  memcpy(_previousMitigation, slot.header.mitigation, sizeof(_previousMitigation));
+  _havePrevious = true;
+
+  if (state == Triggered) {
+    if (_remaining == 0) {
+      _state.store(Frozen, std::memory_order_release);
+      {
+	std::lock_guard<std::mutex> lock(_dumpMutex);
+	_dumpRequested = true;
+      }
+      _dumpCondVar.notify_one();
+    }
+    else {
+      _remaining--;
+    }
+  }
+}
+
+/**
+ * Write the frozen ring to disk. Called by the dump thread only.
+ */
+bool PostMortem::dump() {
+  std::stringstream fileName;
+  {
+    std::lock_guard<std::mutex> lock(_dumpMutex);
+    struct tm triggerTm;
+    char timeString[32];
+    localtime_r(&_triggerTime, &triggerTm);
+    strftime(timeString, sizeof(timeString), "%Y%m%d-%H%M%S", &triggerTm);
+    fileName << _directory << "/postmortem-" << timeString << "-" << _triggerCycle << ".dat";
+  }
+
+  std::ofstream file(fileName.str().c_str(), std::ofstream::out | std::ofstream::binary);
+  if (!file.is_open()) {
+    std::cerr << "ERROR: Failed to open post-mortem dump file " << fileName.str()
+	      << " (" << strerror(errno) << ")" << std::endl;
+    return false;
+  }
+
+  uint32_t count = _recorded < _frames.size() ? _recorded : _frames.size();
+  uint64_t first = _recorded - count;
+
+  PostMortemFileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = POSTMORTEM_MAGIC;
+  header.version = POSTMORTEM_VERSION;
+  header.frameSize = _frameSize;
+  header.mitigationWords = POSTMORTEM_MITIGATION_WORDS;
+  header.frameCount = count;
+  header.trigger = _trigger;
+  header.triggerCycle = _triggerCycle;
+  header.triggerTime = _triggerTime;
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  std::vector<uint8_t> empty(_frameSize, 0);
+  for (uint64_t i = first; i < _recorded; ++i) {
+    const PostMortemFrame &frame = _frames[i % _frames.size()];
+    file.write(reinterpret_cast<const char *>(&frame.header), sizeof(frame.header));
+    // Frames of unexpected size are padded/truncated to keep the file seekable
+    const std::vector<uint8_t> &data = frame.data.size() >= _frameSize ? frame.data : empty;
+    file.write(reinterpret_cast<const char *>(data.data()), _frameSize);
+  }
+
+  file.close();
+  if (!file) {
+    std::cerr << "ERROR: Failed to write post-mortem dump file " << fileName.str() << std::endl;
+    return false;
+  }
+
+  std::cout << "INFO: Post-mortem dump (" << triggerName(_trigger) << ", "
+	    << count << " frames) written to " << fileName.str() << std::endl;
+
+  std::lock_guard<std::mutex> lock(_dumpMutex);
+  _lastDump = fileName.str();
+  return true;
+}
+
+void PostMortem::dumpThread() {
+  std::unique_lock<std::mutex> lock(_dumpMutex);
+  while (true) {
+    _dumpCondVar.wait(lock, [this] { return _dumpRequested || _done; });
+    if (_done) {
+      return;
+    }
+    _dumpRequested = false;
+
+    lock.unlock();
+    if (dump()) {
+      _dumpCount++;
+    }
+    else {
+      _dumpErrors++;
+    }
+    _state.store(Recording, std::memory_order_release);
+    lock.lock();
+  }
+}
+
+const char *PostMortem::triggerName(uint32_t reason) {
+  switch (reason) {
+  case PostMortemPowerClassDecrease: return "power class decrease";
+  case PostMortemFirmwareTrip: return "firmware trip";
+  case PostMortemManual: return "manual";
+  default: return "none";
+  }
+}
+
+std::ostream & operator<<(std::ostream &os, PostMortem * const postMortem) {
+  static const char *stateNames[] = {"recording", "triggered", "frozen (dump pending)"};
+
+  os << "=== Post-mortem buffer ===" << std::endl;
+  os << "  frames: " << postMortem->_frames.size()
+     << " (" << postMortem->_postTriggerFrames << " after trigger, "
+     << postMortem->_frameSize << " bytes each)" << std::endl;
+  os << "  state: " << stateNames[postMortem->_state.load()] << std::endl;
+  os << "  recorded: " << postMortem->_recorded << std::endl;
+  os << "  triggers:";
+  for (uint32_t i = PostMortemPowerClassDecrease; i <= PostMortemManual; ++i) {
+    os << " " << PostMortem::triggerName(i) << "=" << postMortem->_triggerCount[i];
+  }
+  os << " (ignored " << postMortem->_ignoredTriggers.load() << ")" << std::endl;
+  os << "  dumps: " << postMortem->_dumpCount << " (errors " << postMortem->_dumpErrors << ")";
+  {
+    std::lock_guard<std::mutex> lock(postMortem->_dumpMutex);
+    if (!postMortem->_lastDump.empty()) {
+      os << ", last " << postMortem->_lastDump;
+    }
+  }
+  os << std::endl;
+
+  return os;
+}
@@ -0,0 +1,156 @@
+#ifndef CENTRAL_NODE_POSTMORTEM_H
+#define CENTRAL_NODE_POSTMORTEM_H
+
+#include <central_node_database_defs.h>
+
+#include <stdint.h>
+#include <time.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Default number of frames kept (0.5 s at 360 Hz, about 9 MB), and number
+ * of frames recorded after the trigger before the buffer is frozen.
+ */
+const uint32_t POSTMORTEM_DEFAULT_FRAMES = 180;
+const uint32_t POSTMORTEM_DEFAULT_POST_TRIGGER_FRAMES = 36;
+
+/**
+ * Words in the software mitigation buffer (4 bits per destination)
+ */
+const uint32_t POSTMORTEM_MITIGATION_WORDS = NUM_DESTINATIONS / 8;
+
+enum PostMortemTrigger {
+  PostMortemNoTrigger = 0,
+  PostMortemPowerClassDecrease, // Software allowed power class decreased on a destination
+  PostMortemFirmwareTrip,       // Firmware power class decreased on a destination
+  PostMortemManual,             // Requested by the operator
+};
+
+/**
+ * Post-mortem dump file format (all little endian):
+ *
+ *   PostMortemFileHeader
+ *   'frameCount' x {
+ *     PostMortemFrameHeader
+ *     uint8_t data['frameSize']     // Raw firmware update frame
+ *   }
+ *
+ * Frames are stored oldest first. The data is the frame as received from
+ * the firmware update stream, and can be sent as-is to the simulated
+ * firmware (see central_node_postmortem_replay).
+ */
+const uint64_t POSTMORTEM_MAGIC = 0x504D5544504D534DULL; // "MSMPDUMP"
+const uint32_t POSTMORTEM_VERSION = 1;
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t frameSize;
+  uint32_t mitigationWords;
+  uint32_t frameCount;
+  uint32_t trigger;         // PostMortemTrigger
+  uint32_t reserved;
+  uint64_t triggerCycle;    // Cycle of the frame where the trigger fired
+  uint64_t triggerTime;     // Wall clock time of the trigger (time_t)
+} PostMortemFileHeader;
+
+typedef struct {
+  uint64_t cycle;
+  uint64_t timestamp;
+  uint32_t mitigation[POSTMORTEM_MITIGATION_WORDS];
+} PostMortemFrameHeader;
+
+/**
+ * Frame kept in the ring
+ */
+struct PostMortemFrame {
+  PostMortemFrameHeader header;
+  std::vector<uint8_t> data;
+};
+
+/**
+ * Always-on ring of the last raw firmware update frames with the software
+ * mitigation words computed for each of them.
+ *
+ * The input update thread records each frame after the engine has
+ * evaluated it. Recording swaps the frame vector with the oldest one in
+ * the ring (no copy of the frame data), the storage of the oldest frame is
+ * released by the caller as before.
+ *
+ * When a trigger fires (from any thread, see trigger()) a few more frames
+ * are recorded, then the ring is frozen and the dump thread writes it to
+ * '<directory>/postmortem-<time>-<cycle>.dat' with normal priority. The
+ * ring records again once the dump is written. Triggers that fire while a
+ * dump is pending are counted and ignored.
+ */
+class PostMortem {
+ private:
+  enum State {
+    Recording,
+    Triggered,
+    Frozen,
+  };
+
+  PostMortem();
+  PostMortem(PostMortem const &);
+  void operator=(PostMortem const &);
+
+  std::vector<PostMortemFrame> _frames;
+  uint32_t _frameSize;
+  uint64_t _recorded;
+  uint32_t _postTriggerFrames;
+  uint32_t _remaining;
+  uint32_t _previousMitigation[POSTMORTEM_MITIGATION_WORDS];
+  bool _havePrevious;
+
+  std::atomic<uint32_t> _state;
+  std::atomic<uint32_t> _pendingTrigger;
+  uint32_t _trigger;
+  uint64_t _triggerCycle;
+  time_t _triggerTime;
+  std::string _directory;
+
+  std::thread *_dumpThread;
+  std::mutex _dumpMutex;
+  std::condition_variable _dumpCondVar;
+  bool _dumpRequested;
+  bool _done;
+
+  // Statistics
+  uint32_t _triggerCount[PostMortemManual + 1];
+  std::atomic<uint32_t> _ignoredTriggers;
+  uint32_t _dumpCount;
+  uint32_t _dumpErrors;
+  std::string _lastDump;
+
+  void dumpThread();
+  bool dump();
+  bool powerClassDecreased(const uint32_t *mitigation) const;
+
+ public:
+  ~PostMortem();
+
+  void configure(uint32_t frames, uint32_t postTriggerFrames, uint32_t frameSize);
+  void setDirectory(std::string directory);
+
+  void record(std::vector<uint8_t> &frame, const std::vector<uint32_t> &mitigation,
+	      uint64_t cycle, uint64_t timestamp);
+  void trigger(PostMortemTrigger reason);
+
+  static const char *triggerName(uint32_t reason);
+
+  static PostMortem &getInstance() {
+    static PostMortem instance;
+    return instance;
+  }
+
+  friend std::ostream & operator<<(std::ostream &os, PostMortem * const postMortem);
+};
+
+#endif
@@ -26,14 +26,14 @@ namespace YAML {
   template<>
     struct convert<DbCrateMapPtr> {
     static bool decode(const Node &node, DbCrateMapPtr &rhs) {
-      DbCrateMap *crates = new DbCrateMap();
+      DbCrateMapPtr crates = dbArenaNew<DbCrateMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbCrateMapPtr(crates);
+      rhs = crates;
 
       for (YAML::Node::const_iterator it = node["Crate"].begin();
 	   it != node["Crate"].end(); ++it) {
-	DbCrate *crate = new DbCrate();
+	DbCratePtr crate = dbArenaNew<DbCrate>();
 
 	try {
 	  field = "id";
@@ -55,7 +55,7 @@ namespace YAML {
 	  throw(DbException(errorStream.str()));
 	}
 
-	rhs->insert(std::pair<int, DbCratePtr>(crate->id, DbCratePtr(crate)));
+	rhs->insert(std::pair<int, DbCratePtr>(crate->id, crate));
       }
 
       return true;
@@ -75,14 +75,14 @@ namespace YAML {
   template<>
     struct convert<DbInfoMapPtr> {
     static bool decode(const Node &node, DbInfoMapPtr &rhs) {
-      DbInfoMap *appTypes = new DbInfoMap();
+      DbInfoMapPtr appTypes = dbArenaNew<DbInfoMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbInfoMapPtr(appTypes);
+      rhs = appTypes;
 
       for (YAML::Node::const_iterator it = node["DatabaseInfo"].begin();
 	   it != node["DatabaseInfo"].end(); ++it) {
-	DbInfo *dbInfo = new DbInfo();
+	DbInfoPtr dbInfo = dbArenaNew<DbInfo>();
 
 	try {
 	  field = "source";
@@ -104,7 +104,7 @@ namespace YAML {
 	  throw(DbException(errorStream.str()));
 	}
 
-	rhs->insert(std::pair<int, DbInfoPtr>(0, DbInfoPtr(dbInfo)));
+	rhs->insert(std::pair<int, DbInfoPtr>(0, dbInfo));
       }
 
       return true;
@@ -124,14 +124,14 @@ namespace YAML {
   template<>
     struct convert<DbApplicationTypeMapPtr> {
     static bool decode(const Node &node, DbApplicationTypeMapPtr &rhs) {
-      DbApplicationTypeMap *appTypes = new DbApplicationTypeMap();
+      DbApplicationTypeMapPtr appTypes = dbArenaNew<DbApplicationTypeMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbApplicationTypeMapPtr(appTypes);
+      rhs = appTypes;
 
       for (YAML::Node::const_iterator it = node["ApplicationType"].begin();
 	   it != node["ApplicationType"].end(); ++it) {
-	DbApplicationType *appType = new DbApplicationType();
+	DbApplicationTypePtr appType = dbArenaNew<DbApplicationType>();
 
 	try {
 	  field = "id";
@@ -166,7 +166,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbApplicationTypePtr>(appType->id,
-							 DbApplicationTypePtr(appType)));
+							 appType));
       }
 
       return true;
@@ -187,14 +187,14 @@ namespace YAML {
   template<>
     struct convert<DbApplicationCardMapPtr> {
     static bool decode(const Node &node, DbApplicationCardMapPtr &rhs) {
-      DbApplicationCardMap *appCards = new DbApplicationCardMap();
+      DbApplicationCardMapPtr appCards = dbArenaNew<DbApplicationCardMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbApplicationCardMapPtr(appCards);
+      rhs = appCards;
 
       for (YAML::Node::const_iterator it = node["ApplicationCard"].begin();
 	   it != node["ApplicationCard"].end(); ++it) {
-	DbApplicationCard *appCard = new DbApplicationCard();
+	DbApplicationCardPtr appCard = dbArenaNew<DbApplicationCard>();
 
 	try {
 	  field = "id";
@@ -232,7 +232,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbApplicationCardPtr>(appCard->id,
-							 DbApplicationCardPtr(appCard)));
+							 appCard));
       }
 
       return true;
@@ -261,14 +261,14 @@ namespace YAML {
 	key = "AnalogChannel";
       }
 
-      DbChannelMap *channels = new DbChannelMap();
+      DbChannelMapPtr channels = dbArenaNew<DbChannelMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbChannelMapPtr(channels);
+      rhs = channels;
 
       for (YAML::Node::const_iterator it = node[key].begin();
 	   it != node[key].end(); ++it) {
-	DbChannel *channel = new DbChannel();
+	DbChannelPtr channel = dbArenaNew<DbChannel>();
 
 	try {
 	  field = "id";
@@ -290,7 +290,7 @@ namespace YAML {
 	  throw(DbException(errorStream.str()));
 	}
 
-	rhs->insert(std::pair<int, DbChannelPtr>(channel->id, DbChannelPtr(channel)));
+	rhs->insert(std::pair<int, DbChannelPtr>(channel->id, channel));
       }
 
       return true;
@@ -305,14 +305,14 @@ namespace YAML {
   template<>
     struct convert<DbDeviceTypeMapPtr> {
     static bool decode(const Node &node, DbDeviceTypeMapPtr &rhs) {
-      DbDeviceTypeMap *deviceTypes = new DbDeviceTypeMap();
+      DbDeviceTypeMapPtr deviceTypes = dbArenaNew<DbDeviceTypeMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbDeviceTypeMapPtr(deviceTypes);
+      rhs = deviceTypes;
 
       for (YAML::Node::const_iterator it = node["DeviceType"].begin();
 	   it != node["DeviceType"].end(); ++it) {
-	DbDeviceType *deviceType = new DbDeviceType();
+	DbDeviceTypePtr deviceType = dbArenaNew<DbDeviceType>();
 
 	try {
 	  field = "id";
@@ -335,7 +335,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbDeviceTypePtr>(deviceType->id,
-						    DbDeviceTypePtr(deviceType)));
+						    deviceType));
       }
 
       return true;
@@ -352,14 +352,14 @@ namespace YAML {
   template<>
     struct convert<DbDeviceStateMapPtr> {
     static bool decode(const Node &node, DbDeviceStateMapPtr &rhs) {
-      DbDeviceStateMap *deviceStates = new DbDeviceStateMap();
+      DbDeviceStateMapPtr deviceStates = dbArenaNew<DbDeviceStateMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbDeviceStateMapPtr(deviceStates);
+      rhs = deviceStates;
 
       for (YAML::Node::const_iterator it = node["DeviceState"].begin();
 	   it != node["DeviceState"].end(); ++it) {
-	DbDeviceState *	deviceState = new DbDeviceState();
+	DbDeviceStatePtr deviceState = dbArenaNew<DbDeviceState>();
 
 	try {
 	  field = "id";
@@ -388,7 +388,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbDeviceStatePtr>(deviceState->id,
-						     DbDeviceStatePtr(deviceState)));
+						     deviceState));
       }
 
       return true;
@@ -403,14 +403,14 @@ namespace YAML {
   template<>
     struct convert<DbDigitalDeviceMapPtr> {
     static bool decode(const Node &node, DbDigitalDeviceMapPtr &rhs) {
-      DbDigitalDeviceMap *digitalDevices = new DbDigitalDeviceMap();
+      DbDigitalDeviceMapPtr digitalDevices = dbArenaNew<DbDigitalDeviceMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbDigitalDeviceMapPtr(digitalDevices);
+      rhs = digitalDevices;
 
       for (YAML::Node::const_iterator it = node["DigitalDevice"].begin();
 	   it != node["DigitalDevice"].end(); ++it) {
-	DbDigitalDevice *digitalDevice = new DbDigitalDevice();
+	DbDigitalDevicePtr digitalDevice = dbArenaNew<DbDigitalDevice>();
 
 	try {
 	  field = "id";
@@ -451,7 +451,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbDigitalDevicePtr>(digitalDevice->id,
-						       DbDigitalDevicePtr(digitalDevice)));
+						       digitalDevice));
       }
 
       return true;
@@ -470,14 +470,14 @@ namespace YAML {
   template<>
     struct convert<DbDeviceInputMapPtr> {
     static bool decode(const Node &node, DbDeviceInputMapPtr &rhs) {
-      DbDeviceInputMap *deviceInputs = new DbDeviceInputMap();
+      DbDeviceInputMapPtr deviceInputs = dbArenaNew<DbDeviceInputMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbDeviceInputMapPtr(deviceInputs);
+      rhs = deviceInputs;
 
       for (YAML::Node::const_iterator it = node["DeviceInput"].begin();
 	   it != node["DeviceInput"].end(); ++it) {
-	DbDeviceInput *deviceInput = new DbDeviceInput();
+	DbDeviceInputPtr deviceInput = dbArenaNew<DbDeviceInput>();
 
 	try {
 	  field = "id";
@@ -508,7 +508,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbDeviceInputPtr>(deviceInput->id,
-						     DbDeviceInputPtr(deviceInput)));
+						     deviceInput));
       }
 
       return true;
@@ -525,14 +525,14 @@ namespace YAML {
   template<>
     struct convert<DbConditionMapPtr> {
     static bool decode(const Node &node, DbConditionMapPtr &rhs) {
-      DbConditionMap *conditions = new DbConditionMap();
+      DbConditionMapPtr conditions = dbArenaNew<DbConditionMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbConditionMapPtr(conditions);
+      rhs = conditions;
 
       for (YAML::Node::const_iterator it = node["Condition"].begin();
 	   it != node["Condition"].end(); ++it) {
-	DbCondition *condition = new DbCondition();
+	DbConditionPtr condition = dbArenaNew<DbCondition>();
 
 	try {
 	  field = "id";
@@ -557,7 +557,7 @@ namespace YAML {
 	  throw(DbException(errorStream.str()));
 	}
 
-	rhs->insert(std::pair<int, DbConditionPtr>(condition->id, DbConditionPtr(condition)));
+	rhs->insert(std::pair<int, DbConditionPtr>(condition->id, condition));
       }
 
       return true;
@@ -573,14 +573,14 @@ namespace YAML {
   template<>
     struct convert<DbIgnoreConditionMapPtr> {
     static bool decode(const Node &node, DbIgnoreConditionMapPtr &rhs) {
-      DbIgnoreConditionMap *ignoreConditions = new DbIgnoreConditionMap();
+      DbIgnoreConditionMapPtr ignoreConditions = dbArenaNew<DbIgnoreConditionMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbIgnoreConditionMapPtr(ignoreConditions);
+      rhs = ignoreConditions;
 
       for (YAML::Node::const_iterator it = node["IgnoreCondition"].begin();
 	   it != node["IgnoreCondition"].end(); ++it) {
-	DbIgnoreCondition *ignoreCondition = new DbIgnoreCondition();
+	DbIgnoreConditionPtr ignoreCondition = dbArenaNew<DbIgnoreCondition>();
 
 	ignoreCondition->faultStateId = DbIgnoreCondition::INVALID_ID;
 	ignoreCondition->deviceId = DbIgnoreCondition::INVALID_ID;
@@ -628,7 +628,7 @@ namespace YAML {
 	  throw(DbException(errorStream.str()));
 	}
 
-	rhs->insert(std::pair<int, DbIgnoreConditionPtr>(ignoreCondition->id, DbIgnoreConditionPtr(ignoreCondition)));
+	rhs->insert(std::pair<int, DbIgnoreConditionPtr>(ignoreCondition->id, ignoreCondition));
       }
 
       return true;
@@ -645,14 +645,14 @@ namespace YAML {
   template<>
     struct convert<DbConditionInputMapPtr> {
     static bool decode(const Node &node, DbConditionInputMapPtr &rhs) {
-      DbConditionInputMap *conditionInputs = new DbConditionInputMap();
+      DbConditionInputMapPtr conditionInputs = dbArenaNew<DbConditionInputMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbConditionInputMapPtr(conditionInputs);
+      rhs = conditionInputs;
 
       for (YAML::Node::const_iterator it = node["ConditionInput"].begin();
 	   it != node["ConditionInput"].end(); ++it) {
-	DbConditionInput *conditionInput = new DbConditionInput();
+	DbConditionInputPtr conditionInput = dbArenaNew<DbConditionInput>();
 
 	try {
 	  field = "id";
@@ -674,7 +674,7 @@ namespace YAML {
 	  throw(DbException(errorStream.str()));
 	}
 
-	rhs->insert(std::pair<int, DbConditionInputPtr>(conditionInput->id, DbConditionInputPtr(conditionInput)));
+	rhs->insert(std::pair<int, DbConditionInputPtr>(conditionInput->id, conditionInput));
       }
 
       return true;
@@ -690,14 +690,14 @@ namespace YAML {
   template<>
     struct convert<DbFaultMapPtr> {
     static bool decode(const Node &node, DbFaultMapPtr &rhs) {
-      DbFaultMap *faults = new DbFaultMap();
+      DbFaultMapPtr faults = dbArenaNew<DbFaultMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbFaultMapPtr(faults);
+      rhs = faults;
 
       for (YAML::Node::const_iterator it = node["Fault"].begin();
 	   it != node["Fault"].end(); ++it) {
-	DbFault *fault = new DbFault();
+	DbFaultPtr fault = dbArenaNew<DbFault>();
 
 	try {
 	  field = "id";
@@ -720,7 +720,7 @@ namespace YAML {
 	  throw(DbException(errorStream.str()));
 	}
 
-	rhs->insert(std::pair<int, DbFaultPtr>(fault->id, DbFaultPtr(fault)));
+	rhs->insert(std::pair<int, DbFaultPtr>(fault->id, fault));
       }
 
       return true;
@@ -737,14 +737,14 @@ namespace YAML {
   template<>
     struct convert<DbFaultInputMapPtr> {
     static bool decode(const Node &node, DbFaultInputMapPtr &rhs) {
-      DbFaultInputMap *faultInputs = new DbFaultInputMap();
+      DbFaultInputMapPtr faultInputs = dbArenaNew<DbFaultInputMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbFaultInputMapPtr(faultInputs);
+      rhs = faultInputs;
 
       for (YAML::Node::const_iterator it = node["FaultInput"].begin();
 	   it != node["FaultInput"].end(); ++it) {
-	DbFaultInput *faultInput = new DbFaultInput();
+	DbFaultInputPtr faultInput = dbArenaNew<DbFaultInput>();
 
 	try {
 	  field = "id";
@@ -769,7 +769,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbFaultInputPtr>(faultInput->id,
-						    DbFaultInputPtr(faultInput)));
+						    faultInput));
       }
 
       return true;
@@ -786,14 +786,14 @@ namespace YAML {
   template<>
     struct convert<DbFaultStateMapPtr> {
     static bool decode(const Node &node, DbFaultStateMapPtr &rhs) {
-      DbFaultStateMap *faultStates = new DbFaultStateMap();
+      DbFaultStateMapPtr faultStates = dbArenaNew<DbFaultStateMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbFaultStateMapPtr(faultStates);
+      rhs = faultStates;
 
       for (YAML::Node::const_iterator it = node["FaultState"].begin();
 	   it != node["FaultState"].end(); ++it) {
-	DbFaultState *faultState = new DbFaultState();
+	DbFaultStatePtr faultState = dbArenaNew<DbFaultState>();
 
 	try {
 	  field = "id";
@@ -819,7 +819,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbFaultStatePtr>(faultState->id,
-						    DbFaultStatePtr(faultState)));
+						    faultState));
       }
 
       return true;
@@ -835,14 +835,14 @@ namespace YAML {
   template<>
     struct convert<DbAnalogDeviceMapPtr> {
     static bool decode(const Node &node, DbAnalogDeviceMapPtr &rhs) {
-      DbAnalogDeviceMap *analogDevices = new DbAnalogDeviceMap();
+      DbAnalogDeviceMapPtr analogDevices = dbArenaNew<DbAnalogDeviceMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbAnalogDeviceMapPtr(analogDevices);
+      rhs = analogDevices;
 
       for (YAML::Node::const_iterator it = node["AnalogDevice"].begin();
 	   it != node["AnalogDevice"].end(); ++it) {
-	DbAnalogDevice *analogDevice = new DbAnalogDevice();
+	DbAnalogDevicePtr analogDevice = dbArenaNew<DbAnalogDevice>();
 
 	try {
 	  field = "id";
@@ -879,7 +879,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbAnalogDevicePtr>(analogDevice->id,
-						      DbAnalogDevicePtr(analogDevice)));
+						      analogDevice));
       }
 
       return true;
@@ -895,14 +895,14 @@ namespace YAML {
   template<>
     struct convert<DbBeamDestinationMapPtr> {
     static bool decode(const Node &node, DbBeamDestinationMapPtr &rhs) {
-      DbBeamDestinationMap *beamDestinations = new DbBeamDestinationMap();
+      DbBeamDestinationMapPtr beamDestinations = dbArenaNew<DbBeamDestinationMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbBeamDestinationMapPtr(beamDestinations);
+      rhs = beamDestinations;
 
       for (YAML::Node::const_iterator it = node["BeamDestination"].begin();
 	   it != node["BeamDestination"].end(); ++it) {
-	DbBeamDestination *beamDestination = new DbBeamDestination();
+	DbBeamDestinationPtr beamDestination = dbArenaNew<DbBeamDestination>();
 
 	try {
 	  field = "id";
@@ -912,85 +912,7 @@ namespace YAML {
 	  beamDestination->name = (*it)[field].as<std::string>();
 
 	  field = "destination_mask";
-	  beamDestination->destinationMask = (*it)[field].as<short>();
-
-	  // Find the device position in the softwareMitigationBuffer (32-bit array)
-	  // Each mitigation device defines has a 4-bit power class, the
-	  // position tells in which byte it falls based on the
-	  // destination mask
-
-	  // Destination mask
-	  // [16 15 14 13 12 11 10 09][08 07 06 05 04 03 02 01]
-	  beamDestination->softwareMitigationBufferIndex = 1; // when FW is fixed this goes back to index 0
-	  beamDestination->bitShift = 0;
-	  uint16_t mask = beamDestination->destinationMask;
-    beamDestination->buffer0DestinationMask = 0;
-    beamDestination->buffer1DestinationMask = 0;
-    if ((beamDestination->destinationMask & 0x1) > 0) {
-      beamDestination->buffer1DestinationMask |= 0x0000000F;
-    }
-    if ((beamDestination->destinationMask & 0x2) > 0) {
-      beamDestination->buffer1DestinationMask |= 0x000000F0;
-    }
-    if ((beamDestination->destinationMask & 0x4) > 0) {
-      beamDestination->buffer1DestinationMask |= 0x00000F00;
-    }
-    if ((beamDestination->destinationMask & 0x8) > 0) {
-      beamDestination->buffer1DestinationMask |= 0x0000F000;
-    }
-    if ((beamDestination->destinationMask & 0x10) > 0) {
-      beamDestination->buffer1DestinationMask |= 0x000F0000;
-    }
-    if ((beamDestination->destinationMask & 0x20) > 0) {
-      beamDestination->buffer1DestinationMask |= 0x00F00000;
-    }
-    if ((beamDestination->destinationMask & 0x40) > 0) {
-      beamDestination->buffer1DestinationMask |= 0x0F000000;
-    }
-    if ((beamDestination->destinationMask & 0x80) > 0) {
-      beamDestination->buffer1DestinationMask |= 0xF0000000;
-    }
-    if ((beamDestination->destinationMask & 0x100) > 0) {
-      beamDestination->buffer0DestinationMask |= 0x0000000F;
-    }
-    if ((beamDestination->destinationMask & 0x200) > 0) {
-      beamDestination->buffer0DestinationMask |= 0x000000F0;
-    }
-    if ((beamDestination->destinationMask & 0x400) > 0) {
-      beamDestination->buffer0DestinationMask |= 0x00000F00;
-    }
-    if ((beamDestination->destinationMask & 0x800) > 0) {
-      beamDestination->buffer0DestinationMask |= 0x0000F000;
-    }
-    if ((beamDestination->destinationMask & 0x1000) > 0) {
-      beamDestination->buffer0DestinationMask |= 0x000F0000;
-    }
-    if ((beamDestination->destinationMask & 0x2000) > 0) {
-      beamDestination->buffer0DestinationMask |= 0x00F00000;
-    }
-    if ((beamDestination->destinationMask & 0x4000) > 0) {
-      beamDestination->buffer0DestinationMask |= 0x0F000000;
-    }
-    if ((beamDestination->destinationMask & 0x8000) > 0) {
-      beamDestination->buffer0DestinationMask |= 0xF0000000;
-    }
-	  if ((mask & 0xFF00) > 0) {
-	    // beamDestination->softwareMitigationBufferIndex = 1; // if destination bit set from 8 to 15, use second mitigation position
-	    beamDestination->softwareMitigationBufferIndex = 0; // when FW is fixed this goes back to index 1
-	    mask >>= 8;
-	  }
-
-	  for (int i = 0; i < 8; ++i) {
-	    if (mask & 1) {
-	      mask = 0;
-	    }
-	    else {
-	      if (mask > 0) {
-		      beamDestination->bitShift += 4;
-		      mask >>= 1;
-	      }
-	    }
-	  }
+	  beamDestination->setDestinationMask((*it)[field].as<short>());
   } catch(YAML::InvalidNode &e) {
 	  errorStream << "ERROR: Failed to find field " << field << " for BeamDestination.";
 	  throw(DbException(errorStream.str()));
@@ -1006,7 +928,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbBeamDestinationPtr>(beamDestination->id,
-							  DbBeamDestinationPtr(beamDestination)));
+							  beamDestination));
       }
 
       return true;
@@ -1023,14 +945,14 @@ namespace YAML {
   template<>
     struct convert<DbBeamClassMapPtr> {
     static bool decode(const Node &node, DbBeamClassMapPtr &rhs) {
-      DbBeamClassMap *beamClasses = new DbBeamClassMap();
+      DbBeamClassMapPtr beamClasses = dbArenaNew<DbBeamClassMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbBeamClassMapPtr(beamClasses);
+      rhs = beamClasses;
 
       for (YAML::Node::const_iterator it = node["BeamClass"].begin();
 	   it != node["BeamClass"].end(); ++it) {
-	DbBeamClass *beamClass = new DbBeamClass();
+	DbBeamClassPtr beamClass = dbArenaNew<DbBeamClass>();
 
 	try {
 	  field = "id";
@@ -1064,7 +986,7 @@ namespace YAML {
 	  throw(DbException(errorStream.str()));
 	}
 
-	rhs->insert(std::pair<int, DbBeamClassPtr>(beamClass->id, DbBeamClassPtr(beamClass)));
+	rhs->insert(std::pair<int, DbBeamClassPtr>(beamClass->id, beamClass));
       }
 
       return true;
@@ -1081,14 +1003,14 @@ namespace YAML {
   template<>
     struct convert<DbAllowedClassMapPtr> {
     static bool decode(const Node &node, DbAllowedClassMapPtr &rhs) {
-      DbAllowedClassMap *allowedClasses = new DbAllowedClassMap();
+      DbAllowedClassMapPtr allowedClasses = dbArenaNew<DbAllowedClassMap>();
       std::stringstream errorStream;
       std::string field;
-      rhs = DbAllowedClassMapPtr(allowedClasses);
+      rhs = allowedClasses;
 
       for (YAML::Node::const_iterator it = node["AllowedClass"].begin();
 	   it != node["AllowedClass"].end(); ++it) {
-	DbAllowedClass *allowedClass = new DbAllowedClass();
+	DbAllowedClassPtr allowedClass = dbArenaNew<DbAllowedClass>();
 
 	try {
 	  field = "id";
@@ -1111,7 +1033,7 @@ namespace YAML {
 	}
 
 	rhs->insert(std::pair<int, DbAllowedClassPtr>(allowedClass->id,
-						      DbAllowedClassPtr(allowedClass)));
+						      allowedClass));
       }
 
       return true;
@@ -0,0 +1,86 @@
+#include "cycle_counter.h"
+
+#include <unistd.h>
+#include <mutex>
+#include <functional>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+std::atomic<bool> CycleCounter::calibrated(false);
+bool     CycleCounter::tsc = false;
+double   CycleCounter::ticksPerNs = 1;
+uint32_t CycleCounter::sampling = CYCLE_DEFAULT_SAMPLING;
+uint32_t CycleCounter::sampleCounter = 0;
+
+static uint64_t monotonicNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+ * Check for an invariant TSC and measure its frequency over 20 ms. Done
+ * once, by the first CycleCounter call (or an explicit calibrate() at
+ * startup), the other threads wait for it: the time base must not change
+ * once timers are running.
+ */
+static void calibrateOnce(bool &tsc, double &ticksPerNs)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    bool invariant = false;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) && eax >= 0x80000007)
+    {
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        invariant = (edx & (1 << 8)) != 0;
+    }
+
+    if (!invariant)
+    {
+        tsc = false;
+        ticksPerNs = 1;
+        std::cout << "INFO: CycleCounter: no invariant TSC, using CLOCK_MONOTONIC" << std::endl;
+        return;
+    }
+
+    uint64_t ns0 = monotonicNs();
+    uint64_t tsc0 = __rdtsc();
+    usleep(20000);
+    uint64_t ns1 = monotonicNs();
+    uint64_t tsc1 = __rdtsc();
+
+    ticksPerNs = static_cast<double>(tsc1 - tsc0) / (ns1 - ns0);
+    tsc = true;
+    std::cout << "INFO: CycleCounter: TSC at " << ticksPerNs << " GHz" << std::endl;
+#else
+    tsc = false;
+    ticksPerNs = 1;
+#endif
+}
+
+void CycleCounter::calibrate()
+{
+    static std::once_flag once;
+    std::call_once(once, calibrateOnce, std::ref(tsc), std::ref(ticksPerNs));
+    calibrated.store(true, std::memory_order_release);
+}
+
+void CycleCounter::setSampling(uint32_t oneInN)
+{
+    sampling = oneInN;
+    sampleCounter = 0;
+}
+
+void CycleStat::show(const std::string& name) const
+{
+    std::cout << "--- " << name << " ---" << std::endl;
+    std::cout << "Samples             : " << count << std::endl;
+    if (count)
+    {
+        std::cout << "Average             : " << getMeanNs() / 1e3 << " us" << std::endl;
+        std::cout << "Maximum             : " << getMaxNs() / 1e3 << " us" << std::endl;
+    }
+}
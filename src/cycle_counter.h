@@ -0,0 +1,117 @@
+#ifndef _CYCLE_COUNTER_H_
+#define _CYCLE_COUNTER_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <iostream>
+#include <string>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Low overhead time stamps for the cycle instrumentation.
+ *
+ * On x86 with an invariant TSC (constant rate, not stopped in idle
+ * states) now() is a single rdtsc, no vDSO call and no conversion to a
+ * timespec (see central_node_instrumentation_bench_tst). The TSC frequency is calibrated against
+ * CLOCK_MONOTONIC by the first call (about 20 ms), before the first time
+ * stamp is returned, so all time stamps use the same time base. On other
+ * CPUs, or without an invariant TSC, ticks are CLOCK_MONOTONIC
+ * nanoseconds.
+ *
+ * Per-item costs (device input and analog device updates) are sampled:
+ * only one item in getSampling() is measured, 0 disables them. Building
+ * with -DCYCLE_SAMPLING_DISABLED removes the per-item instrumentation
+ * from the code entirely.
+ */
+const uint32_t CYCLE_DEFAULT_SAMPLING = 64;
+
+class CycleCounter
+{
+public:
+    static inline uint64_t now()
+    {
+        ensureCalibrated();
+#if defined(__x86_64__) || defined(__i386__)
+        if (tsc)
+            return __rdtsc();
+#endif
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1000000000ULL + t.tv_nsec;
+    }
+
+    static void     calibrate();
+    static bool     usingTsc()                { ensureCalibrated(); return tsc; };
+    static double   getTicksPerNs()           { ensureCalibrated(); return ticksPerNs; };
+    static double   toNs(uint64_t ticks)      { ensureCalibrated(); return ticks / ticksPerNs; };
+    static uint64_t fromNs(double ns)         { ensureCalibrated(); return static_cast<uint64_t>(ns * ticksPerNs); };
+
+    static void     setSampling(uint32_t oneInN);
+    static uint32_t getSampling()             { return sampling; };
+
+    // True for one call in getSampling(). Only called by the input update
+    // thread, so the counter is not atomic.
+    static inline bool sample()
+    {
+#ifdef CYCLE_SAMPLING_DISABLED
+        return false;
+#else
+        if (0 == sampling)
+            return false;
+        if (++sampleCounter < sampling)
+            return false;
+        sampleCounter = 0;
+        return true;
+#endif
+    }
+
+private:
+    static inline void ensureCalibrated()
+    {
+        if (!calibrated.load(std::memory_order_acquire))
+            calibrate();
+    }
+
+    static std::atomic<bool> calibrated;
+    static bool     tsc;
+    static double   ticksPerNs;
+    static uint32_t sampling;
+    static uint32_t sampleCounter;
+};
+
+/**
+ * Aggregate of measured durations (in CycleCounter ticks): count, total,
+ * maximum. Single writer, add() is a few instructions.
+ */
+class CycleStat
+{
+public:
+    CycleStat() { clear(); };
+
+    void     add(uint64_t ticks)
+    {
+        total += ticks;
+        ++count;
+        if (ticks > max)
+            max = ticks;
+    };
+    void     clear() { count = 0; total = 0; max = 0; };
+
+    uint64_t getCount() const  { return count; };
+    double   getMeanNs() const { return count ? CycleCounter::toNs(total) / count : 0; };
+    double   getMaxNs() const  { return CycleCounter::toNs(max); };
+    double   getTotalNs() const { return CycleCounter::toNs(total); };
+
+    void     show(const std::string& name) const;
+
+private:
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+};
+
+#endif
@@ -1,113 +1,226 @@
 #include "heartbeat.h"
+#include <central_node_firmware_sim.h>
 
 #ifndef FW_ENABLED
 
-#warning "Code compiled without CPSW - fake heartbeat core"
+//====================================================================
+// Heartbeat without the Central Node board/firmware: the heartbeats and
+// the software watchdog registers go to the FirmwareSimulator.
+//====================================================================
 template <typename BeatPolicy>
 HeartBeat<BeatPolicy>::HeartBeat( Path root, const uint32_t& timeout, size_t timerBufferSize )
 :
-    txPeriod     ( "Time Between Heartbeats", timerBufferSize ),
-    txDuration   ( "Time to send Heartbeats", timerBufferSize ),
-    hbCnt        ( 0 ),
-    wdErrorCnt   ( 0 ),
-    beatReq      ( false ),
-    run          ( true ),
-    beatThread   ( std::thread( &HeartBeat::beatWriter, this ) )
+    BeatPolicy    ( root, timerBufferSize )
 {
     printf("\n");
     printf("Central Node HeartBeat started.\n");
-
-    if( pthread_setname_np( beatThread.native_handle(), "HeartBeat" ) )
-        perror( "pthread_setname_np failed for HeartBeat thread" );
+    FirmwareSimulator::getInstance().setWatchdogTime( timeout );
+    printf("Software Watchdog timer set to: %" PRIu32 "\n", timeout);
 }
+
 template<typename BeatPolicy>
 HeartBeat<BeatPolicy>::~HeartBeat()
 {
-    // Stop the heartbeat thread
-    run = false;
-    beatThread.join();
-
     // Print final report
     printReport();
+    std::cout << std::flush;
 }
+
 template<typename BeatPolicy>
 void HeartBeat<BeatPolicy>::printReport()
 {
     printf( "\n" );
     printf( "HeartBeat report:\n" );
     printf( "===============================================\n" );
-    printf( "Heartbeat count:                   %d\n",    hbCnt );
-    printf( "Software watchdog error count:     %d\n",    wdErrorCnt );
-    printf( "Maximum period between heartbeats: %f us\n", ( txPeriod.getAllMaxPeriod()    * 1000000 ) );
-    printf( "Average period between heartbeats: %f us\n", ( txPeriod.getMeanPeriod()   * 1000000 ) );
-    printf( "Minimum period between heartbeats: %f us\n", ( txPeriod.getMinPeriod()    * 1000000 ) );
-    printf( "Maximum period to send heartbeats: %f us\n", ( txDuration.getAllMaxPeriod()  * 1000000 ) );
-    printf( "Average period to send heartbeats: %f us\n", ( txDuration.getMeanPeriod() * 1000000 ) );
-    printf( "Minimum period to send heartbeats: %f us\n", ( txDuration.getMinPeriod()  * 1000000 ) );
-    printf( "===============================================\n" );
-    printf( "\n" );
+    uint32_t u32 = FirmwareSimulator::getInstance().getWatchdogTime();
+    printf( "Software watchdog timer       : %" PRIu32 " us\n", u32 );
+    this->printBeatReport();
 }
+
 template<typename BeatPolicy>
 void HeartBeat<BeatPolicy>::setWdTime( const uint32_t& timeout )
 {
+    FirmwareSimulator::getInstance().setWatchdogTime( timeout );
 }
-template<typename BeatPolicy>
-void HeartBeat<BeatPolicy>::beat()
+
+////////////////////////////////
+// BeatBase class definitions //
+////////////////////////////////
+BeatBase::BeatBase(Path, size_t timerBufferSize)
+:
+    txPeriod      ( "Time Between Heartbeats", timerBufferSize ),
+    txDuration    ( "Time to send Heartbeats", timerBufferSize ),
+    hbCnt         ( 0 ),
+    wdErrorCnt    ( 0 )
 {
-    std::unique_lock<std::mutex> lock(beatMutex);
-    beatReq = true;
-    beatCondVar.notify_all();
 }
-template<typename BeatPolicy>
-void HeartBeat<BeatPolicy>::beatWriter()
+
+void BeatBase::defaultClear()
+{
+    txPeriod.clear();
+    txDuration.clear();
+    hbCnt = 0;
+    wdErrorCnt = 0;
+}
+
+void BeatBase::defaultBeat()
+{
+    // Start the TX duration timer
+    txDuration.start();
+
+    // Check if there was a WD error, and increase counter accordingly
+    if (FirmwareSimulator::getInstance().getWatchdogError())
+        ++wdErrorCnt;
+
+    // Set heartbeat bit
+    FirmwareSimulator::getInstance().heartbeat();
+
+    // Tick period timer;
+    txPeriod.tick();
+
+    // Increase counter
+    ++hbCnt;
+
+    // Tick the TX duration timer
+    txDuration.tick();
+}
+
+void BeatBase::defaultPrintReport()
+{
+    printf( "Heartbeat count               : %d\n",    hbCnt );
+    printf( "Software watchdog error count : %d\n",    wdErrorCnt );
+    txPeriod.show();
+    txDuration.show();
+}
+
+////////////////////////////////////
+// BlockingBeat class definitions //
+////////////////////////////////////
+BlockingBeat::BlockingBeat(Path root, size_t timerBufferSize)
+:
+    BeatBase ( root, timerBufferSize )
+{
+}
+
+void BlockingBeat::clear()
+{
+    defaultClear();
+}
+
+void BlockingBeat::beat()
+{
+    defaultBeat();
+}
+
+void BlockingBeat::printBeatReport()
+{
+    defaultPrintReport();
+}
+
+///////////////////////////////////////
+// NonBlockingBeat class definitions //
+///////////////////////////////////////
+NonBlockingBeat::NonBlockingBeat(Path root, size_t timerBufferSize)
+:
+    BeatBase        ( root, timerBufferSize ),
+    reqTimeoutCnt   ( 0 ),
+    reqTimeout      ( 5 ),
+    beatReqCount    ( 0 ),
+    beatReqCountMax ( 0 ),
+    run             ( true ),
+    beatThread      ( std::thread( &NonBlockingBeat::beatWriter, this ) )
+{
+    if( pthread_setname_np( beatThread.native_handle(), "HeartBeat" ) )
+       perror( "pthread_setname_np failed for HeartBeat thread" );
+}
+
+NonBlockingBeat::~NonBlockingBeat()
+{
+    // Stop the heartbeat thread
+    run = false;
+    beatThread.join();
+}
+
+void NonBlockingBeat::clear()
+{
+    {
+        std::lock_guard<std::mutex> lock(beatMutex);
+        beatReqCountMax = 0;
+        reqTimeoutCnt = 0;
+    }
+    defaultClear();
+}
+
+void NonBlockingBeat::beat()
+{
+    {
+        std::lock_guard<std::mutex> lock(beatMutex);
+        // Increase the request counter
+        ++beatReqCount;
+
+        // Keep track of the maximum number of requests without handling
+        if (beatReqCount > beatReqCountMax)
+            beatReqCountMax = beatReqCount;
+    }
+
+    beatCondVar.notify_one();
+}
+
+void NonBlockingBeat::beatWriter()
 {
     std::cout << "Heartbeat writer thread started..." << std::endl;
 
     // Declare as real time task
     struct sched_param  param;
-    param.sched_priority = 20;
+    param.sched_priority = 87;
     if(sched_setscheduler(0, SCHED_FIFO, &param) == -1)
     {
         perror("Set priority");
         std::cerr << "WARN: Setting thread RT priority failed on Heartbeat thread." << std::endl;
     }
 
-    // Start the period timer
-    txPeriod.start();
-
     for(;;)
     {
+        // Wait for a request
+        std::unique_lock<std::mutex> lock(beatMutex);
+        if (beatCondVar.wait_for(lock, std::chrono::milliseconds(reqTimeout), std::bind(&NonBlockingBeat::pred, this)))
         {
-            // Wait for a request
-            std::unique_lock<std::mutex> lock(beatMutex);
-            while(!beatReq)
-            {
-                beatCondVar.wait_for( lock, std::chrono::milliseconds(5) );
-                if(!run)
-                {
-                    std::cout << "Heartbeat writer thread interrupted" << std::endl;
-                    return;
-                }
-            }
-        }
+            --beatReqCount;
+            lock.unlock();
 
-        // Start the TX duration Timer
-        txDuration.start();
+            defaultBeat();
+        }
+        else
+        {
+            ++reqTimeoutCnt;
+        }
 
-        // Check if there was a WD error, and increase counter accordingly
+        if (!run)
+        {
+            std::cout << "Heartbeat writer thread interrupted" << std::endl;
+            return;
+        }
+    }
+}
 
-        // Set heartbeat command
+void NonBlockingBeat::printBeatReport()
+{
+    std::size_t max, cnt;
 
-        // Tick period timer;
-        txPeriod.tick();
+    {
+        std::lock_guard<std::mutex> lock(beatMutex);
+        max = beatReqCountMax;
+        cnt = reqTimeoutCnt;
+    }
 
-        // Increase counter
-        ++hbCnt;
+    printf( "Request timeout               : %zu ms\n", reqTimeout );
+    printf( "Timeouts waiting for requests : %zu\n",    cnt        );
+    printf( "Maximum queued requests       : %zu\n",    max        );
+    defaultPrintReport();
+}
 
-        // Tick the duration timer
-        txDuration.tick();
+// Explicit template instantiations
+template class HeartBeat<BlockingBeat>;
+template class HeartBeat<NonBlockingBeat>;
 
-        beatReq = false;
-    }
-}
 #endif
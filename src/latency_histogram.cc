@@ -0,0 +1,184 @@
+#include "latency_histogram.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+uint32_t LatencyHistogram::getBucket(uint64_t value)
+{
+    if (value < HIST_SUB_BUCKET_COUNT)
+        return value;
+
+    uint32_t msb = 63 - __builtin_clzll(value);
+    if (msb >= HIST_MAX_VALUE_BITS)
+        return HIST_BUCKET_COUNT - 1;
+
+    // Top HIST_SUB_BUCKET_BITS bits of the value, the first one is always set
+    uint32_t shift = msb - HIST_SUB_BUCKET_BITS + 1;
+    uint32_t sub = (value >> shift) - HIST_SUB_BUCKET_HALF;
+    return HIST_SUB_BUCKET_COUNT + (shift - 1) * HIST_SUB_BUCKET_HALF + sub;
+}
+
+uint64_t LatencyHistogram::getBucketLowest(uint32_t bucket)
+{
+    if (bucket < HIST_SUB_BUCKET_COUNT)
+        return bucket;
+
+    uint32_t shift = (bucket - HIST_SUB_BUCKET_COUNT) / HIST_SUB_BUCKET_HALF + 1;
+    uint64_t sub = (bucket - HIST_SUB_BUCKET_COUNT) % HIST_SUB_BUCKET_HALF + HIST_SUB_BUCKET_HALF;
+    return sub << shift;
+}
+
+uint64_t LatencyHistogram::getBucketHighest(uint32_t bucket)
+{
+    if (bucket < HIST_SUB_BUCKET_COUNT)
+        return bucket;
+    if (bucket == HIST_BUCKET_COUNT - 1)
+        return UINT64_MAX;
+
+    uint32_t shift = (bucket - HIST_SUB_BUCKET_COUNT) / HIST_SUB_BUCKET_HALF + 1;
+    return getBucketLowest(bucket) + (1ULL << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    ++counts[getBucket(value)];
+    ++count;
+    sum += value;
+    if (value < min)
+        min = value;
+    if (value > max)
+        max = value;
+}
+
+void LatencyHistogram::reset()
+{
+    memset(counts, 0, sizeof(counts));
+    count = 0;
+    sum = 0;
+    min = UINT64_MAX;
+    max = 0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (uint32_t i = 0; i < HIST_BUCKET_COUNT; ++i)
+        counts[i] += other.counts[i];
+    count += other.count;
+    sum += other.sum;
+    if (other.min < min)
+        min = other.min;
+    if (other.max > max)
+        max = other.max;
+}
+
+/**
+ * Value below which 'percentile' percent of the values fall. Returns the
+ * upper end of the bucket (i.e. never underestimates), capped to the
+ * maximum recorded value.
+ */
+uint64_t LatencyHistogram::getValueAtPercentile(double percentile) const
+{
+    if (count == 0)
+        return 0;
+
+    if (percentile > 100)
+        percentile = 100;
+
+    uint64_t target = static_cast<uint64_t>(percentile / 100 * count + 0.5);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HIST_BUCKET_COUNT; ++i)
+    {
+        seen += counts[i];
+        if (seen >= target)
+        {
+            uint64_t highest = getBucketHighest(i);
+            return highest < max ? highest : max;
+        }
+    }
+    return max;
+}
+
+/**
+ * Number of values above 'value'. Values in the same bucket as 'value'
+ * are not counted, so the result is exact only for bucket boundaries
+ * (within 1.6% otherwise).
+ */
+uint64_t LatencyHistogram::getCountAbove(uint64_t value) const
+{
+    uint64_t above = 0;
+    for (uint32_t i = getBucket(value) + 1; i < HIST_BUCKET_COUNT; ++i)
+        above += counts[i];
+    return above;
+}
+
+void LatencyHistogram::show(std::ostream& os, double scale, const char *unit) const
+{
+    os << "Samples             : " << count << std::endl;
+    if (0 == count)
+        return;
+
+    os << "Minimum             : " << getMin() * scale << " " << unit << std::endl;
+    os << "Mean                : " << getMean() * scale << " " << unit << std::endl;
+    os << "p50                 : " << getValueAtPercentile(50) * scale << " " << unit << std::endl;
+    os << "p99                 : " << getValueAtPercentile(99) * scale << " " << unit << std::endl;
+    os << "p99.9               : " << getValueAtPercentile(99.9) * scale << " " << unit << std::endl;
+    os << "p99.99              : " << getValueAtPercentile(99.99) * scale << " " << unit << std::endl;
+    os << "Maximum             : " << getMax() * scale << " " << unit << std::endl;
+}
+
+/**
+ * Text export: one header line, then one "<bucket> <count>" line per non
+ * empty bucket, terminated by "end".
+ *
+ *   hist <sub bucket bits> <max value bits> <count> <sum> <min> <max>
+ */
+void LatencyHistogram::exportTo(std::ostream& os) const
+{
+    os << "hist " << HIST_SUB_BUCKET_BITS << " " << HIST_MAX_VALUE_BITS << " "
+       << count << " " << sum << " " << getMin() << " " << max << std::endl;
+    for (uint32_t i = 0; i < HIST_BUCKET_COUNT; ++i)
+        if (counts[i])
+            os << i << " " << counts[i] << std::endl;
+    os << "end" << std::endl;
+}
+
+/**
+ * Read an exported histogram and merge it into this one. Returns false
+ * (and leaves this histogram unchanged) if the input is not a histogram
+ * with the same layout.
+ */
+bool LatencyHistogram::importFrom(std::istream& is)
+{
+    std::string tag;
+    uint32_t subBucketBits, maxValueBits;
+    LatencyHistogram h;
+
+    if (!(is >> tag >> subBucketBits >> maxValueBits >> h.count >> h.sum >> h.min >> h.max) ||
+        tag != "hist" || subBucketBits != HIST_SUB_BUCKET_BITS || maxValueBits != HIST_MAX_VALUE_BITS)
+        return false;
+    if (0 == h.count)
+        h.min = UINT64_MAX;
+
+    while (is >> tag && tag != "end")
+    {
+        uint32_t bucket = strtoul(tag.c_str(), NULL, 10);
+        uint64_t n;
+        if (bucket >= HIST_BUCKET_COUNT || !(is >> n))
+            return false;
+        h.counts[bucket] += n;
+    }
+    if (tag != "end")
+        return false;
+
+    merge(h);
+    return true;
+}
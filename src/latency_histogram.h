@@ -0,0 +1,60 @@
+#ifndef _LATENCY_HISTOGRAM_H_
+#define _LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <iostream>
+
+/**
+ * Log-linear latency histogram (HdrHistogram-like), values in ns.
+ *
+ * Values below 2^HIST_SUB_BUCKET_BITS ns have their own bucket. Above
+ * that each power of two is split into 2^(HIST_SUB_BUCKET_BITS-1) linear
+ * buckets, so any value is known within 1/64 (1.6%) of its magnitude.
+ * Values of 2^HIST_MAX_VALUE_BITS ns (18 minutes) and above are counted
+ * in the last bucket.
+ *
+ * Fixed memory (HIST_BUCKET_COUNT counters, about 18 KB), record() is
+ * O(1) and does not allocate. Histograms with the same layout can be
+ * merged, and exported/imported as text to merge measurements from
+ * several runs or hosts.
+ */
+const uint32_t HIST_SUB_BUCKET_BITS = 7;
+const uint32_t HIST_MAX_VALUE_BITS = 40;
+const uint32_t HIST_SUB_BUCKET_COUNT = 1 << HIST_SUB_BUCKET_BITS;
+const uint32_t HIST_SUB_BUCKET_HALF = HIST_SUB_BUCKET_COUNT / 2;
+const uint32_t HIST_BUCKET_COUNT = HIST_SUB_BUCKET_COUNT +
+    (HIST_MAX_VALUE_BITS - HIST_SUB_BUCKET_BITS) * HIST_SUB_BUCKET_HALF;
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void     record(uint64_t value);
+    void     reset();
+    void     merge(const LatencyHistogram& other);
+
+    uint64_t getCount() const { return count; };
+    uint64_t getMin() const   { return count ? min : 0; };
+    uint64_t getMax() const   { return max; };
+    double   getMean() const  { return count ? static_cast<double>(sum) / count : 0; };
+    uint64_t getValueAtPercentile(double percentile) const;
+    uint64_t getCountAbove(uint64_t value) const;
+
+    void     show(std::ostream& os, double scale = 1e-3, const char *unit = "us") const;
+    void     exportTo(std::ostream& os) const;
+    bool     importFrom(std::istream& is);
+
+    static uint32_t getBucket(uint64_t value);
+    static uint64_t getBucketLowest(uint32_t bucket);
+    static uint64_t getBucketHighest(uint32_t bucket);
+
+private:
+    uint64_t counts[HIST_BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <fstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <central_node_archive.h>
+#include <central_node_exception.h>
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " -d <dir> [-l] [-s <start>] [-e <end>] [-o <file>]" << std::endl;
+  std::cerr << "Lists or extracts update frames from a central node frame archive" << std::endl;
+  std::cerr << "       -d <dir>    :  archive directory" << std::endl;
+  std::cerr << "       -l          :  list the segments" << std::endl;
+  std::cerr << "       -s <start>  :  first firmware timestamp to extract (default: first frame)" << std::endl;
+  std::cerr << "       -e <end>    :  last firmware timestamp to extract (default: last frame)" << std::endl;
+  std::cerr << "       -o <file>   :  write the raw frames, back to back, to <file>" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string directory = "";
+  std::string outputFileName = "";
+  bool list = false;
+  uint64_t start = 0;
+  uint64_t end = UINT64_MAX;
+
+  for (int opt; (opt = getopt(argc, argv, "d:ls:e:o:h")) > 0;) {
+    switch (opt) {
+    case 'd':
+      directory = optarg;
+      break;
+    case 'l':
+      list = true;
+      break;
+    case 's':
+      start = strtoull(optarg, NULL, 0);
+      break;
+    case 'e':
+      end = strtoull(optarg, NULL, 0);
+      break;
+    case 'o':
+      outputFileName = optarg;
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (directory == "") {
+    std::cerr << "Missing -d option" << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+
+  FrameArchiveReader reader;
+  try {
+    reader.open(directory);
+  } catch (CentralNodeException &ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
+
+  uint64_t first, lastKeyframe;
+  if (!reader.getRange(first, lastKeyframe)) {
+    std::cerr << "ERROR: No segments found in " << directory << std::endl;
+    return 1;
+  }
+
+  if (list) {
+    for (size_t i = 0; i < reader.getSegmentCount(); ++i) {
+      std::string name;
+      uint64_t timestamp;
+      uint32_t keyframes;
+      reader.getSegmentInfo(i, name, timestamp, keyframes);
+      std::cout << name << ": first timestamp " << timestamp
+		<< ", " << keyframes << " keyframes" << std::endl;
+    }
+    std::cout << "Range: " << first << " to " << lastKeyframe << " (last keyframe)" << std::endl;
+  }
+
+  if (outputFileName == "" && list) {
+    return 0;
+  }
+
+  std::ofstream output;
+  if (outputFileName != "") {
+    output.open(outputFileName.c_str(), std::ofstream::out | std::ofstream::binary);
+    if (!output.is_open()) {
+      std::cerr << "ERROR: Failed to open " << outputFileName << std::endl;
+      return 1;
+    }
+  }
+
+  reader.seek(start);
+
+  ArchiveFrame frame;
+  uint32_t count = 0;
+  uint64_t firstCycle = 0, lastCycle = 0;
+  while (reader.next(frame)) {
+    if (frame.timestamp < start) {
+      continue;
+    }
+    if (frame.timestamp > end) {
+      break;
+    }
+    if (count == 0) {
+      firstCycle = frame.cycle;
+    }
+    lastCycle = frame.cycle;
+    count++;
+
+    if (output.is_open()) {
+      output.write(reinterpret_cast<const char *>(frame.data.data()), frame.data.size());
+    }
+    else {
+      std::cout << "cycle=" << frame.cycle << " ts=" << frame.timestamp << std::endl;
+    }
+  }
+
+  std::cout << "Frames: " << count;
+  if (count > 0) {
+    std::cout << " (cycles " << firstCycle << " to " << lastCycle << ")";
+  }
+  std::cout << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <central_node_archive.h>
+#include <central_node_exception.h>
+
+#include "central_node_test_util.h"
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-d <dir>] [-v]" << std::endl;
+  std::cerr << "       -d <dir>    :  scratch archive directory (default /tmp/central_node_archive_tst.<pid>)" << std::endl;
+  std::cerr << "       -v          :  verbose output" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+const uint32_t FRAME_SIZE = 256;
+const uint32_t KEYFRAME_INTERVAL = 10;
+const uint32_t SEGMENT_FRAMES = 40;
+const uint32_t SEGMENTS = 5;
+
+/**
+ * Checks of the frame archive: frames written by FrameArchiver are read
+ * back by FrameArchiveReader, unreadable segments are skipped and old
+ * segments are pruned from the directory.
+ */
+class ArchiveTest : public TestChecks {
+ public:
+  ArchiveTest(std::string d, bool v) : TestChecks(v), directory(d) {
+  }
+
+  // A few words change every frame, the others stay constant
+  static std::vector<uint8_t> makeFrame(uint64_t cycle) {
+    std::vector<uint8_t> frame(FRAME_SIZE);
+    for (uint32_t i = 0; i < FRAME_SIZE; ++i) {
+      frame[i] = (i < 16 || i % 64 == 0) ? static_cast<uint8_t>(cycle + i) : static_cast<uint8_t>(i);
+    }
+    return frame;
+  }
+
+  // Firmware time stamps start at 'base', one per cycle
+  void writeFrames(uint64_t base, uint64_t first, uint32_t count, uint32_t maxSegments) {
+    FrameArchiver &archiver = FrameArchiver::getInstance();
+    archiver.start(directory, KEYFRAME_INTERVAL, SEGMENT_FRAMES, maxSegments, FRAME_SIZE);
+    for (uint64_t cycle = first; cycle < first + count; ++cycle) {
+      archiver.push(makeFrame(cycle), cycle, base + cycle);
+      // Let the writer thread keep up, push() drops frames when it is full
+      usleep(1000);
+    }
+    archiver.stop();
+  }
+
+  std::vector<std::string> listSegments() {
+    std::vector<std::string> names;
+    DIR *dir = opendir(directory.c_str());
+    if (dir == NULL) {
+      return names;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      std::string name = entry->d_name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".seg") == 0) {
+        names.push_back(directory + "/" + name);
+      }
+    }
+    closedir(dir);
+    return names;
+  }
+
+  // Read all frames, returns their cycles
+  std::vector<uint64_t> readAll(FrameArchiveReader &reader, bool &dataOk) {
+    std::vector<uint64_t> cycles;
+    ArchiveFrame frame;
+    dataOk = true;
+    reader.seek(0);
+    while (reader.next(frame)) {
+      cycles.push_back(frame.cycle);
+      dataOk = dataOk && frame.data == makeFrame(frame.cycle) && frame.timestamp == 1000 + frame.cycle;
+    }
+    return cycles;
+  }
+
+  void testReadBack() {
+    writeFrames(1000, 0, SEGMENTS * SEGMENT_FRAMES, 0);
+    check(listSegments().size() == SEGMENTS, "one segment every SEGMENT_FRAMES frames");
+
+    FrameArchiveReader reader;
+    reader.open(directory);
+    bool dataOk;
+    std::vector<uint64_t> cycles = readAll(reader, dataOk);
+    check(cycles.size() == SEGMENTS * SEGMENT_FRAMES, "all frames read back");
+    check(dataOk, "frames read back match the frames written");
+  }
+
+  // A segment with a damaged header, and one removed after the reader
+  // loaded the index, are skipped: reading goes on with the next segment
+  void testMissingSegment() {
+    FrameArchiveReader reader;
+    reader.open(directory);
+    check(reader.getSegmentCount() == SEGMENTS, "reader lists all segments");
+
+    std::string name;
+    uint64_t timestamp;
+    uint32_t keyframes;
+    reader.getSegmentInfo(1, name, timestamp, keyframes);
+    check(truncate((name + ".seg").c_str(), 0) == 0, "damage segment 1");
+    reader.getSegmentInfo(3, name, timestamp, keyframes);
+    check(unlink((name + ".seg").c_str()) == 0, "remove segment 3");
+
+    bool dataOk;
+    std::vector<uint64_t> cycles = readAll(reader, dataOk);
+    check(cycles.size() == (SEGMENTS - 2) * SEGMENT_FRAMES, "frames of the other segments read");
+    check(dataOk, "frames after the missing segments match the frames written");
+    bool skipped = cycles.size() == (SEGMENTS - 2) * SEGMENT_FRAMES &&
+      cycles[SEGMENT_FRAMES - 1] == SEGMENT_FRAMES - 1 &&
+      cycles[SEGMENT_FRAMES] == 2 * SEGMENT_FRAMES &&
+      cycles[2 * SEGMENT_FRAMES] == 4 * SEGMENT_FRAMES;
+    check(skipped, "reading continues after each missing segment");
+  }
+
+  // Segments left by earlier runs (here a segment file the archiver
+  // did not write) count against maxSegments
+  void testPrune() {
+    const uint32_t maxSegments = 2;
+    std::string earlier = directory + "/archive-00000000000000000001";
+    FILE *file = fopen((earlier + ".seg").c_str(), "wb");
+    check(file != NULL, "segment of an earlier run");
+    if (file != NULL) {
+      fclose(file);
+    }
+
+    writeFrames(1000, SEGMENTS * SEGMENT_FRAMES, 3 * SEGMENT_FRAMES, maxSegments);
+    check(listSegments().size() == maxSegments, "old segments pruned from the directory");
+    check(access((earlier + ".seg").c_str(), F_OK) != 0, "segment of an earlier run pruned");
+
+    FrameArchiveReader reader;
+    reader.open(directory);
+    bool dataOk;
+    std::vector<uint64_t> cycles = readAll(reader, dataOk);
+    check(!cycles.empty() && cycles.front() == (SEGMENTS + 1) * SEGMENT_FRAMES,
+          "only the newest segments are kept");
+  }
+
+  void cleanUp() {
+    DIR *dir = opendir(directory.c_str());
+    if (dir == NULL) {
+      return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      std::string name = entry->d_name;
+      if (name.compare(0, 8, "archive-") == 0) {
+        unlink((directory + "/" + name).c_str());
+      }
+    }
+    closedir(dir);
+    rmdir(directory.c_str());
+  }
+
+  std::string directory;
+};
+
+int main(int argc, char **argv) {
+  std::stringstream defaultDirectory;
+  defaultDirectory << "/tmp/central_node_archive_tst." << getpid();
+  std::string directory = defaultDirectory.str();
+  bool verbose = false;
+
+  for (int opt; (opt = getopt(argc, argv, "vhd:")) > 0;) {
+    switch (opt) {
+    case 'd':
+      directory = optarg;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  ArchiveTest t(directory, verbose);
+  t.cleanUp();
+  try {
+    t.testReadBack();
+    t.testMissingSegment();
+    t.testPrune();
+  } catch (CentralNodeException &e) {
+    std::cerr << e.what() << std::endl;
+    t.failures++;
+  }
+  t.cleanUp();
+
+  return t.getResult();
+}
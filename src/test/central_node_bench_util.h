@@ -0,0 +1,102 @@
+#ifndef CENTRAL_NODE_BENCH_UTIL_H
+#define CENTRAL_NODE_BENCH_UTIL_H
+
+/**
+ * Helpers shared by the engine benchmarks (central_node_engine_bench_tst
+ * and central_node_scaling_bench_tst): random update frames and the child
+ * process harness used to load each database in a fresh engine.
+ */
+
+#include <central_node_database_defs.h>
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/**
+ * Random update frames (xorshift), the same sequence for the same seed.
+ */
+class BenchRandom {
+ private:
+  uint64_t _random;
+
+ public:
+  BenchRandom(uint64_t seed) : _random(seed * 0x9E3779B97F4A7C15ULL + 1) {
+  }
+
+  /**
+   * Fill the input bits of the update frame with random values, the header
+   * (time stamp) is left as is.
+   */
+  void frame(std::vector<uint8_t> &frame) {
+    for (uint32_t i = APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES; i + 8 <= frame.size(); i += 8) {
+      _random ^= _random << 13;
+      _random ^= _random >> 7;
+      _random ^= _random << 17;
+      memcpy(&frame[i], &_random, sizeof(_random));
+    }
+  }
+};
+
+/**
+ * Run 'size' bytes of results in a child process: the child fills the
+ * buffer and sends it back through a pipe. The engine output goes to
+ * /dev/null, errors are still printed.
+ */
+class BenchChild {
+ public:
+  virtual ~BenchChild() {}
+  virtual void run(void *result) = 0;
+
+  bool spawn(void *result, size_t size) {
+    int fd[2];
+
+    if (pipe(fd) != 0) {
+      perror("pipe");
+      return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      close(fd[0]);
+      close(fd[1]);
+      return false;
+    }
+
+    if (pid == 0) {
+      close(fd[0]);
+      int devNull = open("/dev/null", O_WRONLY);
+      if (devNull >= 0) {
+        dup2(devNull, STDOUT_FILENO);
+      }
+
+      run(result);
+
+      // Do not wait for the engine threads, the process is done
+      if (write(fd[1], result, size) != (ssize_t) size) {
+        _exit(1);
+      }
+      _exit(0);
+    }
+
+    close(fd[1]);
+    ssize_t received = read(fd[0], result, size);
+    close(fd[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    return received == (ssize_t) size;
+  }
+};
+
+static inline std::string benchBaseName(std::string fileName) {
+  size_t slash = fileName.rfind('/');
+  return slash == std::string::npos ? fileName : fileName.substr(slash + 1);
+}
+
+#endif
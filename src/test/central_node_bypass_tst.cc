@@ -1,13 +1,18 @@
 #include <iostream>
 #include <fstream>
+#include <thread>
 #include <stdio.h>
 #include <stdint.h>
 
 #include <central_node_yaml.h>
 #include <central_node_database.h>
 #include <central_node_engine.h>
+#include <central_node_bypass_queue.h>
+#include <central_node_bypass_state.h>
 #include <log.h>
 
+#include "central_node_test_util.h"
+
 class TestFailed {};
 
 static void usage(const char *nm) {
@@ -21,10 +26,10 @@ static void usage(const char *nm) {
 }
 
 
-class BypassTest {
+class BypassTest : public TestChecks {
  public:
   //  BypassTest(EnginePtr e) : engine(e), digital(false), analog(false) {};
-  BypassTest() : digital(false), analog(false) {};
+  BypassTest(bool v) : TestChecks(v), digital(false), analog(false) {};
 
   //  EnginePtr engine;
   int testInputCount;
@@ -111,6 +116,182 @@ class BypassTest {
     }
   }
 
+  /**
+   * Indexed heap of bypass expirations: one entry per bypass, changing the
+   * expiration moves the entry, removal, bypasses expiring at a given time
+   * and the sorted copy.
+   */
+  void testQueue() {
+    BypassQueue queue;
+    std::vector<InputBypassPtr> bypasses;
+    time_t until[] = { 50, 20, 40, 20, 30, 60, 20, 10 };
+    for (uint32_t i = 0; i < 8; ++i) {
+      InputBypassPtr bypass = InputBypassPtr(new InputBypass());
+      bypass->id = i;
+      bypasses.push_back(bypass);
+      queue.update(bypass, until[i]);
+    }
+    check(queue.size() == 8 && queue.top().first == 10, "queue: earliest expiration at the top");
+
+    queue.update(bypasses[7], 70);
+    queue.update(bypasses[5], 5);
+    check(queue.size() == 8, "queue: update keeps one entry per bypass");
+    check(queue.top().second == bypasses[5], "queue: shortened bypass moves to the top");
+
+    check(queue.remove(1) && !queue.contains(1), "queue: remove a queued bypass");
+    check(!queue.remove(1) && !queue.remove(100), "queue: remove a bypass not queued");
+
+    std::vector<InputBypassPtr> expiring;
+    queue.getExpiringAt(20, expiring);
+    bool found = expiring.size() == 2 &&
+      ((expiring[0]->id == 3 && expiring[1]->id == 6) || (expiring[0]->id == 6 && expiring[1]->id == 3));
+    check(found, "queue: bypasses expiring at a given time");
+    expiring.clear();
+    queue.getExpiringAt(25, expiring);
+    check(expiring.empty(), "queue: no bypass expiring at a given time");
+
+    std::vector<BypassQueueEntry> sorted;
+    queue.getSorted(sorted);
+    bool ordered = sorted.size() == queue.size();
+    for (size_t i = 1; ordered && i < sorted.size(); ++i) {
+      ordered = sorted[i - 1].first <= sorted[i].first;
+    }
+    check(ordered && sorted.front().first == 5 && sorted.back().first == 70, "queue: sorted copy");
+
+    time_t previous = 0;
+    size_t count = 0;
+    while (!queue.empty()) {
+      ordered = ordered && queue.top().first >= previous;
+      previous = queue.top().first;
+      queue.pop();
+      count++;
+    }
+    check(ordered && count == 7 && !queue.contains(5), "queue: pop in expiration order");
+  }
+
+  static void updateStateTable(BypassStateTable *table, uint32_t rounds) {
+    for (uint32_t round = 1; round <= rounds; ++round) {
+      table->beginUpdate();
+      for (uint32_t i = 0; i < table->size(); ++i) {
+        table->set(i, BYPASS_VALID, round);
+      }
+      table->endUpdate();
+    }
+  }
+
+  /**
+   * Bypass state published with the sequence lock: reads fail while an
+   * update is in progress, and a successful read never mixes two updates.
+   */
+  void testStateTable() {
+    BypassStateTable table;
+    std::vector<BypassRecord> records;
+    uint32_t sequence = 0;
+    table.resize(64);
+    check(table.read(records, sequence) && records.size() == 64 && records[2].status == BYPASS_EXPIRED,
+          "state table: all bypasses expired after resize");
+
+    table.beginUpdate();
+    table.set(2, BYPASS_VALID, 1);
+    uint32_t updateSequence = 0;
+    check(!table.read(records, updateSequence), "state table: read fails while an update is in progress");
+    table.endUpdate();
+    check(table.read(records, updateSequence) && updateSequence != sequence &&
+          records[2].status == BYPASS_VALID && records[2].value == 1,
+          "state table: update visible after endUpdate()");
+
+    // Every update sets all the records to the same value
+    table.resize(64);
+    std::thread writer(&BypassTest::updateStateTable, &table, 100000);
+    uint32_t reads = 0;
+    uint32_t torn = 0;
+    while (reads < 100000) {
+      if (table.read(records, sequence)) {
+        for (size_t i = 1; i < records.size(); ++i) {
+          if (records[i].value != records[0].value) {
+            torn++;
+            break;
+          }
+        }
+      }
+      reads++;
+    }
+    writer.join();
+    check(torn == 0, "state table: concurrent reads never mix two updates");
+    check(table.read(records, sequence) && records[63].value == 100000, "state table: last update visible");
+  }
+
+  static BypassRequest makeRequest(BypassType type, uint32_t deviceId, int index, uint32_t value, time_t until) {
+    BypassRequest request;
+    request.type = type;
+    request.deviceId = deviceId;
+    request.index = index;
+    request.value = value;
+    request.until = until;
+    return request;
+  }
+
+  /**
+   * setBypasses() validates the whole request list first: a bad entry
+   * throws and none of the bypasses of the list are applied.
+   */
+  void testSetBypasses() {
+    BypassManagerPtr manager = Engine::getInstance()._bypassManager;
+    MpsDbPtr db = Engine::getInstance()._mpsDb;
+    InputBypassPtr digital = db->deviceInputs->at(1)->bypass;
+    InputBypassPtr analog = db->analogDevices->at(9)->bypass[0];
+    BypassStatus digitalStatus = digital->status;
+    size_t queued = manager->bypassQueue.size();
+
+    // Far enough in the future for the bypass thread not to expire them
+    time_t until = time(NULL) + 3600;
+    BypassRequestList requests;
+    requests.push_back(makeRequest(BYPASS_DIGITAL, 1, 0, 1, until));
+    requests.push_back(makeRequest(BYPASS_ANALOG, 9, ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL, 0, until));
+    bool thrown = false;
+    try {
+      manager->setBypasses(db, requests, false, false);
+    } catch (CentralNodeException &e) {
+      thrown = true;
+    }
+    check(thrown, "setBypasses: invalid integrator index rejected");
+    check(digital->status == digitalStatus && manager->bypassQueue.size() == queued,
+          "setBypasses: nothing applied when an integrator index is invalid");
+
+    requests[1] = makeRequest(BYPASS_DIGITAL, 99999, 0, 0, until);
+    thrown = false;
+    try {
+      manager->setBypasses(db, requests, false, false);
+    } catch (CentralNodeException &e) {
+      thrown = true;
+    }
+    check(thrown && digital->status == digitalStatus && manager->bypassQueue.size() == queued,
+          "setBypasses: unknown device rejected, nothing applied");
+
+    requests[1] = makeRequest(BYPASS_ANALOG, 9, 0, 0, time(NULL) - 10);
+    thrown = false;
+    try {
+      manager->setBypasses(db, requests, false, false);
+    } catch (CentralNodeException &e) {
+      thrown = true;
+    }
+    check(thrown && digital->status == digitalStatus && manager->bypassQueue.size() == queued,
+          "setBypasses: expiration in the past rejected, nothing applied");
+
+    requests[1] = makeRequest(BYPASS_ANALOG, 9, 0, 0, until);
+    manager->setBypasses(db, requests, false, false);
+    check(digital->status == BYPASS_VALID && analog->status == BYPASS_VALID &&
+          manager->bypassQueue.contains(digital->id) && manager->bypassQueue.contains(analog->id),
+          "setBypasses: valid requests applied");
+
+    requests[0].until = 0;
+    requests[1].until = 0;
+    manager->setBypasses(db, requests, false, false);
+    check(digital->status == BYPASS_EXPIRED && analog->status == BYPASS_EXPIRED &&
+          !manager->bypassQueue.contains(digital->id) && !manager->bypassQueue.contains(analog->id),
+          "setBypasses: bypasses cancelled");
+  }
+
   void showFaults() {
     Engine::getInstance()._mpsDb->showFaults();
   }
@@ -296,6 +477,11 @@ int main(int argc, char **argv) {
 #endif
   }
 
+  // Checks that do not need a database
+  BypassTest *t = new BypassTest(verbose);
+  t->testQueue();
+  t->testStateTable();
+
   try {
     if (Engine::getInstance().loadConfig(mpsFileName) != 0) {
       std::cerr << "ERROR: Failed to load MPS configuration" << std::endl;
@@ -306,8 +492,6 @@ int main(int argc, char **argv) {
     return -1;
   }
 
-  BypassTest *t = new BypassTest();
-
   if (inputFileName != "") {
     if (t->loadInputTestFile(inputFileName, 0) != 0) {
       std::cerr << "ERROR: Failed to open input test file" << std::endl;
@@ -453,9 +637,10 @@ int main(int argc, char **argv) {
     Engine::getInstance().showStats();
   }
 
-  delete t;
+  t->testSetBypasses();
 
-  std::cout << "Done." << std::endl;
+  int result = t->getResult();
+  delete t;
 
-  return 0;
+  return result;
 }
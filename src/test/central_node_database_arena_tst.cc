@@ -0,0 +1,110 @@
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <central_node_database_arena.h>
+
+#include "central_node_test_util.h"
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-n <entries>] [-v]" << std::endl;
+  std::cerr << "       -n <entries>:  entries inserted and erased after the seal (default 10000)" << std::endl;
+  std::cerr << "       -v          :  verbose output" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+class ArenaEntry {
+ public:
+  uint32_t id;
+  DbString name;
+};
+
+typedef boost::shared_ptr<ArenaEntry> ArenaEntryPtr;
+typedef DbArenaMap<ArenaEntryPtr>::type ArenaEntryMap;
+typedef boost::shared_ptr<ArenaEntryMap> ArenaEntryMapPtr;
+
+/**
+ * Checks of the database arena: entries and map nodes are allocated from
+ * the arena while loading, and from the heap once it is sealed, so inserts
+ * and erases after the seal (MpsDb::applyDelta()) do not grow the arena.
+ */
+class ArenaTest : public TestChecks {
+ public:
+  ArenaTest(bool v) : TestChecks(v) {
+  }
+
+  void insert(ArenaEntryMapPtr map, uint32_t id, const char *name) {
+    ArenaEntryPtr entry = dbArenaNew<ArenaEntry>();
+    entry->id = id;
+    entry->name = name;
+    map->insert(std::make_pair(id, entry));
+  }
+
+  void testPostSeal(uint32_t entries) {
+    DbArenaPtr arena = DbArenaPtr(new DbArena());
+    ArenaEntryMapPtr map;
+    {
+      DbArenaScope scope(arena, "Entries");
+      map = boost::allocate_shared<ArenaEntryMap>(DbArenaAllocator<ArenaEntryMap>());
+      for (uint32_t id = 0; id < 100; ++id) {
+        insert(map, id, "Entry");
+      }
+    }
+    check(arena->contains(map->begin()->second.get()), "entries allocated from the arena before the seal");
+
+    arena->seal();
+    size_t reserved = arena->getReservedBytes();
+
+    {
+      DbArenaScope scope(arena, "Delta");
+      for (uint32_t round = 0; round < 10; ++round) {
+        for (uint32_t id = 1000; id < 1000 + entries; ++id) {
+          // Empty names, strings interned after the seal use the arena
+          insert(map, id, "");
+        }
+        if (round == 0) {
+          check(!arena->contains(map->find(1000)->second.get()), "entries allocated from the heap after the seal");
+        }
+        for (uint32_t id = 1000; id < 1000 + entries; ++id) {
+          map->erase(id);
+        }
+      }
+      // Entries allocated before the seal are released with the arena
+      for (uint32_t id = 0; id < 50; ++id) {
+        map->erase(id);
+      }
+    }
+
+    check(map->size() == 50 && map->begin()->second->id == 50, "map consistent after the post-seal updates");
+    check(arena->getReservedBytes() == reserved, "arena does not grow with post-seal updates");
+  }
+};
+
+int main(int argc, char **argv) {
+  uint32_t entries = 10000;
+  bool verbose = false;
+
+  for (int opt; (opt = getopt(argc, argv, "vhn:")) > 0;) {
+    switch (opt) {
+    case 'n':
+      entries = atoi(optarg);
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  ArenaTest t(verbose);
+  t.testPostSeal(entries);
+
+  return t.getResult();
+}
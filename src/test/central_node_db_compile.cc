@@ -0,0 +1,148 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <central_node_yaml.h>
+#include <central_node_database.h>
+#include <central_node_database_image.h>
+#include <log.h>
+
+#if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
+using namespace easyloggingpp;
+#endif
+
+/**
+ * Compile an MPS database YAML file into a binary image (see
+ * central_node_database_image.h), and compare the load+configure time of
+ * the YAML file and of the image. The per table YAML load times and the
+ * configure steps times are also printed.
+ */
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " -f <file> [-o <file> | -d <dir>] [-c] [-j <threads>]" << std::endl;
+  std::cerr << "       -f <file>   :  MPS database YAML file" << std::endl;
+  std::cerr << "       -o <file>   :  output image file" << std::endl;
+  std::cerr << "       -d <dir>    :  write the image in the image cache directory <dir>" << std::endl;
+  std::cerr << "                      (named after the DatabaseInfo md5sum)" << std::endl;
+  std::cerr << "       -c          :  load the image back and check it matches the YAML file" << std::endl;
+  std::cerr << "       -j <threads>:  threads loading the YAML tables (default one per core)" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+static void showTimes(const char *what, MpsDb *db) {
+  std::cout << what << ": load " << db->getLoadTime() * 1e3 << " ms, configure "
+	    << db->getConfigureTime() * 1e3 << " ms, total "
+	    << (db->getLoadTime() + db->getConfigureTime()) * 1e3 << " ms" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string yamlFileName = "";
+  std::string imageFileName = "";
+  std::string cacheDir = "";
+  bool check = false;
+
+  for (int opt; (opt = getopt(argc, argv, "hf:o:d:cj:")) > 0;) {
+    switch (opt) {
+    case 'f':
+      yamlFileName = optarg;
+      break;
+    case 'o':
+      imageFileName = optarg;
+      break;
+    case 'd':
+      cacheDir = optarg;
+      break;
+    case 'c':
+      check = true;
+      break;
+    case 'j':
+      MpsDb::setYamlLoadThreads(atoi(optarg));
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      std::cerr << "Unknown option '" << opt << "'"  << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (yamlFileName == "" || (imageFileName == "" && cacheDir == "")) {
+    usage(argv[0]);
+    return 1;
+  }
+
+#if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
+  Configurations c;
+  c.setAll(ConfigurationType::Enabled, "false");
+  Loggers::setDefaultConfigurations(c, true);
+#endif
+
+  DbImageSource source = MpsDbImage::scanSource(yamlFileName);
+  if (imageFileName == "") {
+    if (source.md5sum.empty()) {
+      std::cerr << "ERROR: " << yamlFileName << " has no DatabaseInfo md5sum, use -o" << std::endl;
+      return 1;
+    }
+    try {
+      MpsDbImage::checkCacheDir(cacheDir);
+    } catch (DbException &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    imageFileName = MpsDbImage::getCacheFileName(cacheDir, source.md5sum);
+  }
+
+  // Always parse the YAML file, not a cached image. The MpsDb instances
+  // are not deleted, the process exits when done.
+  MpsDb::setImageCacheDir("");
+  MpsDb *yamlDb = new MpsDb();
+  try {
+    yamlDb->load(yamlFileName);
+    MpsDbImage::write(yamlDb, imageFileName, source);
+    yamlDb->configure();
+  } catch (DbException &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  std::cout << "Wrote " << imageFileName << std::endl;
+  showTimes("YAML ", yamlDb);
+  yamlDb->showYamlLoadTimes();
+  yamlDb->showConfigureTimes();
+  yamlDb->showMemory();
+
+  MpsDb *imageDb = new MpsDb();
+  try {
+    imageDb->load(imageFileName);
+    imageDb->configure();
+  } catch (DbException &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  showTimes("Image", imageDb);
+
+  // Compile the database loaded from the image again, it must give the
+  // same image (i.e. all the fields read from the YAML file are kept).
+  if (check) {
+    std::string checkFileName = imageFileName + ".check";
+    try {
+      MpsDbImage::write(imageDb, checkFileName, source);
+    } catch (DbException &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    std::ifstream a(imageFileName.c_str(), std::ios::binary);
+    std::ifstream b(checkFileName.c_str(), std::ios::binary);
+    std::string imageBytes((std::istreambuf_iterator<char>(a)), std::istreambuf_iterator<char>());
+    std::string checkBytes((std::istreambuf_iterator<char>(b)), std::istreambuf_iterator<char>());
+    unlink(checkFileName.c_str());
+    if (imageBytes != checkBytes) {
+      std::cerr << "ERROR: database loaded from the image differs from the YAML file" << std::endl;
+      return 1;
+    }
+    std::cout << "Image matches the YAML file" << std::endl;
+  }
+
+  return 0;
+}
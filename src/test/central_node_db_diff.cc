@@ -0,0 +1,189 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <central_node_yaml.h>
+#include <central_node_database.h>
+#include <central_node_database_image.h>
+#include <central_node_database_delta.h>
+#include <log.h>
+
+#if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
+using namespace easyloggingpp;
+#endif
+
+/**
+ * Compute the delta between two versions of an MPS database (YAML files or
+ * compiled images), see central_node_database_delta.h. The delta file is
+ * applied to a running engine with Engine::applyDelta().
+ *
+ * With -c the delta is applied to a configured copy of the old version,
+ * which is then compared with the new version: same tables and same fast
+ * (firmware) configuration for every device.
+ */
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " -a <file> -b <file> [-o <file>] [-c]" << std::endl;
+  std::cerr << "       " << nm << " -s <file>" << std::endl;
+  std::cerr << "       -a <file>   :  old MPS database (YAML file or image)" << std::endl;
+  std::cerr << "       -b <file>   :  new MPS database (YAML file or image)" << std::endl;
+  std::cerr << "       -o <file>   :  output delta file" << std::endl;
+  std::cerr << "       -c          :  apply the delta to the old database and check it matches the new one" << std::endl;
+  std::cerr << "       -s <file>   :  show a delta file" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+static MpsDb *loadDb(std::string fileName, bool configure) {
+  MpsDb *db = new MpsDb();
+  db->load(fileName);
+  if (configure) {
+    db->configure();
+  }
+  return db;
+}
+
+/**
+ * Compare the fast configuration of the devices of both databases, returns
+ * the number of devices that differ.
+ */
+static uint32_t checkFastConfiguration(MpsDb *patched, MpsDb *expected) {
+  uint32_t errors = 0;
+
+  for (DbAnalogDeviceMap::iterator it = expected->analogDevices->begin();
+       it != expected->analogDevices->end(); ++it) {
+    DbAnalogDevicePtr device = patched->analogDevices->find(it->first)->second;
+    bool same = true;
+    for (uint32_t i = 0; i < ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL; ++i) {
+      same = same && device->fastDestinationMask[i] == it->second->fastDestinationMask[i];
+    }
+    for (uint32_t i = 0; i < ANALOG_CHANNEL_MAX_INTEGRATORS_PER_CHANNEL * ANALOG_CHANNEL_INTEGRATORS_SIZE; ++i) {
+      same = same && device->fastPowerClass[i] == it->second->fastPowerClass[i];
+    }
+    if (!same) {
+      std::cerr << "ERROR: fast configuration differs for AnalogDevice " << it->first << std::endl;
+      errors++;
+    }
+  }
+
+  for (DbDigitalDeviceMap::iterator it = expected->digitalDevices->begin();
+       it != expected->digitalDevices->end(); ++it) {
+    DbDigitalDevicePtr device = patched->digitalDevices->find(it->first)->second;
+    if (device->fastDestinationMask != it->second->fastDestinationMask ||
+        device->fastPowerClass != it->second->fastPowerClass ||
+        device->fastExpectedState != it->second->fastExpectedState) {
+      std::cerr << "ERROR: fast configuration differs for DigitalDevice " << it->first << std::endl;
+      errors++;
+    }
+  }
+
+  return errors;
+}
+
+int main(int argc, char **argv) {
+  std::string fromFileName = "";
+  std::string toFileName = "";
+  std::string deltaFileName = "";
+  std::string showFileName = "";
+  bool check = false;
+
+  for (int opt; (opt = getopt(argc, argv, "ha:b:o:cs:")) > 0;) {
+    switch (opt) {
+    case 'a':
+      fromFileName = optarg;
+      break;
+    case 'b':
+      toFileName = optarg;
+      break;
+    case 'o':
+      deltaFileName = optarg;
+      break;
+    case 'c':
+      check = true;
+      break;
+    case 's':
+      showFileName = optarg;
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      std::cerr << "Unknown option '" << opt << "'"  << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (showFileName == "" && (fromFileName == "" || toFileName == "")) {
+    usage(argv[0]);
+    return 1;
+  }
+
+#if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
+  Configurations c;
+  c.setAll(ConfigurationType::Enabled, "false");
+  Loggers::setDefaultConfigurations(c, true);
+#endif
+
+  MpsDbDelta delta;
+  if (showFileName != "") {
+    try {
+      delta.read(showFileName);
+    } catch (DbException &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    delta.show(std::cout);
+    return 0;
+  }
+
+  // Don't use or fill the image cache. The MpsDb instances are not
+  // deleted, the process exits when done.
+  MpsDb::setImageCacheDir("");
+  MpsDb *fromDb;
+  MpsDb *toDb;
+  try {
+    fromDb = loadDb(fromFileName, check);
+    toDb = loadDb(toFileName, check);
+    delta.diff(fromDb, toDb);
+    if (deltaFileName != "") {
+      delta.write(deltaFileName);
+    }
+  } catch (DbException &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  delta.show(std::cout);
+  if (deltaFileName != "") {
+    std::cout << "Wrote " << deltaFileName << std::endl;
+  }
+
+  if (check) {
+    std::string reason;
+    if (!delta.isPatchable(reason)) {
+      std::cout << "Not checked, the delta can't be applied in place" << std::endl;
+      return 0;
+    }
+
+    std::set<uint32_t> cardIds;
+    try {
+      fromDb->applyDelta(delta, cardIds);
+    } catch (DbException &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+
+    DbImageWriter patched;
+    DbImageWriter expected;
+    MpsDbImage::encode(fromDb, patched);
+    MpsDbImage::encode(toDb, expected);
+    if (patched.getWords() != expected.getWords() || patched.getPool() != expected.getPool()) {
+      std::cerr << "ERROR: tables of the patched database differ from the new database" << std::endl;
+      return 1;
+    }
+    if (checkFastConfiguration(fromDb, toDb) > 0) {
+      return 1;
+    }
+    std::cout << "Patched database matches the new database, "
+              << cardIds.size() << " application(s) to reconfigure" << std::endl;
+  }
+
+  return 0;
+}
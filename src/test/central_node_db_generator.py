@@ -0,0 +1,246 @@
+#!/usr/bin/env python
+#
+# Generates a synthetic MPS database YAML file, with the same tables and
+# fields as the files exported from the MPS database, of configurable size
+# and shape. Used to measure how the central node engine scales with the
+# database size (see central_node_scaling_bench_tst).
+#
+# Digital cards have 'devices' digital devices of 'inputs' inputs each
+# (one DigitalChannel per input), analog cards have up to 6 analog devices
+# (BLM like, one AnalogChannel each). Each digital Fault takes 'fan_in'
+# devices of the same card, each analog device has its own Fault. Every
+# FaultState has one AllowedClass per beam destination. A fraction of the
+# analog devices are ignored by a Condition.
+#
+# Example (1024 cards, 25% analog):
+#   central_node_db_generator.py --cards 1024 --analog 0.25 -o mps_1024.yaml
+#
+
+from __future__ import print_function
+
+import argparse
+import hashlib
+import random
+import sys
+
+NUM_APPLICATIONS = 1024
+NUM_DESTINATIONS = 16
+APP_CARD_MAX_DIGITAL_CHANNELS = 64
+APP_CARD_MAX_ANALOG_CHANNELS = 6
+SLOTS_PER_CRATE = 8
+ANALOG_THRESHOLD_BITS = 32  # 4 integrators x 8 thresholds
+NUM_BEAM_CLASSES = 5
+
+DIGITAL_DEVICE_TYPE = 1
+ANALOG_DEVICE_TYPE = 2
+DIGITAL_APP_TYPE = 1
+ANALOG_APP_TYPE = 2
+
+TABLES = ['Crate', 'ApplicationType', 'ApplicationCard', 'DigitalChannel', 'AnalogChannel',
+          'DeviceType', 'DeviceState', 'DigitalDevice', 'DeviceInput', 'Fault', 'FaultInput',
+          'FaultState', 'AnalogDevice', 'BeamDestination', 'BeamClass', 'AllowedClass',
+          'Condition', 'IgnoreCondition', 'ConditionInput', 'DatabaseInfo']
+
+
+class Database:
+    def __init__(self):
+        self.tables = {}
+        self.ids = {}
+
+    def nextId(self, table):
+        self.ids[table] = self.ids.get(table, 0) + 1
+        return self.ids[table]
+
+    def add(self, table, fields):
+        if fields[0][0] != 'id':
+            fields = [('id', self.nextId(table))] + fields
+        self.tables.setdefault(table, []).append(fields)
+        return fields[0][1]
+
+    def write(self, out):
+        for table in TABLES:
+            if table not in self.tables:
+                continue
+            out.write('---\n%s:\n' % table)
+            for row in self.tables[table]:
+                prefix = '-'
+                for name, value in row:
+                    out.write('%s %s: %s\n' % (prefix, name, formatValue(value)))
+                    prefix = ' '
+
+
+def formatValue(value):
+    if value is None:
+        return 'null'
+    if isinstance(value, bool):
+        return 'True' if value else 'False'
+    if isinstance(value, str):
+        return "'%s'" % value
+    return str(value)
+
+
+def pick(rnd, count):
+    # Same sequence with python 2 and 3 (unlike randint() and choice())
+    return int(rnd.random() * count)
+
+
+def generate(args):
+    rnd = random.Random(args.seed)
+    db = Database()
+
+    for d in range(args.destinations):
+        db.add('BeamDestination', [('name', 'DEST%d' % d), ('destination_mask', 1 << d)])
+    for c in range(NUM_BEAM_CLASSES):
+        db.add('BeamClass', [('name', 'Class %d' % c), ('number', c), ('min_period', 0),
+                             ('integration_window', 0), ('total_charge', 0),
+                             ('description', 'Power class %d' % c)])
+
+    # Digital fault values are made of 'fan_in' devices of 'inputs' bits
+    faultBits = args.fan_in * args.inputs
+    db.add('DeviceType', [('name', 'DIGITAL'), ('num_integrators', 0)])
+    db.add('DeviceType', [('name', 'BLM'), ('num_integrators', 4)])
+    digitalStates = []
+    analogStates = []
+    for s in range(args.states):
+        digitalStates.append(db.add('DeviceState', [('value', (s + 1) % (1 << faultBits)),
+                                                    ('mask', (1 << faultBits) - 1),
+                                                    ('device_type_id', DIGITAL_DEVICE_TYPE),
+                                                    ('name', 'STATE%d' % s)]))
+        analogStates.append(db.add('DeviceState', [('value', 1 << s), ('mask', 1 << s),
+                                                   ('device_type_id', ANALOG_DEVICE_TYPE),
+                                                   ('name', 'THRESHOLD%d' % s)]))
+
+    db.add('ApplicationType', [('number', 0), ('analog_channel_count', 0), ('analog_channel_size', 0),
+                               ('digital_channel_count', APP_CARD_MAX_DIGITAL_CHANNELS),
+                               ('digital_channel_size', 1), ('name', 'Digital Card')])
+    db.add('ApplicationType', [('number', 1), ('analog_channel_count', APP_CARD_MAX_ANALOG_CHANNELS),
+                               ('analog_channel_size', 1), ('digital_channel_count', 0),
+                               ('digital_channel_size', 0), ('name', 'Analog Card')])
+    for c in range((args.cards + SLOTS_PER_CRATE - 1) // SLOTS_PER_CRATE):
+        db.add('Crate', [('crate_id', c + 1), ('num_slots', SLOTS_PER_CRATE), ('shelf_number', c + 1)])
+
+    # The analog cards are spread evenly among the digital cards
+    analogCards = int(round(args.cards * args.analog))
+    faultStates = []
+    analogDevices = []
+    deviceId = 0
+    for card in range(args.cards):
+        analog = (card * analogCards) // args.cards != ((card + 1) * analogCards) // args.cards
+        cardId = db.add('ApplicationCard', [('number', card + 1), ('crate_id', card // SLOTS_PER_CRATE + 1),
+                                            ('slot_number', card % SLOTS_PER_CRATE + 1),
+                                            ('type_id', ANALOG_APP_TYPE if analog else DIGITAL_APP_TYPE),
+                                            ('global_id', card), ('name', 'CARD%d' % card),
+                                            ('description', 'Generated card %d' % card)])
+        if analog:
+            for d in range(min(args.devices, APP_CARD_MAX_ANALOG_CHANNELS)):
+                deviceId += 1
+                channelId = db.add('AnalogChannel', [('name', 'BLM%d' % deviceId), ('number', d),
+                                                     ('card_id', cardId)])
+                db.add('AnalogDevice', [('id', deviceId), ('device_type_id', ANALOG_DEVICE_TYPE),
+                                        ('channel_id', channelId), ('name', 'BLM%d' % deviceId),
+                                        ('description', 'Generated BLM'),
+                                        ('evaluation', args.evaluation), ('card_id', cardId)])
+                analogDevices.append(deviceId)
+                faultId = db.add('Fault', [('name', 'BLM%d_LOSS' % deviceId),
+                                           ('description', 'Generated analog fault')])
+                db.add('FaultInput', [('bit_position', 0), ('device_id', deviceId), ('fault_id', faultId)])
+                for s in range(args.states):
+                    faultStates.append(db.add('FaultState', [('fault_id', faultId),
+                                                             ('device_state_id', analogStates[s]),
+                                                             ('default', False)]))
+        else:
+            devices = []
+            for d in range(args.devices):
+                deviceId += 1
+                db.add('DigitalDevice', [('id', deviceId), ('device_type_id', DIGITAL_DEVICE_TYPE),
+                                         ('name', 'DEVICE%d' % deviceId),
+                                         ('description', 'Generated digital device'),
+                                         ('evaluation', args.evaluation), ('card_id', cardId)])
+                for i in range(args.inputs):
+                    channelId = db.add('DigitalChannel', [('name', 'CHANNEL%d' % (db.ids.get('DigitalChannel', 0) + 1)),
+                                                          ('number', d * args.inputs + i),
+                                                          ('card_id', cardId)])
+                    db.add('DeviceInput', [('bit_position', i), ('fault_value', 0),
+                                           ('digital_device_id', deviceId), ('channel_id', channelId),
+                                           ('auto_reset', 0)])
+                devices.append(deviceId)
+
+            for f in range(0, len(devices), args.fan_in):
+                faultId = db.add('Fault', [('name', 'FAULT%d' % (db.ids.get('Fault', 0) + 1)),
+                                           ('description', 'Generated digital fault')])
+                for i, device in enumerate(devices[f:f + args.fan_in]):
+                    db.add('FaultInput', [('bit_position', i * args.inputs), ('device_id', device),
+                                          ('fault_id', faultId)])
+                for s in range(args.states):
+                    faultStates.append(db.add('FaultState', [('fault_id', faultId),
+                                                             ('device_state_id', digitalStates[s]),
+                                                             ('default', False)]))
+
+    for faultState in faultStates:
+        for d in range(args.destinations):
+            db.add('AllowedClass', [('beam_class_id', pick(rnd, NUM_BEAM_CLASSES) + 1),
+                                    ('fault_state_id', faultState), ('beam_destination_id', d + 1)])
+
+    if args.conditions > 0 and faultStates:
+        for c in range(args.conditions):
+            conditionId = db.add('Condition', [('name', 'CONDITION%d' % c),
+                                               ('description', 'Generated condition'), ('value', 1)])
+            db.add('ConditionInput', [('bit_position', 0), ('fault_state_id', faultStates[pick(rnd, len(faultStates))]),
+                                      ('condition_id', conditionId)])
+        for device in analogDevices:
+            if rnd.random() < args.ignore:
+                db.add('IgnoreCondition', [('condition_id', pick(rnd, args.conditions) + 1),
+                                           ('fault_state_id', None), ('device_id', device)])
+
+    shape = ' '.join('%s=%s' % (k, v) for k, v in sorted(vars(args).items()) if k != 'output')
+    db.add('DatabaseInfo', [('source', 'central_node_db_generator.py ' + shape), ('date', 'generated'),
+                            ('user', 'generator'), ('md5sum', hashlib.md5(shape.encode()).hexdigest())])
+    return db
+
+
+def check(args):
+    if args.cards < 1 or args.cards > NUM_APPLICATIONS:
+        return 'cards must be between 1 and %d' % NUM_APPLICATIONS
+    if args.analog < 0 or args.analog > 1:
+        return 'analog must be between 0 and 1'
+    if args.devices < 1 or args.inputs < 1 or args.devices * args.inputs > APP_CARD_MAX_DIGITAL_CHANNELS:
+        return 'devices x inputs must be between 1 and %d' % APP_CARD_MAX_DIGITAL_CHANNELS
+    if args.fan_in < 1 or args.fan_in * args.inputs > 32:
+        return 'fan-in x inputs must be between 1 and 32'
+    if args.states < 1 or args.states > ANALOG_THRESHOLD_BITS:
+        return 'states must be between 1 and %d' % ANALOG_THRESHOLD_BITS
+    if args.destinations < 1 or args.destinations > NUM_DESTINATIONS:
+        return 'destinations must be between 1 and %d' % NUM_DESTINATIONS
+    if args.conditions < 0 or args.ignore < 0 or args.ignore > 1:
+        return 'conditions must be positive and ignore between 0 and 1'
+    if args.evaluation == 1 and (args.inputs != 1 or args.fan_in != 1 or args.states != 1):
+        return 'fast evaluation needs one input, one device per fault and one state'
+    return None
+
+
+parser = argparse.ArgumentParser(description='Generate a synthetic MPS database YAML file')
+parser.add_argument('--cards', type=int, default=64, help='number of application cards (default 64)')
+parser.add_argument('--analog', type=float, default=0.25, help='fraction of analog cards (default 0.25)')
+parser.add_argument('--devices', type=int, default=16, help='devices per card (default 16, up to 6 for analog cards)')
+parser.add_argument('--inputs', type=int, default=2, help='inputs per digital device (default 2)')
+parser.add_argument('--fan-in', type=int, default=1, help='devices per digital fault (default 1)')
+parser.add_argument('--states', type=int, default=4, help='fault states per fault (default 4)')
+parser.add_argument('--destinations', type=int, default=4, help='beam destinations (default 4)')
+parser.add_argument('--conditions', type=int, default=8, help='number of conditions (default 8)')
+parser.add_argument('--ignore', type=float, default=0.5, help='fraction of analog devices with an ignore condition (default 0.5)')
+parser.add_argument('--evaluation', type=int, default=0, choices=[0, 1], help='device evaluation, 0=slow 1=fast (default 0)')
+parser.add_argument('--seed', type=int, default=1, help='random seed (default 1)')
+parser.add_argument('-o', '--output', type=str, default=None, help='output file (default stdout)')
+
+args = parser.parse_args()
+error = check(args)
+if error:
+    print('ERROR: %s' % error, file=sys.stderr)
+    sys.exit(1)
+
+database = generate(args)
+if args.output:
+    with open(args.output, 'w') as f:
+        database.write(f)
+else:
+    database.write(sys.stdout)
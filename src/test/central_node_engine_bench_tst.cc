@@ -0,0 +1,773 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <central_node_yaml.h>
+#include <central_node_database.h>
+#include <central_node_engine.h>
+#include <central_node_history.h>
+#include <cycle_counter.h>
+#include <queue.h>
+#include <log_wrapper.h>
+
+#include "central_node_bench_util.h"
+
+#if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
+using namespace easyloggingpp;
+#endif
+
+/**
+ * Microbenchmarks of the engine hot paths. Each benchmark times a single
+ * operation over many iterations, with a fixed random seed, and reports
+ * the mean, median, 99th percentile and maximum time of one iteration:
+ *
+ *   yaml_load, configure      MpsDb::load() and MpsDb::configure(), each
+ *                             iteration in a new process (see -l, -C)
+ *   decode_digital/analog     DbApplicationCard::updateInputs() for all the
+ *                             digital/analog cards, one random update frame
+ *   evaluate_faults, evaluate_ignore, mitigate, allowed_class
+ *                             one Engine::checkFaults() stage, the other
+ *                             stages of the frame run untimed
+ *   check_faults              Engine::checkFaults()
+ *   config_digital/analog     writeDigitalConfiguration() and
+ *                             writeAnalogConfiguration() for all the cards
+ *   queue_handoff             one update frame through a Queue between two
+ *                             threads (half of the round trip)
+ *   history_add               History::add() of one message
+ *
+ * The engine loads a database only once per process, so each database is
+ * benchmarked in a child process, which sends its results back through a
+ * pipe. The results can be written as JSON (-j) to track regressions.
+ *
+ * The engine runs with the no-op firmware (build without FW_ENABLED), no
+ * hardware is needed.
+ */
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-n <iterations>] [-w <iterations>] [-l <iterations>] [-s <seed>]" << std::endl;
+  std::cerr << "       " << std::string(strlen(nm), ' ')
+            << " [-b <name>[,<name>...]] [-c <cpu>] [-C <dir>] [-j <file>] <file> [<file> ...]" << std::endl;
+  std::cerr << "       <file>          :  MPS database YAML files" << std::endl;
+  std::cerr << "       -n <iterations> :  iterations per benchmark (default 2000)" << std::endl;
+  std::cerr << "       -w <iterations> :  untimed warm-up iterations (default 100)" << std::endl;
+  std::cerr << "       -l <iterations> :  iterations of the yaml_load/configure benchmarks (default 5)" << std::endl;
+  std::cerr << "       -s <seed>       :  seed of the random update frames (default 1)" << std::endl;
+  std::cerr << "       -b <names>      :  run only these benchmarks (default all)" << std::endl;
+  std::cerr << "       -c <cpu>        :  run on this CPU only" << std::endl;
+  std::cerr << "       -C <dir>        :  load the databases through the compiled image cache in <dir>" << std::endl;
+  std::cerr << "                          (default: always parse the YAML)" << std::endl;
+  std::cerr << "       -j <file>       :  write the results as JSON" << std::endl;
+  std::cerr << "       -h              :  print this message" << std::endl;
+}
+
+enum BenchId {
+  BenchYamlLoad = 0,
+  BenchConfigure,
+  BenchDecodeDigital,
+  BenchDecodeAnalog,
+  BenchEvaluateFaults,
+  BenchEvaluateIgnore,
+  BenchMitigate,
+  BenchAllowedClass,
+  BenchCheckFaults,
+  BenchConfigDigital,
+  BenchConfigAnalog,
+  BenchQueueHandoff,
+  BenchHistoryAdd,
+
+  BENCH_COUNT
+};
+
+static const char *benchNames[BENCH_COUNT] = {
+  "yaml_load", "configure", "decode_digital", "decode_analog",
+  "evaluate_faults", "evaluate_ignore", "mitigate", "allowed_class", "check_faults",
+  "config_digital", "config_analog", "queue_handoff", "history_add"
+};
+
+/**
+ * What one iteration works on, reported as 'items'
+ */
+static const char *benchItems[BENCH_COUNT] = {
+  "bytes", "devices", "cards", "cards",
+  "faults", "conditions", "destinations", "destinations", "faults",
+  "cards", "cards", "bytes", "messages"
+};
+
+typedef struct {
+  bool ran;
+  uint32_t iterations;
+  uint32_t items;
+  double mean;        // us
+  double min;
+  double p50;
+  double p99;
+  double max;
+  double stddev;
+} BenchResult;
+
+typedef struct {
+  bool ok;
+  char error[256];
+
+  uint64_t fileSize;
+  uint32_t digitalCards;
+  uint32_t analogCards;
+  uint32_t deviceInputs;
+  uint32_t analogDevices;
+  uint32_t faults;
+  uint32_t ignoreConditions;
+  uint32_t destinations;
+
+  BenchResult results[BENCH_COUNT];
+} BenchReport;
+
+typedef struct {
+  bool ok;
+  double loadTime;    // s
+  double configureTime;
+  uint32_t devices;
+} LoadSample;
+
+/**
+ * Fill the result with the statistics of the samples (ns)
+ */
+static void setResult(std::vector<double> &samples, uint32_t items, BenchResult &result) {
+  memset(&result, 0, sizeof(result));
+  if (samples.empty()) {
+    return;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    sum += samples[i];
+  }
+  double mean = sum / samples.size();
+  double variance = 0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    variance += (samples[i] - mean) * (samples[i] - mean);
+  }
+
+  result.ran = true;
+  result.iterations = samples.size();
+  result.items = items;
+  result.mean = mean * 1e-3;
+  result.min = samples.front() * 1e-3;
+  result.p50 = samples[samples.size() / 2] * 1e-3;
+  result.p99 = samples[std::min(samples.size() - 1, (size_t)(samples.size() * 0.99))] * 1e-3;
+  result.max = samples.back() * 1e-3;
+  result.stddev = sqrt(variance / samples.size()) * 1e-3;
+}
+
+/**
+ * Echo side of the queue hand-off benchmark: returns every frame received
+ * on 'ping' through 'pong', until an empty frame is received.
+ */
+class QueueEcho {
+ private:
+  Queue< std::vector<uint8_t> > &_ping;
+  Queue< std::vector<uint8_t> > &_pong;
+
+ public:
+  QueueEcho(Queue< std::vector<uint8_t> > &ping, Queue< std::vector<uint8_t> > &pong) :
+    _ping(ping), _pong(pong) {
+  }
+
+  void run() {
+    for (;;) {
+      std::vector<uint8_t> frame;
+      _ping.pop(frame);
+      _pong.push(frame);
+      if (frame.empty()) {
+        return;
+      }
+    }
+  }
+};
+
+class EngineBench {
+ private:
+  Engine &_engine;
+  MpsDbPtr _db;
+  BenchRandom _random;
+  uint32_t _iterations;
+  uint32_t _warmUp;
+  std::vector<DbApplicationCardPtr> _digitalCards;
+  std::vector<DbApplicationCardPtr> _analogCards;
+
+  /**
+   * Messages queued by the engine are normally taken by the history sender
+   * thread, which is not running here.
+   */
+  void drainHistory() {
+    HistoryEvent events[HIST_SEND_BATCH_SIZE];
+    while (History::getInstance()._ring.pop(events, HIST_SEND_BATCH_SIZE) > 0) {
+    }
+  }
+
+  /**
+   * Process one random update frame as the input update thread and the
+   * engine thread do, returns the time (ns) of the 'timed' benchmark.
+   */
+  double frame(BenchId timed) {
+    uint64_t start;
+    uint64_t ticks = 0;
+
+    _random.frame(_db->fwUpdateBuffer);
+
+    start = CycleCounter::now();
+    for (size_t i = 0; i < _digitalCards.size(); ++i) {
+      _digitalCards[i]->updateInputs();
+    }
+    if (timed == BenchDecodeDigital) {
+      ticks = CycleCounter::now() - start;
+    }
+
+    start = CycleCounter::now();
+    for (size_t i = 0; i < _analogCards.size(); ++i) {
+      _analogCards[i]->updateInputs();
+    }
+    if (timed == BenchDecodeAnalog) {
+      ticks = CycleCounter::now() - start;
+    }
+
+    if (timed == BenchCheckFaults) {
+      start = CycleCounter::now();
+      _engine.checkFaults();
+      ticks = CycleCounter::now() - start;
+    }
+    else {
+      // Same stages as Engine::checkFaults()
+      std::unique_lock<std::mutex> lock(*_db->getMutex());
+      _db->clearMitigationBuffer();
+      _engine.updateBypassView();
+      _engine.setTentativeBeamClass();
+
+      start = CycleCounter::now();
+      _engine.evaluateFaults();
+      if (timed == BenchEvaluateFaults) {
+        ticks = CycleCounter::now() - start;
+      }
+
+      _engine.breakAnalogIgnore();
+
+      start = CycleCounter::now();
+      _engine.evaluateIgnoreConditions();
+      if (timed == BenchEvaluateIgnore) {
+        ticks = CycleCounter::now() - start;
+      }
+
+      _engine.setFaultIgnore();
+
+      start = CycleCounter::now();
+      _engine.mitigate();
+      if (timed == BenchMitigate) {
+        ticks = CycleCounter::now() - start;
+      }
+
+      start = CycleCounter::now();
+      _engine.setAllowedBeamClass();
+      if (timed == BenchAllowedClass) {
+        ticks = CycleCounter::now() - start;
+      }
+
+      _db->getDbReload();
+      _db->resetDbReload();
+    }
+
+    drainHistory();
+    return CycleCounter::toNs(ticks);
+  }
+
+  void runFrames(BenchId id, uint32_t items, BenchResult &result) {
+    std::vector<double> samples;
+    samples.reserve(_iterations);
+    for (uint32_t i = 0; i < _warmUp + _iterations; ++i) {
+      double ns = frame(id);
+      if (i >= _warmUp) {
+        samples.push_back(ns);
+      }
+    }
+    setResult(samples, items, result);
+  }
+
+  void runConfig(BenchId id, std::vector<DbApplicationCardPtr> &cards, BenchResult &result) {
+    std::vector<double> samples;
+    samples.reserve(_iterations);
+    for (uint32_t i = 0; i < _warmUp + _iterations; ++i) {
+      uint64_t start = CycleCounter::now();
+      for (size_t c = 0; c < cards.size(); ++c) {
+        if (id == BenchConfigDigital) {
+          cards[c]->writeDigitalConfiguration(cards[c]->applicationConfigBuffer);
+        }
+        else {
+          cards[c]->writeAnalogConfiguration(cards[c]->applicationConfigBuffer);
+        }
+      }
+      double ns = CycleCounter::toNs(CycleCounter::now() - start);
+      if (i >= _warmUp) {
+        samples.push_back(ns);
+      }
+    }
+    setResult(samples, cards.size(), result);
+  }
+
+  void runQueueHandoff(BenchResult &result) {
+    Queue< std::vector<uint8_t> > ping;
+    Queue< std::vector<uint8_t> > pong;
+    QueueEcho echo(ping, pong);
+    std::thread echoThread(&QueueEcho::run, &echo);
+
+    std::vector<double> samples;
+    samples.reserve(_iterations);
+    std::vector<uint8_t> frame(FW_UPDATE_BUFFER_SIZE_BYTES);
+    for (uint32_t i = 0; i < _warmUp + _iterations; ++i) {
+      _random.frame(frame);
+      uint64_t start = CycleCounter::now();
+      ping.push(frame);
+      pong.pop(frame);
+      double ns = CycleCounter::toNs(CycleCounter::now() - start) / 2;
+      if (i >= _warmUp) {
+        samples.push_back(ns);
+      }
+    }
+
+    ping.push(std::vector<uint8_t>());
+    echoThread.join();
+    setResult(samples, FW_UPDATE_BUFFER_SIZE_BYTES, result);
+  }
+
+  void runHistoryAdd(BenchResult &result) {
+    History &history = History::getInstance();
+    Message message;
+    message.type = FaultStateType;
+    message.aux = 0;
+
+    std::vector<double> samples;
+    samples.reserve(_iterations);
+    for (uint32_t i = 0; i < _warmUp + _iterations; ++i) {
+      message.id = i;
+      message.oldValue = i & 1;
+      message.newValue = !message.oldValue;
+
+      uint64_t start = CycleCounter::now();
+      history.add(message);
+      double ns = CycleCounter::toNs(CycleCounter::now() - start);
+      if (i >= _warmUp) {
+        samples.push_back(ns);
+      }
+
+      // Keep the ring from filling up, full ring adds are cheaper
+      if (i % (HIST_RING_SIZE / 2) == 0) {
+        drainHistory();
+      }
+    }
+    drainHistory();
+    setResult(samples, 1, result);
+  }
+
+ public:
+  EngineBench(uint64_t seed, uint32_t iterations, uint32_t warmUp) :
+    _engine(Engine::getInstance()),
+    _random(seed),
+    _iterations(iterations),
+    _warmUp(warmUp) {
+  }
+
+  void run(std::string fileName, bool *selected, BenchReport &report) {
+    if (_engine.loadConfig(fileName) != 0) {
+      snprintf(report.error, sizeof(report.error), "Failed to load %s", fileName.c_str());
+      return;
+    }
+
+    _db = _engine._mpsDb;
+    for (DbApplicationCardMap::iterator card = _db->applicationCards->begin();
+         card != _db->applicationCards->end(); ++card) {
+      if ((*card).second->isAnalog()) {
+        _analogCards.push_back((*card).second);
+      }
+      else {
+        _digitalCards.push_back((*card).second);
+      }
+    }
+
+    report.digitalCards = _digitalCards.size();
+    report.analogCards = _analogCards.size();
+    report.deviceInputs = _db->deviceInputs->size();
+    report.analogDevices = _db->analogDevices ? _db->analogDevices->size() : 0;
+    report.faults = _db->faults->size();
+    report.ignoreConditions = _db->ignoreConditions ? _db->ignoreConditions->size() : 0;
+    report.destinations = _db->beamDestinations->size();
+
+    uint32_t items[BENCH_COUNT];
+    memset(items, 0, sizeof(items));
+    items[BenchDecodeDigital] = report.digitalCards;
+    items[BenchDecodeAnalog] = report.analogCards;
+    items[BenchEvaluateFaults] = report.faults;
+    items[BenchEvaluateIgnore] = report.ignoreConditions;
+    items[BenchMitigate] = report.destinations;
+    items[BenchAllowedClass] = report.destinations;
+    items[BenchCheckFaults] = report.faults;
+
+    for (uint32_t id = BenchDecodeDigital; id <= BenchCheckFaults; ++id) {
+      if (selected[id]) {
+        runFrames(static_cast<BenchId>(id), items[id], report.results[id]);
+      }
+    }
+    if (selected[BenchConfigDigital]) {
+      runConfig(BenchConfigDigital, _digitalCards, report.results[BenchConfigDigital]);
+    }
+    if (selected[BenchConfigAnalog]) {
+      runConfig(BenchConfigAnalog, _analogCards, report.results[BenchConfigAnalog]);
+    }
+    if (selected[BenchQueueHandoff]) {
+      runQueueHandoff(report.results[BenchQueueHandoff]);
+    }
+    if (selected[BenchHistoryAdd]) {
+      runHistoryAdd(report.results[BenchHistoryAdd]);
+    }
+    report.ok = true;
+  }
+};
+
+class LoadChild : public BenchChild {
+ private:
+  std::string _fileName;
+
+ public:
+  LoadChild(std::string fileName) : _fileName(fileName) {
+  }
+
+  void run(void *result) {
+    LoadSample *sample = static_cast<LoadSample *>(result);
+    try {
+      // Not deleted, the process exits when done
+      MpsDb *db = new MpsDb();
+      db->load(_fileName);
+      db->configure();
+      sample->loadTime = db->getLoadTime();
+      sample->configureTime = db->getConfigureTime();
+      sample->devices = db->digitalDevices->size() + (db->analogDevices ? db->analogDevices->size() : 0);
+      sample->ok = true;
+    } catch (DbException &e) {
+      std::cerr << "ERROR: " << e.what() << std::endl;
+    }
+  }
+};
+
+class EngineChild : public BenchChild {
+ private:
+  std::string _fileName;
+  bool *_selected;
+  uint64_t _seed;
+  uint32_t _iterations;
+  uint32_t _warmUp;
+
+ public:
+  EngineChild(std::string fileName, bool *selected, uint64_t seed, uint32_t iterations, uint32_t warmUp) :
+    _fileName(fileName), _selected(selected), _seed(seed), _iterations(iterations), _warmUp(warmUp) {
+  }
+
+  void run(void *result) {
+    BenchReport *report = static_cast<BenchReport *>(result);
+    try {
+      EngineBench bench(_seed, _iterations, _warmUp);
+      bench.run(_fileName, _selected, *report);
+    } catch (CentralNodeException &e) {
+      snprintf(report->error, sizeof(report->error), "%s", e.what());
+    }
+  }
+};
+
+static bool benchmark(std::string fileName, bool *selected, uint64_t seed, uint32_t iterations,
+                      uint32_t warmUp, uint32_t loadIterations, BenchReport &report) {
+  struct stat st;
+
+  memset(&report, 0, sizeof(report));
+  if (stat(fileName.c_str(), &st) != 0) {
+    snprintf(report.error, sizeof(report.error), "%s not found", fileName.c_str());
+    return false;
+  }
+  report.fileSize = st.st_size;
+
+  if (selected[BenchYamlLoad] || selected[BenchConfigure]) {
+    std::vector<double> loadSamples;
+    std::vector<double> configureSamples;
+    uint32_t devices = 0;
+    LoadChild child(fileName);
+    for (uint32_t i = 0; i < loadIterations; ++i) {
+      LoadSample sample;
+      memset(&sample, 0, sizeof(sample));
+      if (!child.spawn(&sample, sizeof(sample)) || !sample.ok) {
+        snprintf(report.error, sizeof(report.error), "Failed to load %s", fileName.c_str());
+        return false;
+      }
+      loadSamples.push_back(sample.loadTime * 1e9);
+      configureSamples.push_back(sample.configureTime * 1e9);
+      devices = sample.devices;
+    }
+    if (selected[BenchYamlLoad]) {
+      setResult(loadSamples, report.fileSize, report.results[BenchYamlLoad]);
+    }
+    if (selected[BenchConfigure]) {
+      setResult(configureSamples, devices, report.results[BenchConfigure]);
+    }
+  }
+
+  bool engine = false;
+  for (uint32_t id = BenchDecodeDigital; id < BENCH_COUNT; ++id) {
+    engine = engine || selected[id];
+  }
+  if (!engine) {
+    report.ok = true;
+    return true;
+  }
+
+  // The child fills the database counters and the engine results
+  BenchReport engineReport;
+  memset(&engineReport, 0, sizeof(engineReport));
+  EngineChild child(fileName, selected, seed, iterations, warmUp);
+  if (!child.spawn(&engineReport, sizeof(engineReport))) {
+    snprintf(report.error, sizeof(report.error), "benchmark process failed");
+    return false;
+  }
+  if (!engineReport.ok) {
+    memcpy(report.error, engineReport.error, sizeof(report.error));
+    return false;
+  }
+
+  engineReport.fileSize = report.fileSize;
+  engineReport.results[BenchYamlLoad] = report.results[BenchYamlLoad];
+  engineReport.results[BenchConfigure] = report.results[BenchConfigure];
+  report = engineReport;
+  return true;
+}
+
+static std::string jsonString(std::string value) {
+  std::stringstream out;
+  out << "\"";
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '"' || value[i] == '\\') {
+      out << "\\" << value[i];
+    }
+    else if (static_cast<unsigned char>(value[i]) < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) value[i]
+          << std::dec << std::setfill(' ');
+    }
+    else {
+      out << value[i];
+    }
+  }
+  out << "\"";
+  return out.str();
+}
+
+static void writeJson(std::ostream &os, std::vector<std::string> &names, std::vector<BenchReport> &reports,
+                      uint64_t seed, uint32_t iterations, uint32_t warmUp, uint32_t loadIterations) {
+  os << std::fixed << std::setprecision(3);
+  os << "{" << std::endl;
+  os << "  \"benchmark\": \"central_node_engine_bench\"," << std::endl;
+  os << "  \"time\": " << time(0) << "," << std::endl;
+  os << "  \"seed\": " << seed << "," << std::endl;
+  os << "  \"iterations\": " << iterations << "," << std::endl;
+  os << "  \"warmUp\": " << warmUp << "," << std::endl;
+  os << "  \"loadIterations\": " << loadIterations << "," << std::endl;
+  os << "  \"databases\": [";
+  for (size_t d = 0; d < reports.size(); ++d) {
+    BenchReport &r = reports[d];
+    os << (d == 0 ? "" : ",") << std::endl;
+    os << "    {" << std::endl;
+    os << "      \"file\": " << jsonString(names[d]) << "," << std::endl;
+    os << "      \"size\": " << r.fileSize << "," << std::endl;
+    os << "      \"digitalCards\": " << r.digitalCards << "," << std::endl;
+    os << "      \"analogCards\": " << r.analogCards << "," << std::endl;
+    os << "      \"deviceInputs\": " << r.deviceInputs << "," << std::endl;
+    os << "      \"analogDevices\": " << r.analogDevices << "," << std::endl;
+    os << "      \"faults\": " << r.faults << "," << std::endl;
+    os << "      \"ignoreConditions\": " << r.ignoreConditions << "," << std::endl;
+    os << "      \"destinations\": " << r.destinations << "," << std::endl;
+    os << "      \"results\": [";
+    bool first = true;
+    for (uint32_t id = 0; id < BENCH_COUNT; ++id) {
+      BenchResult &b = r.results[id];
+      if (!b.ran) {
+        continue;
+      }
+      os << (first ? "" : ",") << std::endl;
+      first = false;
+      os << "        { \"name\": \"" << benchNames[id] << "\", \"iterations\": " << b.iterations
+         << ", \"items\": " << b.items << ", \"itemType\": \"" << benchItems[id] << "\","
+         << " \"mean_us\": " << b.mean << ", \"min_us\": " << b.min << ", \"p50_us\": " << b.p50
+         << ", \"p99_us\": " << b.p99 << ", \"max_us\": " << b.max << ", \"stddev_us\": " << b.stddev << " }";
+    }
+    os << std::endl << "      ]" << std::endl;
+    os << "    }";
+  }
+  os << std::endl << "  ]" << std::endl;
+  os << "}" << std::endl;
+}
+
+static bool selectBenchmarks(std::string names, bool *selected) {
+  std::stringstream list(names);
+  std::string name;
+
+  memset(selected, 0, sizeof(bool) * BENCH_COUNT);
+  while (std::getline(list, name, ',')) {
+    uint32_t id = 0;
+    while (id < BENCH_COUNT && name != benchNames[id]) {
+      id++;
+    }
+    if (id == BENCH_COUNT) {
+      std::cerr << "ERROR: unknown benchmark '" << name << "', valid names are:";
+      for (id = 0; id < BENCH_COUNT; ++id) {
+        std::cerr << " " << benchNames[id];
+      }
+      std::cerr << std::endl;
+      return false;
+    }
+    selected[id] = true;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 2000;
+  uint32_t warmUp = 100;
+  uint32_t loadIterations = 5;
+  uint64_t seed = 1;
+  int cpu = -1;
+  std::string cacheDir = "";
+  std::string jsonFileName = "";
+  bool selected[BENCH_COUNT];
+
+  for (uint32_t id = 0; id < BENCH_COUNT; ++id) {
+    selected[id] = true;
+  }
+
+  for (int opt; (opt = getopt(argc, argv, "n:w:l:s:b:c:C:j:h")) > 0;) {
+    switch (opt) {
+    case 'n':
+      iterations = atoi(optarg);
+      break;
+    case 'w':
+      warmUp = atoi(optarg);
+      break;
+    case 'l':
+      loadIterations = atoi(optarg);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'b':
+      if (!selectBenchmarks(optarg, selected)) {
+        return 1;
+      }
+      break;
+    case 'c':
+      cpu = atoi(optarg);
+      break;
+    case 'C':
+      cacheDir = optarg;
+      break;
+    case 'j':
+      jsonFileName = optarg;
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind >= argc || iterations == 0 || loadIterations == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+#ifdef FW_ENABLED
+  std::cerr << "ERROR: the benchmark runs the engine with the no-op firmware, "
+            << "build without FW_ENABLED" << std::endl;
+  return 1;
+#endif
+
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      perror("sched_setaffinity");
+      return 1;
+    }
+  }
+
+  // Measure the YAML load unless a cache directory is given
+  MpsDb::setImageCacheDir(cacheDir);
+
+#if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
+  Configurations c;
+  c.setAll(ConfigurationType::Enabled, "false");
+  Loggers::setDefaultConfigurations(c, true);
+#endif
+
+  std::vector<std::string> names;
+  std::vector<BenchReport> reports;
+  bool failed = false;
+  for (int i = optind; i < argc; ++i) {
+    BenchReport report;
+    if (!benchmark(argv[i], selected, seed, iterations, warmUp, loadIterations, report)) {
+      std::cerr << "ERROR: " << argv[i] << ": " << report.error << std::endl;
+      failed = true;
+      continue;
+    }
+    names.push_back(benchBaseName(argv[i]));
+    reports.push_back(report);
+  }
+
+  std::cout << std::fixed << std::setprecision(3);
+  for (size_t d = 0; d < reports.size(); ++d) {
+    BenchReport &r = reports[d];
+    std::cout << names[d] << ": " << r.digitalCards << " digital cards, " << r.analogCards
+              << " analog cards, " << r.deviceInputs << " inputs, " << r.analogDevices
+              << " analog devices, " << r.faults << " faults" << std::endl;
+    std::cout << std::left << std::setw(18) << "  Benchmark" << std::right
+              << std::setw(8) << "Iter" << std::setw(10) << "Items"
+              << std::setw(12) << "Mean[us]" << std::setw(12) << "Min[us]" << std::setw(12) << "P50[us]"
+              << std::setw(12) << "P99[us]" << std::setw(12) << "Max[us]" << std::endl;
+    for (uint32_t id = 0; id < BENCH_COUNT; ++id) {
+      BenchResult &b = r.results[id];
+      if (!b.ran) {
+        continue;
+      }
+      std::cout << "  " << std::left << std::setw(16) << benchNames[id] << std::right
+                << std::setw(8) << b.iterations << std::setw(10) << b.items
+                << std::setw(12) << b.mean << std::setw(12) << b.min << std::setw(12) << b.p50
+                << std::setw(12) << b.p99 << std::setw(12) << b.max << std::endl;
+    }
+    std::cout << std::endl;
+  }
+
+  if (jsonFileName != "") {
+    std::ofstream json(jsonFileName.c_str());
+    if (!json.is_open()) {
+      std::cerr << "ERROR: failed to open " << jsonFileName << std::endl;
+      return 1;
+    }
+    writeJson(json, names, reports, seed, iterations, warmUp, loadIterations);
+    std::cout << "Wrote " << jsonFileName << std::endl;
+  }
+
+  return failed ? 1 : 0;
+}
@@ -9,6 +9,14 @@
 #include <central_node_engine.h>
 #include <central_node_firmware.h>
 #include <central_node_history.h>
+#include <central_node_postmortem.h>
+#include <central_node_archive.h>
+#include <central_node_frame_tap.h>
+#include <central_node_metrics.h>
+#include <cycle_counter.h>
+#ifndef FW_ENABLED
+#include <central_node_firmware_sim.h>
+#endif
 
 //#include <log.h>
 #include <log_wrapper.h>
@@ -21,13 +29,29 @@ class TestFailed {};
 
 static void usage(const char *nm) {
   std::cerr << "Usage: " << nm << " -f <file> -i <file>" << std::endl;
-  std::cerr << "       -f <file>   :  MPS database YAML file" << std::endl;
+  std::cerr << "       -f <file>   :  MPS database YAML file (or compiled image)" << std::endl;
 #ifdef FW_ENABLED
   std::cerr << "       -w <file>   :  central node firmware YAML config file" << std::endl;
+#else
+  std::cerr << "       -s <rate>   :  simulated firmware update rate in Hz (0: lock step with the engine)," << std::endl;
+  std::cerr << "                      default is to receive updates on UDP port CENTRAL_NODE_TEST_PORT" << std::endl;
+  std::cerr << "       -x <file>   :  simulated firmware scenario (implies -s " << FW_SIM_DEFAULT_RATE << ")" << std::endl;
 #endif
   std::cerr << "       -t          :  trace output" << std::endl;
   std::cerr << "       -c          :  clear firmware - disable MPS" << std::endl;
   std::cerr << "       -l <PC ID>  :  force linac power class" << std::endl;
+  std::cerr << "       -H <ver>    :  history protocol version (1 or 2, default 1)" << std::endl;
+  std::cerr << "       -j <file>   :  history journal file (memory-mapped ring)" << std::endl;
+  std::cerr << "       -R <n>      :  history chatter filter, summarize inputs with more than <n>" << std::endl;
+  std::cerr << "                      transitions per second (requires -H 2, default: disabled)" << std::endl;
+  std::cerr << "       -P <dir>    :  post-mortem dump directory (default /tmp)" << std::endl;
+  std::cerr << "       -A <dir>    :  archive all update frames to <dir>" << std::endl;
+  std::cerr << "       -T          :  publish update frames in shared memory (" << FRAME_TAP_DEFAULT_NAME << ")" << std::endl;
+  std::cerr << "       -M          :  publish statistics in shared memory (" << METRICS_DEFAULT_NAME << ")" << std::endl;
+  std::cerr << "       -S <n>      :  measure the update time of 1 in <n> inputs (default "
+            << CYCLE_DEFAULT_SAMPLING << ", 0 disables)" << std::endl;
+  std::cerr << "       -C <dir>    :  compiled database image cache, private to the engine user" << std::endl;
+  std::cerr << "                      (default: disabled, always parse the YAML)" << std::endl;
   std::cerr << "       -h          :  print this message" << std::endl;
 }
 
@@ -47,10 +71,20 @@ int main(int argc, char **argv) {
   bool trace = false;
   bool clear = false;
   uint32_t powerClassId = CLEAR_BEAM_CLASS;
+  uint32_t historyVersion = 1;
+  uint32_t chatterTransitions = 0;
+  std::string journalFileName = "";
+  std::string archiveDirectory = "";
+  bool frameTap = false;
+  bool metrics = false;
+#ifndef FW_ENABLED
+  int simulationRate = -1;
+  std::string scenarioFileName = "";
+#endif
 
   signal(SIGINT, intHandler);
 
-  for (int opt; (opt = getopt(argc, argv, "tvhf:w:cl:")) > 0;) {
+  for (int opt; (opt = getopt(argc, argv, "tvhf:w:cl:H:j:R:P:A:TMS:C:s:x:")) > 0;) {
     switch (opt) {
       //    case 'f': doc = YAML::LoadFile(optarg); break;
     case 'f' :
@@ -68,6 +102,41 @@ int main(int argc, char **argv) {
     case 'l':
       powerClassId = atoi(optarg);
       break;
+    case 'H':
+      historyVersion = atoi(optarg);
+      break;
+    case 'j':
+      journalFileName = optarg;
+      break;
+    case 'R':
+      chatterTransitions = atoi(optarg);
+      break;
+    case 'P':
+      PostMortem::getInstance().setDirectory(optarg);
+      break;
+    case 'A':
+      archiveDirectory = optarg;
+      break;
+    case 'T':
+      frameTap = true;
+      break;
+    case 'M':
+      metrics = true;
+      break;
+    case 'S':
+      CycleCounter::setSampling(atoi(optarg));
+      break;
+    case 'C':
+      MpsDb::setImageCacheDir(optarg);
+      break;
+#ifndef FW_ENABLED
+    case 's':
+      simulationRate = atoi(optarg);
+      break;
+    case 'x':
+      scenarioFileName = optarg;
+      break;
+#endif
     case 'h': usage(argv[0]); return 0;
     default:
       std::cerr << "Unknown option '" << opt << "'"  << std::endl;
@@ -113,6 +182,38 @@ int main(int argc, char **argv) {
 #endif
   }
 
+  try {
+    History::getInstance().setProtocolVersion(historyVersion);
+    if (chatterTransitions > 0) {
+      History::getInstance().setChatterFilter(chatterTransitions);
+    }
+    if (journalFileName != "") {
+      History::getInstance().openJournal(journalFileName);
+    }
+    if (archiveDirectory != "") {
+      FrameArchiver::getInstance().start(archiveDirectory);
+    }
+    if (frameTap) {
+      FrameTap::getInstance().open();
+    }
+    if (metrics) {
+      Metrics::getInstance().open();
+    }
+#ifndef FW_ENABLED
+    if (scenarioFileName != "") {
+      FirmwareSimulator::getInstance().loadScenario(scenarioFileName);
+      if (simulationRate < 0) {
+        simulationRate = FW_SIM_DEFAULT_RATE;
+      }
+    }
+    if (simulationRate >= 0) {
+      FirmwareSimulator::getInstance().start(simulationRate);
+    }
+#endif
+  } catch (CentralNodeException &ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
   History::getInstance().startSenderThread();
 
   //  sleep(5);
@@ -127,6 +228,16 @@ int main(int argc, char **argv) {
     return -1;
   }
 
+#ifndef FW_ENABLED
+  // The MPS is enabled by the IOC after the first load, do it here when
+  // the firmware is simulated
+  if (simulationRate >= 0) {
+    Firmware::getInstance().setEnable(true);
+    Firmware::getInstance().setSoftwareEnable(true);
+    Firmware::getInstance().clearAll();
+  }
+#endif
+
   if (powerClassId != CLEAR_BEAM_CLASS) {
     Engine::getInstance().getCurrentDb()->forceBeamDestination(1, powerClassId);
   }
@@ -58,10 +58,10 @@ public:
     try {
       for (uint32_t appId = 0; appId < numApps; ++appId) {
 	if (buffer == 0) {
-	  Firmware::getInstance()._configSV[appId]->setVal(appConfigWrite, APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES / 4);
+	  Firmware::getInstance().getConfigRegister(appId)->setVal(appConfigWrite, APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES / 4);
 	}
 	else {
-	  Firmware::getInstance()._configSV[appId]->setVal(appConfigWrite2, APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES / 4);
+	  Firmware::getInstance().getConfigRegister(appId)->setVal(appConfigWrite2, APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES / 4);
 	}
       }
     } catch (BadStatusError &e) {
@@ -74,7 +74,7 @@ public:
   int readFirmwareConfig(int buffer = 0) {
     for (uint32_t appId = 0; appId < numApps; ++appId) {
       try {
-	Firmware::getInstance()._configSV[appId]->getVal(&appConfigRead[0], APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES / 4);
+	Firmware::getInstance().getConfigRegister(appId)->getVal(&appConfigRead[0], APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES / 4);
       } catch (BadStatusError &e) {
 	std::cerr << "BadStatusError reading config... no good" <<std::endl;
 	return -1;
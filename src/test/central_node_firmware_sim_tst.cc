@@ -0,0 +1,418 @@
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <exception>
+#include <stdlib.h>
+
+#include <central_node_exception.h>
+#include <central_node_firmware.h>
+#include <central_node_firmware_sim.h>
+#ifndef FW_ENABLED
+#include <central_node_yaml.h>
+#include <central_node_database.h>
+#include <central_node_engine.h>
+#endif
+
+#include "central_node_test_util.h"
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-f <file>] [-v]" << std::endl;
+#ifndef FW_ENABLED
+  std::cerr << "       -f <file>   :  MPS database, also run the engine against the simulator" << std::endl;
+#endif
+  std::cerr << "       -v          :  verbose output" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+/**
+ * Checks of the simulated firmware (FirmwareSimulator). All checks use
+ * the same simulator, each one leaves the generator stopped.
+ */
+class FirmwareSimTest : public TestChecks {
+ public:
+  FirmwareSimTest(bool v) : TestChecks(v), sim(FirmwareSimulator::getInstance()) {
+  }
+
+  // Frames are only sent while the software is enabled
+  void enable(bool value) {
+    sim.setRegister(FwSimEnable, value);
+    sim.setRegister(FwSimSoftwareEnable, value);
+  }
+
+  // Read one update frame, returns the number of bytes read
+  uint64_t readFrame(uint8_t *frame) {
+    memset(frame, 0, FW_UPDATE_BUFFER_SIZE_BYTES);
+    return sim.readUpdate(frame, FW_UPDATE_BUFFER_SIZE_BYTES, 1000000);
+  }
+
+  static bool getBit(const uint8_t *frame, uint32_t appId, bool high, uint32_t bit) {
+    const uint8_t *inputs = frame + APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES +
+      appId * APPLICATION_UPDATE_BUFFER_INPUTS_SIZE_BYTES + (high ? FW_SIM_INPUT_BYTES : 0);
+    return (inputs[bit / 8] >> (bit % 8)) & 1;
+  }
+
+  static bool isSilent(const uint8_t *frame, uint32_t appId) {
+    const uint8_t *inputs = frame + APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES +
+      appId * APPLICATION_UPDATE_BUFFER_INPUTS_SIZE_BYTES;
+    for (uint32_t i = 0; i < APPLICATION_UPDATE_BUFFER_INPUTS_SIZE_BYTES; ++i) {
+      if (inputs[i] != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Discard the power class change messages, returns the last one
+  Firmware::pc_change_t drainPCChanges() {
+    Firmware::pc_change_t message;
+    Firmware::pc_change_t last;
+    memset(&last, 0, sizeof(last));
+    while (sim.readPCChange(reinterpret_cast<uint8_t *>(&message), sizeof(message), 1000) > 0) {
+      last = message;
+    }
+    return last;
+  }
+
+  void testConfigBanks() {
+    std::vector<uint8_t> write(APPLICATION_CONFIG_BUFFER_SIZE_BYTES);
+    std::vector<uint8_t> read(APPLICATION_CONFIG_BUFFER_SIZE_BYTES);
+    for (uint32_t i = 0; i < write.size(); ++i) {
+      write[i] = random();
+    }
+
+    uint32_t switches = sim.getConfigSwitches();
+    sim.writeConfig(3, &write[0], write.size());
+    check(sim.getPendingConfigCount() == 1, "config write is pending until switchConfig");
+    sim.readConfig(3, &read[0], read.size(), true);
+    check(read != write, "config write goes to the staged bank");
+    sim.readConfig(3, &read[0], read.size(), false);
+    check(read == write, "staged bank holds the new config");
+
+    sim.switchConfig();
+    check(sim.getConfigSwitches() == switches + 1 && sim.getPendingConfigCount() == 0,
+          "switchConfig clears the pending configs");
+    sim.readConfig(3, &read[0], read.size(), true);
+    check(read == write, "switchConfig makes the new config active");
+    sim.readConfig(3, &read[0], read.size(), false);
+    check(read == write, "switchConfig copies the active config to the staged bank");
+
+    std::vector<uint8_t> previous(write);
+    write[0] ^= 0xFF;
+    sim.writeConfig(3, &write[0], write.size());
+    sim.readConfig(3, &read[0], read.size(), true);
+    check(read == previous, "active config unchanged until the next switchConfig");
+    sim.switchConfig();
+    sim.readConfig(3, &read[0], read.size(), true);
+    check(read == write, "second switchConfig activates the second config");
+  }
+
+  void testInputsAndTimeouts() {
+    uint8_t frame[FW_UPDATE_BUFFER_SIZE_BYTES];
+    ApplicationBitMaskSet mask;
+    ApplicationBitMaskSet status;
+
+    mask.set(5);
+    mask.set(6);
+    sim.writeTimeoutMask(mask);
+    sim.setAppSilent(5, true);
+    sim.setAppSilent(7, true);
+    sim.setInput(6, 10, true);
+
+    enable(true);
+    sim.start(0);
+    check(readFrame(frame) == FW_UPDATE_BUFFER_SIZE_BYTES, "frame generated in lock step");
+    uint64_t timestamp;
+    memcpy(&timestamp, frame + APPLICATION_UPDATE_BUFFER_HEADER_ZEROES_SIZE_BYTES, sizeof(timestamp));
+    check(timestamp != 0, "frame has a timestamp");
+    check(isSilent(frame, 5) && isSilent(frame, 7), "silent applications send no bits");
+    check(getBit(frame, 6, true, 10) && !getBit(frame, 6, false, 10), "input set sends wasHigh");
+    check(!getBit(frame, 6, true, 11) && getBit(frame, 6, false, 11), "input clear sends wasLow");
+
+    sim.readTimeoutStatus(status);
+    check(status[5] && !status[6], "silent application with timeout enabled latches its error");
+    check(!status[7], "silent application with timeout disabled has no error");
+
+    sim.setAppSilent(5, false);
+    readFrame(frame);
+    sim.readTimeoutStatus(status);
+    check(status[5], "timeout error stays latched");
+    sim.toErrClear();
+    readFrame(frame);
+    sim.readTimeoutStatus(status);
+    check(status.none(), "toErrClear clears the timeout errors");
+    sim.stop();
+    enable(false);
+
+    sim.setAppSilent(7, false);
+    sim.setInput(6, 10, false);
+    sim.writeTimeoutMask(ApplicationBitMaskSet());
+  }
+
+  void testMitigation() {
+    uint32_t mitigation[2];
+    uint32_t write[2];
+
+    enable(true);
+    sim.swErrClear();
+    drainPCChanges();
+
+    // Register order: destinations 0-7 in the second word
+    write[0] = 0xFFFFFFFF;
+    write[1] = 0xFFFFFF43;
+    sim.writeMitigation(write);
+    sim.getMitigation(mitigation);
+    check(mitigation[0] == 0xFFFFFF43 && mitigation[1] == 0xFFFFFFFF,
+          "final mitigation is the software mitigation");
+
+    Firmware::pc_change_t message = drainPCChanges();
+    check(message.tag != 0 && (message.powerClass & 0xFF) == 0x43,
+          "power class change message sent");
+    check(message.flags == Firmware::PcChangePacketFlagsMask, "power class change flags without errors");
+
+    sim.writeMitigation(write);
+    check(sim.readPCChange(reinterpret_cast<uint8_t *>(&message), sizeof(message), 1000) == 0,
+          "no message without power class change");
+
+    // Software class was 0 before the first write
+    sim.evalLatchClear();
+    sim.setFirmwareClass(2, 1);
+    sim.getMitigation(mitigation);
+    check(((mitigation[0] >> 8) & 0xF) == 1, "firmware class limits the final mitigation");
+    sim.setFirmwareClass(2, FW_NUM_BEAM_CLASSES - 1);
+    sim.getLatchedMitigation(mitigation);
+    check(((mitigation[0] >> 8) & 0xF) == 1, "latched mitigation keeps the lowest class");
+    sim.evalLatchClear();
+    sim.getLatchedMitigation(mitigation);
+    check(((mitigation[0] >> 8) & 0xF) == 0xF, "evalLatchClear resets the latched mitigation");
+
+    sim.setRegister(FwSimEnable, false);
+    message = drainPCChanges();
+    check(!(message.flags & (1 << 14)), "disabled MPS reported in the power class change flags");
+    sim.getMitigation(mitigation);
+    check(mitigation[0] == 0xFFFFFFFF, "software mitigation ignored when the MPS is disabled");
+  }
+
+  void testSoftwareLoss() {
+    uint8_t frame[FW_UPDATE_BUFFER_SIZE_BYTES];
+    uint32_t mitigation[2] = { 0xFFFFFFFF, 0xFFFFFFFF };
+
+    enable(true);
+    sim.setWatchdogTime(200000);
+    sim.swErrClear();
+    drainPCChanges();
+
+    // Engine loop: read the frame, write the mitigation, heartbeat
+    uint32_t lossCount = sim.getSoftwareLossCount();
+    sim.start(0);
+    for (uint32_t i = 0; i < 20; ++i) {
+      readFrame(frame);
+      sim.writeMitigation(mitigation);
+      sim.heartbeat();
+    }
+    sim.stop();
+    check(sim.getSoftwareLossCount() == lossCount && !sim.getSoftwareLossError(),
+          "no software loss when the mitigation is written each frame");
+    check(!sim.getWatchdogError(), "no watchdog error with a heartbeat each frame");
+
+    // Mitigation not written
+    sim.start(1000);
+    usleep(50000);
+    sim.stop();
+    check(sim.getSoftwareLossCount() > lossCount && sim.getSoftwareLossError(),
+          "software loss when the mitigation is not written");
+    sim.getMitigation(mitigation);
+    check(mitigation[0] == 0 && mitigation[1] == 0, "software loss forces power class 0");
+    Firmware::pc_change_t message = drainPCChanges();
+    check(!(message.flags & (1 << 13)), "software error reported in the power class change flags");
+    check(!sim.getWatchdogError(), "no watchdog error within the watchdog time");
+
+    // No heartbeat
+    uint32_t wdErrors = sim.getWatchdogErrorCount();
+    usleep(200000);
+    sim.start(1000);
+    usleep(20000);
+    sim.stop();
+    check(sim.getWatchdogError() && sim.getWatchdogErrorCount() == wdErrors + 1,
+          "watchdog error when the heartbeat stops");
+
+    sim.swErrClear();
+    check(!sim.getWatchdogError() && !sim.getSoftwareLossError(), "swErrClear clears the software errors");
+    sim.getMitigation(mitigation);
+    check(mitigation[0] != 0, "power class restored after swErrClear");
+
+    enable(false);
+    sim.setWatchdogTime(FW_SIM_DEFAULT_WD_TIME);
+  }
+
+  void testRate() {
+    uint64_t sent = sim.getFramesSent();
+    enable(true);
+    sim.start(FW_SIM_DEFAULT_RATE);
+    usleep(500000);
+    sim.stop();
+    enable(false);
+    sent = sim.getFramesSent() - sent;
+    if (verbose) {
+      std::cout << "INFO: " << sent << " frames generated in 0.5 s at "
+                << FW_SIM_DEFAULT_RATE << " Hz" << std::endl;
+    }
+    check(sent > FW_SIM_DEFAULT_RATE / 2 * 0.8 && sent < FW_SIM_DEFAULT_RATE / 2 * 1.2,
+          "frame generator rate");
+    check(sim.getFramesDropped() > 0, "unread frames are dropped");
+  }
+
+  void testScenario() {
+    uint8_t frame[FW_UPDATE_BUFFER_SIZE_BYTES];
+    std::string fileName = "/tmp/central_node_firmware_sim_tst.txt";
+
+    std::ofstream bad(fileName.c_str());
+    bad << "0 input 2000 0 1" << std::endl;
+    bad.close();
+    bool thrown = false;
+    try {
+      sim.loadScenario(fileName);
+    } catch (CentralNodeException &ex) {
+      thrown = true;
+    }
+    check(thrown, "invalid scenario step rejected");
+
+    std::ofstream file(fileName.c_str());
+    file << "# Scenario test" << std::endl;
+    file << "3 input 9 0 0   # cleared after the stall" << std::endl;
+    file << "0 input 9 0 1" << std::endl;
+    file << "1 stall 2" << std::endl;
+    file << "4 silent 9 1" << std::endl;
+    file.close();
+    try {
+      sim.loadScenario(fileName);
+    } catch (CentralNodeException &ex) {
+      std::cerr << ex.what() << std::endl;
+    }
+    unlink(fileName.c_str());
+
+    enable(true);
+    sim.start(0);
+    readFrame(frame);
+    check(getBit(frame, 9, true, 0), "scenario step applied at frame 0");
+    readFrame(frame);
+    check(!getBit(frame, 9, true, 0) && !isSilent(frame, 9), "frames 1 and 2 not sent (stall)");
+    readFrame(frame);
+    check(isSilent(frame, 9), "scenario step applied at frame 4");
+    sim.stop();
+    enable(false);
+
+    sim.clearScenario();
+    sim.setAppSilent(9, false);
+  }
+
+#ifndef FW_ENABLED
+  /**
+   * Run the engine with the simulator: load, application timeouts (read
+   * by the bypass thread) and full reload
+   */
+  void testEngine(std::string mpsFileName) {
+    sim.start(FW_SIM_DEFAULT_RATE);
+    try {
+      if (Engine::getInstance().loadConfig(mpsFileName) != 0) {
+        check(false, "engine loads the database");
+        return;
+      }
+    } catch (CentralNodeException &ex) {
+      std::cerr << ex.what() << std::endl;
+      check(false, "engine loads the database");
+      return;
+    }
+
+    sleep(1);
+    check(sim.getConfigSwitches() > 0, "engine writes the firmware configuration");
+    check(!Firmware::getInstance().getEnable(), "MPS left disabled after the first load");
+
+    // Enable the MPS, as done by the IOC
+    uint32_t writes = sim.getMitigationWrites();
+    Firmware::getInstance().setEnable(true);
+    Firmware::getInstance().setSoftwareEnable(true);
+    Firmware::getInstance().evalLatchClear();
+    Firmware::getInstance().swErrClear();
+    // The engine threads may take a while to pick up the first frames
+    for (uint32_t i = 0; i < 50 && sim.getMitigationWrites() == writes; ++i) {
+      usleep(100000);
+    }
+    check(Engine::getInstance().getUpdateCounter() > 0, "engine evaluates the simulated updates");
+    check(sim.getMitigationWrites() > writes, "engine writes the mitigation");
+
+    uint32_t appId = FW_NUM_APPLICATIONS;
+    MpsDbPtr db = Engine::getInstance().getCurrentDb();
+    for (DbApplicationCardMap::iterator card = db->applicationCards->begin();
+         card != db->applicationCards->end(); ++card) {
+      if (Firmware::getInstance().getAppTimeoutEnable((*card).second->globalId)) {
+        appId = (*card).second->globalId;
+        break;
+      }
+    }
+    if (appId < FW_NUM_APPLICATIONS) {
+      sim.setAppSilent(appId, true);
+      sleep(2);
+      check(Firmware::getInstance().getAppTimeoutStatus(appId), "engine sees the application timeout");
+      sim.setAppSilent(appId, false);
+    }
+
+    uint32_t switches = sim.getConfigSwitches();
+    Engine::getInstance().reloadConfig();
+    check(sim.getConfigSwitches() == switches + 1, "engine reload switches the configuration");
+
+    if (verbose) {
+      std::cout << &sim;
+    }
+  }
+#endif
+
+  FirmwareSimulator &sim;
+};
+
+int main(int argc, char **argv) {
+  std::string mpsFileName = "";
+  bool verbose = false;
+
+  for (int opt; (opt = getopt(argc, argv, "vhf:")) > 0;) {
+    switch (opt) {
+    case 'f':
+      mpsFileName = optarg;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  FirmwareSimTest t(verbose);
+  t.testConfigBanks();
+  t.testInputsAndTimeouts();
+  t.testMitigation();
+  t.testSoftwareLoss();
+  t.testRate();
+  t.testScenario();
+#ifndef FW_ENABLED
+  if (mpsFileName != "") {
+    t.testEngine(mpsFileName);
+  }
+#endif
+
+  int result = t.getResult();
+
+  // The engine threads can't be stopped (the mitigation writer waits on
+  // its queue), leave without the static destructors
+  if (mpsFileName != "") {
+    std::cout << std::flush;
+    _exit(result);
+  }
+
+  return result;
+}
@@ -68,7 +68,7 @@ public:
 
     for (uint32_t appId = 0; appId < 2; ++appId) {
       try {
-	Firmware::getInstance()._configSV[0]->getVal(&appFwConfig[appId], APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES / 4);
+	Firmware::getInstance().getConfigRegister(0)->getVal(&appFwConfig[appId], APPLICATION_CONFIG_BUFFER_USED_SIZE_BYTES / 4);
       } catch (BadStatusError &e) {
 	std::cerr << "BadStatusError reading config... no good" <<std::endl;
 	return -1;
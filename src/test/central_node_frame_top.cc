@@ -0,0 +1,151 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <central_node_database_defs.h>
+#include <central_node_frame_tap.h>
+#include <central_node_exception.h>
+
+/**
+ * Follows the engine frame tap and prints the inputs with the most bit
+ * transitions in each interval. Each application has
+ * APPLICATION_UPDATE_BUFFER_INPUTS_SIZE bits after the frame header, the
+ * first half are the 'was low' bits, the second half the 'was high' bits.
+ */
+static const uint32_t HALF_BITS = APPLICATION_UPDATE_BUFFER_INPUTS_SIZE / 2;
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-n <name>] [-i <sec>] [-t <count>] [-c <count>]" << std::endl;
+  std::cerr << "Shows the most active firmware inputs from the engine frame tap" << std::endl;
+  std::cerr << "       -n <name>   :  shared memory name (default " << FRAME_TAP_DEFAULT_NAME << ")" << std::endl;
+  std::cerr << "       -i <sec>    :  report interval (default 1)" << std::endl;
+  std::cerr << "       -t <count>  :  number of inputs listed (default 10)" << std::endl;
+  std::cerr << "       -c <count>  :  stop after <count> reports (default: run forever)" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static bool compareCount(const std::pair<uint32_t, uint32_t> &a,
+			 const std::pair<uint32_t, uint32_t> &b) {
+  return a.first > b.first;
+}
+
+int main(int argc, char **argv) {
+  std::string name = FRAME_TAP_DEFAULT_NAME;
+  double interval = 1;
+  uint32_t top = 10;
+  uint32_t reports = 0;
+
+  for (int opt; (opt = getopt(argc, argv, "n:i:t:c:h")) > 0;) {
+    switch (opt) {
+    case 'n':
+      name = optarg;
+      break;
+    case 'i':
+      interval = atof(optarg);
+      break;
+    case 't':
+      top = atoi(optarg);
+      break;
+    case 'c':
+      reports = atoi(optarg);
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  FrameTapReader reader;
+  try {
+    reader.open(name);
+  } catch (CentralNodeException &ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
+
+  uint32_t frameSize = reader.getFrameSize();
+  if (frameSize <= APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES) {
+    std::cerr << "ERROR: Unexpected frame size " << frameSize << std::endl;
+    return 1;
+  }
+  uint32_t bits = (frameSize - APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES) * 8;
+
+  std::vector<uint32_t> transitions(bits, 0);
+  std::vector<uint8_t> previous;
+  FrameTapFrame frame;
+  uint64_t lost = 0;
+  uint64_t totalLost = 0;
+  uint64_t frames = 0;
+  double start = now();
+
+  for (uint32_t report = 0; reports == 0 || report < reports;) {
+    uint64_t l;
+    if (reader.next(frame, l)) {
+      totalLost += l;
+      if (l > 0 || previous.empty()) {
+	// Transitions across lost frames are unknown, restart from this one
+	previous = frame.data;
+	lost += l;
+	continue;
+      }
+      for (uint32_t byte = APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES; byte < frameSize; ++byte) {
+	uint8_t changed = frame.data[byte] ^ previous[byte];
+	for (uint32_t bit = 0; changed != 0; ++bit, changed >>= 1) {
+	  if (changed & 1) {
+	    transitions[(byte - APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES) * 8 + bit]++;
+	  }
+	}
+      }
+      previous.swap(frame.data);
+      frames++;
+    }
+    else {
+      usleep(500);
+    }
+
+    double t = now();
+    if (t - start < interval) {
+      continue;
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t> > counts;
+    for (uint32_t i = 0; i < bits; ++i) {
+      if (transitions[i] > 0) {
+	counts.push_back(std::make_pair(transitions[i], i));
+      }
+    }
+    uint32_t shown = std::min<size_t>(top, counts.size());
+    std::partial_sort(counts.begin(), counts.begin() + shown, counts.end(), compareCount);
+
+    std::cout << "=== " << frames << " frames in " << std::fixed << std::setprecision(1)
+	      << t - start << " s, " << lost << " lost (" << totalLost << " total), "
+	      << counts.size() << " active bits ===" << std::endl;
+    std::cout << "   App   Bit  Type  Transitions" << std::endl;
+    for (uint32_t i = 0; i < shown; ++i) {
+      uint32_t app = counts[i].second / APPLICATION_UPDATE_BUFFER_INPUTS_SIZE;
+      uint32_t bit = counts[i].second % APPLICATION_UPDATE_BUFFER_INPUTS_SIZE;
+      std::cout << std::setw(6) << app << std::setw(6) << bit % HALF_BITS
+		<< (bit < HALF_BITS ? "  low " : "  high") << std::setw(13)
+		<< counts[i].first << std::endl;
+    }
+
+    std::fill(transitions.begin(), transitions.end(), 0);
+    frames = 0;
+    lost = 0;
+    start = t;
+    report++;
+  }
+
+  return 0;
+}
@@ -0,0 +1,258 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <central_node_history.h>
+#include "central_node_history_decoder.h"
+
+/**
+ * Throughput benchmark of the history protocols: sends the same synthetic
+ * fault storm over loopback with protocol v1 (one message per datagram)
+ * and v2 (packed events), decodes it with the reference decoder and checks
+ * the received events against the sent ones.
+ */
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-n <events>] [-e <events/datagram>]" << std::endl;
+  std::cerr << "       -n <events> :  number of events (default 1000000)" << std::endl;
+  std::cerr << "       -e <events> :  v2 events per datagram (default "
+	    << HIST_V2_DEFAULT_EVENTS << ")" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+class TestFailed {};
+
+struct Result {
+  double seconds;
+  uint32_t datagrams;
+  uint64_t bytes;
+  uint32_t received;
+  uint32_t lost;
+  uint32_t mismatches;
+};
+
+/**
+ * Fault storm: a few hundred inputs changing every cycle, ids mostly
+ * increasing within a cycle, one firmware update every 1/360 s.
+ */
+static void generate(std::vector<HistoryEvent> &events, uint32_t count) {
+  uint64_t timestamp = 1000000000ULL;
+  uint64_t cycle = 0;
+  uint32_t id = 0;
+
+  events.resize(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (i % 300 == 0) {
+      cycle++;
+      timestamp += 2777778;
+      id = 100 + rand() % 50;
+    }
+    id += 1 + rand() % 8;
+    events[i].message.type = (i % 10 == 0) ? FaultStateType : DeviceInputType;
+    events[i].message.id = id;
+    events[i].message.oldValue = i & 1;
+    events[i].message.newValue = (i + 1) & 1;
+    events[i].message.aux = (i % 10 == 0) ? rand() % 4 : 0;
+    events[i].timestamp = timestamp;
+    events[i].cycle = cycle;
+  }
+}
+
+static bool sameEvent(const HistoryEvent &a, const HistoryEvent &b, bool stamped) {
+  return a.message.type == b.message.type &&
+    a.message.id == b.message.id &&
+    a.message.oldValue == b.message.oldValue &&
+    a.message.newValue == b.message.newValue &&
+    a.message.aux == b.message.aux &&
+    (!stamped || (a.timestamp == b.timestamp && a.cycle == b.cycle));
+}
+
+static Result run(uint32_t version, const std::vector<HistoryEvent> &events, uint32_t eventsPerDatagram) {
+  Result result = {0, 0, 0, 0, 0, 0};
+
+  int rxSock = socket(AF_INET, SOCK_DGRAM, 0);
+  int txSock = socket(AF_INET, SOCK_DGRAM, 0);
+  int rcvbuf = 64 * 1024 * 1024;
+  setsockopt(rxSock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  struct sockaddr_in addr;
+  socklen_t addrLen = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (bind(rxSock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+    perror("bind");
+    throw TestFailed();
+  }
+  getsockname(rxSock, reinterpret_cast<struct sockaddr *>(&addr), &addrLen);
+
+  struct timeval timeout = {0, 200000};
+  setsockopt(rxSock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  std::atomic<bool> sending(true);
+  HistoryDecoder decoder;
+  std::vector<HistoryEvent> received;
+  received.reserve(events.size());
+
+  std::thread receiver([&]() {
+      uint8_t buffer[HIST_V2_MAX_DATAGRAM_SIZE];
+      while (true) {
+	ssize_t n = recv(rxSock, buffer, sizeof(buffer), 0);
+	if (n < 0) {
+	  if (!sending) {
+	    break;
+	  }
+	  continue;
+	}
+	decoder.decode(buffer, n, received);
+      }
+    });
+
+  std::vector<uint8_t> datagramBuffer(HIST_SEND_BATCH_SIZE * HIST_V2_MAX_DATAGRAM_SIZE);
+  Message messages[HIST_SEND_BATCH_SIZE];
+  struct iovec vectors[HIST_SEND_BATCH_SIZE];
+  struct mmsghdr headers[HIST_SEND_BATCH_SIZE];
+  uint32_t sequence = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  uint32_t done = 0;
+  while (done < events.size()) {
+    uint32_t datagrams = 0;
+    if (version == HIST_V2_VERSION) {
+      // Same batching as History::send(), events are packed until the
+      // batch of datagrams is full
+      while (done < events.size() && datagrams < HIST_SEND_BATCH_SIZE) {
+	uint8_t *buffer = &datagramBuffer[datagrams * HIST_V2_MAX_DATAGRAM_SIZE];
+	uint32_t encoded;
+	vectors[datagrams].iov_base = buffer;
+	vectors[datagrams].iov_len = History::encodeV2(buffer, HIST_V2_MAX_DATAGRAM_SIZE, sequence++,
+						       &events[done], events.size() - done,
+						       eventsPerDatagram, encoded);
+	done += encoded;
+	datagrams++;
+      }
+    }
+    else {
+      while (done < events.size() && datagrams < HIST_SEND_BATCH_SIZE) {
+	messages[datagrams] = events[done++].message;
+	vectors[datagrams].iov_base = &messages[datagrams];
+	vectors[datagrams].iov_len = sizeof(Message);
+	datagrams++;
+      }
+    }
+
+    memset(headers, 0, sizeof(headers));
+    for (uint32_t i = 0; i < datagrams; ++i) {
+      headers[i].msg_hdr.msg_name = &addr;
+      headers[i].msg_hdr.msg_namelen = sizeof(addr);
+      headers[i].msg_hdr.msg_iov = &vectors[i];
+      headers[i].msg_hdr.msg_iovlen = 1;
+      result.bytes += vectors[i].iov_len;
+    }
+
+    uint32_t sent = 0;
+    while (sent < datagrams) {
+      int n = sendmmsg(txSock, &headers[sent], datagrams - sent, 0);
+      if (n <= 0) {
+	perror("sendmmsg");
+	throw TestFailed();
+      }
+      sent += n;
+    }
+    result.datagrams += datagrams;
+  }
+
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  sending = false;
+  receiver.join();
+  close(rxSock);
+  close(txSock);
+
+  result.received = received.size();
+  result.lost = decoder.lost;
+  if (decoder.errors > 0) {
+    std::cerr << "ERROR: " << decoder.errors << " malformed datagrams" << std::endl;
+    throw TestFailed();
+  }
+
+  // Loopback may drop datagrams under load, only compare when all arrived
+  if (received.size() == events.size()) {
+    for (uint32_t i = 0; i < events.size(); ++i) {
+      if (!sameEvent(events[i], received[i], version == HIST_V2_VERSION)) {
+	result.mismatches++;
+      }
+    }
+  }
+
+  return result;
+}
+
+static void print(const char *name, const Result &result, uint32_t count) {
+  std::cout << std::setw(4) << name
+	    << std::fixed << std::setprecision(0)
+	    << std::setw(14) << count / result.seconds
+	    << std::setw(12) << result.datagrams
+	    << std::setw(14) << result.bytes
+	    << std::setprecision(2)
+	    << std::setw(14) << static_cast<double>(result.bytes) / count
+	    << std::setw(12) << result.received << std::endl;
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = 1000000;
+  uint32_t eventsPerDatagram = HIST_V2_DEFAULT_EVENTS;
+
+  for (int opt; (opt = getopt(argc, argv, "n:e:h")) > 0;) {
+    switch (opt) {
+    case 'n':
+      count = atoi(optarg);
+      break;
+    case 'e':
+      eventsPerDatagram = atoi(optarg);
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<HistoryEvent> events;
+  generate(events, count);
+
+  try {
+    Result v1 = run(1, events, eventsPerDatagram);
+    Result v2 = run(HIST_V2_VERSION, events, eventsPerDatagram);
+
+    std::cout << "   " << std::setw(15) << "events/s"
+	      << std::setw(12) << "datagrams"
+	      << std::setw(14) << "bytes"
+	      << std::setw(14) << "bytes/event"
+	      << std::setw(12) << "received" << std::endl;
+    print("v1", v1, count);
+    print("v2", v2, count);
+    std::cout << "v2 lost datagrams: " << v2.lost << std::endl;
+
+    if (v1.mismatches > 0 || v2.mismatches > 0) {
+      std::cerr << "ERROR: decoded events differ from sent events (v1: "
+		<< v1.mismatches << ", v2: " << v2.mismatches << ")" << std::endl;
+      throw TestFailed();
+    }
+  } catch (TestFailed &) {
+    std::cerr << "FAILED" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "central_node_history_decoder.h"
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-p <port>] [-q]" << std::endl;
+  std::cerr << "Receives and prints MPS history messages (protocol v1 and v2)" << std::endl;
+  std::cerr << "       -p <port>   :  UDP port (default 3356)" << std::endl;
+  std::cerr << "       -q          :  quiet, print only the statistics on exit" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+static bool done = false;
+
+void intHandler(int) {
+  done = true;
+}
+
+int main(int argc, char **argv) {
+  int port = 3356;
+  bool quiet = false;
+
+  for (int opt; (opt = getopt(argc, argv, "p:qh")) > 0;) {
+    switch (opt) {
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'q':
+      quiet = true;
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    perror("socket");
+    return 1;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+    perror("bind");
+    return 1;
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = intHandler;
+  sigaction(SIGINT, &sa, NULL);
+
+  HistoryDecoder decoder;
+  std::vector<HistoryEvent> events;
+  uint8_t buffer[HIST_V2_MAX_DATAGRAM_SIZE];
+
+  while (!done) {
+    ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      continue; // Interrupted
+    }
+
+    events.clear();
+    if (!decoder.decode(buffer, n, events)) {
+      std::cerr << "ERROR: malformed datagram (" << n << " bytes)" << std::endl;
+    }
+
+    if (!quiet) {
+      for (std::vector<HistoryEvent>::iterator it = events.begin(); it != events.end(); ++it) {
+	std::cout << "cycle=" << it->cycle
+		  << " ts=" << it->timestamp
+		  << " type=" << it->message.type
+		  << " id=" << it->message.id
+		  << " old=" << it->message.oldValue
+		  << " new=" << it->message.newValue
+		  << " aux=" << it->message.aux << std::endl;
+      }
+    }
+  }
+
+  std::cout << "Datagrams: " << decoder.datagrams
+	    << ", events: " << decoder.events
+	    << ", lost datagrams: " << decoder.lost
+	    << ", errors: " << decoder.errors << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef CENTRAL_NODE_HISTORY_DECODER_H
+#define CENTRAL_NODE_HISTORY_DECODER_H
+
+/**
+ * Reference decoder for the MPS history datagrams (protocol v1 and v2, see
+ * central_node_history_protocol.h). Written independently from the
+ * encoder in History so it can be used to check it, and as an example for
+ * the history server.
+ */
+
+#include <central_node_history_protocol.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+class HistoryDecoder {
+ private:
+  bool first;
+  uint32_t expectedSequence;
+
+  static bool getVarint(const uint8_t *&data, const uint8_t *end, uint64_t &value) {
+    value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+      if (data >= end) {
+	return false;
+      }
+      uint8_t byte = *data++;
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  static int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+
+ public:
+  uint32_t datagrams;
+  uint32_t events;
+  uint32_t lost;       // Datagrams missing from the v2 sequence
+  uint32_t errors;     // Malformed datagrams
+
+  HistoryDecoder() : first(true), expectedSequence(0),
+    datagrams(0), events(0), lost(0), errors(0) {}
+
+  /**
+   * Decode one datagram, the events are appended to 'decoded'. v1
+   * datagrams have no timestamp/cycle, they are returned as zero. Returns
+   * false if the datagram is malformed.
+   */
+  bool decode(const uint8_t *data, uint32_t size, std::vector<HistoryEvent> &decoded) {
+    datagrams++;
+
+    if (size == sizeof(Message)) {
+      HistoryEvent event;
+      memcpy(&event.message, data, sizeof(Message));
+      event.timestamp = 0;
+      event.cycle = 0;
+      decoded.push_back(event);
+      events++;
+      return true;
+    }
+
+    HistoryHeaderV2 header;
+    if (size < sizeof(header)) {
+      errors++;
+      return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != HIST_V2_MAGIC || header.version != HIST_V2_VERSION) {
+      errors++;
+      return false;
+    }
+
+    if (!first && header.sequence != expectedSequence) {
+      lost += header.sequence - expectedSequence;
+    }
+    first = false;
+    expectedSequence = header.sequence + 1;
+
+    const uint8_t *p = data + sizeof(header);
+    const uint8_t *end = data + size;
+    int64_t id = 0;
+    for (uint32_t i = 0; i < header.count; ++i) {
+      uint64_t type, idDelta, oldValue, newValue, aux, timestampDelta, cycleDelta;
+      if (p >= end) {
+	errors++;
+	return false;
+      }
+      type = *p++;
+      if (!getVarint(p, end, idDelta) ||
+	  !getVarint(p, end, oldValue) ||
+	  !getVarint(p, end, newValue) ||
+	  !getVarint(p, end, aux) ||
+	  !getVarint(p, end, timestampDelta) ||
+	  !getVarint(p, end, cycleDelta)) {
+	errors++;
+	return false;
+      }
+
+      id += unzigzag(idDelta);
+
+      HistoryEvent event;
+      event.message.type = static_cast<HistoryMessageType>(type);
+      event.message.id = id;
+      event.message.oldValue = oldValue;
+      event.message.newValue = newValue;
+      event.message.aux = aux;
+      event.timestamp = header.timestamp + unzigzag(timestampDelta);
+      event.cycle = header.cycle + unzigzag(cycleDelta);
+      decoded.push_back(event);
+      events++;
+    }
+
+    if (p != end) {
+      errors++;
+      return false;
+    }
+
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <central_node_history_journal.h>
+#include <central_node_exception.h>
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " -f <file> [-n <events>]" << std::endl;
+  std::cerr << "Prints the events in an MPS history journal, oldest first" << std::endl;
+  std::cerr << "       -f <file>   :  journal file" << std::endl;
+  std::cerr << "       -n <events> :  print only the last <events> events" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string fileName = "";
+  uint64_t last = 0;
+
+  for (int opt; (opt = getopt(argc, argv, "f:n:h")) > 0;) {
+    switch (opt) {
+    case 'f':
+      fileName = optarg;
+      break;
+    case 'n':
+      last = strtoull(optarg, NULL, 0);
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (fileName == "") {
+    std::cerr << "Missing -f option" << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+
+  HistoryJournal journal;
+  std::vector<HistoryEvent> events;
+  std::vector<uint64_t> sequences;
+
+  try {
+    journal.openReadOnly(fileName);
+    journal.getEvents(events, sequences);
+  } catch (CentralNodeException &ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << "Journal: " << fileName << std::endl;
+  std::cout << "Capacity: " << journal.getCapacity() << " events" << std::endl;
+  std::cout << "Written: " << journal.getWritePosition() << " events" << std::endl;
+  std::cout << "Valid: " << events.size() << " events" << std::endl;
+
+  size_t first = 0;
+  if (last > 0 && last < events.size()) {
+    first = events.size() - last;
+  }
+
+  uint64_t missing = 0;
+  for (size_t i = first; i < events.size(); ++i) {
+    if (i > first && sequences[i] != sequences[i - 1] + 1) {
+      std::cout << "--- " << sequences[i] - sequences[i - 1] - 1 << " events missing ---" << std::endl;
+      missing += sequences[i] - sequences[i - 1] - 1;
+    }
+    std::cout << sequences[i]
+	      << ": cycle=" << events[i].cycle
+	      << " ts=" << events[i].timestamp
+	      << " type=" << events[i].message.type
+	      << " id=" << events[i].message.id
+	      << " old=" << events[i].message.oldValue
+	      << " new=" << events[i].message.newValue
+	      << " aux=" << events[i].message.aux << std::endl;
+  }
+
+  if (missing > 0) {
+    std::cout << "Missing: " << missing << " events" << std::endl;
+  }
+
+  return 0;
+}
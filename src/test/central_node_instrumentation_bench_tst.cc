@@ -0,0 +1,127 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <cycle_counter.h>
+#include <time_util.h>
+#include "timer.h"
+
+/**
+ * Measures the cost of the cycle instrumentation itself: the time stamp
+ * sources, the stage timers (Timer), the per-card aggregates (CycleStat)
+ * and the sampled per-input measurement, compared with the TimeAverage
+ * calls previously made for every input.
+ */
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-n <iterations>]" << std::endl;
+  std::cerr << "       -n <iterations> :  calls per measurement (default 1000000)" << std::endl;
+  std::cerr << "       -h              :  print this message" << std::endl;
+}
+
+static volatile uint64_t sink;
+
+static double elapsedNs(struct timespec &start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+static void report(const char *name, double ns, uint32_t iterations) {
+  std::cout << std::left << std::setw(40) << name << std::right << std::setw(10)
+	    << std::fixed << std::setprecision(2) << ns / iterations << " ns" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 1000000;
+
+  for (int opt; (opt = getopt(argc, argv, "n:h")) > 0;) {
+    switch (opt) {
+    case 'n':
+      iterations = atoi(optarg);
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::cout << "Time base: " << (CycleCounter::usingTsc() ? "TSC" : "CLOCK_MONOTONIC")
+	    << ", " << CycleCounter::getTicksPerNs() << " ticks/ns" << std::endl;
+
+  struct timespec start;
+  uint64_t v = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint32_t i = 0; i < iterations; ++i)
+    v += CycleCounter::now();
+  sink = v;
+  report("CycleCounter::now()", elapsedNs(start), iterations);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint32_t i = 0; i < iterations; ++i) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    v += t.tv_nsec;
+  }
+  sink = v;
+  report("clock_gettime(CLOCK_MONOTONIC)", elapsedNs(start), iterations);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint32_t i = 0; i < iterations; ++i)
+    v += std::chrono::high_resolution_clock::now().time_since_epoch().count();
+  sink = v;
+  report("high_resolution_clock::now()", elapsedNs(start), iterations);
+
+  TimeAverage timeAverage(5, "TimeAverage");
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint32_t i = 0; i < iterations; ++i) {
+    timeAverage.start();
+    timeAverage.end();
+  }
+  report("TimeAverage start()/end()", elapsedNs(start), iterations);
+
+  Timer<double> timer("Timer", 720);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint32_t i = 0; i < iterations; ++i) {
+    timer.start();
+    timer.tick();
+    timer.stop();
+  }
+  report("Timer start()/tick()/stop()", elapsedNs(start), iterations);
+
+  CycleStat stat;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint64_t previous = CycleCounter::now();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    uint64_t now = CycleCounter::now();
+    stat.add(now - previous);
+    previous = now;
+  }
+  report("Per-card aggregate (now() + add())", elapsedNs(start), iterations);
+
+  uint32_t samplings[] = { 0, 64, 1 };
+  for (uint32_t s = 0; s < sizeof(samplings) / sizeof(samplings[0]); ++s) {
+    CycleCounter::setSampling(samplings[s]);
+    stat.clear();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < iterations; ++i) {
+      bool sample = CycleCounter::sample();
+      uint64_t t = sample ? CycleCounter::now() : 0;
+      v += i;
+      if (sample)
+	stat.add(CycleCounter::now() - t);
+    }
+    sink = v;
+    std::stringstream name;
+    name << "Per-input, sampling 1 in " << samplings[s];
+    report(name.str().c_str(), elapsedNs(start), iterations);
+  }
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <central_node_metrics.h>
+#include <central_node_exception.h>
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-n <name>] [-w <sec>] [-p <prefix>]" << std::endl;
+  std::cerr << "Prints the statistics published by the engine in shared memory" << std::endl;
+  std::cerr << "       -n <name>   :  shared memory name (default " << METRICS_DEFAULT_NAME << ")" << std::endl;
+  std::cerr << "       -w <sec>    :  print every <sec> seconds, with the rate of the counters" << std::endl;
+  std::cerr << "       -p <prefix> :  only print metrics starting with <prefix> (e.g. engine.)" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string name = METRICS_DEFAULT_NAME;
+  std::string prefix = "";
+  double interval = 0;
+
+  for (int opt; (opt = getopt(argc, argv, "n:w:p:h")) > 0;) {
+    switch (opt) {
+    case 'n':
+      name = optarg;
+      break;
+    case 'w':
+      interval = atof(optarg);
+      break;
+    case 'p':
+      prefix = optarg;
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  MetricsReader reader;
+  try {
+    reader.open(name);
+  } catch (CentralNodeException &ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
+
+  time_t start = reader.getStartTime();
+  std::cout << "Engine pid " << reader.getPid() << ", started " << ctime(&start);
+
+  std::vector<uint64_t> previous(reader.getCount(), 0);
+  uint64_t previousUpdates = 0;
+  bool first = true;
+
+  while (true) {
+    uint64_t updates = reader.getUpdateCount();
+    std::cout << "--- " << updates << " updates";
+    if (!first) {
+      std::cout << " (" << std::fixed << std::setprecision(1)
+		<< (updates - previousUpdates) / interval << "/s)";
+    }
+    std::cout << " ---" << std::endl;
+
+    for (uint32_t i = 0; i < reader.getCount(); ++i) {
+      std::string metric = reader.getName(i);
+      uint64_t value = reader.getValue(i);
+      if (metric.compare(0, prefix.size(), prefix) != 0) {
+	continue;
+      }
+      std::cout << std::left << std::setw(32) << metric << std::right << std::setw(20) << value
+		<< " " << std::setw(2) << reader.getUnit(i);
+      if (!first && reader.getKind(i) == MetricCounter) {
+	std::cout << std::setw(12) << std::fixed << std::setprecision(1)
+		  << (value - previous[i]) / interval << "/s";
+      }
+      std::cout << std::endl;
+      previous[i] = value;
+    }
+
+    if (interval <= 0) {
+      break;
+    }
+    previousUpdates = updates;
+    first = false;
+    usleep(interval * 1e6);
+  }
+
+  return 0;
+}
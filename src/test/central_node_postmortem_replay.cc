@@ -0,0 +1,135 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <central_node_postmortem.h>
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " -f <file> [-s <host>] [-p <port>] [-r <rate>]" << std::endl;
+  std::cerr << "Lists the frames in a post-mortem dump, or replays them to the" << std::endl;
+  std::cerr << "central node built with the simulated firmware" << std::endl;
+  std::cerr << "       -f <file>   :  post-mortem dump file" << std::endl;
+  std::cerr << "       -s <host>   :  send the frames to <host> (default: only list them)" << std::endl;
+  std::cerr << "       -p <port>   :  UDP port (default 4356, see CENTRAL_NODE_TEST_PORT)" << std::endl;
+  std::cerr << "       -r <rate>   :  frames per second when sending (default 360)" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string fileName = "";
+  std::string host = "";
+  int port = 4356;
+  uint32_t rate = 360;
+
+  for (int opt; (opt = getopt(argc, argv, "f:s:p:r:h")) > 0;) {
+    switch (opt) {
+    case 'f':
+      fileName = optarg;
+      break;
+    case 's':
+      host = optarg;
+      break;
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (fileName == "" || rate == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::ifstream file(fileName.c_str(), std::ifstream::in | std::ifstream::binary);
+  if (!file.is_open()) {
+    std::cerr << "ERROR: Failed to open " << fileName << std::endl;
+    return 1;
+  }
+
+  PostMortemFileHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != POSTMORTEM_MAGIC ||
+      header.version != POSTMORTEM_VERSION ||
+      header.mitigationWords != POSTMORTEM_MITIGATION_WORDS) {
+    std::cerr << "ERROR: " << fileName << " is not a post-mortem dump" << std::endl;
+    return 1;
+  }
+
+  time_t triggerTime = header.triggerTime;
+  std::cout << "Trigger: " << PostMortem::triggerName(header.trigger)
+	    << " at cycle " << header.triggerCycle << ", " << ctime(&triggerTime);
+  std::cout << "Frames: " << header.frameCount << " x " << header.frameSize << " bytes" << std::endl;
+
+  int sock = -1;
+  struct sockaddr_in addr;
+  if (host != "") {
+    struct hostent *server = gethostbyname(host.c_str());
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (server == NULL || sock < 0) {
+      std::cerr << "ERROR: Failed to create socket for " << host << std::endl;
+      return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    memcpy(&addr.sin_addr.s_addr, server->h_addr, server->h_length);
+    addr.sin_port = htons(port);
+  }
+
+  PostMortemFrameHeader frameHeader;
+  std::vector<uint8_t> frame(header.frameSize);
+  std::vector<uint8_t> previous(header.frameSize, 0);
+
+  for (uint32_t i = 0; i < header.frameCount; ++i) {
+    if (!file.read(reinterpret_cast<char *>(&frameHeader), sizeof(frameHeader)) ||
+	!file.read(reinterpret_cast<char *>(frame.data()), header.frameSize)) {
+      std::cerr << "ERROR: " << fileName << " is truncated (frame " << i << ")" << std::endl;
+      return 1;
+    }
+
+    uint32_t changed = 0;
+    if (i > 0) {
+      // Skip the timestamp header, count the input bytes that changed
+      for (uint32_t j = APPLICATION_UPDATE_BUFFER_HEADER_SIZE_BYTES; j < header.frameSize; ++j) {
+	if (frame[j] != previous[j]) {
+	  changed++;
+	}
+      }
+    }
+
+    std::cout << (frameHeader.cycle == header.triggerCycle ? "* " : "  ")
+	      << "cycle=" << frameHeader.cycle
+	      << " ts=" << frameHeader.timestamp
+	      << " mitigation=" << std::hex << std::setfill('0');
+    for (uint32_t w = 0; w < POSTMORTEM_MITIGATION_WORDS; ++w) {
+      std::cout << std::setw(8) << frameHeader.mitigation[w] << (w + 1 < POSTMORTEM_MITIGATION_WORDS ? ":" : "");
+    }
+    std::cout << std::dec << std::setfill(' ') << " changed=" << changed << std::endl;
+
+    if (sock >= 0) {
+      if (sendto(sock, frame.data(), frame.size(), 0,
+		 reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+	perror("sendto");
+	return 1;
+      }
+      usleep(1000000 / rate);
+    }
+
+    frame.swap(previous);
+  }
+
+  return 0;
+}
@@ -0,0 +1,328 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <central_node_yaml.h>
+#include <central_node_database.h>
+#include <central_node_engine.h>
+#include <cycle_counter.h>
+#include <log_wrapper.h>
+
+#include "central_node_bench_util.h"
+
+#if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
+using namespace easyloggingpp;
+#endif
+
+/**
+ * Scaling benchmark: loads each MPS database (e.g. generated with
+ * central_node_db_generator.py) and drives random update frames through
+ * the input update and the engine evaluation (Engine::checkFaults()),
+ * reporting the load time, the memory footprint and the time of each
+ * evaluation stage as a function of the database size.
+ *
+ * The engine loads a database only once per process, so each database is
+ * benchmarked in a child process, which sends its results back through a
+ * pipe.
+ */
+
+static void usage(const char *nm) {
+  std::cerr << "Usage: " << nm << " [-n <frames>] [-C <dir>] <file> [<file> ...]" << std::endl;
+  std::cerr << "       <file>      :  MPS database YAML files, smallest first" << std::endl;
+  std::cerr << "       -n <frames> :  update frames per database (default 1000)" << std::endl;
+  std::cerr << "       -C <dir>    :  load the databases through the compiled image cache in <dir>" << std::endl;
+  std::cerr << "                      (default: always parse the YAML)" << std::endl;
+  std::cerr << "       -h          :  print this message" << std::endl;
+}
+
+/**
+ * Engine evaluation stages, in Engine::checkFaults() order
+ */
+enum BenchStage {
+  StageTentativeBeamClass = 0,
+  StageEvaluateFaults,
+  StageBreakAnalogIgnore,
+  StageEvaluateIgnoreConditions,
+  StageSetFaultIgnore,
+  StageMitigate,
+  StageSetAllowedBeamClass,
+
+  BENCH_STAGE_COUNT
+};
+
+static const char *stageNames[BENCH_STAGE_COUNT] = {
+  "Tentative", "Faults", "BreakIgn", "IgnoreCond", "SetIgnore", "Mitigate", "Allowed"
+};
+
+typedef struct {
+  double mean;        // us
+  double p99;
+  double max;
+} BenchTime;
+
+typedef struct {
+  bool ok;
+  char error[256];
+
+  uint64_t fileSize;
+  uint32_t cards;
+  uint32_t devices;
+  uint32_t deviceInputs;
+  uint32_t faults;
+  uint32_t faultStates;
+  uint32_t allowedClasses;
+  uint32_t ignoreConditions;
+
+  bool image;
+  double loadTime;    // ms
+  double configureTime;
+  long dbKb;          // Resident memory added by the database
+  long peakKb;        // Peak resident memory of the process
+
+  uint32_t frames;
+  BenchTime inputUpdate;
+  BenchTime checkFaults;
+  double stageMean[BENCH_STAGE_COUNT]; // us
+} BenchResult;
+
+/**
+ * Resident set size (VmRSS) or peak (VmHWM) in kB
+ */
+static long getMemoryKb(const char *field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, strlen(field), field) == 0) {
+      return atol(line.c_str() + strlen(field) + 1);
+    }
+  }
+  return 0;
+}
+
+static BenchTime getTime(Timer<double> &timer) {
+  BenchTime time;
+  time.mean = timer.getHistogram().getMean() * 1e-3;
+  time.p99 = timer.getPercentile(99) * 1e6;
+  time.max = timer.getAllMaxPeriod() * 1e6;
+  return time;
+}
+
+class ScalingBench {
+ private:
+  BenchRandom _random;
+
+ public:
+  ScalingBench() : _random(1) {
+  }
+
+  void run(std::string fileName, uint32_t frames, BenchResult &result) {
+    Engine &engine = Engine::getInstance();
+    struct stat st;
+
+    if (stat(fileName.c_str(), &st) == 0) {
+      result.fileSize = st.st_size;
+    }
+
+    long rssBefore = getMemoryKb("VmRSS:");
+    if (engine.loadConfig(fileName) != 0) {
+      snprintf(result.error, sizeof(result.error), "Failed to load %s", fileName.c_str());
+      return;
+    }
+    result.dbKb = getMemoryKb("VmRSS:") - rssBefore;
+    result.peakKb = getMemoryKb("VmHWM:");
+
+    MpsDbPtr db = engine._mpsDb;
+    result.image = db->isLoadedFromImage();
+    result.loadTime = db->getLoadTime() * 1e3;
+    result.configureTime = db->getConfigureTime() * 1e3;
+    result.cards = db->applicationCards->size();
+    result.devices = db->digitalDevices->size() + (db->analogDevices ? db->analogDevices->size() : 0);
+    result.deviceInputs = db->deviceInputs->size();
+    result.faults = db->faults->size();
+    result.faultStates = db->faultStates->size();
+    result.allowedClasses = db->allowedClasses->size();
+    result.ignoreConditions = db->ignoreConditions ? db->ignoreConditions->size() : 0;
+
+    // A few frames to warm up the caches, then clear the engine timers
+    const uint32_t warmUpFrames = 10;
+    // Engine::_checkFaultTime is never stopped (it measures the period
+    // between evaluations), checkFaults() is timed here
+    Timer<double> inputUpdateTime("Input update", 720);
+    Timer<double> checkFaultsTime("checkFaults()", 720);
+    for (uint32_t i = 0; i < warmUpFrames + frames; ++i) {
+      if (i == warmUpFrames) {
+        inputUpdateTime.clear();
+        checkFaultsTime.clear();
+        engine._setTentativeBeamClassTimer.clear();
+        engine._evaluateFaultsTimer.clear();
+        engine._breakAnalogIgnoreTimer.clear();
+        engine._evaluateIgnoreConditionsTimer.clear();
+        engine._setFaultIgnoreTimer.clear();
+        engine._mitigateTimer.clear();
+        engine._setAllowedBeamClassTimer.clear();
+      }
+
+      _random.frame(db->fwUpdateBuffer);
+
+      // Same as MpsDb::updateInputs() for each frame received
+      inputUpdateTime.start();
+      for (DbApplicationCardMap::iterator card = db->applicationCards->begin();
+           card != db->applicationCards->end(); ++card) {
+        (*card).second->updateInputs();
+      }
+      inputUpdateTime.tick();
+      inputUpdateTime.stop();
+
+      checkFaultsTime.start();
+      engine.checkFaults();
+      checkFaultsTime.tick();
+      checkFaultsTime.stop();
+    }
+
+    result.frames = frames;
+    result.inputUpdate = getTime(inputUpdateTime);
+    result.checkFaults = getTime(checkFaultsTime);
+    result.stageMean[StageTentativeBeamClass] = engine._setTentativeBeamClassTimer.getHistogram().getMean() * 1e-3;
+    result.stageMean[StageEvaluateFaults] = engine._evaluateFaultsTimer.getHistogram().getMean() * 1e-3;
+    result.stageMean[StageBreakAnalogIgnore] = engine._breakAnalogIgnoreTimer.getHistogram().getMean() * 1e-3;
+    result.stageMean[StageEvaluateIgnoreConditions] = engine._evaluateIgnoreConditionsTimer.getHistogram().getMean() * 1e-3;
+    result.stageMean[StageSetFaultIgnore] = engine._setFaultIgnoreTimer.getHistogram().getMean() * 1e-3;
+    result.stageMean[StageMitigate] = engine._mitigateTimer.getHistogram().getMean() * 1e-3;
+    result.stageMean[StageSetAllowedBeamClass] = engine._setAllowedBeamClassTimer.getHistogram().getMean() * 1e-3;
+    result.ok = true;
+  }
+};
+
+class ScalingChild : public BenchChild {
+ private:
+  std::string _fileName;
+  uint32_t _frames;
+
+ public:
+  ScalingChild(std::string fileName, uint32_t frames) : _fileName(fileName), _frames(frames) {
+  }
+
+  void run(void *result) {
+    BenchResult *benchResult = static_cast<BenchResult *>(result);
+    try {
+      ScalingBench bench;
+      bench.run(_fileName, _frames, *benchResult);
+    } catch (CentralNodeException &e) {
+      snprintf(benchResult->error, sizeof(benchResult->error), "%s", e.what());
+    }
+  }
+};
+
+/**
+ * Benchmark one database in a child process
+ */
+static bool benchmark(std::string fileName, uint32_t frames, BenchResult &result) {
+  memset(&result, 0, sizeof(result));
+  ScalingChild child(fileName, frames);
+  if (!child.spawn(&result, sizeof(result))) {
+    snprintf(result.error, sizeof(result.error), "benchmark process failed");
+    return false;
+  }
+  return result.ok;
+}
+
+int main(int argc, char **argv) {
+  uint32_t frames = 1000;
+  std::string cacheDir = "";
+
+  for (int opt; (opt = getopt(argc, argv, "n:C:h")) > 0;) {
+    switch (opt) {
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 'C':
+      cacheDir = optarg;
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind >= argc || frames == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Measure the YAML load unless a cache directory is given
+  MpsDb::setImageCacheDir(cacheDir);
+
+#if defined(LOG_ENABLED) && !defined(LOG_STDOUT)
+  Configurations c;
+  c.setAll(ConfigurationType::Enabled, "false");
+  Loggers::setDefaultConfigurations(c, true);
+#endif
+
+  std::vector<std::string> names;
+  std::vector<BenchResult> results;
+  for (int i = optind; i < argc; ++i) {
+    BenchResult result;
+    if (!benchmark(argv[i], frames, result)) {
+      std::cerr << "ERROR: " << argv[i] << ": " << result.error << std::endl;
+      continue;
+    }
+    names.push_back(benchBaseName(argv[i]));
+    results.push_back(result);
+  }
+
+  if (results.empty()) {
+    return 1;
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "Database size, load time and memory:" << std::endl;
+  std::cout << std::left << std::setw(24) << "Database" << std::right
+            << std::setw(10) << "Size[kB]" << std::setw(7) << "Cards" << std::setw(9) << "Devices"
+            << std::setw(8) << "Inputs" << std::setw(8) << "Faults" << std::setw(9) << "FStates"
+            << std::setw(9) << "Allowed" << std::setw(8) << "Ignore"
+            << std::setw(11) << "Load[ms]" << std::setw(10) << "Conf[ms]"
+            << std::setw(9) << "DB[MB]" << std::setw(10) << "Peak[MB]" << std::endl;
+  for (size_t i = 0; i < results.size(); ++i) {
+    BenchResult &r = results[i];
+    std::cout << std::left << std::setw(24) << names[i].substr(0, 23) << std::right
+              << std::setw(10) << r.fileSize / 1024 << std::setw(7) << r.cards << std::setw(9) << r.devices
+              << std::setw(8) << r.deviceInputs << std::setw(8) << r.faults << std::setw(9) << r.faultStates
+              << std::setw(9) << r.allowedClasses << std::setw(8) << r.ignoreConditions
+              << std::setw(10) << r.loadTime << (r.image ? "*" : " ") << std::setw(10) << r.configureTime
+              << std::setw(9) << r.dbKb / 1024.0 << std::setw(10) << r.peakKb / 1024.0 << std::endl;
+  }
+  std::cout << "(* loaded from the compiled image cache)" << std::endl << std::endl;
+
+  std::cout << "Cycle time per update frame [us], " << frames << " random frames:" << std::endl;
+  std::cout << std::left << std::setw(24) << "Database" << std::right
+            << std::setw(22) << "Inputs mean/max" << std::setw(28) << "checkFaults mean/p99/max";
+  for (uint32_t s = 0; s < BENCH_STAGE_COUNT; ++s) {
+    std::cout << std::setw(11) << stageNames[s];
+  }
+  std::cout << std::endl;
+  for (size_t i = 0; i < results.size(); ++i) {
+    BenchResult &r = results[i];
+    std::stringstream inputs;
+    std::stringstream check;
+    inputs << std::fixed << std::setprecision(1) << r.inputUpdate.mean << "/" << r.inputUpdate.max;
+    check << std::fixed << std::setprecision(1) << r.checkFaults.mean << "/" << r.checkFaults.p99
+          << "/" << r.checkFaults.max;
+    std::cout << std::left << std::setw(24) << names[i].substr(0, 23) << std::right
+              << std::setw(22) << inputs.str() << std::setw(28) << check.str();
+    for (uint32_t s = 0; s < BENCH_STAGE_COUNT; ++s) {
+      std::cout << std::setw(11) << r.stageMean[s];
+    }
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef CENTRAL_NODE_TEST_UTIL_H
+#define CENTRAL_NODE_TEST_UTIL_H
+
+/**
+ * Check counter shared by the standalone tests: a failed check prints an
+ * ERROR line and the test goes on, passed checks are printed with -v.
+ * The test classes derive from it and main() returns getResult().
+ */
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+class TestChecks {
+ public:
+  TestChecks(bool v) : verbose(v), failures(0) {
+  }
+
+  void check(bool condition, std::string what) {
+    if (!condition) {
+      std::cerr << "ERROR: " << what << std::endl;
+      failures++;
+    }
+    else if (verbose) {
+      std::cout << "INFO: " << what << " ... ok" << std::endl;
+    }
+  }
+
+  /**
+   * Print the summary, returns the exit status of the test.
+   */
+  int getResult() const {
+    if (failures > 0) {
+      std::cerr << "ERROR: " << failures << " checks failed" << std::endl;
+      return 1;
+    }
+    std::cout << "Done." << std::endl;
+    return 0;
+  }
+
+  bool verbose;
+  uint32_t failures;
+};
+
+#endif
@@ -3,37 +3,71 @@
 template<typename T>
 Timer<T>::Timer( const std::string& name, size_t size )
 :
-    size      ( size ),
-    name      ( name ),
-    TickCount ( 0 ),
-    cb        ( size ),
-    started   ( false ),
-    max       ( 0 )
+    size             ( size ? size : 1 ),
+    name             ( name ),
+    TickCount        ( 0 ),
+    started          ( false ),
+    last             ( -1 ),
+    budget           ( 0 ),
+    budgetViolations ( 0 )
 {
+    for (int i = 0; i < 2; ++i)
+    {
+        windowCount[i] = 0;
+        windowSum[i] = 0;
+        windowMin[i] = 0;
+        windowMax[i] = 0;
+    }
 }
 
 template <typename T>
 void Timer<T>::start()
 {
     if (!started) {
-      t = std::chrono::high_resolution_clock::now();
+      t = CycleCounter::now();
       start_time = t;
       started = true;
     }
 }
 
+template <typename T>
+void Timer<T>::record(uint64_t ticks)
+{
+    uint64_t ns = CycleCounter::toNs(ticks);
+    T value = ns * 1e-9;
+
+    // Start a new window block every 'size' samples
+    if (windowCount[0] == size)
+    {
+        windowCount[1] = windowCount[0];
+        windowSum[1] = windowSum[0];
+        windowMin[1] = windowMin[0];
+        windowMax[1] = windowMax[0];
+        windowCount[0] = 0;
+        windowSum[0] = 0;
+    }
+    if (0 == windowCount[0] || value < windowMin[0])
+        windowMin[0] = value;
+    if (0 == windowCount[0] || value > windowMax[0])
+        windowMax[0] = value;
+    windowSum[0] += value;
+    ++windowCount[0];
+    last = value;
+
+    total.record(ns);
+    interval.record(ns);
+    if (budget && ns > budget)
+        ++budgetViolations;
+}
+
 template <typename T>
 void Timer<T>::tick()
 {
-    std::chrono::high_resolution_clock::time_point now =  std::chrono::high_resolution_clock::now();
+    uint64_t now = CycleCounter::now();
 
     if ( started )
     {
-        std::chrono::duration<T> diff = now - t;
-        cb.push_back( diff.count() );
-	if (diff.count() > max) {
-	  max = diff.count();
-	}
+        record( now - t );
         t = now;
         ++TickCount;
     }
@@ -54,11 +88,10 @@ void Timer<T>::stop()
 template <typename T>
 bool Timer<T>::countdownComplete(double minTime)
 {
-    std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+    uint64_t now = CycleCounter::now();
     if (started) 
     {
-        std::chrono::duration<T> diff = now - start_time;
-        if (diff.count() > minTime) {
+        if (CycleCounter::toNs(now - start_time) * 1e-9 > minTime) {
             started = false;
             return true;
         }
@@ -75,29 +108,32 @@ bool Timer<T>::countdownComplete(double minTime)
 template <typename T>
 const T Timer<T>::getMinPeriod()
 {
-    typename boost::circular_buffer<T>::iterator it = std::min_element(cb.begin(), cb.end());
+    if (0 == windowCount[0])
+        return -1;
 
-    if (it != cb.end())
-        return *it;
-    else
-        return -1;}
+    if (windowCount[1] && windowMin[1] < windowMin[0])
+        return windowMin[1];
+    return windowMin[0];
+}
 
 template <typename T>
 const T Timer<T>::getMaxPeriod()
 {
-    typename boost::circular_buffer<T>::iterator it = std::max_element(cb.begin(), cb.end());
-
-    if (it != cb.end())
-        return *it;
-    else
+    if (0 == windowCount[0])
         return -1;
+
+    if (windowCount[1] && windowMax[1] > windowMax[0])
+        return windowMax[1];
+    return windowMax[0];
 }
 
 template <typename T>
 const T Timer<T>::getMeanPeriod()
 {
-    T sum = std::accumulate(cb.begin(), cb.end(), 0.0);
-    return sum / cb.size();
+    size_t count = windowCount[0] + windowCount[1];
+    if (0 == count)
+        return 0;
+    return (windowSum[0] + windowSum[1]) / count;
 }
 
 template<typename T>
@@ -106,16 +142,70 @@ const int Timer<T>::getTickCount() const
     return TickCount;
 }
 
+/**
+ * Maximum since the timer was created or cleared.
+ */
 template <typename T>
 const T Timer<T>::getAllMaxPeriod()
 {
-    return max;
+    return total.getMax() * 1e-9;
+}
+
+template <typename T>
+const T Timer<T>::getLastPeriod() const
+{
+    return last;
+}
+
+/**
+ * Percentile (e.g. 99.9) since the timer was created or cleared.
+ */
+template <typename T>
+const T Timer<T>::getPercentile(double percentile) const
+{
+    return total.getValueAtPercentile(percentile) * 1e-9;
+}
+
+/**
+ * Count the samples longer than 'budget' (0 to disable).
+ */
+template <typename T>
+void Timer<T>::setBudget(T budget)
+{
+    this->budget = budget > 0 ? static_cast<uint64_t>(budget * 1e9) : 0;
+}
+
+template <typename T>
+uint64_t Timer<T>::getBudgetViolations() const
+{
+    return budgetViolations;
+}
+
+/**
+ * Copy the samples recorded since the previous snapshot, and start a new
+ * interval.
+ */
+template <typename T>
+void Timer<T>::snapshot(LatencyHistogram& histogram)
+{
+    histogram = interval;
+    interval.reset();
+}
+
+template <typename T>
+const LatencyHistogram& Timer<T>::getHistogram() const
+{
+    return total;
 }
 
+/**
+ * Clear the all time maximum and percentiles. The budget violations keep
+ * counting since the timer was created.
+ */
 template<typename T>
 void Timer<T>::clear()
 {
-  max = 0;
+    total.reset();
 }
 
 template<typename T>
@@ -129,6 +219,11 @@ void Timer<T>::show()
         std::cout << "Average period      : " << Timer<T>::getMeanPeriod() * 1e6 << " us" << std::endl;
         std::cout << "Maximum period      : " << Timer<T>::getMaxPeriod()  * 1e6 << " us" << std::endl;
         std::cout << "Maximum period (All): " << Timer<T>::getAllMaxPeriod()  * 1e6 << " us" << std::endl;
+        std::cout << "p99 / p99.9 / p99.99: " << Timer<T>::getPercentile(99) * 1e6 << " / "
+                  << Timer<T>::getPercentile(99.9) * 1e6 << " / "
+                  << Timer<T>::getPercentile(99.99) * 1e6 << " us (" << total.getCount() << " samples)" << std::endl;
+        if ( budget )
+            std::cout << "Over budget         : " << budgetViolations << " (" << budget / 1e3 << " us)" << std::endl;
     }
 }
 
@@ -2,11 +2,27 @@
 #define _TIMER_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include <iostream>
-#include <chrono>
-#include <boost/circular_buffer.hpp>
-#include <numeric>
 
+#include "latency_histogram.h"
+#include "cycle_counter.h"
+
+/**
+ * Measures the time between tick() calls (or between start() and tick()).
+ *
+ * Min/mean/max are reported over a window of the last 'size' to
+ * 2 * 'size' samples. All samples since the timer was created (or last
+ * cleared) go into a histogram for the all time maximum and percentiles,
+ * and the samples over the budget (if one is set) are counted. A second
+ * histogram collects the samples between calls to snapshot().
+ *
+ * Time stamps are CycleCounter ticks (TSC when available).
+ *
+ * Recording is O(1) and does not allocate. Like before, the statistics
+ * methods may be called from other threads while the owner thread is
+ * recording, in which case they return approximate values.
+ */
 template<typename T>
 class Timer
 {
@@ -25,16 +41,35 @@ public:
     const T   getMaxPeriod();
     const T   getMeanPeriod();
     const T   getAllMaxPeriod();
-    
+    const T   getLastPeriod() const;
+
+    const T   getPercentile(double percentile) const;
+    void      setBudget(T budget);
+    uint64_t  getBudgetViolations() const;
+    void      snapshot(LatencyHistogram& histogram);
+    const LatencyHistogram& getHistogram() const;
+
 private:
-    int                                            size;
+    void      record(uint64_t ticks);
+
+    size_t                                         size;
     std::string                                    name;
     int                                            TickCount;
-    boost::circular_buffer<T>                      cb;
-    std::chrono::high_resolution_clock::time_point t;
-    std::chrono::high_resolution_clock::time_point start_time;
+    uint64_t                                       t;
+    uint64_t                                       start_time;
     bool                                           started;
-    T                                              max;
+
+    // Window: samples in the current and previous blocks of 'size' samples
+    size_t                                         windowCount[2];
+    T                                              windowSum[2];
+    T                                              windowMin[2];
+    T                                              windowMax[2];
+    T                                              last;
+
+    uint64_t                                       budget;     // ns, 0 if none
+    uint64_t                                       budgetViolations;
+    LatencyHistogram                               total;
+    LatencyHistogram                               interval;
 };
 
 #endif